@@ -25,6 +25,7 @@ IF(UNIX)
     CHECK_INCLUDE_FILES(arpa/inet.h HAVE_ARPA_INET_H)
     CHECK_INCLUDE_FILES(inttypes.h HAVE_INTTYPES_H)
     CHECK_INCLUDE_FILES(arpa/nameser.h HAVE_ARPA_NAMESER_H)
+    CHECK_INCLUDE_FILES(sys/eventfd.h HAVE_SYS_EVENTFD_H)
 ENDIF()
 
 IF (WIN32)
@@ -57,6 +57,7 @@ SET(LCB_CORE_CXXSRC
     src/dump.cc
     src/errmap.cc
     src/getconfig.cc
+    src/group.cc
     src/nodeinfo.cc
     src/handler.cc
     src/hostlist.cc
@@ -89,9 +90,11 @@ SET(LCB_CORE_CXXSRC
     src/retrychk.cc
     src/retryq.cc
     src/rnd.cc
+    src/scramcache.cc
     src/docreq/docreq.cc
     src/views/viewreq.cc
     src/cntl.cc
+    src/submitq.cc
     src/wait.cc
     ${LCB_TRACING_SRC}
     ${LCB_CAPI_SRC}
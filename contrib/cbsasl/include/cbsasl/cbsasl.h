@@ -63,10 +63,21 @@ extern "C" {
 
     typedef struct cbsasl_conn_st cbsasl_conn_t;
 
+    /**
+     * Optional hook used to avoid re-deriving the SCRAM salted password.
+     * When `store` is zero, the callback should copy a previously stored
+     * value into `salted` and set `*saltedlen`, returning SASL_OK if found.
+     * When `store` is nonzero, `salted` contains a freshly derived value.
+     */
+    typedef int (*cbsasl_salted_password_fn)(void *context, int store, cbsasl_auth_mechanism_t mech,
+                                             const char *salt, unsigned int saltlen, unsigned int itcount,
+                                             unsigned char *salted, unsigned int *saltedlen);
+
     typedef struct {
         void *context;
         int (*username)(void *context, int id, const char **result, unsigned int *len);
         int (*password)(cbsasl_conn_t *conn, void *context, int id, cbsasl_secret_t **psecret);
+        cbsasl_salted_password_fn salted_password; /* may be NULL */
     } cbsasl_callbacks_t;
 
     typedef cbsasl_error_t (*cbsasl_init_fn)(void);
@@ -90,6 +101,8 @@ extern "C" {
         int (*get_password)(cbsasl_conn_t *conn, void *context, int id,
                             cbsasl_secret_t **psecret);
         void *get_password_ctx;
+        cbsasl_salted_password_fn salted_password;
+        void *salted_password_ctx;
         char *nonce; // client nonce for SCRAM-SHA authentication
         char *client_first_message_bare; // for SCRAM-SHA authentication
         unsigned char *saltedpassword; // for SCRAM-SHA authentication
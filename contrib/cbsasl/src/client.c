@@ -47,6 +47,8 @@ cbsasl_error_t cbsasl_client_new(const char *service, const char *serverFQDN, co
     conn->c.client.get_username_ctx = callbacks->context;
     conn->c.client.get_password = callbacks->password;
     conn->c.client.get_password_ctx = callbacks->context;
+    conn->c.client.salted_password = callbacks->salted_password;
+    conn->c.client.salted_password_ctx = callbacks->context;
 
     if (conn->c.client.get_username == NULL || conn->c.client.get_password == NULL) {
         cbsasl_dispose(&conn);
@@ -276,10 +278,20 @@ cbsasl_error_t cbsasl_client_step(cbsasl_conn_t *conn, const char *serverin, uns
                     return SASL_BADPARAM;
                 }
                 // ok, now we can compute the client proof
-                ret = generate_salted_password(conn->c.client.auth_mech, pass, salt, saltlen, itcount, saltedpassword,
-                                               &saltedpasslen);
-                if (ret != SASL_OK) {
-                    return ret;
+                if (conn->c.client.salted_password == NULL ||
+                    conn->c.client.salted_password(conn->c.client.salted_password_ctx, 0, conn->c.client.auth_mech,
+                                                   salt, saltlen, itcount, saltedpassword,
+                                                   &saltedpasslen) != SASL_OK) {
+                    ret = generate_salted_password(conn->c.client.auth_mech, pass, salt, saltlen, itcount,
+                                                   saltedpassword, &saltedpasslen);
+                    if (ret != SASL_OK) {
+                        return ret;
+                    }
+                    if (conn->c.client.salted_password != NULL) {
+                        conn->c.client.salted_password(conn->c.client.salted_password_ctx, 1,
+                                                       conn->c.client.auth_mech, salt, saltlen, itcount,
+                                                       saltedpassword, &saltedpasslen);
+                    }
                 }
                 // save salted password for later use
                 conn->c.client.saltedpassword = calloc(saltedpasslen, 1);
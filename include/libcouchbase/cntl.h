@@ -495,6 +495,15 @@ typedef enum {
  * the configuration in the cluster changes.  Multiple instances may race
  * to update the file, and that is the intended behavior.
  *
+ * The file keeps the JSON format used by older versions of the library, so
+ * they can share it. A binary snapshot of the configuration and of the known
+ * collection IDs is written next to it, under the same name with a
+ * `.snapshot` suffix, and is memory mapped and loaded without JSON parsing.
+ * The snapshot is preferred unless the JSON file is newer (i.e. it was
+ * rewritten by an older version); a corrupt snapshot is removed and the JSON
+ * file used instead. Both files are replaced atomically, and are not
+ * rewritten if they already hold the same or a newer revision.
+ *
  * @note The leading directories for the file must exist, otherwise the file
  * will never be created.
  *
@@ -1297,11 +1306,521 @@ typedef enum {
 
 #define LCB_CNTL_ENABLE_ERRMAP 0x65
 
+/**
+ * @brief Replica hedge delay
+ *
+ * How long a read issued with ::LCB_REPLICA_MODE_HEDGED waits for the active
+ * node before racing a read against a replica. When set to zero (the default),
+ * the delay is the 99th percentile of the KV timings histogram (see
+ * lcb_enable_timings()), or 10 milliseconds if timings are not enabled.
+ *
+ * Use `replica_hedge_delay` in the connection string
+ *
+ * @cntl_arg_both{lcb_U32*}
+ * @volatile
+ */
+#define LCB_CNTL_REPLICA_HEDGE_DELAY 0x66
+
+/**
+ * @brief Randomize retry intervals
+ *
+ * When enabled, the interval before an operation in the retry queue is
+ * retried is drawn between its base interval (derived from the error map or
+ * @ref LCB_CNTL_RETRY_INTERVAL) and three times the previous interval
+ * ("decorrelated jitter"), so that operations which failed together are not
+ * retried in lockstep. Disabled by default, which retries at the base
+ * interval.
+ *
+ * Use `retry_jitter` in the connection string
+ *
+ * @cntl_arg_both{int* (as boolean)}
+ * @volatile
+ */
+#define LCB_CNTL_RETRY_JITTER 0x67
+
+/**
+ * @brief Per-server retry budget
+ *
+ * Maximum number of retries per second the retry queue will send to any single
+ * server, allowing bursts of up to one second worth of retries. Once exhausted,
+ * operations stay queued (subject to their timeout) until the budget refills.
+ * Zero (the default) means unlimited.
+ *
+ * Use `retry_budget` in the connection string
+ *
+ * @cntl_arg_both{lcb_U32*}
+ * @volatile
+ */
+#define LCB_CNTL_RETRY_BUDGET 0x68
+
+/**
+ * @brief Maximum number of in-flight KV operations per server
+ *
+ * Once a server has this many operations scheduled and not yet completed,
+ * further KV operations routed to it fail immediately with
+ * @ref LCB_ERR_BACKPRESSURE instead of being queued. After a rejection, the
+ * callback installed with lcb_set_ready_callback() is invoked once usage drops
+ * below three quarters of the limit. Zero (the default) means unlimited.
+ *
+ * Use `kv_pipeline_max_ops` in the connection string
+ *
+ * @cntl_arg_both{lcb_U32*}
+ * @volatile
+ */
+#define LCB_CNTL_KV_PIPELINE_MAX_OPS 0x69
+
+/**
+ * @brief Maximum number of bytes held by in-flight KV operations per server
+ *
+ * Like @ref LCB_CNTL_KV_PIPELINE_MAX_OPS, but limits the encoded size (header,
+ * key and value) of the operations. Zero (the default) means unlimited.
+ *
+ * Use `kv_pipeline_max_bytes` in the connection string
+ *
+ * @cntl_arg_both{lcb_SIZE*}
+ * @volatile
+ */
+#define LCB_CNTL_KV_PIPELINE_MAX_BYTES 0x6a
+
+/**
+ * @brief Maximum number of in-flight KV operations for the instance
+ *
+ * Like @ref LCB_CNTL_KV_PIPELINE_MAX_OPS, but applies to the sum over all
+ * servers. Zero (the default) means unlimited.
+ *
+ * Use `kv_max_ops` in the connection string
+ *
+ * @cntl_arg_both{lcb_U32*}
+ * @volatile
+ */
+#define LCB_CNTL_KV_MAX_OPS 0x6b
+
+/**
+ * @brief Maximum number of bytes held by in-flight KV operations for the instance
+ *
+ * Like @ref LCB_CNTL_KV_PIPELINE_MAX_BYTES, but applies to the sum over all
+ * servers. Zero (the default) means unlimited.
+ *
+ * Use `kv_max_bytes` in the connection string
+ *
+ * @cntl_arg_both{lcb_SIZE*}
+ * @volatile
+ */
+#define LCB_CNTL_KV_MAX_BYTES 0x6c
+
+/**
+ * @brief Enable per-server circuit breakers
+ *
+ * When enabled, the library tracks the rate of timeouts and network errors
+ * for every KV server over a rolling window (@ref LCB_CNTL_CIRCUIT_BREAKER_WINDOW).
+ * Once at least @ref LCB_CNTL_CIRCUIT_BREAKER_VOLUME operations were seen and
+ * the failure percentage reaches @ref LCB_CNTL_CIRCUIT_BREAKER_THRESHOLD,
+ * the circuit opens: new operations for that server fail immediately with
+ * @ref LCB_ERR_CIRCUIT_OPEN instead of waiting for their timeout.
+ *
+ * After @ref LCB_CNTL_CIRCUIT_BREAKER_SLEEP_WINDOW a NOOP probe is sent to the
+ * server (the circuit is "half-open"). If it succeeds the circuit closes,
+ * otherwise it stays open for another sleep window.
+ *
+ * Disabled by default.
+ *
+ * Use `circuit_breaker` in the connection string
+ *
+ * @cntl_arg_both{int* (as boolean)}
+ * @volatile
+ */
+#define LCB_CNTL_CIRCUIT_BREAKER 0x6d
+
+/**
+ * @brief Minimum number of operations in the window before the circuit may open
+ *
+ * Default is 20.
+ *
+ * Use `circuit_breaker_volume` in the connection string
+ *
+ * @cntl_arg_both{lcb_U32*}
+ * @volatile
+ */
+#define LCB_CNTL_CIRCUIT_BREAKER_VOLUME 0x6e
+
+/**
+ * @brief Failure percentage (1-100) at which the circuit opens
+ *
+ * Default is 50.
+ *
+ * Use `circuit_breaker_threshold` in the connection string
+ *
+ * @cntl_arg_both{lcb_U32*}
+ * @volatile
+ */
+#define LCB_CNTL_CIRCUIT_BREAKER_THRESHOLD 0x6f
+
+/**
+ * @brief Length of the rolling window over which failures are counted
+ *
+ * Default is one minute.
+ *
+ * Use `circuit_breaker_window` in the connection string
+ *
+ * @cntl_arg_both{lcb_U32* (microseconds)}
+ * @volatile
+ */
+#define LCB_CNTL_CIRCUIT_BREAKER_WINDOW 0x70
+
+/**
+ * @brief Time an open circuit waits before probing the server
+ *
+ * Default is five seconds.
+ *
+ * Use `circuit_breaker_sleep_window` in the connection string
+ *
+ * @cntl_arg_both{lcb_U32* (microseconds)}
+ * @volatile
+ */
+#define LCB_CNTL_CIRCUIT_BREAKER_SLEEP_WINDOW 0x71
+
+/**
+ * @brief Resume TLS sessions when reconnecting
+ *
+ * When enabled (the default), the session (or TLS 1.3 session ticket) issued
+ * by each host is cached in the instance and offered on the next connection
+ * to the same host and port, so that reconnects and new pooled HTTP sockets
+ * skip the full handshake.
+ *
+ * Use `ssl_session_cache` in the connection string
+ *
+ * @cntl_arg_both{int* (as boolean)}
+ * @volatile
+ */
+#define LCB_CNTL_SSL_SESSION_CACHE 0x72
+
+/**
+ * @brief Use kernel TLS for encrypted sockets
+ *
+ * When enabled, TLS sockets of event-based I/O plugins are handed to OpenSSL
+ * directly instead of going through memory buffers, and OpenSSL is asked to
+ * offload the record layer to the kernel (kTLS). If the OpenSSL build, the
+ * kernel or the negotiated cipher does not support kTLS, encryption stays in
+ * user space without the intermediate copy. Has no effect with
+ * completion-based I/O plugins or when OpenSSL lacks kTLS support.
+ *
+ * Disabled by default.
+ *
+ * Use `ssl_ktls` in the connection string
+ *
+ * @cntl_arg_both{int* (as boolean)}
+ * @volatile
+ */
+#define LCB_CNTL_SSL_KTLS 0x73
+
+/**
+ * Scope of the cache of SCRAM salted passwords
+ */
+typedef enum {
+    LCB_SCRAM_CACHE_NONE = 0,     /**< derive the keys for every connection */
+    LCB_SCRAM_CACHE_INSTANCE = 1, /**< share derived keys between connections of one instance */
+    LCB_SCRAM_CACHE_PROCESS = 2   /**< share derived keys between all instances of the process */
+} lcb_SCRAM_CACHE;
+
+/**
+ * @brief Cache SCRAM-derived keys across connections
+ *
+ * SCRAM-SHA authentication derives the salted password with PBKDF2 using
+ * the iteration count chosen by the server, which makes every new KV
+ * connection cost several milliseconds of CPU. With the cache enabled the
+ * result is remembered per (mechanism, user, salt, iterations) and reused by
+ * later connections. Cached keys are wiped when the password of the user
+ * changes, when the server rejects them, or when the authenticator of the
+ * instance is replaced.
+ *
+ * The default is LCB_SCRAM_CACHE_INSTANCE.
+ *
+ * Use `scram_cache` in the connection string ("none", "instance" or "process")
+ *
+ * @cntl_arg_both{lcb_SCRAM_CACHE*}
+ * @volatile
+ */
+#define LCB_CNTL_SCRAM_CACHE 0x74
+
+/**
+ * @brief Delay between parallel connection attempts to the addresses of a host
+ *
+ * When a hostname resolves to several addresses, they are tried in the order
+ * recommended by RFC 8305 ("Happy Eyeballs"), alternating address families.
+ * If an attempt did not complete within this delay, the next address is tried
+ * in parallel and the first connection to succeed is used. Failed attempts
+ * start the next address immediately.
+ *
+ * Default is 250 milliseconds. Setting it to zero restores sequential
+ * connects. Only applies to event-based I/O plugins.
+ *
+ * Use `connect_attempt_delay` in the connection string
+ *
+ * @cntl_arg_both{lcb_U32* (microseconds)}
+ * @volatile
+ */
+#define LCB_CNTL_CONNECT_ATTEMPT_DELAY 0x75
+
+/**
+ * @brief Number of nodes raced for the initial CCCP configuration
+ *
+ * When greater than one, the CCCP provider asks up to this many bootstrap
+ * nodes for the cluster configuration in parallel: another node is asked each
+ * time @ref LCB_CNTL_BOOTSTRAP_RACE_DELAY passes without an answer (or
+ * immediately when a node fails), and the first valid configuration wins. A
+ * blackholed seed node then costs one race delay instead of a full
+ * @ref LCB_CNTL_CONFIG_NODE_TIMEOUT.
+ *
+ * Default is 1 (nodes are asked one after another).
+ *
+ * Use `bootstrap_race_count` in the connection string
+ *
+ * @cntl_arg_both{lcb_U32*}
+ * @volatile
+ */
+#define LCB_CNTL_BOOTSTRAP_RACE_COUNT 0x76
+
+/**
+ * @brief Delay before racing the next bootstrap node
+ *
+ * See @ref LCB_CNTL_BOOTSTRAP_RACE_COUNT. Default is 500 milliseconds; zero
+ * asks all the raced nodes at once.
+ *
+ * Use `bootstrap_race_delay` in the connection string
+ *
+ * @cntl_arg_both{lcb_U32* (microseconds)}
+ * @volatile
+ */
+#define LCB_CNTL_BOOTSTRAP_RACE_DELAY 0x77
+
+/**
+ * Allocator used for the read buffers of the KV and HTTP connections
+ */
+typedef enum {
+    LCB_READ_ALLOCATOR_DEFAULT = 0, /**< per-connection buffers sized by recent history */
+    LCB_READ_ALLOCATOR_POOL = 1     /**< size-class pool shared by all the connections of the instance */
+} lcb_READ_ALLOCATOR;
+
+/**
+ * @brief Select the allocator of the read buffers
+ *
+ * By default every connection keeps a handful of buffers tuned to the sizes
+ * it recently received, and allocates larger values with malloc. With
+ * LCB_READ_ALLOCATOR_POOL, buffers are rounded up to a power of two between
+ * 1KB and 2MB and recycled through per-size free lists shared by all the
+ * connections of the instance, which avoids malloc churn and fragmentation
+ * when document sizes vary widely. See @ref LCB_CNTL_READ_POOL_CLASS_CAP and
+ * @ref LCB_CNTL_READ_POOL_HUGEPAGES.
+ *
+ * Only affects connections opened after the change.
+ *
+ * Use `read_allocator` in the connection string ("default" or "pool")
+ *
+ * @cntl_arg_both{lcb_READ_ALLOCATOR*}
+ * @volatile
+ */
+#define LCB_CNTL_READ_ALLOCATOR 0x78
+
+/**
+ * @brief Maximum number of idle bytes kept by each size class of the read pool
+ *
+ * Every class may keep at least one buffer. Zero disables pooling. The
+ * default is 4MB.
+ *
+ * Use `read_pool_class_cap` in the connection string
+ *
+ * @cntl_arg_both{lcb_U32*}
+ * @volatile
+ */
+#define LCB_CNTL_READ_POOL_CLASS_CAP 0x79
+
+/**
+ * @brief Back the large buffers of the read pool with huge pages
+ *
+ * When enabled, buffers of 2MB and more are mapped from reserved huge pages
+ * (MAP_HUGETLB), or from transparent huge pages when none are reserved,
+ * which reduces TLB misses when receiving large values. Falls back to malloc
+ * where huge pages are not available. Disabled by default.
+ *
+ * Use `read_pool_hugepages` in the connection string
+ *
+ * @cntl_arg_both{int* (as boolean)}
+ * @volatile
+ */
+#define LCB_CNTL_READ_POOL_HUGEPAGES 0x7A
+
+/**
+ * Usage of the read buffer pool
+ */
+typedef struct {
+    lcb_U64 live_bytes;      /**< bytes of buffers used by connections */
+    lcb_U64 pooled_bytes;    /**< bytes of idle buffers kept for reuse */
+    lcb_U64 peak_live_bytes; /**< highest value of live_bytes */
+    lcb_U64 hugepage_bytes;  /**< bytes of live or pooled buffers backed by huge pages */
+    lcb_U64 allocations;     /**< number of buffers handed out */
+    lcb_U64 reused;          /**< number of those which came from the pool */
+} lcb_READ_POOL_STATS;
+
+/**
+ * @brief Usage of the read buffer pool
+ *
+ * All the fields are zero until a connection has used the pool.
+ *
+ * @cntl_arg_getonly{lcb_READ_POOL_STATS*}
+ * @volatile
+ */
+#define LCB_CNTL_READ_POOL_STATS 0x7B
+
+/**
+ * @brief Load the whole collections manifest into the collection ID cache
+ *
+ * When enabled, the manifest is fetched once the instance is bootstrapped,
+ * and fetched again whenever a server reports an unknown collection, so that
+ * operations on the known collections do not each need a GET_CID round-trip
+ * to resolve their collection ID. Disabled by default.
+ *
+ * Use `collections_prefetch` in the connection string
+ *
+ * @cntl_arg_both{int* (as boolean)}
+ * @volatile
+ */
+#define LCB_CNTL_COLLECTIONS_PREFETCH 0x7C
+
+/**
+ * @brief Maximum number of operations waiting for the first configuration
+ *
+ * Operations scheduled before the instance is bootstrapped are kept until
+ * the cluster map arrives, and then sent together. Once this many are
+ * waiting, further operations fail with LCB_ERR_TEMPORARY_FAILURE. Waiting
+ * operations fail with LCB_ERR_TIMEOUT when their timeout expires.
+ * 0 (the default) means no limit.
+ *
+ * Use `deferred_max_ops` in the connection string
+ *
+ * @cntl_arg_both{lcb_U32*}
+ * @volatile
+ */
+#define LCB_CNTL_DEFERRED_MAX_OPS 0x7D
+
+/**
+ * @brief Maximum memory held by the operations waiting for the first configuration
+ *
+ * Same as #LCB_CNTL_DEFERRED_MAX_OPS, but counts the size of the commands
+ * (with their keys) in bytes. 0 (the default) means no limit.
+ *
+ * Use `deferred_max_bytes` in the connection string
+ *
+ * @cntl_arg_both{lcb_U32*}
+ * @volatile
+ */
+#define LCB_CNTL_DEFERRED_MAX_BYTES 0x7E
+
+/**
+ * @brief Codec used to encode large values on the client
+ *
+ * Values of at least #LCB_CNTL_VALUE_CODEC_MIN_SIZE bytes which are stored
+ * with upsert, insert or replace are encoded by this codec before they are
+ * sent (unless they already are flagged as compressed, or the encoded value
+ * doesn't shrink to the #LCB_CNTL_COMPRESSION_MIN_RATIO). The encoded value
+ * begins with a small header naming its codec (and whether the original value
+ * was JSON), so that it is decoded transparently when it is read by an
+ * instance which knows the codec and has LCB_COMPRESS_IN in its
+ * #LCB_CNTL_COMPRESSION_OPTS.
+ *
+ * Only instances which opted in, by selecting a codec here or registering one
+ * with #LCB_CNTL_VALUE_CODEC_REGISTER, look for this header: other instances
+ * return the values as they are stored. A value which happens to begin with
+ * the header but cannot be decoded is returned as it is.
+ *
+ * Unlike Snappy compression on the wire (see #LCB_CNTL_COMPRESSION_OPTS),
+ * the server only sees opaque binary values: it cannot inflate them for
+ * views, queries or subdocument operations. This is meant for large
+ * documents which are only ever read as a whole.
+ *
+ * The value is the ID of a codec: 0 (the default) disables client-side
+ * encoding, 1 is the built-in Snappy codec, other IDs must be registered with
+ * #LCB_CNTL_VALUE_CODEC_REGISTER. Values are stored as they are while the
+ * selected codec is not registered.
+ *
+ * Use `value_codec` in the connection string ("none", "snappy" or the ID of
+ * the codec)
+ *
+ * @cntl_arg_both{int*}
+ * @uncommitted
+ */
+#define LCB_CNTL_VALUE_CODEC 0x7F
+
+/**
+ * @brief Minimum size of the values encoded by the #LCB_CNTL_VALUE_CODEC
+ *
+ * The default is 64KB.
+ *
+ * Use `value_codec_min_size` in the connection string
+ *
+ * @cntl_arg_both{lcb_U32*}
+ * @uncommitted
+ */
+#define LCB_CNTL_VALUE_CODEC_MIN_SIZE 0x80
+
+/**
+ * A client-side codec, see #LCB_CNTL_VALUE_CODEC. The callbacks are invoked
+ * from the thread of the instance.
+ */
+typedef struct {
+    /** Tag stored along with the encoded values, from 2 to 255 */
+    lcb_U8 id;
+    /** @return the largest size `nbytes` bytes may be encoded into */
+    lcb_SIZE (*bound)(void *cookie, lcb_SIZE nbytes);
+    /**
+     * Encode `nin` bytes of `in` into `out`, which holds `nout` bytes
+     * (as returned by `bound`).
+     * @return the size of the encoded value, 0 on failure
+     */
+    lcb_SIZE (*encode)(void *cookie, const void *in, lcb_SIZE nin, void *out, lcb_SIZE nout);
+    /**
+     * Decode `nin` bytes of `in` into `out`, which holds `nout` bytes, the
+     * size of the original value.
+     * @return 0 on success, nonzero if the value is corrupted
+     */
+    int (*decode)(void *cookie, const void *in, lcb_SIZE nin, void *out, lcb_SIZE nout);
+    void *cookie;
+} lcb_VALUE_CODEC;
+
+/**
+ * @brief Make a codec available to encode and decode values
+ *
+ * The structure is copied. Registering a codec with the ID of a previous one
+ * replaces it. This allows e.g. zstd or LZ4 to be plugged in by the
+ * application:
+ *
+ * @code{.c}
+ * static lcb_SIZE zstd_bound(void *cookie, lcb_SIZE nbytes) { return ZSTD_compressBound(nbytes); }
+ * static lcb_SIZE zstd_encode(void *cookie, const void *in, lcb_SIZE nin, void *out, lcb_SIZE nout)
+ * {
+ *     size_t rv = ZSTD_compress(out, nout, in, nin, 3);
+ *     return ZSTD_isError(rv) ? 0 : rv;
+ * }
+ * static int zstd_decode(void *cookie, const void *in, lcb_SIZE nin, void *out, lcb_SIZE nout)
+ * {
+ *     return ZSTD_decompress(out, nout, in, nin) == nout ? 0 : -1;
+ * }
+ *
+ * lcb_VALUE_CODEC codec = {2, zstd_bound, zstd_encode, zstd_decode, NULL};
+ * int id = 2;
+ * lcb_cntl(instance, LCB_CNTL_SET, LCB_CNTL_VALUE_CODEC_REGISTER, &codec);
+ * lcb_cntl(instance, LCB_CNTL_SET, LCB_CNTL_VALUE_CODEC, &id);
+ * @endcode
+ *
+ * @cntl_arg_setonly{const lcb_VALUE_CODEC*}
+ * @uncommitted
+ */
+#define LCB_CNTL_VALUE_CODEC_REGISTER 0x81
+
 /**
  * This is not a command, but rather an indicator of the last item.
  * @internal
  */
-#define LCB_CNTL__MAX 0x66
+#define LCB_CNTL__MAX 0x82
 /**@}*/
 
 #ifdef __cplusplus
@@ -778,6 +778,13 @@ typedef enum {
     LCB_REPLICA_MODE_IDX0 = 0x02,
     LCB_REPLICA_MODE_IDX1 = 0x03,
     LCB_REPLICA_MODE_IDX2 = 0x04,
+    /**
+     * Read from the active node, and if no reply arrives within the hedge
+     * delay (see @ref LCB_CNTL_REPLICA_HEDGE_DELAY), race a read against the
+     * first available replica. Only the first successful response is
+     * delivered to the callback.
+     */
+    LCB_REPLICA_MODE_HEDGED = 0x05,
     LCB_REPLICA_MODE__MAX
 } lcb_REPLICA_MODE;
 
@@ -1963,6 +1970,31 @@ void lcb_sched_fail(lcb_INSTANCE *instance);
 LIBCOUCHBASE_API
 void lcb_sched_flush(lcb_INSTANCE *instance);
 
+/**
+ * @volatile
+ * @brief Callback invoked when the library is ready to accept more operations
+ *
+ * Once an operation has been rejected with ::LCB_ERR_BACKPRESSURE because one
+ * of the admission limits (@ref LCB_CNTL_KV_PIPELINE_MAX_OPS,
+ * @ref LCB_CNTL_KV_PIPELINE_MAX_BYTES, @ref LCB_CNTL_KV_MAX_OPS,
+ * @ref LCB_CNTL_KV_MAX_BYTES) was reached, this callback is invoked from the
+ * event loop as soon as the queued operations drain below three quarters of
+ * the limits.
+ *
+ * @param instance the instance
+ */
+typedef void (*lcb_ready_callback)(lcb_INSTANCE *instance);
+
+/**
+ * @volatile
+ * @brief Set the callback invoked when scheduling may resume after backpressure
+ * @param instance the instance
+ * @param callback the callback to set. If `NULL`, return the existing callback
+ * @return The existing (and previous) callback.
+ */
+LIBCOUCHBASE_API
+lcb_ready_callback lcb_set_ready_callback(lcb_INSTANCE *instance, lcb_ready_callback callback);
+
 /**@} (Group: Adanced Scheduling) */
 
 /* @ingroup lcb-public-api
@@ -2432,6 +2464,14 @@ LIBCOUCHBASE_API lcb_STATUS lcb_ingest_options_destroy(lcb_INGEST_OPTIONS *optio
 LIBCOUCHBASE_API lcb_STATUS lcb_ingest_options_method(lcb_INGEST_OPTIONS *options, lcb_INGEST_METHOD method);
 LIBCOUCHBASE_API lcb_STATUS lcb_ingest_options_expiry(lcb_INGEST_OPTIONS *options, uint32_t expiration);
 LIBCOUCHBASE_API lcb_STATUS lcb_ingest_options_ignore_error(lcb_INGEST_OPTIONS *options, int flag);
+/**
+ * @uncommitted
+ *
+ * Upper bound of the number of store operations in flight. The number
+ * actually used adapts to the latency of the responses. 0 selects the
+ * default (512).
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_ingest_options_max_concurrent(lcb_INGEST_OPTIONS *options, uint32_t num);
 LIBCOUCHBASE_API lcb_STATUS lcb_ingest_options_data_converter(lcb_INGEST_OPTIONS *options,
                                                               lcb_INGEST_DATACONVERTER_CALLBACK callback);
 
@@ -2525,6 +2565,8 @@ LIBCOUCHBASE_API lcb_STATUS lcb_cmdanalytics_scope_qualifier(lcb_CMDANALYTICS *c
  */
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdanalytics_handle(lcb_CMDANALYTICS *cmd, lcb_ANALYTICS_HANDLE **handle);
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdanalytics_timeout(lcb_CMDANALYTICS *cmd, uint32_t timeout);
+/** @uncommitted @brief See lcb_cmdquery_high_watermark() */
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdanalytics_high_watermark(lcb_CMDANALYTICS *cmd, size_t nbytes);
 /**
  * Execute a Analytics query.
  *
@@ -2572,6 +2614,13 @@ LIBCOUCHBASE_API lcb_STATUS lcb_analytics(lcb_INSTANCE *instance, void *cookie,
  * @endcode
  */
 LIBCOUCHBASE_API lcb_STATUS lcb_analytics_cancel(lcb_INSTANCE *instance, lcb_ANALYTICS_HANDLE *handle);
+/** @uncommitted @brief Stop reading the response from the network. See lcb_query_pause() */
+LIBCOUCHBASE_API lcb_STATUS lcb_analytics_pause(lcb_INSTANCE *instance, lcb_ANALYTICS_HANDLE *handle);
+/** @uncommitted @brief Resume a request paused with lcb_analytics_pause() */
+LIBCOUCHBASE_API lcb_STATUS lcb_analytics_resume(lcb_INSTANCE *instance, lcb_ANALYTICS_HANDLE *handle);
+/** @uncommitted @brief See lcb_query_consumed() */
+LIBCOUCHBASE_API lcb_STATUS lcb_analytics_consumed(lcb_INSTANCE *instance, lcb_ANALYTICS_HANDLE *handle,
+                                                   size_t nbytes);
 
 /** @} */
 
@@ -2652,6 +2701,8 @@ LIBCOUCHBASE_API lcb_STATUS lcb_cmdsearch_payload(lcb_CMDSEARCH *cmd, const char
  */
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdsearch_handle(lcb_CMDSEARCH *cmd, lcb_SEARCH_HANDLE **handle);
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdsearch_timeout(lcb_CMDSEARCH *cmd, uint32_t timeout);
+/** @uncommitted @brief See lcb_cmdquery_high_watermark() */
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdsearch_high_watermark(lcb_CMDSEARCH *cmd, size_t nbytes);
 
 /**
  * Issue a full-text query. The callback (lcb_SEARCH_CALLBACK) will be invoked
@@ -2673,6 +2724,12 @@ LIBCOUCHBASE_API lcb_STATUS lcb_search(lcb_INSTANCE *instance, void *cookie, con
  * @return LCB_SUCCESS if successful, otherwise an error.
  */
 LIBCOUCHBASE_API lcb_STATUS lcb_search_cancel(lcb_INSTANCE *instance, lcb_SEARCH_HANDLE *handle);
+/** @uncommitted @brief Stop reading the response from the network. See lcb_query_pause() */
+LIBCOUCHBASE_API lcb_STATUS lcb_search_pause(lcb_INSTANCE *instance, lcb_SEARCH_HANDLE *handle);
+/** @uncommitted @brief Resume a request paused with lcb_search_pause() */
+LIBCOUCHBASE_API lcb_STATUS lcb_search_resume(lcb_INSTANCE *instance, lcb_SEARCH_HANDLE *handle);
+/** @uncommitted @brief See lcb_query_consumed() */
+LIBCOUCHBASE_API lcb_STATUS lcb_search_consumed(lcb_INSTANCE *instance, lcb_SEARCH_HANDLE *handle, size_t nbytes);
 /** @} */
 
 /**
@@ -2999,6 +3056,18 @@ LIBCOUCHBASE_API lcb_STATUS lcb_cmdquery_option(lcb_CMDQUERY *cmd, const char *n
                                                 size_t value_len);
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdquery_handle(lcb_CMDQUERY *cmd, lcb_QUERY_HANDLE **handle);
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdquery_timeout(lcb_CMDQUERY *cmd, uint32_t timeout);
+/**
+ * @uncommitted
+ *
+ * Pause the reading of the response automatically once the rows handed to
+ * the callback add up to `nbytes` bytes that the application has not
+ * reported as consumed with lcb_query_consumed(). Reading resumes once the
+ * unconsumed bytes drop to half of the watermark.
+ *
+ * @param cmd the command
+ * @param nbytes the high watermark in bytes, or 0 (default) to disable it
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdquery_high_watermark(lcb_CMDQUERY *cmd, size_t nbytes);
 /**
  * Execute a N1QL query.
  *
@@ -3040,6 +3109,35 @@ LIBCOUCHBASE_API lcb_STATUS lcb_query(lcb_INSTANCE *instance, void *cookie, cons
  * @endcode
  */
 LIBCOUCHBASE_API lcb_STATUS lcb_query_cancel(lcb_INSTANCE *instance, lcb_QUERY_HANDLE *handle);
+/**
+ * @uncommitted
+ *
+ * Stop reading the response of an in-progress query from the network, so
+ * that a slow consumer does not make the library buffer the result set.
+ *
+ * Rows already received are still delivered to the callback, so a few rows
+ * may arrive after this call (including when it is made from the callback).
+ * The query timeout keeps running while the query is paused.
+ *
+ * @param instance the instance
+ * @param handle the handle for the request
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_query_pause(lcb_INSTANCE *instance, lcb_QUERY_HANDLE *handle);
+/**
+ * @uncommitted
+ *
+ * Resume reading the response of a query paused with lcb_query_pause(). The
+ * query stays paused while the high watermark is exceeded.
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_query_resume(lcb_INSTANCE *instance, lcb_QUERY_HANDLE *handle);
+/**
+ * @uncommitted
+ *
+ * Report that the application is done with `nbytes` bytes of the rows
+ * received so far (the lengths of the rows as returned by
+ * lcb_respquery_row()). Only meaningful with lcb_cmdquery_high_watermark().
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_query_consumed(lcb_INSTANCE *instance, lcb_QUERY_HANDLE *handle, size_t nbytes);
 /** @} */
 
 /**
@@ -3094,12 +3192,33 @@ LIBCOUCHBASE_API lcb_STATUS lcb_cmdview_view_name(lcb_CMDVIEW *cmd, const char *
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdview_option_string(lcb_CMDVIEW *cmd, const char *optstr, size_t optstr_len);
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdview_post_data(lcb_CMDVIEW *cmd, const char *data, size_t data_len);
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdview_include_docs(lcb_CMDVIEW *cmd, int include_docs);
+/**
+ * Upper bound of the number of document fetches in flight with
+ * lcb_cmdview_include_docs(). The number actually used adapts to the latency
+ * of the responses, starting at 10. 0 selects the default (512).
+ */
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdview_max_concurrent_docs(lcb_CMDVIEW *cmd, uint32_t num);
+/**
+ * @uncommitted
+ *
+ * With lcb_cmdview_include_docs(), deliver each row as soon as its document
+ * is fetched instead of in the order of the view, so that a slow fetch does
+ * not hold back the rows behind it.
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdview_unordered_docs(lcb_CMDVIEW *cmd, int flag);
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdview_no_row_parse(lcb_CMDVIEW *cmd, int flag);
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdview_handle(lcb_CMDVIEW *cmd, lcb_VIEW_HANDLE **handle);
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdview_timeout(lcb_CMDVIEW *cmd, uint32_t timeout);
+/** @uncommitted @brief See lcb_cmdquery_high_watermark(). Rows are counted with their raw JSON size */
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdview_high_watermark(lcb_CMDVIEW *cmd, size_t nbytes);
 LIBCOUCHBASE_API lcb_STATUS lcb_view(lcb_INSTANCE *instance, void *cookie, const lcb_CMDVIEW *cmd);
 LIBCOUCHBASE_API lcb_STATUS lcb_view_cancel(lcb_INSTANCE *instance, lcb_VIEW_HANDLE *handle);
+/** @uncommitted @brief Stop reading the response from the network. See lcb_query_pause() */
+LIBCOUCHBASE_API lcb_STATUS lcb_view_pause(lcb_INSTANCE *instance, lcb_VIEW_HANDLE *handle);
+/** @uncommitted @brief Resume a request paused with lcb_view_pause() */
+LIBCOUCHBASE_API lcb_STATUS lcb_view_resume(lcb_INSTANCE *instance, lcb_VIEW_HANDLE *handle);
+/** @uncommitted @brief See lcb_query_consumed() */
+LIBCOUCHBASE_API lcb_STATUS lcb_view_consumed(lcb_INSTANCE *instance, lcb_VIEW_HANDLE *handle, size_t nbytes);
 /** @} */
 
 /* @ingroup lcb-public-api
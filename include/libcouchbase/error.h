@@ -203,7 +203,9 @@ X(LCB_ERR_CONNECT_ERROR,                    1051, LCB_ERROR_TYPE_SDK, LCB_ERROR_
 X(LCB_ERR_EMPTY_KEY,                        1052, LCB_ERROR_TYPE_SDK, LCB_ERROR_FLAG_INPUT, "An empty key was passed to an operation") \
 X(LCB_ERR_HTTP,                             1053, LCB_ERROR_TYPE_SDK, 0, "HTTP Operation failed. Inspect status code for details") \
 X(LCB_ERR_QUERY,                            1054, LCB_ERROR_TYPE_SDK, 0, "Query execution failed. Inspect raw response object for information") \
-X(LCB_ERR_TOPOLOGY_CHANGE,                  1055, LCB_ERROR_TYPE_SDK, 0, "Topology Change (internal)")
+X(LCB_ERR_TOPOLOGY_CHANGE,                  1055, LCB_ERROR_TYPE_SDK, 0, "Topology Change (internal)") \
+X(LCB_ERR_BACKPRESSURE,                     1056, LCB_ERROR_TYPE_SDK, LCB_ERROR_FLAG_TRANSIENT, "Too many operations or bytes are queued for the server. Retry once the ready callback is invoked") \
+X(LCB_ERR_CIRCUIT_OPEN,                     1057, LCB_ERROR_TYPE_SDK, LCB_ERROR_FLAG_TRANSIENT, "The circuit breaker for the server is open because of a high rate of failures")
 /* clang-format on */
 
 /** Error codes returned by the library. */
@@ -228,6 +230,14 @@ LIBCOUCHBASE_API lcb_STATUS lcb_errctx_kv_rc(const lcb_KEY_VALUE_ERROR_CONTEXT *
 LIBCOUCHBASE_API lcb_STATUS lcb_errctx_kv_status_code(const lcb_KEY_VALUE_ERROR_CONTEXT *ctx, uint16_t *status_code);
 LIBCOUCHBASE_API lcb_STATUS lcb_errctx_kv_opaque(const lcb_KEY_VALUE_ERROR_CONTEXT *ctx, uint32_t *opaque);
 LIBCOUCHBASE_API lcb_STATUS lcb_errctx_kv_cas(const lcb_KEY_VALUE_ERROR_CONTEXT *ctx, uint64_t *cas);
+/**
+ * @uncommitted
+ * Time (in microseconds) the server spent processing the request, as reported
+ * in the response when tracing is negotiated (see `enable_tracing`). Zero
+ * when the server did not report it.
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_errctx_kv_server_duration(const lcb_KEY_VALUE_ERROR_CONTEXT *ctx,
+                                                          uint64_t *duration);
 LIBCOUCHBASE_API lcb_STATUS lcb_errctx_kv_key(const lcb_KEY_VALUE_ERROR_CONTEXT *ctx, const char **key,
                                               size_t *key_len);
 LIBCOUCHBASE_API lcb_STATUS lcb_errctx_kv_bucket(const lcb_KEY_VALUE_ERROR_CONTEXT *ctx, const char **bucket,
@@ -0,0 +1,143 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2020 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LCB_GROUP_H
+#define LCB_GROUP_H
+#include <libcouchbase/submitq.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @ingroup lcb-public-api
+ * @defgroup lcb-group Sharded instance groups
+ * @brief Run several instances on their own threads, each owning a part of the bucket
+ *
+ * @details
+ * An instance group creates one instance per _shard_, each with its own I/O
+ * table and driven by its own thread (optionally pinned to a CPU), and routes
+ * key-based work to the shard owning the key's vBucket. Work is handed to the
+ * shards through their submission queues (see @ref lcb-submitq), so the
+ * group may be used from any number of application threads.
+ *
+ * The cluster map is fetched once, by the first shard. The other shards
+ * bootstrap from it through the configuration cache (the `config_cache`
+ * connection string option, or a private file of the group when it is not
+ * set), and the group keeps a read-only copy to compute the routing. Each
+ * shard then follows topology changes on its own, so a stale routing only
+ * costs affinity, never correctness.
+ *
+ * With #LCB_GROUP_ROUTE_NODE, the vBuckets of a shard are chosen according to
+ * their active node, so that a shard only opens connections to a subset of
+ * the nodes (one node, when there are at least as many nodes as shards).
+ *
+ * @addtogroup lcb-group
+ * @{
+ */
+
+typedef struct lcb_INSTANCE_GROUP_st lcb_INSTANCE_GROUP;
+
+/** How vBuckets are assigned to the shards */
+typedef enum {
+    /** Spread the vBuckets evenly (vBucket modulo the number of shards) */
+    LCB_GROUP_ROUTE_VBUCKET = 0,
+    /** Give each shard the vBuckets of a disjoint subset of the nodes */
+    LCB_GROUP_ROUTE_NODE
+} lcb_GROUP_ROUTING;
+
+/**
+ * Invoked for every shard after the instance is created and before it
+ * connects, on the thread calling lcb_group_create(). This is the place to
+ * install the response callbacks and to apply settings.
+ */
+typedef void (*lcb_GROUP_INIT_CALLBACK)(lcb_INSTANCE *instance, unsigned shard, void *cookie);
+
+/** Options for lcb_group_create(). Zero-initialize, then set what is needed */
+typedef struct {
+    /** Number of shards. 0 selects the number of CPUs */
+    lcb_U32 nshards;
+    lcb_GROUP_ROUTING routing;
+    /** Whether shard `n` should be pinned to CPU `n` (Linux only) */
+    int pin_threads;
+    /** Capacity of the submission queue of each shard. 0 selects the default */
+    lcb_U32 queue_capacity;
+    lcb_GROUP_INIT_CALLBACK init_callback;
+    void *cookie;
+} lcb_GROUPOPTS;
+
+/**
+ * @uncommitted
+ * @brief Create the instances of a group, bootstrap them and start their threads
+ *
+ * @param[out] group the new group
+ * @param options options used to create every instance. They must not
+ *        specify an I/O table, since every shard has its own
+ * @param gopts group options, may be NULL
+ * @return LCB_SUCCESS once every shard is bootstrapped, or the error of the
+ *         first shard which failed to bootstrap
+ */
+LIBCOUCHBASE_API
+lcb_STATUS lcb_group_create(lcb_INSTANCE_GROUP **group, const lcb_CREATEOPTS *options, const lcb_GROUPOPTS *gopts);
+
+/** @uncommitted @brief Number of shards of the group */
+LIBCOUCHBASE_API
+unsigned lcb_group_nshards(const lcb_INSTANCE_GROUP *group);
+
+/**
+ * @uncommitted
+ * @brief The instance of a shard.
+ *
+ * It must only be used from the shard's own thread, i.e. from a function
+ * submitted to that shard.
+ */
+LIBCOUCHBASE_API
+lcb_INSTANCE *lcb_group_instance(lcb_INSTANCE_GROUP *group, unsigned shard);
+
+/** @uncommitted @brief The shard owning a key. May be called from any thread */
+LIBCOUCHBASE_API
+unsigned lcb_group_shard_for_key(const lcb_INSTANCE_GROUP *group, const void *key, size_t nkey);
+
+/**
+ * @uncommitted
+ * @brief Invoke `callback` on the thread of the shard owning `key`.
+ *
+ * May be called from any thread. See lcb_submitq_push() for the return codes.
+ */
+LIBCOUCHBASE_API
+lcb_STATUS lcb_group_submit(lcb_INSTANCE_GROUP *group, const void *key, size_t nkey, lcb_SUBMIT_CALLBACK callback,
+                            void *arg);
+
+/** @uncommitted @brief Invoke `callback` on the thread of a given shard */
+LIBCOUCHBASE_API
+lcb_STATUS lcb_group_submit_shard(lcb_INSTANCE_GROUP *group, unsigned shard, lcb_SUBMIT_CALLBACK callback, void *arg);
+
+/**
+ * @uncommitted
+ * @brief Stop the shards and destroy the group.
+ *
+ * Work submitted before this call is completed first. Must not be called
+ * from a shard thread.
+ */
+LIBCOUCHBASE_API
+void lcb_group_destroy(lcb_INSTANCE_GROUP *group);
+
+/**@}*/
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* LCB_GROUP_H */
@@ -23,6 +23,7 @@ extern "C" {
 #endif
 
 struct lcb_METRICS_st;
+struct lcb_histogram_st;
 
 typedef struct lcb_IOMETRICS_st {
     const char *hostport;
@@ -32,6 +33,24 @@ typedef struct lcb_IOMETRICS_st {
     lcb_SIZE bytes_received;
 } lcb_IOMETRICS;
 
+/**
+ * Stages of the lifecycle of a KV operation, for the histograms of
+ * lcb_SERVERMETRICS#stage_hg. Each one measures the time between two events
+ */
+typedef enum {
+    /** From scheduling the operation to placing it in the send queue of the server */
+    LCB_PKTSTAGE_SCHEDULE = 0,
+    /** From the send queue to the socket */
+    LCB_PKTSTAGE_SEND_QUEUE,
+    /** From the socket to reading the first byte of the response (network and server) */
+    LCB_PKTSTAGE_WIRE,
+    /** From the first byte of the response to dispatching it */
+    LCB_PKTSTAGE_READ,
+    /** Time spent in the operation callback */
+    LCB_PKTSTAGE_CALLBACK,
+    LCB_PKTSTAGE__MAX
+} lcb_PACKET_STAGE;
+
 typedef struct lcb_SERVERMETRICS_st {
     /** IO Metrics for the underlying socket */
     lcb_IOMETRICS iometrics;
@@ -62,6 +81,73 @@ typedef struct lcb_SERVERMETRICS_st {
 
     /** Number of NOT_MY_VBUCKET replies received */
     lcb_SIZE packets_nmv;
+
+    /** Number of hedged replica reads sent to this server */
+    lcb_SIZE hedges_launched;
+
+    /** Number of hedged replica reads from this server which beat the active node */
+    lcb_SIZE hedges_won;
+
+    /** Number of hedged replica reads from this server whose reply was discarded */
+    lcb_SIZE hedges_wasted;
+
+    /** Number of packets sent to this server from the retry queue */
+    lcb_SIZE packets_retried;
+
+    /** Number of times a retry to this server was deferred because its retry budget was exhausted */
+    lcb_SIZE retry_budget_exhausted;
+
+    /** Total time (in microseconds) packets retried to this server spent in the retry queue */
+    lcb_SIZE retry_queue_time;
+
+    /** Number of operations rejected with LCB_ERR_BACKPRESSURE for this server */
+    lcb_SIZE packets_rejected;
+
+    /** Current state of the circuit breaker: 0 closed, 1 open, 2 half-open */
+    lcb_SIZE circuit_state;
+
+    /** Number of times the circuit breaker for this server opened */
+    lcb_SIZE circuit_opened;
+
+    /** Number of operations rejected with LCB_ERR_CIRCUIT_OPEN for this server */
+    lcb_SIZE circuit_rejected;
+
+    /** Number of NOOP probes sent while the circuit breaker was half-open */
+    lcb_SIZE circuit_probes;
+
+    /** Number of large responses read directly into a buffer sized for the whole packet */
+    lcb_SIZE packets_contig_reserved;
+
+    /** Number of bytes of those responses which did not need to be copied to make them contiguous */
+    lcb_SIZE bytes_consolidate_avoided;
+
+    /** Number of responses from this server which reported the time the server spent on them */
+    lcb_SIZE packets_server_timed;
+
+    /** Total time (in microseconds) the server reported for those responses */
+    lcb_SIZE server_duration;
+
+    /**
+     * Total time (in microseconds) the same responses spent outside of the
+     * server: in the queues of the pipeline, on the network and waiting to be
+     * read
+     */
+    lcb_SIZE network_queue_duration;
+
+    /** Number of compressed values inflated straight from the segments they were read into */
+    lcb_SIZE packets_inflated_fragmented;
+
+    /** Distribution of the time spent by the server (see lcb_histogram_read()) */
+    struct lcb_histogram_st *server_duration_hg;
+
+    /** Distribution of the time spent outside of the server */
+    struct lcb_histogram_st *network_queue_duration_hg;
+
+    /**
+     * Distribution of the time spent by the operations in each stage of their
+     * lifecycle, indexed by lcb_PACKET_STAGE
+     */
+    struct lcb_histogram_st *stage_hg[LCB_PKTSTAGE__MAX];
 } lcb_SERVERMETRICS;
 
 typedef struct lcb_METRICS_st {
@@ -0,0 +1,158 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2020 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LCB_SUBMITQ_H
+#define LCB_SUBMITQ_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @ingroup lcb-public-api
+ * @defgroup lcb-submitq Submitting operations from other threads
+ * @brief Share one instance between several application threads
+ *
+ * @details
+ * An lcb_INSTANCE must only be used from a single thread. A submission queue
+ * lets other threads hand work to the thread which drives the instance (the
+ * _I/O thread_) without locking around every call:
+ *
+ * 1. The I/O thread creates the queue with lcb_submitq_create() once the
+ *    instance is bootstrapped, and then calls lcb_submitq_run().
+ * 2. Any thread calls lcb_submitq_push() with a function and an argument.
+ *    The queue is a bounded lock-free ring, so producers never block each
+ *    other nor the I/O thread.
+ * 3. The I/O thread is woken up (through an eventfd or a pipe watched by the
+ *    event loop), and invokes the pushed functions in batches. Each batch is
+ *    run inside lcb_sched_enter() and lcb_sched_leave(), so the commands
+ *    scheduled by a batch are flushed to the network together.
+ *
+ * The pushed function is where the application calls lcb_get(), lcb_store()
+ * and so on, with a cookie identifying the request. Responses are delivered
+ * to the instance callbacks on the I/O thread, which complete the request
+ * (for example by fulfilling a future stored in the cookie).
+ *
+ * @code{.c}
+ * static void submit_get(lcb_INSTANCE *instance, void *arg)
+ * {
+ *     struct my_request *req = arg;
+ *     lcb_CMDGET *cmd;
+ *     lcb_cmdget_create(&cmd);
+ *     lcb_cmdget_key(cmd, req->key, req->nkey);
+ *     if (lcb_get(instance, req, cmd) != LCB_SUCCESS) {
+ *         my_request_fail(req);
+ *     }
+ *     lcb_cmdget_destroy(cmd);
+ * }
+ *
+ * // On any thread
+ * lcb_submitq_push(queue, submit_get, req);
+ * @endcode
+ *
+ * The wakeup descriptor needs an event-based I/O plugin (select, libevent,
+ * libev). With completion-based plugins (libuv, IOCP) the I/O thread polls
+ * the queue with a timer instead, every #LCB_SUBMITQ_POLL_INTERVAL
+ * microseconds.
+ *
+ * @addtogroup lcb-submitq
+ * @{
+ */
+
+/** Default number of entries in the ring */
+#define LCB_SUBMITQ_DEFAULT_CAPACITY 4096
+
+/** Polling interval (in microseconds) when the I/O plugin cannot watch the wakeup descriptor */
+#define LCB_SUBMITQ_POLL_INTERVAL 1000
+
+typedef struct lcb_SUBMITQ_st lcb_SUBMITQ;
+
+/**
+ * Function invoked on the I/O thread for every entry of the queue
+ * @param instance the instance the queue was created for
+ * @param arg the argument passed to lcb_submitq_push()
+ */
+typedef void (*lcb_SUBMIT_CALLBACK)(lcb_INSTANCE *instance, void *arg);
+
+/**
+ * @uncommitted
+ * @brief Create a submission queue for an instance.
+ *
+ * Must be called from the thread driving the instance.
+ *
+ * @param instance the instance
+ * @param capacity number of entries in the ring, rounded up to a power of
+ *        two. 0 selects #LCB_SUBMITQ_DEFAULT_CAPACITY
+ * @param[out] queue the new queue
+ * @return LCB_SUCCESS, or LCB_ERR_NO_MEMORY, or LCB_ERR_SDK_INTERNAL if the
+ *         wakeup descriptor cannot be created
+ */
+LIBCOUCHBASE_API
+lcb_STATUS lcb_submitq_create(lcb_INSTANCE *instance, lcb_U32 capacity, lcb_SUBMITQ **queue);
+
+/**
+ * @uncommitted
+ * @brief Push an entry into the queue. May be called from any thread.
+ *
+ * @param queue the queue
+ * @param callback the function to invoke on the I/O thread
+ * @param arg the argument to pass to the function
+ * @return LCB_SUCCESS, LCB_ERR_TEMPORARY_FAILURE if the ring is full, or
+ *         LCB_ERR_REQUEST_CANCELED if lcb_submitq_stop() was already called
+ */
+LIBCOUCHBASE_API
+lcb_STATUS lcb_submitq_push(lcb_SUBMITQ *queue, lcb_SUBMIT_CALLBACK callback, void *arg);
+
+/**
+ * @uncommitted
+ * @brief Run the event loop of the instance until lcb_submitq_stop() is called.
+ *
+ * Must be called from the thread driving the instance. Before returning, the
+ * entries pushed before the stop request are invoked and the operations they
+ * scheduled are waited for.
+ *
+ * @param queue the queue
+ * @return the result of the final lcb_wait()
+ */
+LIBCOUCHBASE_API
+lcb_STATUS lcb_submitq_run(lcb_SUBMITQ *queue);
+
+/**
+ * @uncommitted
+ * @brief Ask lcb_submitq_run() to return. May be called from any thread.
+ *
+ * Further lcb_submitq_push() calls fail with LCB_ERR_REQUEST_CANCELED.
+ */
+LIBCOUCHBASE_API
+void lcb_submitq_stop(lcb_SUBMITQ *queue);
+
+/**
+ * @uncommitted
+ * @brief Destroy the queue.
+ *
+ * Must be called from the thread driving the instance, before the instance
+ * itself is destroyed, and once no other thread uses the queue. Entries still
+ * in the ring are invoked first.
+ */
+LIBCOUCHBASE_API
+void lcb_submitq_destroy(lcb_SUBMITQ *queue);
+
+/**@}*/
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* LCB_SUBMITQ_H */
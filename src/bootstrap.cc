@@ -17,6 +17,7 @@
 
 #define LCB_BOOTSTRAP_DEFINE_STRUCT 1
 #include "internal.h"
+#include "collections.h"
 #include "defer.h"
 
 #define LOGARGS(instance, lvl) instance->settings, "bootstrap", LCB_LOG_##lvl, __FILE__, __LINE__
@@ -134,6 +135,9 @@ void Bootstrap::config_callback(EventType event, ConfigInfo *info)
             instance->callbacks.open(instance, LCB_SUCCESS);
             instance->callbacks.open = nullptr;
         }
+        if (LCBT_SETTING(parent, collections_prefetch)) {
+            collcache_prefetch_manifest(instance);
+        }
         lcb::execute_deferred_operations(instance);
 
         // See if we can enable background polling.
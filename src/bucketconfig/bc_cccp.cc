@@ -31,12 +31,14 @@
 #include "ctx-log-inl.h"
 
 #include <cstring>
+#include <vector>
 
 #define LOGFMT CTX_LOGFMT
 #define LOGID(p) CTX_LOGID(p->ioctx)
 #define LOGARGS(cccp, lvl) cccp->parent->settings, "cccp", LCB_LOG_##lvl, __FILE__, __LINE__
 
 struct CccpCookie;
+struct CccpRacer;
 
 using namespace lcb::clconfig;
 
@@ -60,6 +62,14 @@ struct CccpProvider : public Provider {
     lcb_STATUS update(const char *host, const char *data);
     void request_config();
     void on_io_read();
+    bool read_config(lcbio_CTX *ctx, lcb_STATUS &err, std::string &json);
+
+    void start_race(const lcb_host_t &first);
+    void add_racer(const lcb_host_t &host);
+    void on_race_delay();
+    void racer_failed(CccpRacer *racer, lcb_STATUS err);
+    void racer_done(CccpRacer *racer, const std::string &json);
+    void stop_race();
 
     bool pause() override;
     void configure_nodes(const lcb::Hostlist &) override;
@@ -86,7 +96,7 @@ struct CccpProvider : public Provider {
     // Whether there is a pending CCCP config request.
     bool has_pending_request() const
     {
-        return creq != nullptr || cmdcookie != nullptr || ioctx != nullptr;
+        return creq != nullptr || cmdcookie != nullptr || ioctx != nullptr || !racers.empty();
     }
 
     lcb::Hostlist *nodes;
@@ -96,6 +106,22 @@ struct CccpProvider : public Provider {
     lcb::io::ConnectionRequest *creq{};
     lcbio_CTX *ioctx;
     CccpCookie *cmdcookie;
+
+    /** Connections racing for the configuration (see LCB_CNTL_BOOTSTRAP_RACE_COUNT) */
+    std::vector<CccpRacer *> racers;
+    lcb::io::Timer<CccpProvider, &CccpProvider::on_race_delay> race_timer;
+};
+
+/** One node asked for the configuration while racing */
+struct CccpRacer {
+    CccpRacer(CccpProvider *parent_, const lcb_host_t &host_) : parent(parent_), host(host_) {}
+
+    void stop(bool is_clean);
+
+    CccpProvider *parent;
+    lcb_host_t host;
+    lcb::io::ConnectionRequest *creq{};
+    lcbio_CTX *ioctx{};
 };
 
 struct CccpCookie {
@@ -122,6 +148,7 @@ struct CccpCookie {
 static void io_error_handler(lcbio_CTX *, lcb_STATUS);
 static void io_read_handler(lcbio_CTX *, unsigned nr);
 static void on_connected(lcbio_SOCKET *, void *, lcb_STATUS, lcbio_OSERR);
+static void send_config_request(lcbio_CTX *ctx);
 
 static void pooled_close_cb(lcbio_SOCKET *sock, int reusable, void *arg)
 {
@@ -147,6 +174,26 @@ void CccpProvider::stop_current_request(bool is_clean)
         lcbio_ctx_close(ioctx, pooled_close_cb, &is_clean);
         ioctx = nullptr;
     }
+    stop_race();
+}
+
+void CccpRacer::stop(bool is_clean)
+{
+    lcb::io::ConnectionRequest::cancel(&creq);
+    if (ioctx) {
+        lcbio_ctx_close(ioctx, pooled_close_cb, &is_clean);
+        ioctx = nullptr;
+    }
+}
+
+void CccpProvider::stop_race()
+{
+    race_timer.cancel();
+    for (auto *racer : racers) {
+        racer->stop(false);
+        delete racer;
+    }
+    racers.clear();
 }
 
 lcb_STATUS CccpProvider::schedule_next_request(lcb_STATUS err, bool can_rollover)
@@ -159,6 +206,10 @@ lcb_STATUS CccpProvider::schedule_next_request(lcb_STATUS err, bool can_rollover
     }
 
     lcb::Server *server = instance->find_server(*next_host);
+    if (server == nullptr && settings().bootstrap_race_count > 1) {
+        start_race(*next_host);
+        return LCB_SUCCESS;
+    }
     if (server) {
         cmdcookie = new CccpCookie(this);
         lcb_log(LOGARGS(this, TRACE), "Re-Issuing CCCP Command on server struct %p (" LCB_HOST_FMT ")", (void *)server,
@@ -335,6 +386,7 @@ CccpProvider::~CccpProvider()
     }
     delete nodes;
     timer.release();
+    race_timer.release();
 }
 
 void CccpProvider::configure_nodes(const lcb::Hostlist &nodes_)
@@ -378,77 +430,233 @@ static void io_read_handler(lcbio_CTX *ioctx, unsigned)
     reinterpret_cast<CccpProvider *>(lcbio_ctx_data(ioctx))->on_io_read();
 }
 
-void CccpProvider::on_io_read()
+/**
+ * Read the GET_CLUSTER_CONFIG response from the connection.
+ * @return false if more data is needed; otherwise `err` holds the outcome
+ * and, on success, `json` the configuration
+ */
+bool CccpProvider::read_config(lcbio_CTX *ctx, lcb_STATUS &err, std::string &json)
 {
     unsigned required;
-
-#define return_error(e)                                                                                                \
-    resp.release(ioctx);                                                                                               \
-    mcio_error(e);                                                                                                     \
-    return
-
     lcb::MemcachedResponse resp;
-    if (!resp.load(ioctx, &required)) {
-        lcbio_ctx_rwant(ioctx, required);
-        lcbio_ctx_schedule(ioctx);
-        return;
+    if (!resp.load(ctx, &required)) {
+        lcbio_ctx_rwant(ctx, required);
+        lcbio_ctx_schedule(ctx);
+        return false;
     }
 
+    err = LCB_SUCCESS;
     if (resp.status() != PROTOCOL_BINARY_RESPONSE_SUCCESS) {
         std::string value{};
         if (resp.vallen()) {
             value.assign(resp.value(), resp.vallen());
         }
         lcb_log(LOGARGS(this, WARN), LOGFMT "CCCP Packet responded with 0x%02x; nkey=%d, cmd=0x%x, seq=0x%x, value=%s",
-                LOGID(this), resp.status(), resp.keylen(), resp.opcode(), resp.opaque(), value.c_str());
+                CTX_LOGID(ctx), resp.status(), resp.keylen(), resp.opcode(), resp.opaque(), value.c_str());
 
-        if (settings().bucket == nullptr) {
+        if (settings().bucket == nullptr && resp.status() == PROTOCOL_BINARY_RESPONSE_NO_BUCKET) {
+            err = LCB_ERR_UNSUPPORTED_OPERATION;
+        } else {
             switch (resp.status()) {
-                case PROTOCOL_BINARY_RESPONSE_NO_BUCKET:
-                    return_error(LCB_ERR_UNSUPPORTED_OPERATION);
+                case PROTOCOL_BINARY_RESPONSE_NOT_SUPPORTED:
+                case PROTOCOL_BINARY_RESPONSE_UNKNOWN_COMMAND:
+                    err = LCB_ERR_UNSUPPORTED_OPERATION;
+                    break;
+                default:
+                    err = LCB_ERR_PROTOCOL_ERROR;
+                    break;
             }
         }
-
-        switch (resp.status()) {
-            case PROTOCOL_BINARY_RESPONSE_NOT_SUPPORTED:
-            case PROTOCOL_BINARY_RESPONSE_UNKNOWN_COMMAND:
-                return_error(LCB_ERR_UNSUPPORTED_OPERATION);
-            default:
-                return_error(LCB_ERR_PROTOCOL_ERROR);
-        }
+    } else if (!resp.bodylen()) {
+        err = LCB_ERR_PROTOCOL_ERROR;
+    } else {
+        json.assign(resp.value(), resp.vallen());
     }
+    resp.release(ctx);
+    return true;
+}
+
+void CccpProvider::on_io_read()
+{
+    lcb_STATUS err;
+    std::string jsonstr;
 
-    if (!resp.bodylen()) {
-        return_error(LCB_ERR_PROTOCOL_ERROR);
+    if (!read_config(ioctx, err, jsonstr)) {
+        return;
+    }
+    if (err != LCB_SUCCESS) {
+        mcio_error(err);
+        return;
     }
 
-    std::string jsonstr(resp.value(), resp.vallen());
     std::string hoststr(lcbio_get_host(lcbio_ctx_sock(ioctx))->host);
-
-    resp.release(ioctx);
     stop_current_request(true);
 
-    lcb_STATUS err = update(hoststr.c_str(), jsonstr.c_str());
+    err = update(hoststr.c_str(), jsonstr.c_str());
 
     if (err == LCB_SUCCESS) {
         timer.cancel();
     } else {
         schedule_next_request(LCB_ERR_PROTOCOL_ERROR, false);
     }
-
-#undef return_error
 }
 
-void CccpProvider::request_config()
+static void send_config_request(lcbio_CTX *ctx)
 {
     lcb::MemcachedRequest req(PROTOCOL_BINARY_CMD_GET_CLUSTER_CONFIG);
     req.opaque(0xF00D);
-    lcbio_ctx_put(ioctx, req.data(), req.size());
-    lcbio_ctx_rwant(ioctx, 24);
-    lcbio_ctx_schedule(ioctx);
+    lcbio_ctx_put(ctx, req.data(), req.size());
+    lcbio_ctx_rwant(ctx, 24);
+    lcbio_ctx_schedule(ctx);
+}
+
+void CccpProvider::request_config()
+{
+    send_config_request(ioctx);
     timer.rearm(settings().config_node_timeout);
 }
 
+static void racer_io_error(lcbio_CTX *ctx, lcb_STATUS err)
+{
+    auto *racer = reinterpret_cast<CccpRacer *>(lcbio_ctx_data(ctx));
+    racer->parent->racer_failed(racer, err);
+}
+
+static void racer_io_read(lcbio_CTX *ctx, unsigned)
+{
+    auto *racer = reinterpret_cast<CccpRacer *>(lcbio_ctx_data(ctx));
+    CccpProvider *cccp = racer->parent;
+    lcb_STATUS err;
+    std::string jsonstr;
+
+    if (!cccp->read_config(ctx, err, jsonstr)) {
+        return;
+    }
+    if (err != LCB_SUCCESS) {
+        cccp->racer_failed(racer, err);
+    } else {
+        cccp->racer_done(racer, jsonstr);
+    }
+}
+
+static void racer_connected(lcbio_SOCKET *sock, void *data, lcb_STATUS err, lcbio_OSERR)
+{
+    auto *racer = reinterpret_cast<CccpRacer *>(data);
+    CccpProvider *cccp = racer->parent;
+    lcb_settings *settings = cccp->parent->settings;
+    racer->creq = nullptr;
+
+    if (err != LCB_SUCCESS) {
+        if (sock) {
+            lcb::io::Pool::discard(sock);
+        }
+        cccp->racer_failed(racer, err);
+        return;
+    }
+
+    if (lcbio_protoctx_get(sock, LCBIO_PROTOCTX_SESSINFO) == nullptr) {
+        racer->creq = lcb::SessionRequest::start(sock, settings, settings->config_node_timeout, racer_connected, racer);
+        return;
+    }
+
+    lcbio_CTXPROCS ioprocs{};
+    ioprocs.cb_err = racer_io_error;
+    ioprocs.cb_read = racer_io_read;
+    racer->ioctx = lcbio_ctx_new(sock, racer, &ioprocs);
+    racer->ioctx->subsys = "bc_cccp";
+    sock->service = LCBIO_SERVICE_CFG;
+    send_config_request(racer->ioctx);
+}
+
+/**
+ * Ask several nodes for the configuration, starting another one each time the
+ * race delay passes without an answer. The first valid configuration wins.
+ */
+void CccpProvider::start_race(const lcb_host_t &first)
+{
+    timer.rearm(settings().config_node_timeout);
+    add_racer(first);
+}
+
+void CccpProvider::add_racer(const lcb_host_t &host)
+{
+    auto *racer = new CccpRacer(this, host);
+    racers.push_back(racer);
+    lcb_log(LOGARGS(this, INFO), "Requesting connection to node " LCB_HOST_FMT " for CCCP configuration (racer %u of %u)",
+            LCB_HOST_ARG(this->parent->settings, &host), (unsigned)racers.size(),
+            (unsigned)settings().bootstrap_race_count);
+    if (racers.size() < settings().bootstrap_race_count) {
+        race_timer.rearm(settings().bootstrap_race_delay);
+    }
+    racer->creq = instance->memd_sockpool->get(racer->host, settings().config_node_timeout, racer_connected, racer);
+}
+
+void CccpProvider::on_race_delay()
+{
+    if (racers.size() >= settings().bootstrap_race_count) {
+        return;
+    }
+    lcb_host_t *next_host = nodes->next(false);
+    if (next_host) {
+        add_racer(*next_host);
+    }
+}
+
+void CccpProvider::racer_failed(CccpRacer *racer, lcb_STATUS err)
+{
+    lcb_log(LOGARGS(this, ERR), "Could not get configuration from " LCB_HOST_FMT ": %s",
+            LCB_HOST_ARG(this->parent->settings, &racer->host), lcb_strerror_short(err));
+
+    for (auto it = racers.begin(); it != racers.end(); ++it) {
+        if (*it == racer) {
+            racers.erase(it);
+            break;
+        }
+    }
+    racer->stop(err == LCB_ERR_UNSUPPORTED_OPERATION);
+    delete racer;
+
+    if (err == LCB_ERR_PROTOCOL_ERROR && LCBT_SETTING(instance, conntype) == LCB_TYPE_CLUSTER) {
+        lcb_log(LOGARGS(this, WARN), "Failed to bootstrap using CCCP");
+        stop_race();
+        timer.cancel();
+        parent->provider_failed(this, err);
+        return;
+    }
+
+    /* replace the failed node right away */
+    lcb_host_t *next_host = nodes->next(false);
+    if (next_host) {
+        add_racer(*next_host);
+    } else if (racers.empty()) {
+        race_timer.cancel();
+        timer.cancel();
+        parent->provider_failed(this, err);
+    }
+}
+
+void CccpProvider::racer_done(CccpRacer *racer, const std::string &json)
+{
+    std::string hoststr(lcbio_get_host(lcbio_ctx_sock(racer->ioctx))->host);
+
+    for (auto it = racers.begin(); it != racers.end(); ++it) {
+        if (*it == racer) {
+            racers.erase(it);
+            break;
+        }
+    }
+    racer->stop(true);
+    delete racer;
+    stop_race();
+
+    lcb_STATUS err = update(hoststr.c_str(), json.c_str());
+    if (err == LCB_SUCCESS) {
+        timer.cancel();
+    } else {
+        schedule_next_request(LCB_ERR_PROTOCOL_ERROR, false);
+    }
+}
+
 void CccpProvider::dump(FILE *fp) const
 {
     if (!enabled) {
@@ -463,6 +671,8 @@ void CccpProvider::dump(FILE *fp) const
         lcbio_ctx_dump(ioctx, fp);
     } else if (creq) {
         fprintf(fp, "CCCP Is connecting\n");
+    } else if (!racers.empty()) {
+        fprintf(fp, "CCCP Is racing %u nodes\n", (unsigned)racers.size());
     } else {
         fprintf(fp, "CCCP does not have a dedicated connection\n");
     }
@@ -477,7 +687,7 @@ void CccpProvider::dump(FILE *fp) const
 
 CccpProvider::CccpProvider(Confmon *mon)
     : Provider(mon, CLCONFIG_CCCP), nodes(new lcb::Hostlist()), config(nullptr), timer(mon->iot, this),
-      instance(nullptr), ioctx(nullptr), cmdcookie(nullptr)
+      instance(nullptr), ioctx(nullptr), cmdcookie(nullptr), race_timer(mon->iot, this)
 {
 }
 
@@ -17,13 +17,26 @@
 
 #include "internal.h"
 #include "clconfig.h"
+#include "collections.h"
+#include "vbucket/snapshot.h"
+#include "rnd.h"
 #include <lcbio/lcbio.h>
 #include <lcbio/timer-cxx.h>
 #include <fstream>
 #include <istream>
 #include <cstring>
+#include <map>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 #define CONFIG_CACHE_MAGIC "{{{fb85b563d0a8f65fa8d3d58f1b3a0708}}}"
+#define SNAPSHOT_MAGIC "LCBCFGS1"
+#define SNAPSHOT_VERSION 2
+#define SNAPSHOT_SUFFIX ".snapshot"
 
 #define LOGARGS(pb, lvl) static_cast<Provider *>(pb)->parent->settings, "bc_file", LCB_LOG_##lvl, __FILE__, __LINE__
 #define LOGFMT "(cache=%s) "
@@ -31,53 +44,301 @@
 
 using namespace lcb::clconfig;
 
+static void put_le(std::string &out, lcb_U64 val, size_t n)
+{
+    for (size_t ii = 0; ii < n; ii++) {
+        out += static_cast<char>((val >> (8 * ii)) & 0xff);
+    }
+}
+
+static lcb_U64 get_le(const char *data, size_t n)
+{
+    lcb_U64 val = 0;
+    for (size_t ii = 0; ii < n; ii++) {
+        val |= static_cast<lcb_U64>(static_cast<unsigned char>(data[ii])) << (8 * ii);
+    }
+    return val;
+}
+
+/**
+ * Header of the binary snapshot. It is followed by the lcbvb_save_binary()
+ * image of the configuration, and by the known collections, each of them
+ * stored as the collection ID, the length of the path and the path itself.
+ * Integers are little endian.
+ */
+struct SnapshotHeader {
+    enum { SIZE = 8 + 5 * 4 + 2 * 8 };
+
+    lcb_U32 version{SNAPSHOT_VERSION};
+    lcb_U32 nconfig{0};      /**< Size of the configuration image */
+    lcb_U32 ncollections{0}; /**< Number of collection entries */
+    lcb_U32 ncolldata{0};    /**< Size of the collection entries */
+    lcb_U32 checksum{0};     /**< FNV-1a of everything following the header */
+    lcb_S64 revepoch{0};
+    lcb_S64 revid{0};
+
+    void encode(std::string &out) const
+    {
+        out.append(SNAPSHOT_MAGIC, 8);
+        put_le(out, version, 4);
+        put_le(out, nconfig, 4);
+        put_le(out, ncollections, 4);
+        put_le(out, ncolldata, 4);
+        put_le(out, checksum, 4);
+        put_le(out, static_cast<lcb_U64>(revepoch), 8);
+        put_le(out, static_cast<lcb_U64>(revid), 8);
+    }
+
+    /** @param data at least SIZE bytes, starting with the magic */
+    void decode(const char *data)
+    {
+        data += 8;
+        version = get_le(data, 4);
+        nconfig = get_le(data + 4, 4);
+        ncollections = get_le(data + 8, 4);
+        ncolldata = get_le(data + 12, 4);
+        checksum = get_le(data + 16, 4);
+        revepoch = static_cast<lcb_S64>(get_le(data + 20, 8));
+        revid = static_cast<lcb_S64>(get_le(data + 28, 8));
+    }
+};
+
+typedef std::map<std::string, uint32_t> CollectionMap;
+
+static lcb_U32 snapshot_checksum(const char *data, size_t size)
+{
+    lcb_U32 hash = 2166136261U;
+    for (size_t ii = 0; ii < size; ii++) {
+        hash ^= static_cast<unsigned char>(data[ii]);
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+/**
+ * Read-only view of the cache file. The file is mapped rather than read where
+ * possible; writers always replace the file by renaming a new one over it, so
+ * a mapping is never modified under a reader.
+ */
+struct CacheFileView {
+    explicit CacheFileView(const std::string &path)
+    {
+#ifndef _WIN32
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd == -1) {
+            error = errno;
+            return;
+        }
+        struct stat st {
+        };
+        if (fstat(fd, &st) != 0) {
+            error = errno;
+        } else if (st.st_size == 0) {
+            data = "";
+        } else {
+            void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            if (addr == MAP_FAILED) {
+                error = errno;
+            } else {
+                data = static_cast<const char *>(addr);
+                size = st.st_size;
+                mapped = true;
+            }
+        }
+        close(fd);
+#else
+        std::ifstream ifs(path.c_str(), std::ios::in | std::ios::binary | std::ios::ate);
+        if (!ifs.is_open() || !ifs.good()) {
+            error = errno;
+            return;
+        }
+        buf.resize(static_cast<size_t>(ifs.tellg()));
+        ifs.seekg(0, std::ios::beg);
+        if (!buf.empty()) {
+            ifs.read(&buf[0], buf.size());
+        }
+        data = buf.data();
+        size = buf.size();
+#endif
+    }
+
+    ~CacheFileView()
+    {
+#ifndef _WIN32
+        if (mapped) {
+            munmap(const_cast<char *>(data), size);
+        }
+#endif
+    }
+
+    CacheFileView(const CacheFileView &) = delete;
+    CacheFileView &operator=(const CacheFileView &) = delete;
+
+    bool is_snapshot() const
+    {
+        return size >= SnapshotHeader::SIZE && memcmp(data, SNAPSHOT_MAGIC, 8) == 0;
+    }
+
+    const char *data{nullptr};
+    size_t size{0};
+    int error{0};
+    bool mapped{false};
+#ifdef _WIN32
+    std::vector<char> buf;
+#endif
+};
+
 struct FileProvider : Provider, Listener {
     explicit FileProvider(Confmon *parent_);
     ~FileProvider() override;
 
     enum Status { CACHE_ERROR, NO_CHANGES, UPDATED };
     Status load_cache();
+    Status load_file(const std::string &path, bool snapshot);
+    bool load_json(const CacheFileView &view, lcbvb_CONFIG *vbc);
+    bool load_snapshot(const CacheFileView &view, lcbvb_CONFIG *vbc, CollectionMap &collections);
+    bool snapshot_is_current(const lcbvb_CONFIG *cfg, size_t ncollections);
     void reload_cache();
-    void maybe_remove_file() const
+    void maybe_remove_file(const std::string &path) const
     {
-        if (!is_readonly && !filename.empty()) {
-            remove(filename.c_str());
+        if (!is_readonly && !path.empty()) {
+            remove(path.c_str());
         }
     }
+    bool replace_file(const std::string &path, const std::string &data);
     void write_cache(lcbvb_CONFIG *cfg);
 
+    /**
+     * The binary snapshot lives next to the JSON cache, which keeps its
+     * format and name so that older versions sharing the file can read it
+     */
+    std::string snapshot_filename() const
+    {
+        return file_snapshot_filename(filename);
+    }
+
     /* Overrides */
     ConfigInfo *get_cached() override;
     lcb_STATUS refresh() override;
     void dump(FILE *) const override;
     void clconfig_lsn(EventType, ConfigInfo *) override;
 
+    lcb::CollectionCache *collcache() const
+    {
+        return parent->instance ? parent->instance->collcache : nullptr;
+    }
+
     std::string filename;
     ConfigInfo *config;
     time_t last_mtime;
     int last_errno;
     bool is_readonly; /* Whether the config cache should _not_ overwrite the file */
+    size_t saved_collections; /* Number of collections in the snapshot we loaded or wrote */
     lcb::io::Timer<FileProvider, &FileProvider::reload_cache> timer;
 };
 
+bool FileProvider::load_json(const CacheFileView &view, lcbvb_CONFIG *vbc)
+{
+    std::vector<char> buf(view.data, view.data + view.size);
+    buf.push_back(0); // NUL termination
+
+    char *end = std::strstr(&buf[0], CONFIG_CACHE_MAGIC);
+    if (end == nullptr) {
+        lcb_log(LOGARGS(this, ERROR), LOGFMT "Couldn't find magic", LOGID(this));
+        return false;
+    }
+    *end = '\0'; // Stop parsing at MAGIC
+
+    if (lcbvb_load_json(vbc, &buf[0]) != 0) {
+        lcb_log(LOGARGS(this, ERROR), LOGFMT "Couldn't parse configuration", LOGID(this));
+        lcb_log_badconfig(LOGARGS(this, ERROR), vbc, &buf[0]);
+        return false;
+    }
+    return true;
+}
+
+bool FileProvider::load_snapshot(const CacheFileView &view, lcbvb_CONFIG *vbc, CollectionMap &collections)
+{
+    SnapshotHeader hdr;
+    hdr.decode(view.data);
+    if (hdr.version != SNAPSHOT_VERSION) {
+        lcb_log(LOGARGS(this, ERROR), LOGFMT "Unsupported snapshot version (%u)", LOGID(this), hdr.version);
+        return false;
+    }
+
+    const char *body = view.data + SnapshotHeader::SIZE;
+    size_t nbody = view.size - SnapshotHeader::SIZE;
+    if (static_cast<size_t>(hdr.nconfig) + hdr.ncolldata != nbody) {
+        lcb_log(LOGARGS(this, ERROR), LOGFMT "Truncated snapshot", LOGID(this));
+        return false;
+    }
+    if (snapshot_checksum(body, nbody) != hdr.checksum) {
+        lcb_log(LOGARGS(this, ERROR), LOGFMT "Snapshot checksum mismatch", LOGID(this));
+        return false;
+    }
+    if (lcbvb_load_binary(vbc, body, hdr.nconfig) != 0) {
+        lcb_log(LOGARGS(this, ERROR), LOGFMT "Couldn't load configuration snapshot: %s", LOGID(this),
+                lcbvb_get_error(vbc));
+        return false;
+    }
+    if (vbc->revepoch != hdr.revepoch || vbc->revid != hdr.revid) {
+        lcb_log(LOGARGS(this, ERROR), LOGFMT "Snapshot revision does not match its configuration", LOGID(this));
+        return false;
+    }
+
+    const char *cur = body + hdr.nconfig;
+    const char *end = cur + hdr.ncolldata;
+    for (lcb_U32 ii = 0; ii < hdr.ncollections; ii++) {
+        if (end - cur < 8) {
+            break;
+        }
+        lcb_U32 cid = get_le(cur, 4);
+        lcb_U32 npath = get_le(cur + 4, 4);
+        cur += 8;
+        if (static_cast<size_t>(end - cur) < npath) {
+            break;
+        }
+        collections[std::string(cur, npath)] = cid;
+        cur += npath;
+    }
+    if (cur != end || collections.size() != hdr.ncollections) {
+        lcb_log(LOGARGS(this, ERROR), LOGFMT "Invalid collections in snapshot", LOGID(this));
+        return false;
+    }
+    return true;
+}
+
 FileProvider::Status FileProvider::load_cache()
 {
     if (filename.empty()) {
         return CACHE_ERROR;
     }
 
-    std::ifstream ifs(filename.c_str(), std::ios::in | std::ios::binary | std::ios::ate);
-
-    if (!ifs.is_open() || !ifs.good()) {
-        int save_errno = last_errno = errno;
-        lcb_log(LOGARGS(this, ERROR), LOGFMT "Couldn't open for reading: %s", LOGID(this), strerror(save_errno));
-        return CACHE_ERROR;
+    /* Prefer the snapshot, unless an older version of the library has
+     * rewritten the JSON cache since */
+    std::string snapshot = snapshot_filename();
+    struct stat st_json {
+    };
+    struct stat st_snapshot {
+    };
+    bool has_json = stat(filename.c_str(), &st_json) == 0;
+    if (stat(snapshot.c_str(), &st_snapshot) == 0 && (!has_json || st_snapshot.st_mtime >= st_json.st_mtime)) {
+        Status status = load_file(snapshot, true);
+        if (status != CACHE_ERROR) {
+            return status;
+        }
     }
+    return load_file(filename, false);
+}
 
+FileProvider::Status FileProvider::load_file(const std::string &path, bool snapshot)
+{
     struct stat st {
     };
-    if (stat(filename.c_str(), &st)) {
-        last_errno = errno;
+    if (stat(path.c_str(), &st)) {
+        int save_errno = last_errno = errno;
+        lcb_log(LOGARGS(this, ERROR), LOGFMT "Couldn't open %s for reading: %s", LOGID(this), path.c_str(),
+                strerror(save_errno));
         return CACHE_ERROR;
     }
 
@@ -86,23 +347,17 @@ FileProvider::Status FileProvider::load_cache()
         return NO_CHANGES;
     }
 
-    size_t fsize = ifs.tellg();
-    if (!fsize) {
-        lcb_log(LOGARGS(this, WARN), LOGFMT "File '%s' is empty", LOGID(this), filename.c_str());
+    CacheFileView view(path);
+    if (view.data == nullptr) {
+        int save_errno = last_errno = view.error;
+        lcb_log(LOGARGS(this, ERROR), LOGFMT "Couldn't open %s for reading: %s", LOGID(this), path.c_str(),
+                strerror(save_errno));
         return CACHE_ERROR;
     }
-    ifs.seekg(0, std::ios::beg);
-    std::vector<char> buf(fsize);
-    ifs.read(&buf[0], fsize);
-    buf.push_back(0); // NUL termination
-
-    char *end = std::strstr(&buf[0], CONFIG_CACHE_MAGIC);
-    if (end == nullptr) {
-        lcb_log(LOGARGS(this, ERROR), LOGFMT "Couldn't find magic", LOGID(this));
-        maybe_remove_file();
+    if (view.size == 0) {
+        lcb_log(LOGARGS(this, WARN), LOGFMT "File '%s' is empty", LOGID(this), path.c_str());
         return CACHE_ERROR;
     }
-    *end = '\0'; // Stop parsing at MAGIC
 
     lcbvb_CONFIG *vbc = lcbvb_create();
     if (vbc == nullptr) {
@@ -110,11 +365,11 @@ FileProvider::Status FileProvider::load_cache()
     }
 
     Status status = CACHE_ERROR;
+    CollectionMap collections;
+    lcb::CollectionCache *cache = nullptr;
 
-    if (lcbvb_load_json(vbc, &buf[0]) != 0) {
-        lcb_log(LOGARGS(this, ERROR), LOGFMT "Couldn't parse configuration", LOGID(this));
-        lcb_log_badconfig(LOGARGS(this, ERROR), vbc, &buf[0]);
-        maybe_remove_file();
+    if (snapshot ? !view.is_snapshot() || !load_snapshot(view, vbc, collections) : !load_json(view, vbc)) {
+        maybe_remove_file(path);
         goto GT_DONE;
     }
 
@@ -137,6 +392,19 @@ FileProvider::Status FileProvider::load_cache()
         config->decref();
     }
 
+    /* Known collection IDs let the first operations skip the GET_CID round trip;
+     * a stale ID is refreshed through the usual unknown-collection handling */
+    cache = collcache();
+    if (cache != nullptr) {
+        for (const auto &entry : collections) {
+            cache->put(entry.first, entry.second);
+        }
+        saved_collections = cache->size();
+    }
+    lcb_log(LOGARGS(this, DEBUG), LOGFMT "Loaded %s (rev=%" PRId64 ":%" PRId64 ", collections=%u)", LOGID(this),
+            snapshot ? "snapshot" : "JSON configuration", vbc->revepoch, vbc->revid,
+            static_cast<unsigned>(collections.size()));
+
     config = ConfigInfo::create(vbc, CLCONFIG_FILE, filename);
     last_mtime = st.st_mtime;
 
@@ -150,23 +418,130 @@ GT_DONE:
     return status;
 }
 
+bool FileProvider::snapshot_is_current(const lcbvb_CONFIG *cfg, size_t ncollections)
+{
+    if (cfg->revid < 0) {
+        return false;
+    }
+    /* The JSON cache must be rewritten if it is missing, or if an older
+     * version of the library has replaced it since */
+    std::string snapshot = snapshot_filename();
+    struct stat st_json {
+    };
+    struct stat st_snapshot {
+    };
+    if (stat(filename.c_str(), &st_json) != 0 || stat(snapshot.c_str(), &st_snapshot) != 0 ||
+        st_json.st_mtime > st_snapshot.st_mtime) {
+        return false;
+    }
+    CacheFileView view(snapshot);
+    if (view.data == nullptr || !view.is_snapshot()) {
+        return false;
+    }
+
+    bool current = false;
+    CollectionMap collections;
+    lcbvb_CONFIG *saved = lcbvb_create();
+    if (saved != nullptr && load_snapshot(view, saved, collections) && saved->bname != nullptr &&
+        strcmp(saved->bname, cfg->bname) == 0 && collections.size() >= ncollections) {
+        current = saved->revepoch > cfg->revepoch ||
+                  (saved->revepoch == cfg->revepoch && saved->revid >= cfg->revid);
+    }
+    if (saved != nullptr) {
+        lcbvb_destroy(saved);
+    }
+    return current;
+}
+
 void FileProvider::write_cache(lcbvb_CONFIG *cfg)
 {
     if (filename.empty() || is_readonly || cfg->bname == nullptr || cfg->bname_len == 0) {
         return;
     }
 
-    std::ofstream ofs(filename.c_str(), std::ios::trunc);
-    if (ofs.good()) {
-        lcb_log(LOGARGS(this, INFO), LOGFMT "Writing configuration to file", LOGID(this));
-        char *json = lcbvb_save_json(cfg);
-        ofs << json;
-        ofs << CONFIG_CACHE_MAGIC;
-        free(json);
-    } else {
+    /* Many processes usually share the file, so do not rewrite it when another
+     * one has already stored this (or a newer) revision */
+    const lcb::CollectionCache *cache = collcache();
+    size_t ncollections = cache ? cache->size() : 0;
+    if (snapshot_is_current(cfg, ncollections)) {
+        lcb_log(LOGARGS(this, DEBUG), LOGFMT "Snapshot is already up to date", LOGID(this));
+        saved_collections = ncollections;
+        return;
+    }
+
+    char *json = lcbvb_save_json(cfg);
+    if (json == nullptr) {
+        lcb_log(LOGARGS(this, ERROR), LOGFMT "Couldn't serialize configuration", LOGID(this));
+        return;
+    }
+    std::string text(json);
+    free(json);
+    text += CONFIG_CACHE_MAGIC;
+
+    size_t nconfig = 0;
+    char *image = lcbvb_save_binary(cfg, &nconfig);
+    if (image == nullptr) {
+        lcb_log(LOGARGS(this, ERROR), LOGFMT "Couldn't serialize configuration", LOGID(this));
+        return;
+    }
+    std::string body(image, nconfig);
+    free(image);
+    if (cache != nullptr) {
+        for (const auto &entry : cache->entries()) {
+            put_le(body, entry.second, 4);
+            put_le(body, entry.first.size(), 4);
+            body.append(entry.first);
+        }
+    }
+
+    SnapshotHeader hdr;
+    hdr.nconfig = nconfig;
+    hdr.ncollections = ncollections;
+    hdr.ncolldata = body.size() - nconfig;
+    hdr.checksum = snapshot_checksum(body.data(), body.size());
+    hdr.revepoch = cfg->revepoch;
+    hdr.revid = cfg->revid;
+    std::string snapshot;
+    hdr.encode(snapshot);
+    snapshot += body;
+
+    /* The JSON file goes first, so that the snapshot is never older than it */
+    lcb_log(LOGARGS(this, INFO), LOGFMT "Writing configuration to file", LOGID(this));
+    if (replace_file(filename, text) && replace_file(snapshot_filename(), snapshot)) {
+        saved_collections = ncollections;
+    }
+}
+
+bool FileProvider::replace_file(const std::string &path, const std::string &data)
+{
+    /* Write a private file and rename it over the target, so that readers
+     * (which may have the old file mapped) never see a partial write */
+    std::string tmpname = path + ".tmp" + std::to_string(lcb_next_rand32());
+    std::ofstream ofs(tmpname.c_str(), std::ios::binary | std::ios::trunc);
+    if (!ofs.good()) {
         int save_errno = errno;
         lcb_log(LOGARGS(this, ERROR), LOGFMT "Couldn't open file for writing: %s", LOGID(this), strerror(save_errno));
+        return false;
+    }
+    ofs.write(data.data(), data.size());
+    ofs.close();
+    if (ofs.fail()) {
+        int save_errno = errno;
+        lcb_log(LOGARGS(this, ERROR), LOGFMT "Couldn't write %s: %s", LOGID(this), path.c_str(), strerror(save_errno));
+        remove(tmpname.c_str());
+        return false;
     }
+#ifdef _WIN32
+    remove(path.c_str());
+#endif
+    if (rename(tmpname.c_str(), path.c_str()) != 0) {
+        int save_errno = errno;
+        lcb_log(LOGARGS(this, ERROR), LOGFMT "Couldn't replace %s: %s", LOGID(this), path.c_str(),
+                strerror(save_errno));
+        remove(tmpname.c_str());
+        return false;
+    }
+    return true;
 }
 
 ConfigInfo *FileProvider::get_cached()
@@ -193,6 +568,11 @@ lcb_STATUS FileProvider::refresh()
 
 FileProvider::~FileProvider()
 {
+    /* Collections resolved since the last write would be lost otherwise */
+    lcb::CollectionCache *cache = collcache();
+    if (enabled && cache != nullptr && cache->size() != saved_collections && parent->instance->cur_configinfo) {
+        write_cache(parent->instance->cur_configinfo->vbc);
+    }
     timer.release();
     if (config) {
         config->decref();
@@ -221,6 +601,7 @@ void FileProvider::dump(FILE *fp) const
     fprintf(fp, "## BEGIN FILE PROVIEDER DUMP ##\n");
     if (!filename.empty()) {
         fprintf(fp, "FILENAME: %s\n", filename.c_str());
+        fprintf(fp, "SNAPSHOT: %s\n", snapshot_filename().c_str());
     }
     fprintf(fp, "LAST SYSTEM ERRNO: %d\n", last_errno);
     fprintf(fp, "LAST MTIME: %lu\n", (unsigned long)last_mtime);
@@ -229,7 +610,7 @@ void FileProvider::dump(FILE *fp) const
 
 FileProvider::FileProvider(Confmon *parent_)
     : Provider(parent_, CLCONFIG_FILE), config(nullptr), last_mtime(0), last_errno(0), is_readonly(false),
-      timer(parent_->iot, this)
+      saved_collections(0), timer(parent_->iot, this)
 {
     parent->add_listener(this);
 }
@@ -300,6 +681,11 @@ void lcb::clconfig::file_set_readonly(Provider *p, bool val)
     static_cast<FileProvider *>(p)->is_readonly = val;
 }
 
+std::string lcb::clconfig::file_snapshot_filename(const std::string &filename)
+{
+    return filename + SNAPSHOT_SUFFIX;
+}
+
 Provider *lcb::clconfig::new_file_provider(Confmon *mon)
 {
     return new FileProvider(mon);
@@ -20,6 +20,7 @@
 
 #include "hostlist.h"
 #include <list>
+#include <string>
 #include <utility>
 #include <lcbio/timer-ng.h>
 #include <lcbio/timer-cxx.h>
@@ -648,6 +649,13 @@ bool file_set_filename(Provider *p, const char *f, bool ro);
  */
 const char *file_get_filename(Provider *p);
 void file_set_readonly(Provider *p, bool val);
+
+/**
+ * Name of the binary snapshot which the file provider keeps next to the
+ * cache file
+ * @param filename the cache file
+ */
+std::string file_snapshot_filename(const std::string &filename);
 /**@}*/
 
 /**
@@ -33,7 +33,8 @@ static lcb_INGEST_STATUS default_data_converter(lcb_INSTANCE *, lcb_INGEST_PARAM
 }
 
 lcb_INGEST_OPTIONS_::lcb_INGEST_OPTIONS_()
-    : method(LCB_INGEST_METHOD_NONE), exptime(0), ignore_errors(false), data_converter(default_data_converter)
+    : method(LCB_INGEST_METHOD_NONE), exptime(0), ignore_errors(false), data_converter(default_data_converter),
+      max_concurrent(0)
 {
 }
 
@@ -135,6 +136,12 @@ LIBCOUCHBASE_API lcb_STATUS lcb_cmdanalytics_timeout(lcb_CMDANALYTICS *cmd, uint
     return LCB_SUCCESS;
 }
 
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdanalytics_high_watermark(lcb_CMDANALYTICS *cmd, size_t nbytes)
+{
+    cmd->high_watermark = nbytes;
+    return LCB_SUCCESS;
+}
+
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdanalytics_scope_name(lcb_CMDANALYTICS *cmd, const char *scope, size_t scope_len)
 {
     if (scope == nullptr || scope_len == 0) {
@@ -327,6 +334,12 @@ LIBCOUCHBASE_API lcb_STATUS lcb_ingest_options_ignore_error(lcb_INGEST_OPTIONS *
     return LCB_SUCCESS;
 }
 
+LIBCOUCHBASE_API lcb_STATUS lcb_ingest_options_max_concurrent(lcb_INGEST_OPTIONS *options, uint32_t num)
+{
+    options->max_concurrent = num;
+    return LCB_SUCCESS;
+}
+
 LIBCOUCHBASE_API lcb_STATUS lcb_ingest_options_data_converter(lcb_INGEST_OPTIONS *options,
                                                               lcb_INGEST_DATACONVERTER_CALLBACK callback)
 {
@@ -45,6 +45,7 @@ struct lcb_INGEST_OPTIONS_ {
     std::uint32_t exptime;
     bool ignore_errors;
     lcb_INGEST_DATACONVERTER_CALLBACK data_converter;
+    std::uint32_t max_concurrent;
 
     lcb_INGEST_OPTIONS_();
 };
@@ -97,6 +98,7 @@ struct lcb_CMDANALYTICS_ {
     std::size_t ncollection;
     lcb_KEYBUF key;
     std::uint32_t timeout{0};
+    std::size_t high_watermark{0};
     lcbtrace_SPAN *pspan{nullptr};
 
     Json::Value root{Json::objectValue};
@@ -51,7 +51,11 @@ enum lcb_replica_t {
 
     /**Query the specific replica specified by the
      * lcb_rget3_cmd_t#index field */
-    LCB_REPLICA_SELECT = 0x02
+    LCB_REPLICA_SELECT = 0x02,
+
+    /**Query the active node first, and race it against the first available
+     * replica if it does not reply within the hedge delay */
+    LCB_REPLICA_HEDGED = 0x03
 };
 
 /**
@@ -115,6 +119,8 @@ struct lcb_CMDGETREPLICA_ {
      * a callback for each reply</li>
      * <li>::LCB_REPLICA_SELECT - queries a specific replica indicated in the
      * #index field</li>
+     * <li>::LCB_REPLICA_HEDGED - queries the active node, and hedges with a
+     * replica read if the active node is slow to respond</li>
      * </ul>
      *
      * @note When ::LCB_REPLICA_ALL is selected, the callback will be invoked
@@ -30,6 +30,8 @@ struct lcb_KEY_VALUE_ERROR_CONTEXT_ {
     std::uint16_t status_code;
     std::uint32_t opaque;
     std::uint64_t cas;
+    /** time (in microseconds) the server reported having spent on the request, 0 if not reported */
+    std::uint64_t server_duration{0};
     std::string key{};
     std::string bucket{};
     std::string collection{};
@@ -82,6 +82,12 @@ LIBCOUCHBASE_API lcb_STATUS lcb_cmdquery_timeout(lcb_CMDQUERY *cmd, uint32_t tim
     return LCB_SUCCESS;
 }
 
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdquery_high_watermark(lcb_CMDQUERY *cmd, size_t nbytes)
+{
+    cmd->high_watermark = nbytes;
+    return LCB_SUCCESS;
+}
+
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdquery_scope_name(lcb_CMDQUERY *cmd, const char *scope, size_t scope_len)
 {
     if (scope == nullptr || scope_len == 0) {
@@ -78,6 +78,7 @@ struct lcb_CMDQUERY_ {
     std::size_t ncollection;
     lcb_KEYBUF key;
     std::uint32_t timeout{0};
+    std::size_t high_watermark{0};
     lcbtrace_SPAN *pspan{nullptr};
 
     Json::Value root{};
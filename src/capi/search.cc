@@ -79,6 +79,12 @@ LIBCOUCHBASE_API lcb_STATUS lcb_cmdsearch_timeout(lcb_CMDSEARCH *cmd, uint32_t t
     return LCB_SUCCESS;
 }
 
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdsearch_high_watermark(lcb_CMDSEARCH *cmd, size_t nbytes)
+{
+    cmd->high_watermark = nbytes;
+    return LCB_SUCCESS;
+}
+
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdsearch_parent_span(lcb_CMDSEARCH *cmd, lcbtrace_SPAN *span)
 {
     cmd->pspan = span;
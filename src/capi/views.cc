@@ -98,6 +98,12 @@ LIBCOUCHBASE_API lcb_STATUS lcb_cmdview_timeout(lcb_CMDVIEW *cmd, uint32_t timeo
     return LCB_SUCCESS;
 }
 
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdview_high_watermark(lcb_CMDVIEW *cmd, size_t nbytes)
+{
+    cmd->high_watermark = nbytes;
+    return LCB_SUCCESS;
+}
+
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdview_parent_span(lcb_CMDVIEW *cmd, lcbtrace_SPAN *span)
 {
     cmd->pspan = span;
@@ -154,6 +160,12 @@ LIBCOUCHBASE_API lcb_STATUS lcb_cmdview_max_concurrent_docs(lcb_CMDVIEW *cmd, ui
     return LCB_SUCCESS;
 }
 
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdview_unordered_docs(lcb_CMDVIEW *cmd, int flag)
+{
+    cmd->docs_unordered = flag ? true : false;
+    return LCB_SUCCESS;
+}
+
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdview_no_row_parse(lcb_CMDVIEW *cmd, int flag)
 {
     if (flag) {
@@ -65,6 +65,7 @@ struct lcb_CMDVIEW_ {
     std::size_t ncollection;
     lcb_KEYBUF key;
     std::uint32_t timeout{0};
+    std::size_t high_watermark{0};
     lcbtrace_SPAN *pspan{nullptr};
 
     /** The design document as a string; e.g. `"beer"` */
@@ -107,6 +108,10 @@ struct lcb_CMDVIEW_ {
      */
     unsigned docs_concurrent_max{0};
 
+    /** Whether rows with @c F_INCLUDE_DOCS may be delivered as soon as their
+     * document is fetched, rather than in the order of the view */
+    bool docs_unordered{false};
+
     /**Callback to invoke for each row. If not provided, @ref LCB_ERR_INVALID_ARGUMENT will
      * be returned from lcb_view_query() */
     lcb_VIEW_CALLBACK callback{nullptr};
@@ -80,6 +80,9 @@ typedef struct lcb_ANALYTICS_HANDLE_ : lcb::jsparse::Parser::Actions {
 
     lcbtrace_SPAN *span;
 
+    /** Pausing of the rows stream, see lcb_analytics_pause() */
+    lcb::http::FlowControl flow;
+
     void unref()
     {
         if (!--refcount) {
@@ -147,6 +150,7 @@ typedef struct lcb_ANALYTICS_HANDLE_ : lcb::jsparse::Parser::Actions {
             ref();
         }
         invoke_row(&resp, false);
+        flow.row_delivered(resp.nrow, htreq);
     }
     void JSPARSE_on_error(const std::string &) override
     {
@@ -425,6 +429,7 @@ lcb_STATUS ANALYTICSREQ::issue_htreq(const std::string &body)
     lcb_cmdhttp_destroy(htcmd);
     if (rc == LCB_SUCCESS) {
         htreq->set_callback(chunk_callback);
+        flow.apply(htreq);
     }
     return rc;
 }
@@ -466,8 +471,7 @@ static void doc_callback(lcb_INSTANCE *, int, const lcb_RESPSTORE *rb)
 
     q->ref();
 
-    q->n_awaiting_response--;
-    dreq->ready = 1;
+    q->on_response(dreq, rb->ctx.rc);
 
     q->check();
 
@@ -549,14 +553,10 @@ static void cb_doc_ready(lcb::docreq::Queue *q, lcb::docreq::DocRequest *req_bas
 static void cb_docq_throttle(lcb::docreq::Queue *q, int enabled)
 {
     auto *req = reinterpret_cast<lcb_ANALYTICS_HANDLE_ *>(q->parent);
-    if (req == nullptr || req->htreq == nullptr) {
+    if (req == nullptr) {
         return;
     }
-    if (enabled) {
-        req->htreq->pause();
-    } else {
-        req->htreq->resume();
-    }
+    req->flow.set(lcb::http::FlowControl::DOCQUEUE, enabled, req->htreq);
 }
 
 lcb_ANALYTICS_HANDLE_::lcb_ANALYTICS_HANDLE_(lcb_INSTANCE *obj, void *user_cookie, const lcb_CMDANALYTICS *cmd)
@@ -568,6 +568,7 @@ lcb_ANALYTICS_HANDLE_::lcb_ANALYTICS_HANDLE_(lcb_INSTANCE *obj, void *user_cooki
     if (cmd->handle) {
         *cmd->handle = this;
     }
+    flow.set_high_watermark(cmd->high_watermark);
 
     std::string encoded = Json::FastWriter().write(cmd->root);
     if (!parse_json(encoded.c_str(), encoded.size(), json)) {
@@ -642,7 +643,9 @@ lcb_ANALYTICS_HANDLE_::lcb_ANALYTICS_HANDLE_(lcb_INSTANCE *obj, void *user_cooki
         docq->cb_schedule = cb_op_schedule;
         docq->cb_ready = cb_doc_ready;
         docq->cb_throttle = cb_docq_throttle;
-        // TODO: docq->max_pending_response;
+        docq->window.set_max(ingest->max_concurrent);
+        /* Rows are not handed to the application, nothing to keep in order */
+        docq->ordered = false;
         lcb_aspend_add(&instance->pendops, LCB_PENDTYPE_COUNTER, nullptr);
     }
 }
@@ -729,6 +732,35 @@ LIBCOUCHBASE_API lcb_STATUS lcb_analytics_cancel(lcb_INSTANCE *, lcb_ANALYTICS_H
         if (handle->docq) {
             handle->docq->cancel();
         }
+        /* The handle is released once the response has been read */
+        handle->flow.release(handle->htreq);
+    }
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_analytics_pause(lcb_INSTANCE *, lcb_ANALYTICS_HANDLE *handle)
+{
+    if (handle == nullptr) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    handle->flow.set(lcb::http::FlowControl::USER, true, handle->htreq);
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_analytics_resume(lcb_INSTANCE *, lcb_ANALYTICS_HANDLE *handle)
+{
+    if (handle == nullptr) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    handle->flow.set(lcb::http::FlowControl::USER, false, handle->htreq);
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_analytics_consumed(lcb_INSTANCE *, lcb_ANALYTICS_HANDLE *handle, size_t nbytes)
+{
+    if (handle == nullptr) {
+        return LCB_ERR_INVALID_ARGUMENT;
     }
+    handle->flow.consumed(nbytes, handle->htreq);
     return LCB_SUCCESS;
 }
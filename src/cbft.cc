@@ -42,6 +42,8 @@ struct lcb_SEARCH_HANDLE_ : lcb::jsparse::Parser::Actions {
     lcbtrace_SPAN *span;
     std::string index_name;
     std::string error_message;
+    /** Pausing of the rows stream, see lcb_search_pause() */
+    lcb::http::FlowControl flow;
 
     void invoke_row(lcb_RESPSEARCH *resp);
     void invoke_last();
@@ -55,6 +57,7 @@ struct lcb_SEARCH_HANDLE_ : lcb::jsparse::Parser::Actions {
         resp.nrow = datum.row.iov_len;
         nrows++;
         invoke_row(&resp);
+        flow.row_delivered(resp.nrow, htreq);
     }
     void JSPARSE_on_error(const std::string &) override
     {
@@ -170,6 +173,7 @@ lcb_SEARCH_HANDLE_::lcb_SEARCH_HANDLE_(lcb_INSTANCE *instance_, const void *cook
         lasterr = LCB_ERR_INVALID_ARGUMENT;
         return;
     }
+    flow.set_high_watermark(cmd->high_watermark);
 
     std::string content_type("application/json");
 
@@ -271,5 +275,35 @@ LIBCOUCHBASE_API lcb_STATUS lcb_search(lcb_INSTANCE *instance, void *cookie, con
 LIBCOUCHBASE_API lcb_STATUS lcb_search_cancel(lcb_INSTANCE * /* instance */, lcb_SEARCH_HANDLE *handle)
 {
     handle->callback = nullptr;
+    /* The handle is released once the next chunk has been read */
+    handle->flow.release(handle->htreq);
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_search_pause(lcb_INSTANCE * /* instance */, lcb_SEARCH_HANDLE *handle)
+{
+    if (handle == nullptr) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    handle->flow.set(lcb::http::FlowControl::USER, true, handle->htreq);
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_search_resume(lcb_INSTANCE * /* instance */, lcb_SEARCH_HANDLE *handle)
+{
+    if (handle == nullptr) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    handle->flow.set(lcb::http::FlowControl::USER, false, handle->htreq);
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_search_consumed(lcb_INSTANCE * /* instance */, lcb_SEARCH_HANDLE *handle,
+                                                size_t nbytes)
+{
+    if (handle == nullptr) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    handle->flow.consumed(nbytes, handle->htreq);
     return LCB_SUCCESS;
 }
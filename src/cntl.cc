@@ -21,6 +21,7 @@
 #include <lcbio/iotable.h>
 #include <mcserver/negotiate.h>
 #include <lcbio/ssl.h>
+#include "rdb/poolalloc.h"
 
 #define LOGARGS(instance, lvl) instance->settings, "cntl", LCB_LOG_##lvl, __FILE__, __LINE__
 
@@ -132,6 +133,16 @@ static std::uint32_t *get_timeout_field(lcb_INSTANCE *instance, int cmd)
             return &settings->tracer_threshold[LCBTRACE_THRESHOLD_ANALYTICS];
         case LCB_CNTL_PERSISTENCE_TIMEOUT_FLOOR:
             return &settings->persistence_timeout_floor;
+        case LCB_CNTL_REPLICA_HEDGE_DELAY:
+            return &settings->replica_hedge_delay;
+        case LCB_CNTL_CIRCUIT_BREAKER_WINDOW:
+            return &settings->circuit_breaker_window;
+        case LCB_CNTL_CIRCUIT_BREAKER_SLEEP_WINDOW:
+            return &settings->circuit_breaker_sleep;
+        case LCB_CNTL_CONNECT_ATTEMPT_DELAY:
+            return &settings->connect_attempt_delay;
+        case LCB_CNTL_BOOTSTRAP_RACE_DELAY:
+            return &settings->bootstrap_race_delay;
         default:
             return nullptr;
     }
@@ -721,6 +732,192 @@ HANDLER(unordered_execution_handler)
     RETURN_GET_SET(int, LCBT_SETTING(instance, enable_unordered_execution))
 }
 
+HANDLER(retry_jitter_handler)
+{
+    RETURN_GET_SET(int, LCBT_SETTING(instance, retry_jitter))
+}
+
+HANDLER(retry_budget_handler)
+{
+    RETURN_GET_SET(lcb_U32, LCBT_SETTING(instance, retry_budget))
+}
+
+HANDLER(kv_pipeline_max_ops_handler)
+{
+    RETURN_GET_SET(lcb_U32, instance->cmdq.admit.max_pipeline_ops)
+}
+
+HANDLER(kv_pipeline_max_bytes_handler)
+{
+    RETURN_GET_SET(lcb_SIZE, instance->cmdq.admit.max_pipeline_bytes)
+}
+
+HANDLER(kv_max_ops_handler)
+{
+    RETURN_GET_SET(lcb_U32, instance->cmdq.admit.max_ops)
+}
+
+HANDLER(kv_max_bytes_handler)
+{
+    RETURN_GET_SET(lcb_SIZE, instance->cmdq.admit.max_bytes)
+}
+
+HANDLER(circuit_breaker_handler)
+{
+    RETURN_GET_SET(int, LCBT_SETTING(instance, circuit_breaker))
+}
+
+HANDLER(ssl_session_cache_handler)
+{
+    RETURN_GET_SET(int, LCBT_SETTING(instance, ssl_session_cache))
+}
+
+HANDLER(ssl_ktls_handler)
+{
+    RETURN_GET_SET(int, LCBT_SETTING(instance, ssl_ktls))
+}
+
+HANDLER(scram_cache_handler)
+{
+    if (mode == LCB_CNTL_SET) {
+        lcb_SCRAM_CACHE val = *reinterpret_cast<lcb_SCRAM_CACHE *>(arg);
+        if (val != LCB_SCRAM_CACHE_NONE && val != LCB_SCRAM_CACHE_INSTANCE && val != LCB_SCRAM_CACHE_PROCESS) {
+            return LCB_ERR_CONTROL_INVALID_ARGUMENT;
+        }
+    }
+    RETURN_GET_SET(lcb_SCRAM_CACHE, LCBT_SETTING(instance, scram_cache_mode))
+}
+
+HANDLER(bootstrap_race_count_handler)
+{
+    if (mode == LCB_CNTL_SET && *reinterpret_cast<lcb_U32 *>(arg) < 1) {
+        return LCB_ERR_CONTROL_INVALID_ARGUMENT;
+    }
+    RETURN_GET_SET(lcb_U32, LCBT_SETTING(instance, bootstrap_race_count))
+}
+
+HANDLER(circuit_breaker_volume_handler)
+{
+    RETURN_GET_SET(lcb_U32, LCBT_SETTING(instance, circuit_breaker_volume))
+}
+
+HANDLER(circuit_breaker_threshold_handler)
+{
+    if (mode == LCB_CNTL_SET) {
+        lcb_U32 val = *reinterpret_cast<lcb_U32 *>(arg);
+        if (val < 1 || val > 100) {
+            return LCB_ERR_CONTROL_INVALID_ARGUMENT;
+        }
+    }
+    RETURN_GET_SET(lcb_U32, LCBT_SETTING(instance, circuit_breaker_threshold))
+}
+
+HANDLER(read_allocator_handler)
+{
+    if (mode == LCB_CNTL_SET) {
+        lcb_READ_ALLOCATOR val = *reinterpret_cast<lcb_READ_ALLOCATOR *>(arg);
+        if (val != LCB_READ_ALLOCATOR_DEFAULT && val != LCB_READ_ALLOCATOR_POOL) {
+            return LCB_ERR_CONTROL_INVALID_ARGUMENT;
+        }
+    }
+    RETURN_GET_SET(lcb_READ_ALLOCATOR, LCBT_SETTING(instance, read_allocator))
+}
+
+/* Apply the pool parameters to the shared pool, if it was already created */
+static void reconfigure_read_pool(lcb_settings *settings)
+{
+    if (settings->read_pool) {
+        rdb_poolalloc_configure(settings->read_pool, settings->read_pool_class_cap, settings->read_pool_hugepages);
+    }
+}
+
+HANDLER(read_pool_class_cap_handler)
+{
+    if (mode == LCB_CNTL_SET) {
+        LCBT_SETTING(instance, read_pool_class_cap) = *reinterpret_cast<lcb_U32 *>(arg);
+        reconfigure_read_pool(instance->settings);
+        return LCB_SUCCESS;
+    }
+    RETURN_GET_ONLY(lcb_U32, LCBT_SETTING(instance, read_pool_class_cap))
+}
+
+HANDLER(read_pool_hugepages_handler)
+{
+    if (mode == LCB_CNTL_SET) {
+        LCBT_SETTING(instance, read_pool_hugepages) = *reinterpret_cast<int *>(arg) != 0;
+        reconfigure_read_pool(instance->settings);
+        return LCB_SUCCESS;
+    }
+    RETURN_GET_ONLY(int, LCBT_SETTING(instance, read_pool_hugepages))
+}
+
+HANDLER(collections_prefetch_handler)
+{
+    RETURN_GET_SET(int, LCBT_SETTING(instance, collections_prefetch))
+}
+
+HANDLER(deferred_max_ops_handler)
+{
+    RETURN_GET_SET(lcb_U32, LCBT_SETTING(instance, deferred_max_ops))
+}
+
+HANDLER(deferred_max_bytes_handler)
+{
+    RETURN_GET_SET(lcb_U32, LCBT_SETTING(instance, deferred_max_bytes))
+}
+
+HANDLER(value_codec_handler)
+{
+    if (mode == LCB_CNTL_SET) {
+        int val = *reinterpret_cast<int *>(arg);
+        if (val < 0 || val > 0xff) {
+            return LCB_ERR_CONTROL_INVALID_ARGUMENT;
+        }
+        LCBT_SETTING(instance, value_codec) = val;
+        return LCB_SUCCESS;
+    }
+    RETURN_GET_ONLY(int, LCBT_SETTING(instance, value_codec))
+}
+
+HANDLER(value_codec_min_size_handler)
+{
+    RETURN_GET_SET(lcb_U32, LCBT_SETTING(instance, value_codec_min_size))
+}
+
+HANDLER(value_codec_register_handler)
+{
+    if (mode != LCB_CNTL_SET) {
+        return LCB_ERR_CONTROL_UNSUPPORTED_MODE;
+    }
+    if (mcreq_codec_register(&instance->codecs, reinterpret_cast<const lcb_VALUE_CODEC *>(arg)) != 0) {
+        return LCB_ERR_CONTROL_INVALID_ARGUMENT;
+    }
+    (void)cmd;
+    return LCB_SUCCESS;
+}
+
+HANDLER(read_pool_stats_handler)
+{
+    if (mode != LCB_CNTL_GET) {
+        return LCB_ERR_CONTROL_UNSUPPORTED_MODE;
+    }
+    auto *out = reinterpret_cast<lcb_READ_POOL_STATS *>(arg);
+    rdb_ALLOCATOR *pool = LCBT_SETTING(instance, read_pool);
+    memset(out, 0, sizeof(*out));
+    if (pool) {
+        rdb_POOLSTATS stats;
+        rdb_poolalloc_stats(pool, &stats);
+        out->live_bytes = stats.live_bytes;
+        out->pooled_bytes = stats.pooled_bytes;
+        out->peak_live_bytes = stats.peak_live_bytes;
+        out->hugepage_bytes = stats.hugepage_bytes;
+        out->allocations = stats.nalloc;
+        out->reused = stats.nreused;
+    }
+    (void)cmd;
+    return LCB_SUCCESS;
+}
+
 /* clang-format off */
 static ctl_handler handlers[] = {
     timeout_common,                       /* LCB_CNTL_OP_TIMEOUT */
@@ -825,6 +1022,34 @@ static ctl_handler handlers[] = {
     timeout_common,                       /* LCB_CNTL_SEARCH_TIMEOUT */
     timeout_common,                       /* LCB_CNTL_QUERY_GRACE_PERIOD */
     enable_errmap_handler,                /* LCB_CNTL_ENABLE_ERRMAP */
+    timeout_common,                       /* LCB_CNTL_REPLICA_HEDGE_DELAY */
+    retry_jitter_handler,                 /* LCB_CNTL_RETRY_JITTER */
+    retry_budget_handler,                 /* LCB_CNTL_RETRY_BUDGET */
+    kv_pipeline_max_ops_handler,          /* LCB_CNTL_KV_PIPELINE_MAX_OPS */
+    kv_pipeline_max_bytes_handler,        /* LCB_CNTL_KV_PIPELINE_MAX_BYTES */
+    kv_max_ops_handler,                   /* LCB_CNTL_KV_MAX_OPS */
+    kv_max_bytes_handler,                 /* LCB_CNTL_KV_MAX_BYTES */
+    circuit_breaker_handler,              /* LCB_CNTL_CIRCUIT_BREAKER */
+    circuit_breaker_volume_handler,       /* LCB_CNTL_CIRCUIT_BREAKER_VOLUME */
+    circuit_breaker_threshold_handler,    /* LCB_CNTL_CIRCUIT_BREAKER_THRESHOLD */
+    timeout_common,                       /* LCB_CNTL_CIRCUIT_BREAKER_WINDOW */
+    timeout_common,                       /* LCB_CNTL_CIRCUIT_BREAKER_SLEEP_WINDOW */
+    ssl_session_cache_handler,            /* LCB_CNTL_SSL_SESSION_CACHE */
+    ssl_ktls_handler,                     /* LCB_CNTL_SSL_KTLS */
+    scram_cache_handler,                  /* LCB_CNTL_SCRAM_CACHE */
+    timeout_common,                       /* LCB_CNTL_CONNECT_ATTEMPT_DELAY */
+    bootstrap_race_count_handler,         /* LCB_CNTL_BOOTSTRAP_RACE_COUNT */
+    timeout_common,                       /* LCB_CNTL_BOOTSTRAP_RACE_DELAY */
+    read_allocator_handler,               /* LCB_CNTL_READ_ALLOCATOR */
+    read_pool_class_cap_handler,          /* LCB_CNTL_READ_POOL_CLASS_CAP */
+    read_pool_hugepages_handler,          /* LCB_CNTL_READ_POOL_HUGEPAGES */
+    read_pool_stats_handler,              /* LCB_CNTL_READ_POOL_STATS */
+    collections_prefetch_handler,         /* LCB_CNTL_COLLECTIONS_PREFETCH */
+    deferred_max_ops_handler,             /* LCB_CNTL_DEFERRED_MAX_OPS */
+    deferred_max_bytes_handler,           /* LCB_CNTL_DEFERRED_MAX_BYTES */
+    value_codec_handler,                  /* LCB_CNTL_VALUE_CODEC */
+    value_codec_min_size_handler,         /* LCB_CNTL_VALUE_CODEC_MIN_SIZE */
+    value_codec_register_handler,         /* LCB_CNTL_VALUE_CODEC_REGISTER */
     nullptr
 };
 /* clang-format on */
@@ -990,6 +1215,46 @@ static lcb_STATUS convert_ipv6(const char *arg, u_STRCONVERT *u)
     return LCB_SUCCESS;
 }
 
+static lcb_STATUS convert_scram_cache(const char *arg, u_STRCONVERT *u)
+{
+    static const STR_u32MAP optmap[] = {
+        {"none", LCB_SCRAM_CACHE_NONE},
+        {"instance", LCB_SCRAM_CACHE_INSTANCE},
+        {"process", LCB_SCRAM_CACHE_PROCESS},
+        {nullptr},
+    };
+    DO_CONVERT_STR2NUM(arg, optmap, u->i);
+    return LCB_SUCCESS;
+}
+
+static lcb_STATUS convert_read_allocator(const char *arg, u_STRCONVERT *u)
+{
+    static const STR_u32MAP optmap[] = {
+        {"default", LCB_READ_ALLOCATOR_DEFAULT},
+        {"pool", LCB_READ_ALLOCATOR_POOL},
+        {nullptr},
+    };
+    DO_CONVERT_STR2NUM(arg, optmap, u->i);
+    return LCB_SUCCESS;
+}
+
+static lcb_STATUS convert_value_codec(const char *arg, u_STRCONVERT *u)
+{
+    if (!strcmp(arg, "none")) {
+        u->i = 0;
+    } else if (!strcmp(arg, "snappy")) {
+        u->i = MCREQ_CODEC_SNAPPY;
+    } else {
+        char *end = nullptr;
+        long val = std::strtol(arg, &end, 10);
+        if (end == arg || *end != '\0' || val < 0 || val > 0xff) {
+            return LCB_ERR_CONTROL_INVALID_ARGUMENT;
+        }
+        u->i = (int)val;
+    }
+    return LCB_SUCCESS;
+}
+
 static cntl_OPCODESTRS stropcode_map[] = {
     {"operation_timeout", LCB_CNTL_OP_TIMEOUT, convert_timevalue},
     {"timeout", LCB_CNTL_OP_TIMEOUT, convert_timevalue},
@@ -1059,6 +1324,32 @@ static cntl_OPCODESTRS stropcode_map[] = {
     {"search_timeout", LCB_CNTL_SEARCH_TIMEOUT, convert_timevalue},
     {"query_grace_period", LCB_CNTL_QUERY_GRACE_PERIOD, convert_timevalue},
     {"enable_errmap", LCB_CNTL_ENABLE_ERRMAP, convert_intbool},
+    {"replica_hedge_delay", LCB_CNTL_REPLICA_HEDGE_DELAY, convert_timevalue},
+    {"retry_jitter", LCB_CNTL_RETRY_JITTER, convert_intbool},
+    {"retry_budget", LCB_CNTL_RETRY_BUDGET, convert_u32},
+    {"kv_pipeline_max_ops", LCB_CNTL_KV_PIPELINE_MAX_OPS, convert_u32},
+    {"kv_pipeline_max_bytes", LCB_CNTL_KV_PIPELINE_MAX_BYTES, convert_SIZE},
+    {"kv_max_ops", LCB_CNTL_KV_MAX_OPS, convert_u32},
+    {"kv_max_bytes", LCB_CNTL_KV_MAX_BYTES, convert_SIZE},
+    {"circuit_breaker", LCB_CNTL_CIRCUIT_BREAKER, convert_intbool},
+    {"circuit_breaker_volume", LCB_CNTL_CIRCUIT_BREAKER_VOLUME, convert_u32},
+    {"circuit_breaker_threshold", LCB_CNTL_CIRCUIT_BREAKER_THRESHOLD, convert_u32},
+    {"circuit_breaker_window", LCB_CNTL_CIRCUIT_BREAKER_WINDOW, convert_timevalue},
+    {"circuit_breaker_sleep_window", LCB_CNTL_CIRCUIT_BREAKER_SLEEP_WINDOW, convert_timevalue},
+    {"ssl_session_cache", LCB_CNTL_SSL_SESSION_CACHE, convert_intbool},
+    {"ssl_ktls", LCB_CNTL_SSL_KTLS, convert_intbool},
+    {"scram_cache", LCB_CNTL_SCRAM_CACHE, convert_scram_cache},
+    {"connect_attempt_delay", LCB_CNTL_CONNECT_ATTEMPT_DELAY, convert_timevalue},
+    {"bootstrap_race_count", LCB_CNTL_BOOTSTRAP_RACE_COUNT, convert_u32},
+    {"bootstrap_race_delay", LCB_CNTL_BOOTSTRAP_RACE_DELAY, convert_timevalue},
+    {"read_allocator", LCB_CNTL_READ_ALLOCATOR, convert_read_allocator},
+    {"read_pool_class_cap", LCB_CNTL_READ_POOL_CLASS_CAP, convert_u32},
+    {"read_pool_hugepages", LCB_CNTL_READ_POOL_HUGEPAGES, convert_intbool},
+    {"collections_prefetch", LCB_CNTL_COLLECTIONS_PREFETCH, convert_intbool},
+    {"deferred_max_ops", LCB_CNTL_DEFERRED_MAX_OPS, convert_u32},
+    {"deferred_max_bytes", LCB_CNTL_DEFERRED_MAX_BYTES, convert_u32},
+    {"value_codec", LCB_CNTL_VALUE_CODEC, convert_value_codec},
+    {"value_codec_min_size", LCB_CNTL_VALUE_CODEC_MIN_SIZE, convert_u32},
     {nullptr, -1}};
 
 #define CNTL_NUM_HANDLERS (sizeof(handlers) / sizeof(handlers[0]))
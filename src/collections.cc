@@ -19,10 +19,12 @@
 #include "collections.h"
 #include "mcserver/negotiate.h"
 
+#include <cstdlib>
 #include <string>
 
 #include "capi/cmd_getcid.hh"
 #include "capi/cmd_getmanifest.hh"
+#include "contrib/lcb-jsoncpp/lcb-jsoncpp.h"
 
 #define LOGARGS(instance, lvl) (instance)->settings, "c9smgmt", LCB_LOG_##lvl, __FILE__, __LINE__
 
@@ -67,8 +69,58 @@ void CollectionCache::erase(uint32_t cid)
         cache_i2n.erase(pos);
     }
 }
+
+std::vector<CollectionCache::resolve_waiter> CollectionCache::end_resolution(const std::string &path)
+{
+    std::vector<resolve_waiter> waiters;
+    auto pos = resolving_.find(path);
+    if (pos != resolving_.end()) {
+        waiters.swap(pos->second);
+        resolving_.erase(pos);
+    }
+    return waiters;
+}
+
+int CollectionCache::load_manifest(const char *json, size_t njson)
+{
+    Json::Value manifest;
+    if (!Json::Reader().parse(json, json + njson, manifest, false) || !manifest["scopes"].isArray()) {
+        return -1;
+    }
+
+    int ncollections = 0;
+    for (const auto &scope : manifest["scopes"]) {
+        const Json::Value &collections = scope["collections"];
+        if (!scope["name"].isString() || !collections.isArray()) {
+            return -1;
+        }
+        for (const auto &collection : collections) {
+            if (!collection["name"].isString() || !collection["uid"].isString()) {
+                return -1;
+            }
+            /* identifiers are hexadecimal strings */
+            uint32_t cid = std::strtoul(collection["uid"].asCString(), nullptr, 16);
+            put(scope["name"].asString() + "." + collection["name"].asString(), cid);
+            ncollections++;
+        }
+    }
+    return ncollections;
+}
 } // namespace lcb
 
+void collcache_release_waiters(std::vector<lcb::CollectionCache::resolve_waiter> &waiters, lcb_STATUS rc,
+                               const lcb_RESPGETCID *resp)
+{
+    lcb_RESPGETCID failed{};
+    if (resp == nullptr) {
+        failed.ctx.rc = rc;
+        resp = &failed;
+    }
+    for (auto &waiter : waiters) {
+        waiter(rc, resp);
+    }
+}
+
 std::string collcache_build_spec(const char *scope, size_t nscope, const char *collection, size_t ncollection)
 {
     std::string spec;
@@ -152,8 +204,7 @@ LIBCOUCHBASE_API lcb_STATUS lcb_cmdgetmanifest_timeout(lcb_CMDGETMANIFEST *cmd,
     return LCB_SUCCESS;
 }
 
-LIBCOUCHBASE_API
-lcb_STATUS lcb_getmanifest(lcb_INSTANCE *instance, void *cookie, const lcb_CMDGETMANIFEST *cmd)
+static lcb_STATUS schedule_getmanifest(lcb_INSTANCE *instance, void *cookie, uint32_t timeout, bool privcallback)
 {
     mc_CMDQUEUE *cq = &instance->cmdq;
     if (cq->config == nullptr) {
@@ -183,13 +234,57 @@ lcb_STATUS lcb_getmanifest(lcb_INSTANCE *instance, void *cookie, const lcb_CMDGE
     pkt->u_rdata.reqdata.cookie = cookie;
     pkt->u_rdata.reqdata.start = gethrtime();
     pkt->u_rdata.reqdata.deadline =
-        pkt->u_rdata.reqdata.start + LCB_US2NS(cmd->timeout ? cmd->timeout : LCBT_SETTING(instance, operation_timeout));
+        pkt->u_rdata.reqdata.start + LCB_US2NS(timeout ? timeout : LCBT_SETTING(instance, operation_timeout));
+    if (privcallback) {
+        pkt->flags |= MCREQ_F_PRIVCALLBACK;
+    }
 
     LCB_SCHED_ADD(instance, pl, pkt)
-    (void)cmd;
     return LCB_SUCCESS;
 }
 
+LIBCOUCHBASE_API
+lcb_STATUS lcb_getmanifest(lcb_INSTANCE *instance, void *cookie, const lcb_CMDGETMANIFEST *cmd)
+{
+    return schedule_getmanifest(instance, cookie, cmd->timeout, false);
+}
+
+static void prefetch_manifest_callback(lcb_INSTANCE *instance, int, const lcb_RESPBASE *rb)
+{
+    const auto *resp = reinterpret_cast<const lcb_RESPGETMANIFEST *>(rb);
+    instance->collcache->end_manifest_fetch();
+    if (resp->ctx.rc != LCB_SUCCESS) {
+        lcb_log(LOGARGS(instance, WARN), "Failed to prefetch collections manifest: %s",
+                lcb_strerror_short(resp->ctx.rc));
+        return;
+    }
+    int ncollections = instance->collcache->load_manifest(resp->value, resp->nvalue);
+    if (ncollections < 0) {
+        lcb_log(LOGARGS(instance, WARN), "Unable to parse collections manifest: %.*s", (int)resp->nvalue,
+                resp->value);
+        return;
+    }
+    lcb_log(LOGARGS(instance, DEBUG), "Prefetched %d collections from manifest", ncollections);
+}
+
+/* Cookie of MCREQ_F_PRIVCALLBACK packets: a pointer to the callback */
+static lcb_RESPCALLBACK prefetch_manifest_cb = prefetch_manifest_callback;
+
+lcb_STATUS collcache_prefetch_manifest(lcb_INSTANCE *instance)
+{
+    if (LCBT_SETTING(instance, conntype) != LCB_TYPE_BUCKET || !LCBT_SETTING(instance, use_collections)) {
+        return LCB_ERR_UNSUPPORTED_OPERATION;
+    }
+    if (!instance->collcache->begin_manifest_fetch()) {
+        return LCB_SUCCESS;
+    }
+    lcb_STATUS rc = schedule_getmanifest(instance, &prefetch_manifest_cb, 0, true);
+    if (rc != LCB_SUCCESS) {
+        instance->collcache->end_manifest_fetch();
+    }
+    return rc;
+}
+
 LIBCOUCHBASE_API lcb_STATUS lcb_respgetcid_status(const lcb_RESPGETCID *resp)
 {
     return resp->ctx.rc;
@@ -19,7 +19,9 @@
 #define LCB_COLLECTIONS_H
 
 #ifdef __cplusplus
+#include <functional>
 #include <memory>
+#include <vector>
 
 #include "capi/cmd_getcid.hh"
 #include "capi/collection_qualifier.hh"
@@ -29,8 +31,15 @@ namespace lcb
 {
 class CollectionCache
 {
+  public:
+    /** Continuation of an operation parked behind a GET_CID request in flight */
+    using resolve_waiter = std::function<void(lcb_STATUS, const lcb_RESPGETCID *)>;
+
+  private:
     std::map<std::string, uint32_t> cache_n2i{};
     std::map<uint32_t, std::string> cache_i2n{};
+    std::map<std::string, std::vector<resolve_waiter>> resolving_{};
+    bool manifest_pending_{false};
 
   public:
     CollectionCache();
@@ -44,6 +53,63 @@ class CollectionCache
     std::string id_to_name(uint32_t cid);
 
     void erase(uint32_t cid);
+
+    size_t size() const
+    {
+        return cache_n2i.size();
+    }
+
+    /** Known collection paths and their IDs */
+    const std::map<std::string, uint32_t> &entries() const
+    {
+        return cache_n2i;
+    }
+
+    /**
+     * Resolution is single-flight: the first operation missing `path` sends
+     * the GET_CID request and calls begin_resolution(). Until the reply comes
+     * back, resolving() is true and the following operations for the same
+     * path park() their continuation instead of sending their own request.
+     * The reply handler takes them all back with end_resolution().
+     */
+    bool resolving(const std::string &path) const
+    {
+        return resolving_.find(path) != resolving_.end();
+    }
+
+    void begin_resolution(const std::string &path)
+    {
+        resolving_[path];
+    }
+
+    void park(const std::string &path, resolve_waiter waiter)
+    {
+        resolving_[path].push_back(std::move(waiter));
+    }
+
+    std::vector<resolve_waiter> end_resolution(const std::string &path);
+
+    /** @return false if a manifest fetch is already in flight */
+    bool begin_manifest_fetch()
+    {
+        if (manifest_pending_) {
+            return false;
+        }
+        manifest_pending_ = true;
+        return true;
+    }
+
+    void end_manifest_fetch()
+    {
+        manifest_pending_ = false;
+    }
+
+    /**
+     * Add all the collections of a manifest (as returned by GET_MANIFEST) to
+     * the cache.
+     * @return the number of collections, or -1 if the manifest is malformed
+     */
+    int load_manifest(const char *json, size_t njson);
 };
 } // namespace lcb
 typedef lcb::CollectionCache lcb_COLLCACHE;
@@ -53,8 +119,19 @@ lcb_STATUS collcache_get(lcb_INSTANCE *instance, const char *scope, size_t nscop
 lcb_STATUS collcache_get(lcb_INSTANCE *instance, lcb::collection_qualifier &collection);
 std::string collcache_build_spec(const char *scope, size_t nscope, const char *collection, size_t ncollection);
 
+/**
+ * Fetch the collections manifest and load it into the cache, unless a fetch
+ * is already in flight. Used when `collections_prefetch` is enabled.
+ */
+lcb_STATUS collcache_prefetch_manifest(lcb_INSTANCE *instance);
+
+/** Release the operations parked behind the GET_CID request for `path` */
+void collcache_release_waiters(std::vector<lcb::CollectionCache::resolve_waiter> &waiters, lcb_STATUS rc,
+                               const lcb_RESPGETCID *resp);
+
 template <typename Command, typename Operation, typename Destructor>
 struct GetCidCtx : mc_REQDATAEX {
+    lcb_INSTANCE *instance_;
     std::string path_;
     Operation op_;
     Command cmd_;
@@ -62,8 +139,9 @@ struct GetCidCtx : mc_REQDATAEX {
 
     static mc_REQDATAPROCS proctable;
 
-    GetCidCtx(std::string path, Operation op, Command cmd, Destructor dtor)
-        : mc_REQDATAEX(nullptr, proctable, gethrtime()), path_(std::move(path)), op_(op), cmd_(cmd), dtor_(dtor)
+    GetCidCtx(lcb_INSTANCE *instance, std::string path, Operation op, Command cmd, Destructor dtor)
+        : mc_REQDATAEX(nullptr, proctable, gethrtime()), instance_(instance), path_(std::move(path)), op_(op),
+          cmd_(cmd), dtor_(dtor)
     {
     }
 
@@ -77,9 +155,10 @@ struct GetCidCtx : mc_REQDATAEX {
 };
 
 template <typename Command, typename Operation, typename Destructor>
-GetCidCtx<Command, Operation, Destructor> *make_cid_ctx(std::string path, Operation op, Command cmd, Destructor dtor)
+GetCidCtx<Command, Operation, Destructor> *make_cid_ctx(lcb_INSTANCE *instance, std::string path, Operation op,
+                                                       Command cmd, Destructor dtor)
 {
-    return new GetCidCtx<Command, Operation, Destructor>(path, op, cmd, dtor);
+    return new GetCidCtx<Command, Operation, Destructor>(instance, path, op, cmd, dtor);
 }
 
 template <typename Command, typename Operation, typename Destructor>
@@ -96,14 +175,19 @@ static void handle_collcache_proc(mc_PIPELINE *pipeline, mc_PACKET *pkt, lcb_STA
         lcb_log((instance)->settings, "collcache", LCB_LOG_DEBUG, __FILE__, __LINE__,
                 "failed to resolve collection, rc: %s", lcb_strerror_short(resp->ctx.rc));
     }
+    auto waiters = instance->collcache->end_resolution(ctx->path_);
     ctx->op_(resp, ctx->cmd_);
     delete ctx;
+    collcache_release_waiters(waiters, resp->ctx.rc, resp);
 }
 
 template <typename Command, typename Operation, typename Destructor>
 static void handle_collcache_schedfail(mc_PACKET *pkt)
 {
-    delete static_cast<GetCidCtx<Command, Operation, Destructor> *>(pkt->u_rdata.exdata);
+    auto *ctx = static_cast<GetCidCtx<Command, Operation, Destructor> *>(pkt->u_rdata.exdata);
+    auto waiters = ctx->instance_->collcache->end_resolution(ctx->path_);
+    delete ctx;
+    collcache_release_waiters(waiters, LCB_ERR_SHEDULE_FAILURE, nullptr);
 }
 
 template <typename Command, typename Operation, typename Destructor>
@@ -129,6 +213,19 @@ lcb_STATUS collcache_resolve(lcb_INSTANCE *instance, Command cmd, Operation op,
         return LCB_ERR_NO_CONFIGURATION;
     }
 
+    if (instance->collcache->resolving(spec)) {
+        MutableCommand clone{};
+        dup(cmd, &clone);
+        instance->collcache->park(spec, [op, clone, dtor](lcb_STATUS, const lcb_RESPGETCID *resp) {
+            if (resp->ctx.rc == LCB_SUCCESS) {
+                clone->cid = resp->collection_id;
+            }
+            op(resp, clone);
+            dtor(clone);
+        });
+        return LCB_SUCCESS;
+    }
+
     int vbid, idx;
     mcreq_map_key(cq, &cmd->key, MCREQ_PKT_BASESIZE, &vbid, &idx);
     if (idx < 0) {
@@ -154,10 +251,11 @@ lcb_STATUS collcache_resolve(lcb_INSTANCE *instance, Command cmd, Operation op,
 
     MutableCommand clone{};
     dup(cmd, &clone);
-    pkt->u_rdata.exdata = make_cid_ctx(spec, op, clone, dtor);
+    pkt->u_rdata.exdata = make_cid_ctx(instance, spec, op, clone, dtor);
     pkt->u_rdata.exdata->deadline =
         pkt->u_rdata.exdata->start + LCB_US2NS(cmd->timeout ? cmd->timeout : LCBT_SETTING(instance, operation_timeout));
     pkt->flags |= MCREQ_F_REQEXT;
+    instance->collcache->begin_resolution(spec);
 
     LCB_SCHED_ADD(instance, pl, pkt)
     return LCB_SUCCESS;
@@ -180,6 +278,16 @@ lcb_STATUS collcache_resolve(lcb_INSTANCE *instance, std::shared_ptr<Command> cm
         return LCB_ERR_NO_CONFIGURATION;
     }
 
+    if (instance->collcache->resolving(spec)) {
+        instance->collcache->park(spec, [cmd, scheduler](lcb_STATUS rc, const lcb_RESPGETCID *resp) {
+            if (resp && resp->ctx.rc == LCB_SUCCESS) {
+                cmd->collection().collection_id(resp->collection_id);
+            }
+            scheduler(rc, resp, cmd);
+        });
+        return LCB_SUCCESS;
+    }
+
     int vbid, idx;
     lcb_KEYBUF keybuf{LCB_KV_COPY, {cmd->key().c_str(), cmd->key().size()}};
     mcreq_map_key(cq, &keybuf, MCREQ_PKT_BASESIZE, &vbid, &idx);
@@ -206,19 +314,22 @@ lcb_STATUS collcache_resolve(lcb_INSTANCE *instance, std::shared_ptr<Command> cm
 
     pkt->u_rdata.exdata = lcb::make_deferred_command_context<Command, lcb_RESPGETCID>(
         cmd, [instance, scheduler](lcb_STATUS rc, const lcb_RESPGETCID *resp, std::shared_ptr<Command> operation) {
-            if (resp->ctx.rc == LCB_SUCCESS) {
-                auto &collection = operation->collection();
+            auto &collection = operation->collection();
+            auto waiters = instance->collcache->end_resolution(collection.spec());
+            if (resp && resp->ctx.rc == LCB_SUCCESS) {
                 instance->collcache->put(collection.spec(), resp->collection_id);
                 collection.collection_id(resp->collection_id);
             } else {
                 lcb_log((instance)->settings, "collcache", LCB_LOG_DEBUG, __FILE__, __LINE__,
-                        "failed to resolve collection, rc: %s", lcb_strerror_short(resp->ctx.rc));
+                        "failed to resolve collection, rc: %s", lcb_strerror_short(resp ? resp->ctx.rc : rc));
             }
             scheduler(rc, resp, operation);
+            collcache_release_waiters(waiters, rc, resp);
         });
     pkt->u_rdata.exdata->deadline =
         pkt->u_rdata.exdata->start + cmd->timeout_or_default_in_nanoseconds(LCBT_SETTING(instance, operation_timeout));
     pkt->flags |= MCREQ_F_REQEXT;
+    instance->collcache->begin_resolution(spec);
 
     LCB_SCHED_ADD(instance, pl, pkt)
     return LCB_SUCCESS;
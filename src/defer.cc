@@ -18,15 +18,145 @@
 #include "internal.h"
 #include "defer.h"
 
+#include <algorithm>
+
 namespace lcb
 {
-lcb_STATUS defer_operation(lcb_INSTANCE *instance, std::function<void(lcb_STATUS)> operation)
+DeferredQueue::~DeferredQueue()
+{
+    if (timer) {
+        lcbio_timer_destroy(timer);
+    }
+}
+
+lcb_STATUS DeferredQueue::push(hrtime_t deadline, size_t size, Operation operation)
+{
+    lcb_U32 max_ops = LCBT_SETTING(instance, deferred_max_ops);
+    lcb_U32 max_bytes = LCBT_SETTING(instance, deferred_max_bytes);
+    if ((max_ops && count >= max_ops) || (max_bytes && nbytes + size > max_bytes)) {
+        return LCB_ERR_TEMPORARY_FAILURE;
+    }
+    if (count == ring.size()) {
+        grow();
+    }
+    Entry &entry = at(count);
+    entry.operation = std::move(operation);
+    entry.deadline = deadline;
+    entry.nbytes = size;
+    count++;
+    nbytes += size;
+
+    if (timer == nullptr) {
+        timer = lcbio_timer_new(instance->iotable, this, timer_callback);
+    }
+    if (!lcbio_timer_armed(timer) || deadline < next_deadline) {
+        hrtime_t now = gethrtime();
+        next_deadline = deadline;
+        lcbio_timer_rearm(timer, deadline > now ? LCB_NS2US(deadline - now) : 0);
+    }
+    return LCB_SUCCESS;
+}
+
+DeferredQueue::Operation DeferredQueue::pop()
+{
+    Entry &entry = at(0);
+    Operation operation = std::move(entry.operation);
+    entry.operation = nullptr;
+    nbytes -= entry.nbytes;
+    head = (head + 1) & (ring.size() - 1);
+    count--;
+    return operation;
+}
+
+void DeferredQueue::grow()
+{
+    std::vector<Entry> bigger(std::max<size_t>(16, ring.size() * 2));
+    for (size_t ii = 0; ii < count; ii++) {
+        bigger[ii] = std::move(at(ii));
+    }
+    ring.swap(bigger);
+    head = 0;
+}
+
+void DeferredQueue::expire()
+{
+    hrtime_t now = gethrtime();
+    std::vector<Operation> expired;
+    size_t kept = 0, nkept_bytes = 0;
+    next_deadline = 0;
+    for (size_t ii = 0; ii < count; ii++) {
+        Entry &entry = at(ii);
+        if (entry.deadline <= now) {
+            expired.emplace_back(std::move(entry.operation));
+            entry.operation = nullptr;
+            continue;
+        }
+        if (kept != ii) {
+            at(kept) = std::move(entry);
+            entry.operation = nullptr;
+        }
+        const Entry &moved = at(kept++);
+        if (next_deadline == 0 || moved.deadline < next_deadline) {
+            next_deadline = moved.deadline;
+        }
+        nkept_bytes += moved.nbytes;
+    }
+    count = kept;
+    nbytes = nkept_bytes;
+    if (count) {
+        lcbio_timer_rearm(timer, LCB_NS2US(next_deadline - now));
+    }
+
+    for (auto &operation : expired) {
+        operation(LCB_ERR_TIMEOUT);
+    }
+    lcb_maybe_breakout(instance);
+}
+
+void DeferredQueue::timer_callback(void *arg)
+{
+    static_cast<DeferredQueue *>(arg)->expire();
+}
+
+void DeferredQueue::execute()
+{
+    if (timer) {
+        lcbio_timer_disarm(timer);
+    }
+    if (count == 0) {
+        return;
+    }
+    /* Operations scheduled by the callbacks are replayed right away, so only
+     * take what is there now */
+    size_t n = count;
+    hrtime_t now = gethrtime();
+    lcb_sched_enter(instance);
+    while (n-- && count) {
+        bool expired = at(0).deadline <= now;
+        Operation operation = pop();
+        operation(expired ? LCB_ERR_TIMEOUT : LCB_SUCCESS);
+    }
+    lcb_sched_leave(instance);
+}
+
+void DeferredQueue::cancel()
+{
+    if (timer) {
+        lcbio_timer_disarm(timer);
+    }
+    while (count) {
+        Operation operation = pop();
+        operation(LCB_ERR_REQUEST_CANCELED);
+    }
+}
+
+lcb_STATUS defer_operation(lcb_INSTANCE *instance, hrtime_t deadline, size_t nbytes,
+                           std::function<void(lcb_STATUS)> operation)
 {
     if (instance == nullptr || instance->deferred_operations == nullptr) {
         return LCB_ERR_INVALID_ARGUMENT;
     }
-    instance->deferred_operations->emplace_back(std::move(operation));
-    return LCB_SUCCESS;
+    return instance->deferred_operations->push(deadline, nbytes, std::move(operation));
 }
 
 void execute_deferred_operations(lcb_INSTANCE *instance)
@@ -37,12 +167,7 @@ void execute_deferred_operations(lcb_INSTANCE *instance)
     if (instance->settings->conntype != LCB_TYPE_BUCKET) {
         return;
     }
-
-    while (instance->has_deferred_operations()) {
-        auto operation = instance->deferred_operations->front();
-        instance->deferred_operations->pop_front();
-        operation(LCB_SUCCESS);
-    }
+    instance->deferred_operations->execute();
 }
 
 void cancel_deferred_operations(lcb_INSTANCE *instance)
@@ -50,10 +175,6 @@ void cancel_deferred_operations(lcb_INSTANCE *instance)
     if (instance == nullptr || instance->deferred_operations == nullptr) {
         return;
     }
-    while (instance->has_deferred_operations()) {
-        auto operation = instance->deferred_operations->front();
-        instance->deferred_operations->pop_front();
-        operation(LCB_ERR_REQUEST_CANCELED);
-    }
+    instance->deferred_operations->cancel();
 }
 } // namespace lcb
@@ -18,12 +18,81 @@
 #ifndef LCB_DEFER_H
 #define LCB_DEFER_H
 
+#include <lcbio/lcbio.h>
+#include <lcbio/timer-ng.h>
+
 #ifdef __cplusplus
 #include <functional>
+#include <vector>
 
 namespace lcb
 {
-lcb_STATUS defer_operation(lcb_INSTANCE *instance, std::function<void(lcb_STATUS)> operation);
+/**
+ * Operations scheduled before the instance has a cluster map. They are kept
+ * in a ring, whose slots are reused once the ring has grown to the size of
+ * the startup burst, and are failed with LCB_ERR_TIMEOUT by a timer if their
+ * deadline passes while waiting. The number of operations and their size may
+ * be capped with the `deferred_max_ops` and `deferred_max_bytes` settings.
+ */
+class DeferredQueue
+{
+  public:
+    using Operation = std::function<void(lcb_STATUS)>;
+
+    explicit DeferredQueue(lcb_INSTANCE *instance_) : instance(instance_) {}
+    ~DeferredQueue();
+
+    /**
+     * @param deadline time at which the operation fails if it is still waiting
+     * @param nbytes memory held by the operation, counted against the cap
+     * @return LCB_ERR_TEMPORARY_FAILURE if the queue is full
+     */
+    lcb_STATUS push(hrtime_t deadline, size_t nbytes, Operation operation);
+
+    /** Invoke the operations, in order, within a single scheduling context */
+    void execute();
+    /** Invoke the operations with LCB_ERR_REQUEST_CANCELED */
+    void cancel();
+
+    bool empty() const
+    {
+        return count == 0;
+    }
+    size_t size() const
+    {
+        return count;
+    }
+
+  private:
+    struct Entry {
+        Operation operation;
+        hrtime_t deadline{0};
+        size_t nbytes{0};
+    };
+
+    Entry &at(size_t ii)
+    {
+        return ring[(head + ii) & (ring.size() - 1)];
+    }
+    /** Remove and return the oldest operation */
+    Operation pop();
+    void grow();
+    /** Fail the operations whose deadline has passed */
+    void expire();
+    static void timer_callback(void *arg);
+
+    lcb_INSTANCE *instance;
+    std::vector<Entry> ring;
+    size_t head{0};
+    size_t count{0};
+    size_t nbytes{0};
+    /** earliest deadline of the waiting operations, when the timer is armed */
+    hrtime_t next_deadline{0};
+    lcbio_pTIMER timer{nullptr};
+};
+
+lcb_STATUS defer_operation(lcb_INSTANCE *instance, hrtime_t deadline, size_t nbytes,
+                           std::function<void(lcb_STATUS)> operation);
 void execute_deferred_operations(lcb_INSTANCE *instance);
 void cancel_deferred_operations(lcb_INSTANCE *instance);
 } // namespace lcb
@@ -19,19 +19,62 @@
 #include "internal.h"
 #include "sllist-inl.h"
 
+#include <algorithm>
+
 using namespace lcb::docreq;
 
 static void docreq_handler(void *arg);
 static void invoke_pending(Queue *);
 
-#define MAX_PENDING_DOCREQ 10
+#define INITIAL_PENDING_DOCREQ 10
+#define MAX_PENDING_DOCREQ 512
 #define MIN_SCHED_SIZE 5
-#define DOCQ_DELAY_US 200000
+/* A response is considered slow when its latency exceeds twice the base
+ * latency plus this slack, so that jitter on an idle cluster does not
+ * shrink the window */
+#define DOCQ_LATENCY_SLACK_NS LCB_US2NS(500)
+
+Window::Window(unsigned initial, unsigned maximum) : cur(initial), max(maximum) {}
+
+void Window::set_max(unsigned maximum)
+{
+    max = maximum ? maximum : MAX_PENDING_DOCREQ;
+    cur = std::min(cur, max);
+}
+
+void Window::on_response(hrtime_t latency, hrtime_t sent, hrtime_t now)
+{
+    if (base_latency == 0 || latency < base_latency) {
+        base_latency = latency;
+    }
+    if (latency > 2 * base_latency + DOCQ_LATENCY_SLACK_NS) {
+        on_congestion(sent, now);
+        return;
+    }
+    if (++nacked >= cur) {
+        nacked = 0;
+        if (cur < max) {
+            cur++;
+        }
+    }
+}
+
+void Window::on_congestion(hrtime_t sent, hrtime_t now)
+{
+    if (sent < last_decrease) {
+        /* Already reacted to this round trip */
+        return;
+    }
+    cur = std::max(1U, cur / 2);
+    nacked = 0;
+    last_decrease = now;
+}
 
 Queue::Queue(lcb_INSTANCE *instance_)
     : instance(instance_), parent(nullptr), timer(lcbio_timer_new(instance->iotable, this, docreq_handler)),
       cb_ready(nullptr), cb_throttle(nullptr), n_awaiting_schedule(0), n_awaiting_response(0),
-      max_pending_response(MAX_PENDING_DOCREQ), min_batch_size(MIN_SCHED_SIZE), cancelled(false), refcount(1)
+      window(INITIAL_PENDING_DOCREQ, MAX_PENDING_DOCREQ), min_batch_size(MIN_SCHED_SIZE), ordered(true),
+      cancelled(false), refcount(1)
 {
 
     memset(&pending_gets, 0, sizeof pending_gets);
@@ -57,20 +100,15 @@ void Queue::cancel()
     cancelled = true;
 }
 
-/* Calling this function ensures that the request will be scheduled in due
- * time. This may be done at the next event loop iteration, or after a delay
- * depending on how many items are actually found within the queue. */
+/* Calling this function ensures that the requests will be scheduled in due
+ * time. When the window has room, this happens at the next event loop
+ * iteration, so that the rows of the chunk being parsed are issued as one
+ * batch while the next chunk is read. Otherwise it happens when responses
+ * make room in the window (see Queue::check()). */
 static void docq_poke(Queue *q)
 {
-    if (q->n_awaiting_response < q->max_pending_response) {
-        if (q->n_awaiting_schedule > q->min_batch_size) {
-            lcbio_async_signal(q->timer);
-            q->cb_throttle(q, 0);
-        }
-    }
-
-    if (!lcbio_timer_armed(q->timer)) {
-        lcbio_timer_rearm(q->timer, DOCQ_DELAY_US);
+    if (q->n_awaiting_schedule && q->n_awaiting_response < q->window.size() && !lcbio_timer_armed(q->timer)) {
+        lcbio_async_signal(q->timer);
     }
 }
 
@@ -90,14 +128,18 @@ static void docreq_handler(void *arg)
     sllist_iterator iter;
     lcb_INSTANCE *instance = q->instance;
 
+    hrtime_t now = gethrtime();
     lcb_sched_enter(instance);
     SLLIST_ITERFOR(&q->pending_gets, &iter)
     {
         DocRequest *cont = SLLIST_ITEM(iter.cur, DocRequest, slnode);
 
-        if (q->n_awaiting_response > q->max_pending_response) {
-            lcbio_timer_rearm(q->timer, DOCQ_DELAY_US);
-            q->cb_throttle(q, 1);
+        if (q->n_awaiting_response >= q->window.size()) {
+            /* Keep parsing while there is no more than a window's worth of
+             * rows waiting, so the next batch is ready when room is made */
+            if (q->n_awaiting_schedule > q->window.size()) {
+                q->cb_throttle(q, 1);
+            }
             break;
         }
 
@@ -109,6 +151,7 @@ static void docreq_handler(void *arg)
 
         } else {
             lcb_STATUS rc;
+            cont->start = now;
             rc = q->cb_schedule(q, cont);
             if (rc != LCB_SUCCESS) {
                 cont->docresp.ctx.rc = rc;
@@ -124,13 +167,10 @@ static void docreq_handler(void *arg)
     lcb_sched_leave(instance);
     lcb_sched_flush(instance);
 
-    if (q->n_awaiting_schedule < q->min_batch_size) {
+    if (q->n_awaiting_schedule < std::max(q->min_batch_size, q->window.size() / 2)) {
         q->cb_throttle(q, 0);
     }
 
-    /* Ensure we're called again */
-    docq_poke(q);
-
     /* Flush out any bad responses */
     invoke_pending(q);
 }
@@ -147,7 +187,10 @@ static void invoke_pending(Queue *q)
         void *bufh = nullptr;
 
         if (dreq->ready == 0) {
-            break;
+            if (q->ordered) {
+                break;
+            }
+            continue;
         }
 
         if (dreq->docresp.ctx.rc == LCB_SUCCESS && dreq->docresp.bufh) {
@@ -167,6 +210,25 @@ static void invoke_pending(Queue *q)
     q->unref();
 }
 
+void Queue::on_response(DocRequest *dreq, lcb_STATUS rc)
+{
+    n_awaiting_response--;
+    dreq->ready = 1;
+
+    hrtime_t now = gethrtime();
+    switch (rc) {
+        case LCB_ERR_TEMPORARY_FAILURE:
+        case LCB_ERR_TIMEOUT:
+        case LCB_ERR_AMBIGUOUS_TIMEOUT:
+        case LCB_ERR_UNAMBIGUOUS_TIMEOUT:
+            window.on_congestion(dreq->start, now);
+            break;
+        default:
+            window.on_response(now - dreq->start, dreq->start, now);
+            break;
+    }
+}
+
 void Queue::check()
 {
     /* Ensure the invoke_pending doesn't destroy us */
@@ -37,6 +37,40 @@ namespace docreq
 struct Queue;
 struct DocRequest;
 
+/**
+ * Number of KV operations a Queue keeps in flight, sized by the observed
+ * latency (AIMD): the window grows by one every window's worth of fast
+ * responses, and is halved when responses get slow (or when the server
+ * reports being busy), at most once per round trip.
+ */
+struct Window {
+    Window(unsigned initial, unsigned maximum);
+
+    unsigned size() const
+    {
+        return cur;
+    }
+    /** Change the upper bound of the window (0 means the default) */
+    void set_max(unsigned maximum);
+
+    /**
+     * @param latency time between the scheduling and the response (ns)
+     * @param sent when the operation was scheduled
+     * @param now current time
+     */
+    void on_response(hrtime_t latency, hrtime_t sent, hrtime_t now);
+    void on_congestion(hrtime_t sent, hrtime_t now);
+
+    unsigned cur;
+    unsigned max;
+    /** responses since the last increase */
+    unsigned nacked{0};
+    /** lowest latency observed, i.e. the latency of an idle cluster */
+    hrtime_t base_latency{0};
+    /** operations scheduled before this time do not trigger another decrease */
+    hrtime_t last_decrease{0};
+};
+
 struct Queue {
     explicit Queue(lcb_INSTANCE *);
     ~Queue();
@@ -48,6 +82,8 @@ struct Queue {
     }
     void cancel();
     void check();
+    /** To be called by the operation callback, before check() */
+    void on_response(DocRequest *, lcb_STATUS rc);
     bool has_pending() const
     {
         return n_awaiting_response || n_awaiting_schedule;
@@ -85,8 +121,11 @@ struct Queue {
     unsigned n_awaiting_schedule;
     unsigned n_awaiting_response;
 
-    unsigned max_pending_response;
+    /** Bounds n_awaiting_response. Its maximum is set by the user */
+    Window window;
     unsigned min_batch_size;
+    /** Whether cb_ready has to be invoked in the order of add() */
+    bool ordered;
     unsigned cancelled;
     unsigned refcount;
 };
@@ -100,6 +139,8 @@ struct DocRequest {
     /* To be filled in by the subclass */
     lcb_IOV docid;
     unsigned ready;
+    /** When the operation was scheduled */
+    hrtime_t start;
 };
 
 } // namespace docreq
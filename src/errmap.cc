@@ -287,6 +287,13 @@ LIBCOUCHBASE_API lcb_STATUS lcb_errctx_kv_cas(const lcb_KEY_VALUE_ERROR_CONTEXT
     return LCB_SUCCESS;
 }
 
+LIBCOUCHBASE_API lcb_STATUS lcb_errctx_kv_server_duration(const lcb_KEY_VALUE_ERROR_CONTEXT *ctx,
+                                                          uint64_t *duration)
+{
+    *duration = ctx->server_duration;
+    return LCB_SUCCESS;
+}
+
 LIBCOUCHBASE_API lcb_STATUS lcb_errctx_kv_key(const lcb_KEY_VALUE_ERROR_CONTEXT *ctx, const char **key, size_t *key_len)
 {
     *key = ctx->key.c_str();
@@ -151,8 +151,13 @@ class RetrySpec
         } else if (strategy == LINEAR) {
             cur_interval = num_attempts * interval;
         } else if (strategy == EXPONENTIAL) {
-            // Convert to ms for pow(), convert result back to us.
-            cur_interval = std::pow((double)(interval / 1000), (int)num_attempts) * 1000;
+            // (interval in ms) ^ num_attempts, converted back to us. Computed
+            // by repeated multiplication, saturating instead of overflowing.
+            uint64_t base = interval / 1000, ms = 1;
+            for (size_t ii = 0; ii < num_attempts && ms != 0 && ms < UINT32_MAX / 1000; ii++) {
+                ms *= base;
+            }
+            cur_interval = ms < UINT32_MAX / 1000 ? (uint32_t)(ms * 1000) : UINT32_MAX;
         }
         if (ceil != 0) {
             // Note, I *could* use std::min here, but this file gets
@@ -166,6 +171,11 @@ class RetrySpec
         return cur_interval;
     }
 
+    uint32_t get_ceil() const
+    {
+        return ceil;
+    }
+
     void ref()
     {
         refcount++;
@@ -0,0 +1,264 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2020 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "internal.h"
+#include "group.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#define LOGARGS(instance, lvl) (instance)->settings, "group", LCB_LOG_##lvl, __FILE__, __LINE__
+
+std::vector<lcb_U16> lcb::group_route_vbuckets(lcbvb_CONFIG *config, unsigned nshards, lcb_GROUP_ROUTING routing)
+{
+    std::vector<lcb_U16> routes(config->nvb);
+    unsigned nnodes = LCBVB_NSERVERS(config);
+    /* number of vBuckets of each node assigned so far, to spread them over
+     * the shards sharing the node */
+    std::vector<unsigned> assigned(nnodes, 0);
+
+    for (unsigned vbid = 0; vbid < config->nvb; vbid++) {
+        int master = -1;
+        if (routing == LCB_GROUP_ROUTE_NODE) {
+            master = lcbvb_vbmaster(config, vbid);
+        }
+        if (master < 0 || (unsigned)master >= nnodes) {
+            routes[vbid] = vbid % nshards;
+        } else if (nshards <= nnodes) {
+            /* shard `s` owns the nodes s, s + nshards, s + 2 * nshards... */
+            routes[vbid] = master % nshards;
+        } else {
+            /* node `n` is owned by the shards n, n + nnodes, n + 2 * nnodes... */
+            unsigned nowners = (nshards - master + nnodes - 1) / nnodes;
+            routes[vbid] = master + nnodes * (assigned[master]++ % nowners);
+        }
+    }
+    return routes;
+}
+
+struct lcb_INSTANCE_GROUP_st {
+    struct Shard {
+        lcb_INSTANCE *instance{nullptr};
+        lcb_SUBMITQ *queue{nullptr};
+        std::thread thread;
+    };
+
+    std::vector<Shard> shards;
+    lcbvb_CONFIG *config{nullptr};
+    std::vector<lcb_U16> routes;
+    /** configuration cache the shards bootstrap from */
+    std::string cachefile;
+    /** whether the cache file (and its snapshot) was created by the group, and
+     * must be removed */
+    bool private_cache{false};
+
+    ~lcb_INSTANCE_GROUP_st()
+    {
+        for (auto &shard : shards) {
+            if (shard.queue) {
+                lcb_submitq_stop(shard.queue);
+            }
+        }
+        for (auto &shard : shards) {
+            if (shard.thread.joinable()) {
+                shard.thread.join();
+            }
+        }
+        /* Instances share the authenticator and the logger of the creation
+         * options, so release them from a single thread */
+        for (auto &shard : shards) {
+            if (shard.queue) {
+                lcb_submitq_destroy(shard.queue);
+            }
+            if (shard.instance) {
+                lcb_destroy(shard.instance);
+            }
+        }
+        if (private_cache) {
+            remove(cachefile.c_str());
+            remove(lcb::clconfig::file_snapshot_filename(cachefile).c_str());
+        }
+        if (config) {
+            lcbvb_destroy(config);
+        }
+    }
+
+    /** Keep the path of the cache the first shard writes, or make one up */
+    void setup_cache(lcb_INSTANCE *instance)
+    {
+        const char *filename = nullptr;
+        lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_CONFIGCACHE, &filename);
+        if (filename != nullptr) {
+            cachefile = filename;
+            return;
+        }
+        char name[64];
+        snprintf(name, sizeof(name), "lcb-group-%p-%llu", (void *)this, (unsigned long long)lcb_nstime());
+        std::string path = std::string(lcb_get_tmpdir()) + "/" + name;
+        if (lcb_cntl(instance, LCB_CNTL_SET, LCB_CNTL_CONFIGCACHE, (void *)path.c_str()) == LCB_SUCCESS) {
+            lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_CONFIGCACHE, &filename);
+            cachefile = filename;
+            private_cache = true;
+        }
+    }
+
+    lcb_STATUS copy_config(lcb_INSTANCE *instance, unsigned nshards, lcb_GROUP_ROUTING routing)
+    {
+        lcbvb_CONFIG *vbc = LCBT_VBCONFIG(instance);
+        if (vbc == nullptr || lcbvb_get_distmode(vbc) != LCBVB_DIST_VBUCKET) {
+            lcb_log(LOGARGS(instance, ERROR), "Instance groups need a bucket with vBuckets");
+            return LCB_ERR_SDK_FEATURE_UNAVAILABLE;
+        }
+        char *json = lcbvb_save_json(vbc);
+        config = lcbvb_create();
+        int rv = lcbvb_load_json(config, json);
+        free(json);
+        if (rv != 0) {
+            return LCB_ERR_SDK_INTERNAL;
+        }
+        routes = lcb::group_route_vbuckets(config, nshards, routing);
+        return LCB_SUCCESS;
+    }
+
+    void start(unsigned ii, bool pin)
+    {
+        lcb_SUBMITQ *queue = shards[ii].queue;
+        shards[ii].thread = std::thread([queue]() { lcb_submitq_run(queue); });
+#ifdef __linux__
+        if (pin) {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(ii % CPU_SETSIZE, &cpus);
+            if (pthread_setaffinity_np(shards[ii].thread.native_handle(), sizeof(cpus), &cpus) != 0) {
+                lcb_log(LOGARGS(shards[ii].instance, WARN), "Couldn't pin shard %u to its CPU", ii);
+            }
+        }
+#else
+        (void)pin;
+#endif
+    }
+};
+
+LIBCOUCHBASE_API
+lcb_STATUS lcb_group_create(lcb_INSTANCE_GROUP **group, const lcb_CREATEOPTS *options, const lcb_GROUPOPTS *gopts)
+{
+    lcb_GROUPOPTS defaults{};
+    if (group == nullptr || options == nullptr || options->io != nullptr) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    if (gopts == nullptr) {
+        gopts = &defaults;
+    }
+    unsigned nshards = gopts->nshards;
+    if (nshards == 0) {
+        nshards = std::max(1U, std::thread::hardware_concurrency());
+    }
+
+    auto *grp = new lcb_INSTANCE_GROUP();
+    grp->shards.resize(nshards);
+    /* Shards are bootstrapped one after the other: the first one fetches the
+     * cluster map and writes it to the configuration cache, the others read
+     * it from there without going to the network */
+    lcb_STATUS rc = LCB_SUCCESS;
+    for (unsigned ii = 0; ii < nshards && rc == LCB_SUCCESS; ii++) {
+        lcb_INSTANCE *instance = nullptr;
+        rc = lcb_create(&instance, options);
+        if (rc != LCB_SUCCESS) {
+            break;
+        }
+        grp->shards[ii].instance = instance;
+        if (ii == 0) {
+            grp->setup_cache(instance);
+        } else if (!grp->cachefile.empty() &&
+                   lcb_cntl(instance, LCB_CNTL_SET, LCB_CNTL_CONFIGCACHE_RO, (void *)grp->cachefile.c_str()) !=
+                       LCB_SUCCESS) {
+            lcb_log(LOGARGS(instance, WARN), "Shard %u cannot use the configuration cache, will fetch it", ii);
+        }
+        if (gopts->init_callback) {
+            gopts->init_callback(instance, ii, gopts->cookie);
+        }
+        lcb_connect(instance);
+        lcb_wait(instance, LCB_WAIT_DEFAULT);
+        rc = lcb_get_bootstrap_status(instance);
+        if (rc == LCB_SUCCESS && ii == 0) {
+            rc = grp->copy_config(instance, nshards, gopts->routing);
+        }
+        if (rc == LCB_SUCCESS) {
+            rc = lcb_submitq_create(instance, gopts->queue_capacity, &grp->shards[ii].queue);
+        }
+    }
+    if (rc != LCB_SUCCESS) {
+        delete grp;
+        return rc;
+    }
+    for (unsigned ii = 0; ii < nshards; ii++) {
+        grp->start(ii, gopts->pin_threads != 0);
+    }
+    *group = grp;
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API
+unsigned lcb_group_nshards(const lcb_INSTANCE_GROUP *group)
+{
+    return group->shards.size();
+}
+
+LIBCOUCHBASE_API
+lcb_INSTANCE *lcb_group_instance(lcb_INSTANCE_GROUP *group, unsigned shard)
+{
+    if (shard >= group->shards.size()) {
+        return nullptr;
+    }
+    return group->shards[shard].instance;
+}
+
+LIBCOUCHBASE_API
+unsigned lcb_group_shard_for_key(const lcb_INSTANCE_GROUP *group, const void *key, size_t nkey)
+{
+    int vbid = lcbvb_k2vb(group->config, key, nkey);
+    return group->routes[vbid];
+}
+
+LIBCOUCHBASE_API
+lcb_STATUS lcb_group_submit(lcb_INSTANCE_GROUP *group, const void *key, size_t nkey, lcb_SUBMIT_CALLBACK callback,
+                            void *arg)
+{
+    return lcb_submitq_push(group->shards[lcb_group_shard_for_key(group, key, nkey)].queue, callback, arg);
+}
+
+LIBCOUCHBASE_API
+lcb_STATUS lcb_group_submit_shard(lcb_INSTANCE_GROUP *group, unsigned shard, lcb_SUBMIT_CALLBACK callback, void *arg)
+{
+    if (shard >= group->shards.size()) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    return lcb_submitq_push(group->shards[shard].queue, callback, arg);
+}
+
+LIBCOUCHBASE_API
+void lcb_group_destroy(lcb_INSTANCE_GROUP *group)
+{
+    delete group;
+}
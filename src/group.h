@@ -0,0 +1,35 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2020 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LCB_GROUP_INTERNAL_H
+#define LCB_GROUP_INTERNAL_H
+
+#include <libcouchbase/couchbase.h>
+#include <libcouchbase/vbucket.h>
+#include <libcouchbase/group.h>
+#include <vector>
+
+namespace lcb
+{
+/**
+ * Compute the shard owning each vBucket of `config`.
+ * @return a vector with one entry per vBucket
+ */
+std::vector<lcb_U16> group_route_vbuckets(lcbvb_CONFIG *config, unsigned nshards, lcb_GROUP_ROUTING routing);
+} // namespace lcb
+
+#endif
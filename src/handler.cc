@@ -257,6 +257,7 @@ void init_resp(lcb_INSTANCE *instance, mc_PIPELINE *pipeline, const MemcachedRes
     resp->ctx.status_code = mc_resp->status();
     resp->ctx.cas = mc_resp->cas();
     resp->ctx.opaque = mc_resp->opaque();
+    resp->ctx.server_duration = mc_resp->duration();
     if (instance) {
         resp->ctx.bucket.assign(LCBT_VBCONFIG(instance)->bname, LCBT_VBCONFIG(instance)->bname_len);
     }
@@ -364,14 +365,15 @@ void invoke_callback(const mc_PACKET *pkt, mc_PIPELINE *pipeline, T *resp, lcb_C
 }
 
 /**
- * Optionally decompress an incoming payload.
+ * Optionally decompress an incoming payload, and decode it if it was encoded
+ * by a client-side codec.
  * @param o The instance
  * @param resp The response received
  * @param[out] bytes pointer to the final payload
  * @param[out] nbytes pointer to the size of the final payload
- * @param[out] freeptr pointer to free. This should be initialized to `nullptr`.
- * If temporary dynamic storage is required this will be set to the allocated
- * pointer upon return. Otherwise it will be set to nullptr. In any case it must
+ * @param[out] freeptr buffer of the inflated value. This should be initialized
+ * to `nullptr`, and passed to mcreq_inflate_done() once the value is no longer
+ * required.
  */
 static void maybe_decompress(lcb_INSTANCE *o, const MemcachedResponse *respkt, lcb_RESPGET *rescmd, void **freeptr)
 {
@@ -387,13 +389,35 @@ static void maybe_decompress(lcb_INSTANCE *o, const MemcachedResponse *respkt, l
     if (respkt->datatype() & PROTOCOL_BINARY_DATATYPE_COMPRESSED) {
         if (LCBT_SETTING(o, compressopts) & LCB_COMPRESS_IN) {
             /* if we inflate, we don't set the flag */
-            mcreq_inflate_value(respkt->value(), respkt->vallen(), &rescmd->value, &rescmd->nvalue, freeptr);
-
+            nb_IOV contig;
+            lcb_FRAGBUF compressed{};
+            const nb_IOV *iov = nullptr;
+            compressed.niov = respkt->value_fragments(&iov);
+            if (compressed.niov == 0) {
+                contig.iov_base = const_cast<char *>(respkt->value());
+                contig.iov_len = respkt->vallen();
+                iov = &contig;
+                compressed.niov = 1;
+            }
+            compressed.iov = reinterpret_cast<lcb_IOV *>(const_cast<nb_IOV *>(iov));
+            compressed.total_length = respkt->vallen();
+            if (mcreq_inflate_fragments(&compressed, &o->inflate_buf, &rescmd->value, &rescmd->nvalue, freeptr) != 0 &&
+                compressed.niov > 1) {
+                /* the value isn't contiguous, it cannot be handed out as is */
+                rescmd->ctx.rc = LCB_ERR_DECODING_FAILURE;
+                rescmd->value = nullptr;
+                rescmd->nvalue = 0;
+            }
         } else {
             /* user doesn't want inflation. signal it's compressed */
             dtype |= LCB_VALUE_F_SNAPPYCOMP;
         }
     }
+    if (rescmd->value && (LCBT_SETTING(o, compressopts) & LCB_COMPRESS_IN) &&
+        (LCBT_SETTING(o, value_codec) || o->codecs.ncodecs)) {
+        /* only instances which opted in to client-side codecs look for their header */
+        mcreq_codec_decode_value(&o->codecs, &o->inflate_buf, &rescmd->value, &rescmd->nvalue, freeptr, &dtype);
+    }
     rescmd->datatype = dtype;
 }
 
@@ -419,10 +443,15 @@ static void H_get(mc_PIPELINE *pipeline, mc_PACKET *request, MemcachedResponse *
 
     void *freeptr = nullptr;
     maybe_decompress(o, response, &resp, &freeptr);
-    LCBTRACE_KV_FINISH(pipeline, request, resp, response);
     TRACE_GET_END(o, request, response, &resp);
-    invoke_callback(request, o, &resp, LCB_CALLBACK_GET);
-    free(freeptr);
+    if (request->flags & MCREQ_F_REQEXT) {
+        LCBTRACE_KV_COMPLETE(pipeline, request, resp, response);
+        request->u_rdata.exdata->procs->handler(pipeline, request, resp.ctx.rc, &resp);
+    } else {
+        LCBTRACE_KV_FINISH(pipeline, request, resp, response);
+        invoke_callback(request, o, &resp, LCB_CALLBACK_GET);
+    }
+    mcreq_inflate_done(&o->inflate_buf, freeptr);
 }
 
 static void H_exists(mc_PIPELINE *pipeline, mc_PACKET *request, MemcachedResponse *response, lcb_STATUS immerr)
@@ -476,7 +505,7 @@ static void H_getreplica(mc_PIPELINE *pipeline, mc_PACKET *request, MemcachedRes
 
     maybe_decompress(instance, response, &resp, &freeptr);
     rd->procs->handler(pipeline, request, resp.ctx.rc, &resp);
-    free(freeptr);
+    mcreq_inflate_done(&instance->inflate_buf, freeptr);
 }
 
 static int lcb_sdresult_next(const lcb_RESPSUBDOC *resp, lcb_SDENTRY *ent, size_t *iter);
@@ -983,12 +1012,35 @@ static void H_select_bucket(mc_PIPELINE *pipeline, mc_PACKET *request, Memcached
     }
 }
 
-static void record_metrics(mc_PIPELINE *pipeline, mc_PACKET *req, MemcachedResponse *)
+/**
+ * Split the latency of the operation into the time spent by the server (as
+ * reported by it), and the time spent in the network and the queues of the
+ * pipeline, which is everything else since the operation was scheduled.
+ */
+static void record_server_duration(lcb_SERVERMETRICS *metrics, mc_PACKET *req, MemcachedResponse *res)
+{
+    hrtime_t server = LCB_US2NS(res->duration());
+    if (server == 0 || MCREQ_PKT_RDATA(req)->start == 0) {
+        return;
+    }
+    hrtime_t total = gethrtime() - MCREQ_PKT_RDATA(req)->start;
+    hrtime_t network = total > server ? total - server : 0;
+    metrics->packets_server_timed++;
+    metrics->server_duration += LCB_NS2US(server);
+    metrics->network_queue_duration += LCB_NS2US(network);
+    lcb_histogram_record(metrics->server_duration_hg, server);
+    lcb_histogram_record(metrics->network_queue_duration_hg, network);
+}
+
+static void record_metrics(mc_PIPELINE *pipeline, mc_PACKET *req, MemcachedResponse *res)
 {
     lcb_INSTANCE *instance = get_instance(pipeline);
     if (instance == nullptr) {
         return; /* the instance already destroyed */
     }
+    if (pipeline->metrics) {
+        record_server_duration(pipeline->metrics, req, res);
+    }
     if (
 #ifdef HAVE_DTRACE
         1
@@ -1012,10 +1064,49 @@ static void dispatch_ufwd_error(mc_PIPELINE *pipeline, mc_PACKET *req, lcb_STATU
     instance->callbacks.pktfwd(instance, MCREQ_PKT_COOKIE(req), immerr, &resp);
 }
 
+static void record_stage(lcb_SERVERMETRICS *metrics, lcb_PACKET_STAGE stage, hrtime_t begin, hrtime_t end)
+{
+    if (begin != 0 && end >= begin) {
+        lcb_histogram_record(metrics->stage_hg[stage], end - begin);
+    }
+}
+
+/**
+ * Record the time the packet spent in each stage of its lifecycle. `scheduled`
+ * and `dispatched` are taken before invoking the handler, which may release
+ * the request data.
+ */
+static void record_stages(mc_PIPELINE *pipeline, const mc_PACKET *req, hrtime_t scheduled, hrtime_t dispatched)
+{
+    const mc_PKTSTAGES &stages = req->stages;
+    if (stages.received == 0) {
+        return; /* not a response read from the network */
+    }
+    record_stage(pipeline->metrics, LCB_PKTSTAGE_SCHEDULE, scheduled, stages.queued);
+    record_stage(pipeline->metrics, LCB_PKTSTAGE_SEND_QUEUE, stages.queued, stages.sent);
+    record_stage(pipeline->metrics, LCB_PKTSTAGE_WIRE, stages.sent, stages.received);
+    record_stage(pipeline->metrics, LCB_PKTSTAGE_READ, stages.received, dispatched);
+    record_stage(pipeline->metrics, LCB_PKTSTAGE_CALLBACK, dispatched, gethrtime());
+}
+
+static int dispatch_response(mc_PIPELINE *pipeline, mc_PACKET *req, MemcachedResponse *res, lcb_STATUS immerr);
+
 int mcreq_dispatch_response(mc_PIPELINE *pipeline, mc_PACKET *req, MemcachedResponse *res, lcb_STATUS immerr)
 {
     record_metrics(pipeline, req, res);
 
+    if (pipeline->metrics == nullptr) {
+        return dispatch_response(pipeline, req, res, immerr);
+    }
+    hrtime_t scheduled = MCREQ_PKT_RDATA(req)->start;
+    hrtime_t dispatched = gethrtime();
+    int rv = dispatch_response(pipeline, req, res, immerr);
+    record_stages(pipeline, req, scheduled, dispatched);
+    return rv;
+}
+
+static int dispatch_response(mc_PIPELINE *pipeline, mc_PACKET *req, MemcachedResponse *res, lcb_STATUS immerr)
+{
     if (req->flags & MCREQ_F_UFWD) {
         dispatch_ufwd_error(pipeline, req, immerr);
         return 0;
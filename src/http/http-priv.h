@@ -25,6 +25,7 @@
 #include <lcbht/lcbht.h>
 #include "contrib/http_parser/http_parser.h"
 #include "http.h"
+#include <algorithm>
 #include <string>
 #include <vector>
 #include <set>
@@ -341,6 +342,102 @@ struct Request {
     lcbio_SERVICE service{LCBIO_SERVICE_UNSPEC};
 };
 
+/**
+ * Flow control for the row-streaming services (query, search, analytics and
+ * views). Socket reads of the request are paused while any of the ::Reason
+ * flags is set. The state lives in the row handle rather than in the
+ * Request, so that it carries over to the Request issued by a retry.
+ *
+ * With a high watermark, the size of every row handed to the application is
+ * counted until the application reports it as consumed; reads are paused
+ * when the count reaches the watermark and resumed when it drops to half of
+ * it.
+ */
+class FlowControl
+{
+  public:
+    enum Reason {
+        /** Paused by the application */
+        USER = 1 << 0,
+        /** Too many bytes delivered and not consumed yet */
+        WATERMARK = 1 << 1,
+        /** The document queue (include_docs) is full */
+        DOCQUEUE = 1 << 2
+    };
+
+    void set_high_watermark(size_t nbytes)
+    {
+        high_watermark = nbytes;
+    }
+
+    bool is_paused() const
+    {
+        return reasons != 0;
+    }
+
+    /** Set or clear a reason to pause, and pause or resume `req` accordingly */
+    void set(Reason reason, bool enabled, Request *req)
+    {
+        bool was_paused = is_paused();
+        if (enabled) {
+            reasons |= reason;
+        } else {
+            reasons &= ~reason;
+        }
+        if (was_paused != is_paused()) {
+            apply(req);
+        }
+    }
+
+    /** Bring a (new) request in line with the current state */
+    void apply(Request *req) const
+    {
+        if (req == nullptr) {
+            return;
+        }
+        if (is_paused()) {
+            req->pause();
+        } else {
+            req->resume();
+        }
+    }
+
+    void row_delivered(size_t nbytes, Request *req)
+    {
+        if (high_watermark == 0) {
+            return;
+        }
+        outstanding += nbytes;
+        if (outstanding >= high_watermark) {
+            set(WATERMARK, true, req);
+        }
+    }
+
+    void consumed(size_t nbytes, Request *req)
+    {
+        outstanding -= std::min(nbytes, outstanding);
+        if (outstanding <= high_watermark / 2) {
+            set(WATERMARK, false, req);
+        }
+    }
+
+    /** Drop every reason to pause, e.g. so that a cancelled request drains */
+    void release(Request *req)
+    {
+        high_watermark = 0;
+        outstanding = 0;
+        if (is_paused()) {
+            reasons = 0;
+            apply(req);
+        }
+    }
+
+  private:
+    unsigned reasons{0};
+    size_t high_watermark{0};
+    size_t outstanding{0};
+};
+
 } // namespace http
 } // namespace lcb
 
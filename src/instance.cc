@@ -122,6 +122,8 @@ void lcb_set_auth(lcb_INSTANCE *instance, lcb_AUTHENTICATOR *auth)
     lcbauth_ref(auth);
     lcbauth_unref(instance->settings->auth);
     instance->settings->auth = auth;
+    /* keys derived from the old credentials are no longer useful */
+    instance->settings->scram_cache->clear();
 }
 
 void lcb_st::add_bs_host(const char *host, int port, unsigned bstype)
@@ -226,6 +228,23 @@ lcb_STATUS lcb_st::process_dns_srv(Connspec &spec)
     return LCB_SUCCESS;
 }
 
+static void ready_timer_cb(void *arg)
+{
+    auto *instance = reinterpret_cast<lcb_INSTANCE *>(arg);
+    if (instance->callbacks.ready) {
+        instance->callbacks.ready(instance);
+    }
+}
+
+static void admission_ready(mc_CMDQUEUE *cq)
+{
+    auto *instance = reinterpret_cast<lcb_INSTANCE *>(cq->cqdata);
+    if (instance && instance->callbacks.ready) {
+        /* Never call out to the user from within the packet release path */
+        lcbio_async_signal(instance->ready_timer);
+    }
+}
+
 static lcb_STATUS init_providers(lcb_INSTANCE *obj, const Connspec &spec)
 {
     using namespace lcb::clconfig;
@@ -455,7 +474,7 @@ lcb_STATUS lcb_create(lcb_INSTANCE **instance, const lcb_CREATEOPTS *options)
         goto GT_DONE;
     }
     obj->crypto = new std::map<std::string, lcbcrypto_PROVIDER *>();
-    obj->deferred_operations = new std::list<std::function<void(lcb_STATUS)>>();
+    obj->deferred_operations = new lcb::DeferredQueue(obj);
     if (!(settings = lcb_settings_new())) {
         err = LCB_ERR_NO_MEMORY;
         goto GT_DONE;
@@ -535,6 +554,8 @@ lcb_STATUS lcb_create(lcb_INSTANCE **instance, const lcb_CREATEOPTS *options)
     obj->ht_nodes = new Hostlist();
     obj->mc_nodes = new Hostlist();
     obj->retryq = new RetryQueue(&obj->cmdq, obj->iotable, obj->settings);
+    obj->ready_timer = lcbio_timer_new(obj->iotable, obj, ready_timer_cb);
+    obj->cmdq.admit.ready = admission_ready;
     obj->n1ql_cache = lcb_n1qlcache_create();
     lcb_initialize_packet_handlers(obj);
     lcb_aspend_init(&obj->pendops);
@@ -598,6 +619,7 @@ static void sync_dtor_cb(void *arg)
 
 extern "C" {
 void lcbdur_destroy(void *);
+void lcbdur_poller_destroy(lcb_INSTANCE *);
 }
 
 static void do_pool_shutdown(io::Pool *pool)
@@ -646,6 +668,7 @@ void lcb_destroy(lcb_INSTANCE *instance)
     }
 
     DESTROY(delete, retryq)
+    DESTROY(lcbio_timer_destroy, ready_timer)
     DESTROY(delete, confmon)
     DESTROY(do_pool_shutdown, memd_sockpool)
     DESTROY(do_pool_shutdown, http_sockpool)
@@ -663,6 +686,7 @@ void lcb_destroy(lcb_INSTANCE *instance)
         }
     }
     mcreq_queue_cleanup(&instance->cmdq);
+    lcbdur_poller_destroy(instance);
     DESTROY(delete, collcache)
     if (instance->cur_configinfo) {
         instance->cur_configinfo->decref();
@@ -693,6 +717,8 @@ void lcb_destroy(lcb_INSTANCE *instance)
     DESTROY(lcbio_table_unref, iotable)
     DESTROY(lcb_settings_unref, settings)
     DESTROY(lcb_histogram_destroy, kv_timings)
+    mcreq_inflatebuf_cleanup(&instance->inflate_buf);
+    mcreq_codecs_cleanup(&instance->codecs);
     if (instance->scratch) {
         delete instance->scratch;
         instance->scratch = nullptr;
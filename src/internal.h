@@ -39,6 +39,7 @@
 #include <lcbio/lcbio.h>
 #include "mcserver/mcserver.h"
 #include "mc/mcreq.h"
+#include "mc/compress.h"
 #include "settings.h"
 
 #include "internalstructs.h"
@@ -54,6 +55,7 @@
 #include "tracing/tracing-internal.h"
 
 #include "hostlist.h"
+#include "defer.h"
 
 #ifdef __cplusplus
 #include <functional>
@@ -65,6 +67,10 @@ struct Spechost;
 class RetryQueue;
 class Bootstrap;
 class CollectionCache;
+namespace durability
+{
+class SeqnoPoller;
+} // namespace durability
 namespace clconfig
 {
 struct Confmon;
@@ -87,6 +93,7 @@ struct lcb_callback_st {
     lcb_pktfwd_callback pktfwd;
     lcb_pktflushed_callback pktflushed;
     lcb_open_callback open;
+    lcb_ready_callback ready;
 };
 
 struct lcb_GUESSVB_st;
@@ -98,12 +105,14 @@ typedef lcb::RetryQueue lcb_RETRYQ;
 typedef lcb::clconfig::Confmon *lcb_pCONFMON;
 typedef lcb::clconfig::ConfigInfo *lcb_pCONFIGINFO;
 typedef lcb::Bootstrap lcb_BOOTSTRAP;
+typedef lcb::durability::SeqnoPoller lcb_DURPOLLER;
 #else
 typedef struct lcb_SCRATCHBUF *lcb_pSCRATCHBUF;
 typedef struct lcb_RETRYQ_st lcb_RETRYQ;
 typedef struct lcb_CONFMON_st *lcb_pCONFMON;
 typedef struct lcb_CONFIGINFO_st *lcb_pCONFIGINFO;
 typedef struct lcb_BOOTSTRAP_st lcb_BOOTSTRAP;
+typedef struct lcb_DURPOLLER_st lcb_DURPOLLER;
 #endif
 
 struct lcb_st {
@@ -131,12 +140,18 @@ struct lcb_st {
     lcbio_pTIMER dtor_timer;     /**< Asynchronous destruction timer */
     lcb_BTYPE btype;             /**< Type of the bucket */
     lcb_COLLCACHE *collcache;    /**< Collection cache */
+    lcb_U32 hedge_delay;         /**< Replica hedge delay derived from kv_timings (us) */
+    hrtime_t hedge_delay_ts;     /**< When hedge_delay was last derived */
+    lcbio_pTIMER ready_timer;    /**< Invokes the ready callback after backpressure */
+    lcb_DURPOLLER *durpoller;    /**< Shared OBSERVE_SEQNO poller for durability sets */
+    mc_INFLATEBUF inflate_buf;   /**< Reused output buffer for inflated values */
+    mc_CODECTABLE codecs;        /**< Client-side codecs registered by the application */
 
 #ifdef __cplusplus
     typedef std::map<std::string, lcbcrypto_PROVIDER *> lcb_ProviderMap;
     lcb_ProviderMap *crypto;
 
-    std::list<std::function<void(lcb_STATUS)>> *deferred_operations;
+    lcb::DeferredQueue *deferred_operations;
 
     lcb_settings *getSettings()
     {
@@ -23,6 +23,8 @@
 #include "timer-cxx.h"
 #include "rnd.h"
 
+#include <vector>
+
 using namespace lcb::io;
 
 /* win32 lacks EAI_SYSTEM */
@@ -65,6 +67,26 @@ struct Connstart : ConnectionRequest {
     void cancel() override;
     void C_connect();
 
+    /**
+     * One of the parallel attempts of a "Happy Eyeballs" (RFC 8305) connect.
+     * Each attempt owns its own socket; the first one to connect hands its
+     * descriptor over to `sock` and the rest are closed.
+     */
+    struct Attempt {
+        Connstart *cs;
+        addrinfo *ai;
+        lcb_socket_t fd;
+        void *event;
+        bool ev_active;
+    };
+
+    void race_start(addrinfo *root);
+    void race_next();
+    void race_won(Attempt *att);
+    void race_failed(Attempt *att);
+    void race_remove(Attempt *att, bool close_fd);
+    void race_clear();
+
     enum State { CS_PENDING, CS_CANCELLED, CS_CONNECTED, CS_ERROR };
 
     void state_signal(State next_state, lcb_STATUS err);
@@ -86,6 +108,11 @@ struct Connstart : ConnectionRequest {
     State state;
     lcb_STATUS last_error;
     Timer<Connstart, &Connstart::handler> timer;
+
+    std::vector<addrinfo *> race_addrs; /* addresses in the order they are tried */
+    size_t race_pos;                    /* next address to try */
+    std::vector<Attempt *> attempts;    /* attempts in flight */
+    Timer<Connstart, &Connstart::race_next> race_timer;
 };
 } // namespace io
 } // namespace lcb
@@ -118,6 +145,7 @@ void Connstart::handler()
 {
     lcb_STATUS err;
 
+    race_clear();
     if (sock && event) {
         unwatch();
         sock->io->E_event_destroy(event);
@@ -175,6 +203,8 @@ GT_DTOR:
 
 Connstart::~Connstart()
 {
+    race_clear();
+    race_timer.release();
     timer.release();
     if (sock) {
         lcbio_unref(sock)
@@ -296,14 +326,53 @@ void Connstart::clear_sock()
     }
 }
 
+enum ConnectStatus { CONNECT_DONE, CONNECT_PENDING, CONNECT_FAILED };
+
+/**
+ * Call connect() on a non-blocking socket, retrying it when interrupted (and
+ * once on EINVAL). Shared by the single connection and the "Happy Eyeballs"
+ * attempts.
+ * @param[out] syserr the error of the last call
+ */
+static ConnectStatus E_try_connect(lcbio_TABLE *io, lcb_socket_t fd, const addrinfo *ai, lcbio_OSERR *syserr)
+{
+    bool retry_once = false;
+
+    while (true) {
+        if (io->E_connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+            return CONNECT_DONE;
+        }
+
+        lcbio_mksyserr(io->get_errno(), syserr);
+        switch (lcbio_mkcserr(io->get_errno())) {
+            case LCBIO_CSERR_INTR:
+                continue;
+
+            case LCBIO_CSERR_CONNECTED:
+                return CONNECT_DONE;
+
+            case LCBIO_CSERR_BUSY:
+                return CONNECT_PENDING;
+
+            case LCBIO_CSERR_EINVAL:
+                if (!retry_once) {
+                    retry_once = true;
+                    continue;
+                }
+                /* fallthrough */
+
+            case LCBIO_CSERR_EFAIL:
+            default:
+                return CONNECT_FAILED;
+        }
+    }
+}
+
 static void E_conncb(lcb_socket_t, short events, void *arg)
 {
     auto *cs = reinterpret_cast<Connstart *>(arg);
     lcbio_SOCKET *s = cs->sock;
     lcbio_TABLE *io = s->io;
-    int retry_once = 0;
-    lcbio_CSERR connstatus;
-    addrinfo *ai = nullptr;
 
 GT_NEXTSOCK:
     if (!cs->ensure_sock()) {
@@ -320,47 +389,22 @@ GT_NEXTSOCK:
                 (int)cs->syserr);
         cs->clear_sock();
         goto GT_NEXTSOCK;
-
-    } else {
-        ai = cs->ai;
-
-    GT_CONNECT:
-        int rv = io->E_connect(s->u.fd, ai->ai_addr, ai->ai_addrlen);
-        if (rv == 0) {
-            cs->unwatch();
-            cs->notify_success();
-            return;
-        }
     }
 
-    connstatus = lcbio_mkcserr(io->get_errno());
-    lcbio_mksyserr(io->get_errno(), &cs->syserr);
-
-    switch (connstatus) {
-
-        case LCBIO_CSERR_INTR:
-            goto GT_CONNECT;
-
-        case LCBIO_CSERR_CONNECTED:
+    switch (E_try_connect(io, s->u.fd, cs->ai, &cs->syserr)) {
+        case CONNECT_DONE:
             cs->unwatch();
             cs->notify_success();
             return;
 
-        case LCBIO_CSERR_BUSY:
+        case CONNECT_PENDING:
             lcb_log(LOGARGS(s, TRACE), CSLOGFMT "Scheduling I/O watcher for asynchronous connection completion.",
                     CSLOGID(s));
             io->E_event_watch(s->u.fd, cs->event, LCB_WRITE_EVENT, cs, E_conncb);
             cs->ev_active = true;
             return;
 
-        case LCBIO_CSERR_EINVAL:
-            if (!retry_once) {
-                retry_once = 1;
-                goto GT_CONNECT;
-            }
-            /* fallthrough */
-
-        case LCBIO_CSERR_EFAIL:
+        case CONNECT_FAILED:
         default:
             /* close the current socket and try again */
             lcb_log(LOGARGS(s, TRACE), CSLOGFMT "connect() failed. errno=%d [%s]", CSLOGID(s), IOT_ERRNO(io),
@@ -447,6 +491,161 @@ GT_CONNECT:
     }
 }
 
+static void E_race_conncb(lcb_socket_t, short events, void *arg)
+{
+    auto *att = reinterpret_cast<Connstart::Attempt *>(arg);
+    Connstart *cs = att->cs;
+    lcbio_SOCKET *s = cs->sock;
+    lcbio_TABLE *io = s->io;
+
+    if (events & LCB_ERROR_EVENT) {
+        socklen_t errlen = sizeof(int);
+        int sockerr = 0;
+        getsockopt(att->fd, SOL_SOCKET, SO_ERROR, (char *)&sockerr, &errlen);
+        lcbio_mksyserr(sockerr, &cs->syserr);
+        lcb_log(LOGARGS(s, TRACE), CSLOGFMT "Received ERROR_EVENT for FD=%d, sockerr=%d", CSLOGID(s), (int)att->fd,
+                sockerr);
+        cs->race_failed(att);
+        return;
+    }
+
+    switch (E_try_connect(io, att->fd, att->ai, &cs->syserr)) {
+        case CONNECT_DONE:
+            cs->race_won(att);
+            return;
+
+        case CONNECT_PENDING:
+            io->E_event_watch(att->fd, att->event, LCB_WRITE_EVENT, att, E_race_conncb);
+            att->ev_active = true;
+            return;
+
+        case CONNECT_FAILED:
+        default:
+            lcb_log(LOGARGS(s, TRACE), CSLOGFMT "connect() failed for FD=%d. errno=%d [%s]", CSLOGID(s), (int)att->fd,
+                    IOT_ERRNO(io), strerror(IOT_ERRNO(io)));
+            cs->race_failed(att);
+            return;
+    }
+}
+
+/**
+ * Order the resolved addresses as recommended by RFC 8305: alternate between
+ * address families, starting with the family of the first address returned by
+ * the resolver.
+ */
+void Connstart::race_start(addrinfo *root)
+{
+    std::vector<addrinfo *> first, second;
+    for (addrinfo *cur = root; cur != nullptr; cur = cur->ai_next) {
+        if (cur->ai_family == root->ai_family) {
+            first.push_back(cur);
+        } else {
+            second.push_back(cur);
+        }
+    }
+    for (size_t ii = 0; ii < first.size() || ii < second.size(); ii++) {
+        if (ii < first.size()) {
+            race_addrs.push_back(first[ii]);
+        }
+        if (ii < second.size()) {
+            race_addrs.push_back(second[ii]);
+        }
+    }
+    race_pos = 0;
+    race_next();
+}
+
+/**
+ * Start a connection attempt to the next address, and schedule the one after
+ * it unless this attempt completes (or fails) first.
+ */
+void Connstart::race_next()
+{
+    lcbio_TABLE *io = sock->io;
+
+    if (state != CS_PENDING) {
+        return;
+    }
+
+    while (race_pos < race_addrs.size()) {
+        addrinfo *cur = race_addrs[race_pos++];
+        lcb_socket_t fd = io->E_socket(cur);
+        if (fd == INVALID_SOCKET) {
+            lcbio_mksyserr(io->get_errno(), &syserr);
+            continue;
+        }
+
+        auto *att = new Attempt{this, cur, fd, io->E_event_create(), false};
+        attempts.push_back(att);
+        lcb_log(LOGARGS_T(DEBUG), CSLOGFMT "Created new socket with FD=%d (attempt %u of %u)", CSLOGID_T(), (int)fd,
+                (unsigned)race_pos, (unsigned)race_addrs.size());
+        if (race_pos < race_addrs.size()) {
+            race_timer.rearm(sock->settings->connect_attempt_delay);
+        }
+        E_race_conncb(-1, LCB_WRITE_EVENT, att);
+        return;
+    }
+
+    if (attempts.empty()) {
+        notify_error(LCB_ERR_CONNECT_ERROR);
+    }
+}
+
+void Connstart::race_won(Attempt *att)
+{
+    race_remove(att, false);
+    sock->u.fd = att->fd;
+    delete att;
+    race_clear();
+    notify_success();
+}
+
+void Connstart::race_failed(Attempt *att)
+{
+    race_remove(att, true);
+    delete att;
+    /* do not wait for the delay if the attempt has already failed */
+    race_timer.cancel();
+    race_next();
+}
+
+void Connstart::race_remove(Attempt *att, bool close_fd)
+{
+    lcbio_TABLE *io = sock->io;
+    for (auto it = attempts.begin(); it != attempts.end(); ++it) {
+        if (*it == att) {
+            attempts.erase(it);
+            break;
+        }
+    }
+    if (att->ev_active) {
+        io->E_event_cancel(att->fd, att->event);
+        att->ev_active = false;
+    }
+    io->E_event_destroy(att->event);
+    if (close_fd) {
+        io->E_close(att->fd);
+    }
+}
+
+/** Abandon all the attempts still in flight */
+void Connstart::race_clear()
+{
+    race_timer.cancel();
+    while (!attempts.empty()) {
+        Attempt *att = attempts.back();
+        race_remove(att, true);
+        delete att;
+    }
+}
+
+static lcbio_RESOLVE_cb resolver = nullptr;
+
+void lcbio_set_resolver(lcbio_RESOLVE_cb resolver_)
+{
+    resolver = resolver_;
+}
+
 ConnectionRequest *lcbio_connect(lcbio_TABLE *iot, lcb_settings *settings, const lcb_host_t *dest, uint32_t timeout,
                                  lcbio_CONNDONE_cb handler, void *arg)
 {
@@ -456,7 +655,8 @@ ConnectionRequest *lcbio_connect(lcbio_TABLE *iot, lcb_settings *settings, const
 Connstart::Connstart(lcbio_TABLE *iot_, lcb_settings *settings_, const lcb_host_t *dest, uint32_t timeout,
                      lcbio_CONNDONE_cb handler_, void *arg)
     : user_handler(handler_), user_arg(arg), sock(nullptr), syserr(0), event(nullptr), ev_active(false),
-      in_uhandler(false), ai_root(nullptr), ai(nullptr), state(CS_PENDING), last_error(LCB_SUCCESS), timer(iot_, this)
+      in_uhandler(false), ai_root(nullptr), ai(nullptr), state(CS_PENDING), last_error(LCB_SUCCESS), timer(iot_, this),
+      race_pos(0), race_timer(iot_, this)
 {
 
     addrinfo hints{};
@@ -496,7 +696,12 @@ Connstart::Connstart(lcbio_TABLE *iot_, lcb_settings *settings_, const lcb_host_
         hints.ai_family = AF_UNSPEC;
     }
 
-    if ((rv = getaddrinfo(dest->host, dest->port, &hints, &ai_root))) {
+    if (resolver) {
+        rv = resolver(dest->host, dest->port, &hints, &ai_root);
+    } else {
+        rv = getaddrinfo(dest->host, dest->port, &hints, &ai_root);
+    }
+    if (rv) {
         const char *errstr = rv != EAI_SYSTEM ? gai_strerror(rv) : "";
         lcb_log(LOGARGS_T(ERR), CSLOGFMT "Couldn't look up %s (%s) [EAI=%d]", CSLOGID_T(), dest->host, errstr, rv);
         notify_error(LCB_ERR_UNKNOWN_HOST);
@@ -504,7 +709,9 @@ Connstart::Connstart(lcbio_TABLE *iot_, lcb_settings *settings_, const lcb_host_
         ai = ai_root;
 
         /** Figure out how to connect */
-        if (iot_->is_E()) {
+        if (iot_->is_E() && settings_->connect_attempt_delay) {
+            race_start(ai_root);
+        } else if (iot_->is_E()) {
             E_conncb(-1, LCB_WRITE_EVENT, this);
         } else {
             C_connect();
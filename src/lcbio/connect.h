@@ -176,6 +176,19 @@ typedef void (*lcbio_CONNDONE_cb)(lcbio_SOCKET *s, void *arg, lcb_STATUS err, lc
 lcbio_pCONNSTART lcbio_connect(lcbio_pTABLE iot, lcb_settings *settings, const lcb_host_t *dest, uint32_t timeout,
                                lcbio_CONNDONE_cb handler, void *arg);
 
+/**
+ * Resolver used by lcbio_connect(), with the signature of getaddrinfo(). The
+ * returned addresses are released with freeaddrinfo().
+ */
+typedef int (*lcbio_RESOLVE_cb)(const char *host, const char *port, const struct addrinfo *hints,
+                                struct addrinfo **res);
+
+/**
+ * Replace the resolver of lcbio_connect(), e.g. so that tests may connect to
+ * several addresses of a single host. NULL restores getaddrinfo().
+ */
+void lcbio_set_resolver(lcbio_RESOLVE_cb resolver);
+
 /**
  * Wraps `lcb_connect()` by traversing a list of hosts. This will cycle through
  * each host in the list until a connection has been successful. Currently
@@ -20,6 +20,7 @@
 #include "timer-ng.h"
 #include "ioutils.h"
 #include <lcbio/ssl.h>
+#include "rdb/poolalloc.h"
 
 #define CTX_FD(ctx) (ctx)->fd
 #define CTX_SD(ctx) (ctx)->sd
@@ -43,6 +44,18 @@ static void err_handler(void *cookie)
     ctx->procs.cb_err(ctx, ctx->err);
 }
 
+/** The pool is created by the first connection which needs it, and shared afterwards */
+static rdb_ALLOCATOR *read_allocator(lcb_settings *settings)
+{
+    if (settings->read_allocator != LCB_READ_ALLOCATOR_POOL) {
+        return settings->allocator_factory();
+    }
+    if (!settings->read_pool) {
+        settings->read_pool = rdb_poolalloc_new(settings->read_pool_class_cap, settings->read_pool_hugepages);
+    }
+    return rdb_poolalloc_ref(settings->read_pool);
+}
+
 static lcb_STATUS convert_lcberr(const lcbio_CTX *ctx, lcbio_IOSTATUS status)
 {
     const lcb_settings *settings = ctx->sock->settings;
@@ -78,7 +91,7 @@ lcbio_CTX *lcbio_ctx_new(lcbio_SOCKET *sock, void *data, const lcbio_CTXPROCS *p
     sock->service = LCBIO_SERVICE_UNSPEC;
     sock->atime = LCB_NS2US(gethrtime());
 
-    rdb_init(&ctx->ior, sock->settings->allocator_factory());
+    rdb_init(&ctx->ior, read_allocator(sock->settings));
     lcbio_ref(sock);
 
     if (IOT_IS_EVENT(ctx->io)) {
@@ -21,6 +21,10 @@
 #include <snappy.h>
 #include <snappy-sinksource.h>
 
+#include <cstdint>
+#include <cstring>
+#include <string>
+
 class FragBufSource : public snappy::Source
 {
   public:
@@ -47,6 +51,11 @@ class FragBufSource : public snappy::Source
 
     const char *Peek(size_t *len) override
     {
+        if (ptr == nullptr) {
+            /* exhausted, the decompressor peeks to detect the end of input */
+            *len = 0;
+            return nullptr;
+        }
         *len = buf->iov[idx].iov_len - static_cast<size_t>((ptr - static_cast<const char *>(buf->iov[idx].iov_base)));
         return ptr;
     }
@@ -168,3 +177,250 @@ int mcreq_inflate_value(const void *compressed, lcb_SIZE ncompressed, const void
     *nbytes = compsize;
     return 0;
 }
+
+/**
+ * Take the buffer of `pool` for an inflated value, unless it is already in
+ * use or the value is too large to be kept, in which case a new buffer is
+ * allocated. Release it with mcreq_inflate_done().
+ */
+static char *inflatebuf_acquire(mc_INFLATEBUF *pool, lcb_SIZE size)
+{
+    if (pool->in_use || size > MCREQ_INFLATEBUF_MAX) {
+        return static_cast<char *>(malloc(size));
+    }
+    if (pool->capacity < size) {
+        /* nothing to preserve: don't let realloc() copy the old contents */
+        free(pool->data);
+        pool->data = static_cast<char *>(malloc(size));
+        pool->capacity = pool->data ? size : 0;
+    }
+    if (pool->data) {
+        pool->in_use = 1;
+    }
+    return pool->data;
+}
+
+int mcreq_inflate_fragments(const lcb_FRAGBUF *compressed, mc_INFLATEBUF *pool, const void **bytes, lcb_SIZE *nbytes,
+                            void **freeptr)
+{
+    uint32_t inflated_size = 0;
+    *freeptr = nullptr;
+    {
+        /* the length header leaves the source unusable for decompression */
+        FragBufSource source(compressed);
+        if (!snappy::GetUncompressedLength(&source, &inflated_size)) {
+            return -1;
+        }
+    }
+
+    if (inflated_size == 0) {
+        *bytes = "";
+        *nbytes = 0;
+        return 0;
+    }
+
+    char *out = inflatebuf_acquire(pool, inflated_size);
+    if (out == nullptr) {
+        return -1;
+    }
+    *freeptr = out;
+
+    FragBufSource source(compressed);
+    if (!snappy::RawUncompress(&source, out)) {
+        mcreq_inflate_done(pool, out);
+        *freeptr = nullptr;
+        return -1;
+    }
+    *bytes = out;
+    *nbytes = inflated_size;
+    return 0;
+}
+
+void mcreq_inflate_done(mc_INFLATEBUF *pool, void *freeptr)
+{
+    if (freeptr == nullptr) {
+        return;
+    }
+    if (freeptr == pool->data && pool->in_use) {
+        pool->in_use = 0;
+    } else {
+        free(freeptr);
+    }
+}
+
+void mcreq_inflatebuf_cleanup(mc_INFLATEBUF *pool)
+{
+    free(pool->data);
+    pool->data = nullptr;
+    pool->capacity = 0;
+    pool->in_use = 0;
+}
+
+static lcb_SIZE snappy_bound(void *, lcb_SIZE nbytes)
+{
+    return snappy::MaxCompressedLength(nbytes);
+}
+
+static lcb_SIZE snappy_encode(void *, const void *in, lcb_SIZE nin, void *out, lcb_SIZE)
+{
+    size_t nout = 0;
+    snappy::RawCompress(static_cast<const char *>(in), nin, static_cast<char *>(out), &nout);
+    return nout;
+}
+
+static int snappy_decode(void *, const void *in, lcb_SIZE nin, void *out, lcb_SIZE nout)
+{
+    size_t inflated_size = 0;
+    if (!snappy::GetUncompressedLength(static_cast<const char *>(in), nin, &inflated_size) || inflated_size != nout) {
+        return -1;
+    }
+    return snappy::RawUncompress(static_cast<const char *>(in), nin, static_cast<char *>(out)) ? 0 : -1;
+}
+
+static const lcb_VALUE_CODEC snappy_codec = {MCREQ_CODEC_SNAPPY, snappy_bound, snappy_encode, snappy_decode, nullptr};
+
+int mcreq_codec_register(mc_CODECTABLE *table, const lcb_VALUE_CODEC *codec)
+{
+    if (codec->id <= MCREQ_CODEC_SNAPPY || !codec->bound || !codec->encode || !codec->decode) {
+        return -1;
+    }
+    for (unsigned ii = 0; ii < table->ncodecs; ii++) {
+        if (table->codecs[ii].id == codec->id) {
+            table->codecs[ii] = *codec;
+            return 0;
+        }
+    }
+    void *codecs = realloc(table->codecs, sizeof(*codec) * (table->ncodecs + 1));
+    if (codecs == nullptr) {
+        return -1;
+    }
+    table->codecs = static_cast<lcb_VALUE_CODEC *>(codecs);
+    table->codecs[table->ncodecs++] = *codec;
+    return 0;
+}
+
+const lcb_VALUE_CODEC *mcreq_codec_find(const mc_CODECTABLE *table, lcb_U8 id)
+{
+    if (id == MCREQ_CODEC_SNAPPY) {
+        return &snappy_codec;
+    }
+    for (unsigned ii = 0; ii < table->ncodecs; ii++) {
+        if (table->codecs[ii].id == id) {
+            return &table->codecs[ii];
+        }
+    }
+    return nullptr;
+}
+
+void mcreq_codecs_cleanup(mc_CODECTABLE *table)
+{
+    free(table->codecs);
+    table->codecs = nullptr;
+    table->ncodecs = 0;
+}
+
+int mcreq_codec_encode_value(mc_PIPELINE *pl, mc_PACKET *pkt, const lcb_VALUE_CODEC *codec, const lcb_VALBUF *vbuf,
+                             lcb_U8 datatype, lcb_settings *settings, int *encoded)
+{
+    const char *input;
+    std::size_t origsize = 0;
+    std::string gathered;
+
+    *encoded = 0;
+    switch (vbuf->vtype) {
+        case LCB_KV_COPY:
+        case LCB_KV_CONTIG:
+            input = static_cast<const char *>(vbuf->u_buf.contig.bytes);
+            origsize = vbuf->u_buf.contig.nbytes;
+            break;
+
+        case LCB_KV_IOV:
+        case LCB_KV_IOVCOPY:
+            for (unsigned int ii = 0; ii < vbuf->u_buf.multi.niov; ii++) {
+                origsize += vbuf->u_buf.multi.iov[ii].iov_len;
+            }
+            if (origsize < settings->value_codec_min_size) {
+                return 0;
+            }
+            /* codecs work on contiguous input */
+            gathered.reserve(origsize);
+            for (unsigned int ii = 0; ii < vbuf->u_buf.multi.niov; ii++) {
+                gathered.append(static_cast<const char *>(vbuf->u_buf.multi.iov[ii].iov_base),
+                                vbuf->u_buf.multi.iov[ii].iov_len);
+            }
+            input = gathered.data();
+            break;
+
+        default:
+            return -1;
+    }
+    if (origsize == 0 || origsize < settings->value_codec_min_size || origsize > UINT32_MAX) {
+        return 0;
+    }
+
+    std::size_t maxsize = MCREQ_CODEC_HDRSIZE + codec->bound(codec->cookie, origsize);
+    if (mcreq_reserve_value2(pl, pkt, maxsize) != LCB_SUCCESS) {
+        return -1;
+    }
+    nb_SPAN *outspan = &pkt->u_value.single;
+    char *out = SPAN_BUFFER(outspan);
+    std::size_t encsize = MCREQ_CODEC_HDRSIZE + codec->encode(codec->cookie, input, origsize, out + MCREQ_CODEC_HDRSIZE,
+                                                              maxsize - MCREQ_CODEC_HDRSIZE);
+    if (encsize == MCREQ_CODEC_HDRSIZE || encsize > maxsize ||
+        ((float)encsize / origsize) > settings->compress_min_ratio) {
+        netbuf_mblock_release(&pl->nbmgr, outspan);
+        outspan->size = 0;
+        pkt->flags &= ~MCREQ_F_HASVALUE;
+        return 0;
+    }
+
+    memcpy(out, MCREQ_CODEC_MAGIC, 4);
+    out[4] = static_cast<char>(codec->id);
+    out[5] = (datatype & LCB_VALUE_F_JSON) ? MCREQ_CODEC_F_JSON : 0;
+    for (int ii = 0; ii < 4; ii++) {
+        out[6 + ii] = static_cast<char>((origsize >> (24 - 8 * ii)) & 0xff);
+    }
+    if (encsize < maxsize) {
+        nb_SPAN trailspan = *outspan;
+        trailspan.offset += encsize;
+        trailspan.size = maxsize - encsize;
+        netbuf_mblock_release(&pl->nbmgr, &trailspan);
+        outspan->size = encsize;
+    }
+    *encoded = 1;
+    return 0;
+}
+
+int mcreq_codec_decode_value(const mc_CODECTABLE *table, mc_INFLATEBUF *pool, const void **bytes, lcb_SIZE *nbytes,
+                             void **freeptr, lcb_U8 *datatype)
+{
+    const unsigned char *in = static_cast<const unsigned char *>(*bytes);
+    if (*nbytes < MCREQ_CODEC_HDRSIZE || memcmp(in, MCREQ_CODEC_MAGIC, 4) != 0) {
+        return 0;
+    }
+    const lcb_VALUE_CODEC *codec = mcreq_codec_find(table, in[4]);
+    if (codec == nullptr || (in[5] & ~MCREQ_CODEC_F_JSON) != 0) {
+        return 0;
+    }
+    lcb_SIZE origsize = ((lcb_SIZE)in[6] << 24) | ((lcb_SIZE)in[7] << 16) | ((lcb_SIZE)in[8] << 8) | in[9];
+    if (origsize == 0) {
+        return 0;
+    }
+
+    char *out = inflatebuf_acquire(pool, origsize);
+    if (out == nullptr) {
+        return 0;
+    }
+    if (codec->decode(codec->cookie, in + MCREQ_CODEC_HDRSIZE, *nbytes - MCREQ_CODEC_HDRSIZE, out, origsize) != 0) {
+        mcreq_inflate_done(pool, out);
+        return 0;
+    }
+    mcreq_inflate_done(pool, *freeptr);
+    *freeptr = out;
+    *bytes = out;
+    *nbytes = origsize;
+    if (in[5] & MCREQ_CODEC_F_JSON) {
+        *datatype |= LCB_VALUE_F_JSON;
+    }
+    return 1;
+}
@@ -24,6 +24,44 @@
 extern "C" {
 #endif
 
+/** Inflated values up to this size keep their buffer for the next response */
+#define MCREQ_INFLATEBUF_MAX (16 * 1024 * 1024)
+
+/**
+ * Output buffer reused to inflate received values, so that decompressing a
+ * response doesn't need an allocation of its own.
+ */
+typedef struct {
+    char *data;
+    lcb_SIZE capacity;
+    /** Set while an inflated value is handed to the user */
+    int in_use;
+} mc_INFLATEBUF;
+
+/**
+ * Client-side codecs (see lcb_VALUE_CODEC) registered on an instance, looked
+ * up by the tag of the values they encoded. The built-in Snappy codec is not
+ * part of the table.
+ */
+typedef struct {
+    lcb_VALUE_CODEC *codecs;
+    unsigned ncodecs;
+} mc_CODECTABLE;
+
+/**
+ * Values encoded by a client-side codec begin with this header: a magic
+ * (MCREQ_CODEC_MAGIC), the ID of the codec, flags (MCREQ_CODEC_F_*) and the
+ * size of the original value (32 bit, network order).
+ */
+#define MCREQ_CODEC_HDRSIZE 10
+#define MCREQ_CODEC_MAGIC "\x89LCZ"
+
+/** The original value was JSON (the server only sees a binary value) */
+#define MCREQ_CODEC_F_JSON 0x01
+
+/** ID of the built-in codec, which is Snappy in its raw format */
+#define MCREQ_CODEC_SNAPPY 1
+
 /**
  * Stores a compressed payload into a packet
  * @param pl The pipeline which hosts the packet
@@ -50,6 +88,82 @@ int mcreq_compress_value(mc_PIPELINE *pl, mc_PACKET *pkt, const lcb_VALBUF *vbuf
 int mcreq_inflate_value(const void *compressed, lcb_SIZE ncompressed, const void **bytes, lcb_SIZE *nbytes,
                         void **freeptr);
 
+/**
+ * Inflate a compressed value which may span several buffers, e.g. the
+ * segments it was read into.
+ *
+ * The value is inflated into the buffer of `pool` unless it is already in
+ * use (or the value is too large to be kept), in which case a new buffer is
+ * allocated.
+ *
+ * @param compressed The fragments of the value to inflate
+ * @param pool The reusable output buffer
+ * @param[out] bytes The inflated value
+ * @param[out] nbytes The size of the inflated value
+ * @param[out] freeptr set to the buffer holding the inflated value, to be
+ * passed to mcreq_inflate_done() once it is no longer required
+ * @return 0 if successful, nonzero on error.
+ */
+int mcreq_inflate_fragments(const lcb_FRAGBUF *compressed, mc_INFLATEBUF *pool, const void **bytes, lcb_SIZE *nbytes,
+                            void **freeptr);
+
+/** Release the buffer of a value inflated with mcreq_inflate_fragments() */
+void mcreq_inflate_done(mc_INFLATEBUF *pool, void *freeptr);
+
+/** Free the memory held by the buffer */
+void mcreq_inflatebuf_cleanup(mc_INFLATEBUF *pool);
+
+/**
+ * Add a codec to the table, replacing the one with the same ID
+ * @return 0 if successful, nonzero if the codec is incomplete or uses a
+ * reserved ID.
+ */
+int mcreq_codec_register(mc_CODECTABLE *table, const lcb_VALUE_CODEC *codec);
+
+/** @return the codec with the given ID, or NULL if it is not known */
+const lcb_VALUE_CODEC *mcreq_codec_find(const mc_CODECTABLE *table, lcb_U8 id);
+
+/** Free the memory held by the table */
+void mcreq_codecs_cleanup(mc_CODECTABLE *table);
+
+/**
+ * Encode the value of a packet with a client-side codec, if it is at least
+ * `settings->value_codec_min_size` bytes and shrinks to
+ * `settings->compress_min_ratio` or better.
+ *
+ * @param pl The pipeline which hosts the packet
+ * @param pkt The packet which hosts the value
+ * @param codec The codec to use
+ * @param vbuf The user input to be encoded
+ * @param datatype The datatype of the input (LCB_VALUE_F_JSON is kept in the
+ * header, so that it is restored when the value is decoded)
+ * @param settings The instance settings
+ * @param[out] encoded set to nonzero if the value of the packet was reserved
+ * and encoded. Otherwise nothing is reserved, and the value should be stored
+ * as usual.
+ * @return 0 if successful, nonzero on error.
+ */
+int mcreq_codec_encode_value(mc_PIPELINE *pl, mc_PACKET *pkt, const lcb_VALUE_CODEC *codec, const lcb_VALBUF *vbuf,
+                             lcb_U8 datatype, lcb_settings *settings, int *encoded);
+
+/**
+ * Decode a value if it was encoded by a known client-side codec. Values
+ * without the header, tagged with an unknown codec, or which fail to decode
+ * (a plain value may begin with the magic) are left as they are.
+ *
+ * @param table The codecs of the instance
+ * @param pool The reusable output buffer
+ * @param[in/out] bytes The value, replaced with the decoded one
+ * @param[in/out] nbytes The size of the value
+ * @param[in/out] freeptr Buffer of the value, as set by
+ * mcreq_inflate_fragments(). If the value is decoded, it is released and
+ * replaced with the buffer of the decoded value.
+ * @param[in/out] datatype LCB_VALUE_F_JSON is added if the decoded value is JSON
+ * @return nonzero if the value was decoded, 0 if it was left as it is.
+ */
+int mcreq_codec_decode_value(const mc_CODECTABLE *table, mc_INFLATEBUF *pool, const void **bytes, lcb_SIZE *nbytes,
+                             void **freeptr, lcb_U8 *datatype);
+
 #ifdef __cplusplus
 }
 #endif
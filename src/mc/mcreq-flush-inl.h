@@ -23,6 +23,8 @@ extern "C" {
 typedef struct {
     mc_PIPELINE *pl;
     hrtime_t now;
+    /** Set when the pipeline has metrics, to timestamp the flushed packets */
+    hrtime_t flushed;
 } mc__FLUSHINFO;
 
 /**
@@ -61,6 +63,7 @@ static nb_SIZE mcreq__pktflush_callback(void *p, nb_SIZE hint, void *arg)
 
     /** Packet is flushed */
     pkt->flags |= MCREQ_F_FLUSHED;
+    pkt->stages.sent = info->flushed;
 
     if (pkt->flags & MCREQ_F_INVOKED) {
         mcreq_packet_done(info->pl, pkt);
@@ -89,7 +92,10 @@ static nb_SIZE mcreq__pktflush_callback(void *p, nb_SIZE hint, void *arg)
 static void mcreq_flush_done_ex(mc_PIPELINE *pl, unsigned nflushed, unsigned expected, lcb_U64 now)
 {
     if (nflushed) {
-        mc__FLUSHINFO info = {pl, now};
+        mc__FLUSHINFO info = {pl, now, 0};
+        if (pl->metrics) {
+            info.flushed = now ? now : gethrtime();
+        }
         netbuf_end_flush2(&pl->nbmgr, nflushed, mcreq__pktflush_callback, offsetof(mc_PACKET, sl_flushq), &info);
     }
     if (nflushed < expected) {
@@ -243,9 +243,94 @@ void mcreq_reenqueue_packet(mc_PIPELINE *pipeline, mc_PACKET *packet)
     sllist_insert_sorted(reqs, &packet->slnode, pkt_tmo_compar);
 }
 
+static lcb_SIZE packet_nbytes(const mc_PACKET *packet)
+{
+    lcb_SIZE nbytes = packet->kh_span.size;
+    if (packet->flags & MCREQ_F_HASVALUE) {
+        if (packet->flags & MCREQ_F_VALUE_IOV) {
+            nbytes += packet->u_value.multi.total_length;
+        } else {
+            nbytes += packet->u_value.single.size;
+        }
+    }
+    return nbytes;
+}
+
+static void packet_admit(mc_PIPELINE *pipeline, mc_PACKET *packet)
+{
+    mc_CMDQUEUE *cq = pipeline->parent;
+    lcb_SIZE nbytes;
+
+    if (packet->flags & MCREQ_F_ADMITTED) {
+        return;
+    }
+    nbytes = packet_nbytes(packet);
+    packet->flags |= MCREQ_F_ADMITTED;
+    pipeline->admitted_ops++;
+    pipeline->admitted_bytes += nbytes;
+    if (cq) {
+        cq->admit.ops++;
+        cq->admit.bytes += nbytes;
+    }
+}
+
+#define ADMIT_LOWAT(limit) ((limit) - (limit) / 4)
+#define ADMIT_OVER(cur, limit) ((limit) && (cur) >= (limit))
+#define ADMIT_DRAINED(cur, limit) (!(limit) || (cur) <= ADMIT_LOWAT(limit))
+
+static void packet_unadmit(mc_PIPELINE *pipeline, mc_PACKET *packet)
+{
+    mc_CMDQUEUE *cq;
+    lcb_SIZE nbytes;
+
+    if (!(packet->flags & MCREQ_F_ADMITTED)) {
+        /* Never counted, or detached (which may be wiped without a pipeline) */
+        return;
+    }
+    cq = pipeline->parent;
+    nbytes = packet_nbytes(packet);
+    packet->flags &= ~MCREQ_F_ADMITTED;
+    pipeline->admitted_ops--;
+    pipeline->admitted_bytes -= nbytes;
+    if (!cq) {
+        return;
+    }
+    cq->admit.ops--;
+    cq->admit.bytes -= nbytes;
+
+    if (cq->admit.blocked && ADMIT_DRAINED(pipeline->admitted_ops, cq->admit.max_pipeline_ops) &&
+        ADMIT_DRAINED(pipeline->admitted_bytes, cq->admit.max_pipeline_bytes) &&
+        ADMIT_DRAINED(cq->admit.ops, cq->admit.max_ops) && ADMIT_DRAINED(cq->admit.bytes, cq->admit.max_bytes)) {
+        cq->admit.blocked = 0;
+        if (cq->admit.ready) {
+            cq->admit.ready(cq);
+        }
+    }
+}
+
+lcb_STATUS mcreq_admission_check(mc_CMDQUEUE *queue, mc_PIPELINE *pipeline)
+{
+    if (pipeline->circuit_open) {
+        MC_INCR_METRIC(pipeline, circuit_rejected, 1);
+        return LCB_ERR_CIRCUIT_OPEN;
+    }
+    if (ADMIT_OVER(pipeline->admitted_ops, queue->admit.max_pipeline_ops) ||
+        ADMIT_OVER(pipeline->admitted_bytes, queue->admit.max_pipeline_bytes) ||
+        ADMIT_OVER(queue->admit.ops, queue->admit.max_ops) || ADMIT_OVER(queue->admit.bytes, queue->admit.max_bytes)) {
+        queue->admit.blocked = 1;
+        MC_INCR_METRIC(pipeline, packets_rejected, 1);
+        return LCB_ERR_BACKPRESSURE;
+    }
+    return LCB_SUCCESS;
+}
+
 void mcreq_enqueue_packet(mc_PIPELINE *pipeline, mc_PACKET *packet)
 {
     nb_SPAN *vspan = &packet->u_value.single;
+    packet_admit(pipeline, packet);
+    if (pipeline->metrics) {
+        packet->stages.queued = gethrtime();
+    }
     sllist_append(&pipeline->requests, &packet->slnode);
     netbuf_enqueue_span(&pipeline->nbmgr, &packet->kh_span, packet);
     MC_INCR_METRIC(pipeline, bytes_queued, packet->kh_span.size);
@@ -273,6 +358,7 @@ GT_ENQUEUE_PDU:
 
 void mcreq_wipe_packet(mc_PIPELINE *pipeline, mc_PACKET *packet)
 {
+    packet_unadmit(pipeline, packet);
     if (!(packet->flags & MCREQ_F_KEY_NOCOPY)) {
         if (packet->flags & MCREQ_F_DETACHED) {
             free(SPAN_BUFFER(&packet->kh_span));
@@ -319,6 +405,7 @@ mc_PACKET *mcreq_allocate_packet(mc_PIPELINE *pipeline)
     ret->opaque = pipeline->parent->seq++;
     ret->u_rdata.reqdata.span = NULL;
     ret->u_rdata.reqdata.deadline = 0;
+    memset(&ret->stages, 0, sizeof(ret->stages));
     return ret;
 }
 
@@ -362,12 +449,13 @@ mc_PACKET *mcreq_renew_packet(const mc_PACKET *src)
     memcpy(kdata, SPAN_BUFFER(&src->kh_span), src->kh_span.size);
     CREATE_STANDALONE_SPAN(&dst->kh_span, kdata, src->kh_span.size);
 
-    dst->flags &= ~(MCREQ_F_KEY_NOCOPY | MCREQ_F_VALUE_NOCOPY | MCREQ_F_VALUE_IOV);
+    dst->flags &= ~(MCREQ_F_KEY_NOCOPY | MCREQ_F_VALUE_NOCOPY | MCREQ_F_VALUE_IOV | MCREQ_F_ADMITTED);
     dst->flags |= MCREQ_F_DETACHED;
     dst->alloc_parent = NULL;
     dst->sl_flushq.next = NULL;
     dst->slnode.next = NULL;
     dst->retries = src->retries;
+    memset(&dst->stages, 0, sizeof(dst->stages));
 
     if (src->flags & MCREQ_F_HASVALUE) {
         /** Get the length */
@@ -515,7 +603,11 @@ lcb_STATUS mcreq_basic_packet(mc_CMDQUEUE *queue, const lcb_KEYBUF *key, uint32_
 
     mcreq_map_key(queue, key, sizeof(*req) + extlen + ffextlen, &vb, &srvix);
     if (srvix > -1 && srvix < (int)queue->npipelines) {
+        lcb_STATUS rc;
         *pipeline = queue->pipelines[srvix];
+        if ((rc = mcreq_admission_check(queue, *pipeline)) != LCB_SUCCESS) {
+            return rc;
+        }
 
     } else {
         if ((options & MCREQ_BASICPACKET_F_FALLBACKOK) && queue->fallback) {
@@ -713,6 +805,9 @@ int mcreq_pipeline_init(mc_PIPELINE *pipeline)
     netbuf_init(&pipeline->reqpool, &settings);
 
     pipeline->metrics = NULL;
+    pipeline->admitted_ops = 0;
+    pipeline->admitted_bytes = 0;
+    pipeline->circuit_open = 0;
     return 0;
 }
 
@@ -758,6 +853,7 @@ int mcreq_queue_init(mc_CMDQUEUE *queue)
     queue->scheds = NULL;
     queue->fallback = NULL;
     queue->npipelines = 0;
+    memset(&queue->admit, 0, sizeof(queue->admit));
     return 0;
 }
 
@@ -846,6 +942,7 @@ void mcreq_sched_add(mc_PIPELINE *pipeline, mc_PACKET *pkt)
         cq->scheds[pipeline->index] = 1;
     }
     sllist_append(&pipeline->ctxqueued, &pkt->slnode);
+    packet_admit(pipeline, pkt);
     mcreq_rearm_timeout(pipeline);
 }
 
@@ -1012,7 +1109,8 @@ static void noop_dumpfn(const void *d, unsigned n, FILE *fp)
     X(UFWD)                                                                                                            \
     X(FLUSHED)                                                                                                         \
     X(INVOKED)                                                                                                         \
-    X(DETACHED)
+    X(DETACHED)                                                                                                        \
+    X(ADMITTED)
 
 void mcreq_dump_packet(const mc_PACKET *packet, FILE *fp, mcreq_payload_dump_fn dumpfn)
 {
@@ -294,7 +294,13 @@ typedef enum {
      * The request has "replace" store semantics.
      * Utilized during error translation to map DOCUMENT_EXISTS to CAS_MISMATCH (see make_error() in handler.cc)
      */
-    MCREQ_F_REPLACE_SEMANTICS = 1u << 11u
+    MCREQ_F_REPLACE_SEMANTICS = 1u << 11u,
+
+    /**
+     * The packet is counted towards the admission totals of the pipeline
+     * it is scheduled on. See mcreq_admission_check()
+     */
+    MCREQ_F_ADMITTED = 1u << 12u
 } mcreq_flags;
 
 /** @brief mask of flags indicating user-allocated buffers */
@@ -320,6 +326,17 @@ union mc_USER {
     mc_REQDATAEX *exdata;
 };
 
+/**
+ * Times at which a packet went through the stages of its lifecycle, other
+ * than scheduling (mc_REQDATA#start) and dispatching its response. Only
+ * recorded when the pipeline has metrics, zero otherwise.
+ */
+typedef struct {
+    hrtime_t queued;   /**< Placed in the send queue of the pipeline */
+    hrtime_t sent;     /**< Completely written to the socket */
+    hrtime_t received; /**< First byte of the response read from the socket */
+} mc_PKTSTAGES;
+
 /**
  * @brief Packet structure for a single Memcached command
  *
@@ -359,6 +376,9 @@ typedef struct mc_packet_st {
     /** Value data */
     union mc_VALUE u_value;
 
+    /** Lifecycle timestamps */
+    mc_PKTSTAGES stages;
+
     /** Allocation data for the PACKET structure itself */
     nb_MBLOCK *alloc_parent;
 } mc_PACKET;
@@ -426,6 +446,15 @@ typedef struct mc_pipeline_st {
 
     /** Optional metrics structure for server */
     struct lcb_SERVERMETRICS_st *metrics;
+
+    /** Number of packets scheduled on this pipeline which are not yet done */
+    unsigned admitted_ops;
+
+    /** Number of bytes held by those packets */
+    lcb_SIZE admitted_bytes;
+
+    /** Set while the server's circuit breaker rejects new packets */
+    int circuit_open;
 } mc_PIPELINE;
 
 typedef struct mc_cmdqueue_st {
@@ -461,6 +490,24 @@ typedef struct mc_cmdqueue_st {
     /**Special pipeline used to contain orphaned packets within a scheduling
      * context. This field is used by mcreq_set_fallback_handler() */
     mc_PIPELINE *fallback;
+
+    /** Admission control. Limits of zero mean unlimited */
+    struct {
+        unsigned max_pipeline_ops;
+        lcb_SIZE max_pipeline_bytes;
+        unsigned max_ops;
+        lcb_SIZE max_bytes;
+
+        /** Totals across all pipelines */
+        unsigned ops;
+        lcb_SIZE bytes;
+
+        /** Set when a packet was rejected, cleared once usage drains */
+        int blocked;
+
+        /** Invoked once usage drains below the low watermark after a rejection */
+        void (*ready)(struct mc_cmdqueue_st *);
+    } admit;
 } mc_CMDQUEUE;
 
 /**
@@ -605,6 +652,23 @@ lcb_STATUS mcreq_reserve_value2(mc_PIPELINE *pipeline, mc_PACKET *packet, lcb_si
  */
 void mcreq_enqueue_packet(mc_PIPELINE *pipeline, mc_PACKET *packet);
 
+/**
+ * Check whether a new packet may be scheduled on the given pipeline without
+ * exceeding the admission limits (`queue->admit`) of the pipeline or of the
+ * whole queue.
+ *
+ * Packets are counted from the moment they are passed to mcreq_sched_add()
+ * (or mcreq_enqueue_packet()) until they are wiped. Once a packet has been
+ * rejected, `queue->admit.ready` is invoked when usage falls back below
+ * three quarters of the limits.
+ *
+ * Packets are also rejected while the pipeline's circuit breaker is open
+ * (`pipeline->circuit_open`).
+ *
+ * @return LCB_SUCCESS, LCB_ERR_BACKPRESSURE or LCB_ERR_CIRCUIT_OPEN
+ */
+lcb_STATUS mcreq_admission_check(mc_CMDQUEUE *queue, mc_PIPELINE *pipeline);
+
 /**
  * Like enqueue packet, except it will also inspect the packet's timeout field
  * and if necessary, restructure the command inside the request list so that
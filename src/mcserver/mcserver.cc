@@ -263,6 +263,11 @@ bool Server::handle_unknown_collection(MemcachedResponse &resp, mc_PACKET *oldpk
         return false;
     }
 
+    if (settings->collections_prefetch) {
+        /* the manifest changed; refresh all the collections at once */
+        collcache_prefetch_manifest(instance);
+    }
+
     if (req.request.opcode == PROTOCOL_BINARY_CMD_COLLECTIONS_GET_CID) {
         mc_PACKET *newpkt = mcreq_renew_packet(oldpkt);
         newpkt->flags &= ~MCREQ_STATE_FLAGS;
@@ -446,6 +451,32 @@ static bool is_warmup_issue(uint16_t status)
     return status == PROTOCOL_BINARY_RESPONSE_NO_BUCKET || status == PROTOCOL_BINARY_RESPONSE_NOT_INITIALIZED;
 }
 
+/* Statuses with which a responsive node tells us it cannot keep up */
+static bool is_overload_status(uint16_t status)
+{
+    return status == PROTOCOL_BINARY_RESPONSE_ETMPFAIL || status == PROTOCOL_BINARY_RESPONSE_EBUSY ||
+           status == PROTOCOL_BINARY_RESPONSE_ENOMEM;
+}
+
+#define DO_ASSIGN_PAYLOAD()                                                                                            \
+    rdb_consumed(ior, mcresp.hdrsize());                                                                               \
+    if (mcresp.bodylen()) {                                                                                            \
+        mcresp.payload = rdb_get_consolidated(ior, mcresp.bodylen());                                                  \
+    }                                                                                                                  \
+    {
+
+#define DO_SWALLOW_PAYLOAD()                                                                                           \
+    }                                                                                                                  \
+    if (mcresp.bodylen()) {                                                                                            \
+        rdb_consumed(ior, mcresp.bodylen());                                                                           \
+    }
+
+/* STAT replies carrying a key are intermediate; the request stays queued */
+static bool is_last_response(const MemcachedResponse &mcresp)
+{
+    return !(mcresp.opcode() == PROTOCOL_BINARY_CMD_STAT && mcresp.keylen() != 0);
+}
+
 /* This function is called within a loop to process a single packet.
  *
  * If a full packet is available, it will process the packet and return
@@ -459,7 +490,8 @@ Server::ReadState Server::try_read(lcbio_CTX *ctx, rdb_IOROPE *ior)
 {
     MemcachedResponse mcresp;
     mc_PACKET *request;
-    unsigned pktsize = 24, is_last = 1;
+    unsigned pktsize = 24;
+    bool is_last;
 
 #define RETURN_NEED_MORE(n)                                                                                            \
     if (has_pending()) {                                                                                               \
@@ -467,40 +499,217 @@ Server::ReadState Server::try_read(lcbio_CTX *ctx, rdb_IOROPE *ior)
     }                                                                                                                  \
     return PKT_READ_PARTIAL
 
-#define DO_ASSIGN_PAYLOAD()                                                                                            \
-    rdb_consumed(ior, mcresp.hdrsize());                                                                               \
-    if (mcresp.bodylen()) {                                                                                            \
-        mcresp.payload = rdb_get_consolidated(ior, mcresp.bodylen());                                                  \
-    }                                                                                                                  \
-    {
-
-#define DO_SWALLOW_PAYLOAD()                                                                                           \
-    }                                                                                                                  \
-    if (mcresp.bodylen()) {                                                                                            \
-        rdb_consumed(ior, mcresp.bodylen());                                                                           \
-    }
-
     if (rdb_get_nused(ior) < pktsize) {
         RETURN_NEED_MORE(pktsize);
     }
 
-    MC_INCR_METRIC(this, packets_read, 1);
-
     /* copy bytes into the info structure */
     rdb_copyread(ior, mcresp.hdrbytes(), mcresp.hdrsize());
 
     pktsize += mcresp.bodylen();
     if (rdb_get_nused(ior) < pktsize) {
+        if (pktsize > ior->rdsize && !inflates_fragmented(mcresp)) {
+            reserve_contig(ior, pktsize);
+        }
         RETURN_NEED_MORE(pktsize);
     }
+#undef RETURN_NEED_MORE
+
+    MC_INCR_METRIC(this, packets_read, 1);
 
     /* Find the packet */
-    if (mcresp.opcode() == PROTOCOL_BINARY_CMD_STAT && mcresp.keylen() != 0) {
-        is_last = 0;
-        request = mcreq_pipeline_find(this, mcresp.opaque());
-    } else {
-        is_last = 1;
+    is_last = is_last_response(mcresp);
+    if (is_last) {
         request = mcreq_pipeline_remove(this, mcresp.opaque());
+    } else {
+        request = mcreq_pipeline_find(this, mcresp.opaque());
+    }
+    return handle_read(ior, mcresp, request, is_last);
+}
+
+/**
+ * A large response was only partially received. Rather than letting the rest
+ * of it spread over several segments, which would later be consolidated by
+ * copying the whole value, move what was received so far into a segment large
+ * enough for the entire packet so that the body is read into place.
+ */
+void Server::reserve_contig(rdb_IOROPE *ior, unsigned pktsize)
+{
+    unsigned ncopied = rdb_reserve_contig(ior, pktsize);
+    if (ncopied) {
+        MC_INCR_METRIC(this, packets_contig_reserved, 1);
+        MC_INCR_METRIC(this, bytes_consolidate_avoided, pktsize - ncopied);
+    }
+}
+
+/**
+ * Number of frames handled by a single pass of try_read_batch(). Bounded so
+ * that the per-frame state fits on the stack and the opaque matching stays
+ * cheap.
+ */
+#define MCSERVER_READ_BATCH 32
+
+#if defined(__GNUC__) || defined(__clang__)
+#define MCSERVER_PREFETCH(addr) __builtin_prefetch(addr)
+#else
+#define MCSERVER_PREFETCH(addr) (void)(addr)
+#endif
+
+/**
+ * Frames which are completely contained within the first segment of the read
+ * rope. The header fields needed to locate the requests are kept in parallel
+ * arrays so the lookup pass only touches what it compares.
+ */
+struct lcb::ReadBatch {
+    unsigned nframes;
+    /** Index of the next frame to dispatch */
+    unsigned next;
+    uint32_t opaque[MCSERVER_READ_BATCH];
+    bool is_last[MCSERVER_READ_BATCH];
+    mc_PACKET *request[MCSERVER_READ_BATCH];
+    /** Whether the lookup pass removed request[i] from the pipeline */
+    bool removed[MCSERVER_READ_BATCH];
+};
+
+/**
+ * Process all complete frames within the first rope segment at once.
+ *
+ * The headers are parsed straight out of the contiguous segment (no
+ * rdb_copyread()), and the pending requests for all of them are resolved in a
+ * single walk of the request list rather than one walk per response, which
+ * matters with unordered execution where replies rarely arrive at the head of
+ * the list. The responses are then dispatched in order exactly as try_read()
+ * would have dispatched them.
+ *
+ * If fewer than two frames are available this falls back to try_read(), which
+ * also handles frames split across segments.
+ */
+Server::ReadState Server::try_read_batch(lcbio_CTX *ctx, rdb_IOROPE *ior)
+{
+    ReadBatch batch;
+    unsigned contig = rdb_get_contigsize(ior);
+    const char *buf;
+    unsigned offset = 0;
+
+    if (contig < 48) {
+        return try_read(ctx, ior);
+    }
+
+    buf = rdb_refread(ior);
+    batch.nframes = 0;
+    batch.next = 0;
+    while (batch.nframes < MCSERVER_READ_BATCH && offset + 24 <= contig) {
+        MemcachedResponse mcresp;
+        memcpy(mcresp.hdrbytes(), buf + offset, mcresp.hdrsize());
+        unsigned pktsize = 24 + mcresp.bodylen();
+        if (offset + pktsize > contig) {
+            break;
+        }
+        unsigned ix = batch.nframes++;
+        batch.opaque[ix] = mcresp.opaque();
+        batch.is_last[ix] = is_last_response(mcresp);
+        batch.request[ix] = nullptr;
+        batch.removed[ix] = false;
+        offset += pktsize;
+    }
+
+    if (batch.nframes < 2) {
+        return try_read(ctx, ior);
+    }
+
+    /* Resolve the requests for every frame with one pass over the list. The
+     * frames are matched in order, so a request stops matching once its final
+     * reply has been seen, just like consecutive mcreq_pipeline_remove() calls */
+    unsigned nunresolved = batch.nframes;
+    sllist_iterator iter;
+    SLLIST_ITERFOR(&requests, &iter)
+    {
+        mc_PACKET *pkt = SLLIST_ITEM(iter.cur, mc_PACKET, slnode);
+        for (unsigned ii = 0; ii < batch.nframes; ii++) {
+            if (batch.request[ii] || batch.opaque[ii] != pkt->opaque) {
+                continue;
+            }
+            batch.request[ii] = pkt;
+            nunresolved--;
+            if (batch.is_last[ii]) {
+                batch.removed[ii] = true;
+                sllist_iter_remove(&requests, &iter);
+                break;
+            }
+        }
+        if (!nunresolved) {
+            break;
+        }
+    }
+
+    /* Until they are dispatched, the requests removed above are only known
+     * to the batch. A callback failing or relocating the pending commands
+     * gets them back through release_read_batch() */
+    ReadState rdstate = PKT_READ_COMPLETE;
+    read_batch = &batch;
+    for (unsigned ii = 0; ii < batch.nframes; ii++) {
+        /* Warm up the requests of the next frames while this one is handled:
+         * the packet two frames ahead, and the header of the next one, whose
+         * packet was prefetched by the previous iteration */
+        if (ii + 2 < batch.nframes && batch.request[ii + 2]) {
+            MCSERVER_PREFETCH(batch.request[ii + 2]);
+        }
+        if (ii + 1 < batch.nframes && batch.request[ii + 1]) {
+            MCSERVER_PREFETCH(SPAN_BUFFER(&batch.request[ii + 1]->kh_span));
+        }
+
+        MemcachedResponse mcresp;
+        memcpy(mcresp.hdrbytes(), rdb_refread(ior), mcresp.hdrsize());
+        lcb_assert(mcresp.opaque() == batch.opaque[ii]);
+        MC_INCR_METRIC(this, packets_read, 1);
+
+        batch.next = ii + 1;
+        rdstate = handle_read(ior, mcresp, batch.request[ii], batch.is_last[ii]);
+        if (rdstate != PKT_READ_COMPLETE || state != S_CLEAN) {
+            break;
+        }
+    }
+
+    /* If dispatch stopped early, the remaining frames are either read by the
+     * regular path or failed along with the rest of the pipeline */
+    release_read_batch();
+    read_batch = nullptr;
+    return rdstate;
+}
+
+void Server::release_read_batch()
+{
+    ReadBatch *batch = read_batch;
+    if (batch == nullptr) {
+        return;
+    }
+    /* Prepend in reverse, so that the requests keep their original order */
+    for (unsigned ii = batch->nframes; ii > batch->next; ii--) {
+        if (batch->removed[ii - 1]) {
+            mc_PACKET *pkt = batch->request[ii - 1];
+            pkt->slnode.next = nullptr;
+            sllist_prepend(&requests, &pkt->slnode);
+        }
+    }
+    batch->nframes = batch->next;
+}
+
+/**
+ * Handle a single response whose header is in `mcresp` and whose full body is
+ * available at the beginning of `ior`. `request` is the packet matching the
+ * response's opaque (if any); it has already been removed from the pipeline if
+ * `is_last` is set.
+ */
+Server::ReadState Server::handle_read(rdb_IOROPE *ior, MemcachedResponse &mcresp, mc_PACKET *request, bool is_last)
+{
+    unsigned pktsize = 24 + mcresp.bodylen();
+
+    if (metrics) {
+        if (request) {
+            request->stages.received = unconsumed_ts;
+        }
+        /* the next response was read at the latest with the current read */
+        unconsumed_ts = read_ts;
     }
 
     if (!request) {
@@ -537,6 +746,7 @@ Server::ReadState Server::try_read(lcbio_CTX *ctx, rdb_IOROPE *ior)
     int unknown_err_rv;
 
     auto status = static_cast<protocol_binary_response_status>(mcresp.status());
+    breaker_record(!is_overload_status(status));
     if (is_warmup_issue(status)) {
         DO_ASSIGN_PAYLOAD()
         mc_PACKET *newpkt = mcreq_renew_packet(request);
@@ -584,10 +794,15 @@ Server::ReadState Server::try_read(lcbio_CTX *ctx, rdb_IOROPE *ior)
 
     /* Figure out if the request is 'ufwd' or not */
     if (!(request->flags & MCREQ_F_UFWD)) {
-        DO_ASSIGN_PAYLOAD()
+        rdb_consumed(ior, mcresp.hdrsize());
+        if (!assign_fragmented_value(ior, mcresp) && mcresp.bodylen()) {
+            mcresp.payload = rdb_get_consolidated(ior, mcresp.bodylen());
+        }
         mcresp.bufh = rdb_get_first_segment(ior);
         mcreq_dispatch_response(this, request, &mcresp, err_override);
-        DO_SWALLOW_PAYLOAD()
+        if (mcresp.bodylen()) {
+            rdb_consumed(ior, mcresp.bodylen());
+        }
 
     } else {
         /* figure out how many buffers we want to use as an upper limit for the
@@ -615,6 +830,60 @@ GT_DONE:
     return rdstate;
 }
 
+/**
+ * A compressed value which is going to be inflated doesn't need to be made
+ * contiguous: the inflation reads it from the segments it was received into.
+ */
+bool Server::inflates_fragmented(const MemcachedResponse &mcresp) const
+{
+    if (!(mcresp.datatype() & PROTOCOL_BINARY_DATATYPE_COMPRESSED) || !(settings->compressopts & LCB_COMPRESS_IN) ||
+        mcresp.status() != PROTOCOL_BINARY_RESPONSE_SUCCESS || mcresp.vallen() == 0) {
+        return false;
+    }
+    switch (mcresp.opcode()) {
+        case PROTOCOL_BINARY_CMD_GET:
+        case PROTOCOL_BINARY_CMD_GAT:
+        case PROTOCOL_BINARY_CMD_GET_LOCKED:
+        case PROTOCOL_BINARY_CMD_GET_REPLICA:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/**
+ * Leave the value of a response which inflates_fragmented() in the segments
+ * of `ior`. Only the part of the body before the value is consolidated, so
+ * that the extras and the key may still be read in place.
+ *
+ * @return true if the payload and the value fragments of `mcresp` were assigned
+ */
+bool Server::assign_fragmented_value(rdb_IOROPE *ior, MemcachedResponse &mcresp)
+{
+    if (rdb_get_contigsize(ior) >= mcresp.bodylen() || !inflates_fragmented(mcresp)) {
+        return false;
+    }
+
+    unsigned nprefix = mcresp.bodylen() - mcresp.vallen();
+    /* along with the first byte of the value, so that it starts in the first fragment */
+    mcresp.payload = rdb_get_consolidated(ior, nprefix + 1);
+    if (value_iov.empty()) {
+        value_iov.resize(16);
+        value_segs.resize(16);
+    }
+    int niov;
+    while ((niov = rdb_refread_ex(ior, value_iov.data(), value_segs.data(), value_iov.size(), mcresp.bodylen())) < 0) {
+        value_iov.resize(value_iov.size() * 2);
+        value_segs.resize(value_iov.size());
+    }
+    value_iov[0].iov_base = static_cast<char *>(value_iov[0].iov_base) + nprefix;
+    value_iov[0].iov_len -= nprefix;
+    mcresp.value_iov = value_iov.data();
+    mcresp.value_niov = niov;
+    MC_INCR_METRIC(this, packets_inflated_fragmented, 1);
+    return true;
+}
+
 static void on_read(lcbio_CTX *ctx, unsigned)
 {
     Server *server = Server::get(ctx);
@@ -624,8 +893,17 @@ static void on_read(lcbio_CTX *ctx, unsigned)
         return;
     }
 
-    while (server->try_read(ctx, ior) == Server::PKT_READ_COMPLETE)
+    if (server->metrics) {
+        server->read_ts = gethrtime();
+        if (server->unconsumed_ts == 0) {
+            server->unconsumed_ts = server->read_ts;
+        }
+    }
+    while (server->try_read_batch(ctx, ior) == Server::PKT_READ_COMPLETE)
         ;
+    if (rdb_get_nused(ior) == 0) {
+        server->unconsumed_ts = 0;
+    }
     lcbio_ctx_schedule(ctx);
     lcb_maybe_breakout(server->instance);
 }
@@ -761,6 +1039,10 @@ static const char *opcode_name(uint8_t code)
 
 void Server::purge_single(mc_PACKET *pkt, lcb_STATUS err)
 {
+    if (err == LCB_ERR_TIMEOUT || LCB_ERROR_IS_NETWORK(err)) {
+        breaker_record(false);
+    }
+
     if (err != LCB_ERR_REQUEST_CANCELED) {
         if (maybe_retry_packet(pkt, err, PROTOCOL_BINARY_RESPONSE_UNSPECIFIED)) {
             return;
@@ -830,6 +1112,7 @@ int Server::purge(lcb_STATUS error, hrtime_t now, RefreshPolicy policy)
 {
     int affected;
 
+    release_read_batch();
     if (now) {
         affected = (int)mcreq_pipeline_timeout(this, error, fail_callback, nullptr, now);
 
@@ -946,6 +1229,143 @@ bool Server::maybe_reconnect_on_fake_timeout(lcb_STATUS err)
     return true;
 }
 
+static const char *breaker_state_name(Server::BreakerState state)
+{
+    switch (state) {
+        case Server::CB_CLOSED:
+            return "closed";
+        case Server::CB_OPEN:
+            return "open";
+        case Server::CB_HALF_OPEN:
+            return "half-open";
+    }
+    return "unknown";
+}
+
+static void breaker_set_state(Server *server, Server::BreakerState state)
+{
+    lcb_log(LOGARGS(server, INFO), LOGFMT "Circuit breaker %s -> %s", LOGID(server),
+            breaker_state_name(server->breaker.state), breaker_state_name(state));
+    server->breaker.state = state;
+    server->circuit_open = state != Server::CB_CLOSED;
+    if (server->metrics) {
+        server->metrics->circuit_state = state;
+    }
+}
+
+static void breaker_timer_cb(void *arg)
+{
+    reinterpret_cast<Server *>(arg)->breaker_probe();
+}
+
+void Server::breaker_record(bool ok)
+{
+    if (!settings->circuit_breaker || breaker.state != CB_CLOSED) {
+        return;
+    }
+
+    hrtime_t now = gethrtime();
+    hrtime_t window = LCB_US2NS(settings->circuit_breaker_window);
+    hrtime_t elapsed = now - breaker.window_start;
+    if (window == 0) {
+        window = 1;
+    }
+    if (elapsed >= window) {
+        if (elapsed < 2 * window) {
+            breaker.prev_total = breaker.total;
+            breaker.prev_failed = breaker.failed;
+            breaker.window_start += window;
+        } else {
+            breaker.prev_total = breaker.prev_failed = 0;
+            breaker.window_start = now;
+        }
+        breaker.total = breaker.failed = 0;
+        elapsed = now - breaker.window_start;
+    }
+
+    breaker.total++;
+    if (ok) {
+        return;
+    }
+    breaker.failed++;
+
+    /* Estimate the rolling window by weighing the previous window by how
+     * much of it still overlaps. Counts are scaled by 1000 */
+    uint64_t weight = 1000 - (elapsed * 1000) / window;
+    uint64_t total = uint64_t(breaker.total) * 1000 + uint64_t(breaker.prev_total) * weight;
+    uint64_t failed = uint64_t(breaker.failed) * 1000 + uint64_t(breaker.prev_failed) * weight;
+    if (total < uint64_t(settings->circuit_breaker_volume) * 1000) {
+        return;
+    }
+    if (failed * 100 < total * settings->circuit_breaker_threshold) {
+        return;
+    }
+    lcb_log(LOGARGS_T(WARN), LOGFMT "Opening circuit breaker. %u of %u operations failed in the current window",
+            LOGID_T(), breaker.failed, breaker.total);
+    MC_INCR_METRIC(this, circuit_opened, 1);
+    breaker_open();
+}
+
+void Server::breaker_open()
+{
+    breaker_set_state(this, CB_OPEN);
+    if (!breaker.timer) {
+        breaker.timer = lcbio_timer_new(instance->iotable, this, breaker_timer_cb);
+    }
+    lcbio_timer_rearm(breaker.timer, settings->circuit_breaker_sleep);
+}
+
+void Server::breaker_probe()
+{
+    if (breaker.state != CB_OPEN) {
+        return;
+    }
+    if (state != S_CLEAN) {
+        /* no probe on a connection being drained, try again after another sleep window */
+        lcbio_timer_rearm(breaker.timer, settings->circuit_breaker_sleep);
+        return;
+    }
+    breaker_set_state(this, CB_HALF_OPEN);
+
+    auto *probe = new BreakerProbe(this);
+    if (probe->send() != LCB_SUCCESS) {
+        delete probe;
+        breaker_open();
+        return;
+    }
+    breaker.probe = probe;
+    MC_INCR_METRIC(this, circuit_probes, 1);
+}
+
+void Server::breaker_probe_done(lcb_STATUS err)
+{
+    breaker.probe = nullptr;
+    if (breaker.state != CB_HALF_OPEN) {
+        return;
+    }
+    if (err != LCB_SUCCESS) {
+        lcb_log(LOGARGS_T(WARN), LOGFMT "Circuit breaker probe failed with %s", LOGID_T(), lcb_strerror_short(err));
+        breaker_open();
+        return;
+    }
+    breaker.total = breaker.failed = breaker.prev_total = breaker.prev_failed = 0;
+    breaker.window_start = gethrtime();
+    breaker_set_state(this, CB_CLOSED);
+}
+
+/** Called when the server goes away; a probe in flight must not call back into it */
+void Server::breaker_detach()
+{
+    if (breaker.probe) {
+        breaker.probe->server = nullptr;
+        breaker.probe = nullptr;
+    }
+    if (breaker.timer) {
+        lcbio_timer_destroy(breaker.timer);
+        breaker.timer = nullptr;
+    }
+}
+
 static void on_connected(lcbio_SOCKET *sock, void *data, lcb_STATUS err, lcbio_OSERR syserr)
 {
     auto *server = reinterpret_cast<Server *>(data);
@@ -1060,6 +1480,8 @@ Server::Server(lcb_INSTANCE *instance_, int ix)
         lcb_host_parsez(curhost, datahost, LCB_CONFIG_MCD_PORT);
     }
 
+    breaker.window_start = gethrtime();
+
     if (settings->metrics) {
         /** Allocate / reinitialize the metrics here */
         metrics = lcb_metrics_getserver(settings->metrics, curhost->host, curhost->port, 1);
@@ -1091,6 +1513,7 @@ Server::~Server()
         }
     }
     this->instance = nullptr;
+    breaker_detach();
     purge(LCB_ERR_REQUEST_CANCELED, 0, Server::REFRESH_NEVER);
 
     mcreq_pipeline_cleanup(this);
@@ -1158,6 +1581,9 @@ void Server::start_errored_ctx(State next_state)
         lcbio_timer_destroy(io_timer);
         io_timer = nullptr;
     }
+    if (next_state == Server::S_CLOSED) {
+        breaker_detach();
+    }
 
     if (ctx == nullptr) {
         if (next_state == Server::S_CLOSED) {
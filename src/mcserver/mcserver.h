@@ -24,11 +24,27 @@
 #include <netbuf/netbuf.h>
 
 #ifdef __cplusplus
+#include <vector>
+
 namespace lcb
 {
 
 class RetryQueue;
 struct RetryOp;
+struct ReadBatch;
+class Server;
+
+/**
+ * NOOP sent by the circuit breaker to test a server while it is half-open.
+ * Implemented in operations/ping.cc
+ */
+struct BreakerProbe : mc_REQDATAEX {
+    /** Server being probed. Reset if the server goes away first */
+    Server *server;
+
+    explicit BreakerProbe(Server *server_);
+    lcb_STATUS send();
+};
 
 /**
  * The structure representing each couchbase server
@@ -77,6 +93,14 @@ class Server : public mc_PIPELINE
     /** Callback for mc_pipeline_fail_chain */
     inline void purge_single(mc_PACKET *, lcb_STATUS);
 
+    /**
+     * Hand the requests of the response frames which try_read_batch() has not
+     * dispatched yet back to the pipeline, so that whoever fails or relocates
+     * the pending commands (e.g. from within a callback) also sees them.
+     * Dispatching stops after the current frame.
+     */
+    void release_read_batch();
+
     /**
      * Returns true or false depending on whether there are pending commands on
      * this server
@@ -197,6 +221,11 @@ class Server : public mc_PIPELINE
     enum ReadState { PKT_READ_COMPLETE, PKT_READ_PARTIAL, PKT_READ_ABORT };
 
     ReadState try_read(lcbio_CTX *ctx, rdb_IOROPE *ior);
+    ReadState try_read_batch(lcbio_CTX *ctx, rdb_IOROPE *ior);
+    ReadState handle_read(rdb_IOROPE *ior, MemcachedResponse &mcresp, mc_PACKET *request, bool is_last);
+    bool inflates_fragmented(const MemcachedResponse &mcresp) const;
+    bool assign_fragmented_value(rdb_IOROPE *ior, MemcachedResponse &mcresp);
+    void reserve_contig(rdb_IOROPE *ior, unsigned pktsize);
     int handle_unknown_error(const mc_PACKET *request, const MemcachedResponse &resinfo, lcb_STATUS &newerr);
     bool handle_nmv(MemcachedResponse &resinfo, mc_PACKET *oldpkt);
     bool handle_unknown_collection(MemcachedResponse &resinfo, mc_PACKET *oldpkt);
@@ -204,6 +233,19 @@ class Server : public mc_PIPELINE
     bool maybe_retry_packet(mc_PACKET *pkt, lcb_STATUS err, protocol_binary_response_status status);
     bool maybe_reconnect_on_fake_timeout(lcb_STATUS received_error);
 
+    enum BreakerState { CB_CLOSED, CB_OPEN, CB_HALF_OPEN };
+
+    /**
+     * Record the outcome of an operation in the circuit breaker window,
+     * opening the circuit if the failure rate is over the threshold.
+     * See LCB_CNTL_CIRCUIT_BREAKER
+     */
+    void breaker_record(bool ok);
+    void breaker_open();
+    void breaker_probe();
+    void breaker_probe_done(lcb_STATUS err);
+    void breaker_detach();
+
     /** Disable */
     Server(const Server &);
 
@@ -238,6 +280,33 @@ class Server : public mc_PIPELINE
     /** Request for current connection */
     lcb_host_t *curhost;
     std::string bucket{}; /** non-empty if bucket has been selected */
+
+    /**
+     * When metrics are enabled: time of the last read, and time at which the
+     * first byte not consumed yet was read (0 if everything was consumed)
+     */
+    hrtime_t read_ts{0};
+    hrtime_t unconsumed_ts{0};
+
+    /** Frames being dispatched by try_read_batch(), if any */
+    ReadBatch *read_batch{nullptr};
+
+    /** Fragments of the value being inflated, see assign_fragmented_value() */
+    std::vector<nb_IOV> value_iov;
+    std::vector<rdb_ROPESEG *> value_segs;
+
+    struct {
+        BreakerState state;
+        /** Start of the current window, and the counts for it and the previous one */
+        hrtime_t window_start;
+        uint32_t total;
+        uint32_t failed;
+        uint32_t prev_total;
+        uint32_t prev_failed;
+        /** Fires when the sleep window elapses, to send a probe */
+        lcbio_pTIMER timer;
+        BreakerProbe *probe;
+    } breaker{};
 };
 } // namespace lcb
 #endif /* __cplusplus */
@@ -31,6 +31,7 @@
 #include "negotiate.h"
 #include "ctx-log-inl.h"
 #include "auth-priv.h"
+#include "scramcache.h"
 
 using namespace lcb;
 
@@ -166,6 +167,27 @@ class lcb::SessionRequestImpl : public SessionRequest
         return last_err != LCB_SUCCESS;
     }
 
+    lcb::ScramCache *scram_cache() const
+    {
+        switch (settings->scram_cache_mode) {
+            case LCB_SCRAM_CACHE_INSTANCE:
+                return settings->scram_cache;
+            case LCB_SCRAM_CACHE_PROCESS:
+                return &lcb::ScramCache::global();
+            default:
+                return nullptr;
+        }
+    }
+
+    /** Forget derived keys if the server rejected them */
+    void forget_scram_keys() const
+    {
+        lcb::ScramCache *cache = scram_cache();
+        if (cache != nullptr && info != nullptr && info->mech.compare(0, 5, "SCRAM") == 0) {
+            cache->forget(username);
+        }
+    }
+
     union {
         cbsasl_secret_t secret;
         char buffer[256];
@@ -211,6 +233,30 @@ static int sasl_get_password(cbsasl_conn_t *conn, void *context, int id, cbsasl_
     return SASL_OK;
 }
 
+static int sasl_salted_password(void *context, int store, cbsasl_auth_mechanism_t mech, const char *salt,
+                                unsigned int saltlen, unsigned int itcount, unsigned char *salted,
+                                unsigned int *saltedlen)
+{
+    SessionRequestImpl *ctx = SessionRequestImpl::get(context);
+    lcb::ScramCache *cache = ctx->scram_cache();
+    if (cache == nullptr) {
+        return SASL_FAIL;
+    }
+
+    std::string password(reinterpret_cast<const char *>(ctx->u_auth.secret.data), ctx->u_auth.secret.len);
+    std::string salt_s(salt, saltlen);
+    if (store) {
+        cache->store(mech, ctx->username, password, salt_s, itcount, salted, *saltedlen);
+        return SASL_OK;
+    }
+    *saltedlen = cache->lookup(mech, ctx->username, password, salt_s, itcount, salted);
+    if (*saltedlen == 0) {
+        return SASL_FAIL;
+    }
+    lcb_log(LOGARGS(ctx, TRACE), LOGFMT "Reusing cached SCRAM salted password", LOGID(ctx));
+    return SASL_OK;
+}
+
 SessionInfo::SessionInfo() : lcbio_PROTOCTX(), selected(false)
 {
     lcbio_PROTOCTX::id = LCBIO_PROTOCTX_SESSINFO;
@@ -223,6 +269,7 @@ bool SessionRequestImpl::setup(const lcbio_NAMEINFO &nistrs, const lcb_host_t &h
     sasl_callbacks.context = this;
     sasl_callbacks.username = sasl_get_username;
     sasl_callbacks.password = sasl_get_password;
+    sasl_callbacks.salted_password = sasl_salted_password;
 
     // Get the credentials
     username = auth.username_for(host.host, host.port, settings->bucket);
@@ -598,6 +645,7 @@ GT_NEXT_PACKET:
             } else if (status == PROTOCOL_BINARY_RESPONSE_AUTH_CONTINUE) {
                 send_step(resp);
             } else {
+                forget_scram_keys();
                 set_error(LCB_ERR_AUTHENTICATION_FAILURE, "SASL AUTH failed", &resp);
                 break;
             }
@@ -609,6 +657,7 @@ GT_NEXT_PACKET:
                 completed = !maybe_select_bucket();
             } else {
                 lcb_log(LOGARGS(this, WARN), LOGFMT "SASL auth failed with STATUS=0x%x", LOGID(this), status);
+                forget_scram_keys();
                 set_error(LCB_ERR_AUTHENTICATION_FAILURE, "SASL Step failed", &resp);
             }
             break;
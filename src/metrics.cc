@@ -31,6 +31,20 @@ class MetricsEntry : public lcb_SERVERMETRICS
     explicit MetricsEntry(std::string key) : lcb_SERVERMETRICS_st(), m_hostport(std::move(key))
     {
         iometrics.hostport = m_hostport.c_str();
+        server_duration_hg = lcb_histogram_create();
+        network_queue_duration_hg = lcb_histogram_create();
+        for (auto &hg : stage_hg) {
+            hg = lcb_histogram_create();
+        }
+    }
+
+    ~MetricsEntry()
+    {
+        lcb_histogram_destroy(server_duration_hg);
+        lcb_histogram_destroy(network_queue_duration_hg);
+        for (auto &hg : stage_hg) {
+            lcb_histogram_destroy(hg);
+        }
     }
 
     MetricsEntry() = delete;
@@ -117,12 +131,30 @@ void lcb_metrics_dumpserver(const lcb_SERVERMETRICS *metrics, FILE *fp)
     fprintf(fp, "Packets errored: %lu\n", (unsigned long int)metrics->packets_errored);
     fprintf(fp, "Packets NMV: %lu\n", (unsigned long int)metrics->packets_nmv);
     fprintf(fp, "Packets timeout: %lu\n", (unsigned long int)metrics->packets_timeout);
-    fprintf(fp, "Packets orphaned: %lu", (unsigned long int)metrics->packets_ownerless);
+    fprintf(fp, "Packets orphaned: %lu\n", (unsigned long int)metrics->packets_ownerless);
+    fprintf(fp, "Hedges launched: %lu\n", (unsigned long int)metrics->hedges_launched);
+    fprintf(fp, "Hedges won: %lu\n", (unsigned long int)metrics->hedges_won);
+    fprintf(fp, "Hedges wasted: %lu\n", (unsigned long int)metrics->hedges_wasted);
+    fprintf(fp, "Packets retried: %lu\n", (unsigned long int)metrics->packets_retried);
+    fprintf(fp, "Retry budget exhausted: %lu\n", (unsigned long int)metrics->retry_budget_exhausted);
+    fprintf(fp, "Retry queue time (us): %lu\n", (unsigned long int)metrics->retry_queue_time);
+    fprintf(fp, "Packets rejected: %lu\n", (unsigned long int)metrics->packets_rejected);
+    fprintf(fp, "Circuit state: %lu\n", (unsigned long int)metrics->circuit_state);
+    fprintf(fp, "Circuit opened: %lu\n", (unsigned long int)metrics->circuit_opened);
+    fprintf(fp, "Circuit rejected: %lu\n", (unsigned long int)metrics->circuit_rejected);
+    fprintf(fp, "Circuit probes: %lu\n", (unsigned long int)metrics->circuit_probes);
+    fprintf(fp, "Packets read contiguously: %lu\n", (unsigned long int)metrics->packets_contig_reserved);
+    fprintf(fp, "Consolidation bytes avoided: %lu\n", (unsigned long int)metrics->bytes_consolidate_avoided);
+    fprintf(fp, "Packets with server duration: %lu\n", (unsigned long int)metrics->packets_server_timed);
+    fprintf(fp, "Server duration (us): %lu\n", (unsigned long int)metrics->server_duration);
+    fprintf(fp, "Network and queue duration (us): %lu\n", (unsigned long int)metrics->network_queue_duration);
+    fprintf(fp, "Packets inflated fragmented: %lu", (unsigned long int)metrics->packets_inflated_fragmented);
 }
 
 void lcb_metrics_reset_pipeline_gauges(lcb_SERVERMETRICS *metrics)
 {
     metrics->packets_queued = 0;
     metrics->bytes_queued = 0;
+    metrics->circuit_state = 0;
 }
 }
@@ -218,6 +218,9 @@ typedef struct lcb_QUERY_HANDLE_ : lcb::jsparse::Parser::Actions {
 
     lcbtrace_SPAN *span;
 
+    /** Pausing of the rows stream, see lcb_query_pause() */
+    lcb::http::FlowControl flow;
+
     lcb_N1QLCACHE &cache() const
     {
         return *instance->n1ql_cache;
@@ -311,6 +314,7 @@ typedef struct lcb_QUERY_HANDLE_ : lcb::jsparse::Parser::Actions {
         resp.nrow = row.row.iov_len;
         nrows++;
         invoke_row(&resp, false);
+        flow.row_delivered(resp.nrow, htreq);
     }
     void JSPARSE_on_error(const std::string &) override
     {
@@ -838,6 +842,7 @@ lcb_STATUS N1QLREQ::issue_htreq(const std::string &body)
     lcb_cmdhttp_destroy(htcmd);
     if (rc == LCB_SUCCESS) {
         htreq->set_callback(chunk_callback);
+        flow.apply(htreq);
     }
     return rc;
 }
@@ -908,6 +913,7 @@ lcb_QUERY_HANDLE_::lcb_QUERY_HANDLE_(lcb_INSTANCE *obj, void *user_cookie, const
     if (cmd->handle) {
         *cmd->handle = this;
     }
+    flow.set_high_watermark(cmd->high_watermark);
 
     if (flags & LCB_CMDN1QL_F_JSONQUERY) {
         json = cmd->root;
@@ -1079,6 +1085,35 @@ LIBCOUCHBASE_API lcb_STATUS lcb_query_cancel(lcb_INSTANCE *instance, lcb_QUERY_H
             handle->prepare_req = nullptr;
         }
         handle->callback = nullptr;
+        /* The handle is released once the response has been read */
+        handle->flow.release(handle->htreq);
+    }
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_query_pause(lcb_INSTANCE *, lcb_QUERY_HANDLE *handle)
+{
+    if (handle == nullptr) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    handle->flow.set(lcb::http::FlowControl::USER, true, handle->htreq);
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_query_resume(lcb_INSTANCE *, lcb_QUERY_HANDLE *handle)
+{
+    if (handle == nullptr) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    handle->flow.set(lcb::http::FlowControl::USER, false, handle->htreq);
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_query_consumed(lcb_INSTANCE *, lcb_QUERY_HANDLE *handle, size_t nbytes)
+{
+    if (handle == nullptr) {
+        return LCB_ERR_INVALID_ARGUMENT;
     }
+    handle->flow.consumed(nbytes, handle->htreq);
     return LCB_SUCCESS;
 }
@@ -293,6 +293,7 @@ static void replace_config(lcb_INSTANCE *instance, lcbvb_CONFIG *oldconfig, lcbv
             continue;
         }
 
+        static_cast<lcb::Server *>(ppold[ii])->release_read_batch();
         mcreq_iterwipe(cq, ppold[ii], iterwipe_cb, nullptr);
         static_cast<lcb::Server *>(ppold[ii])->purge(LCB_ERR_MAP_CHANGED);
         static_cast<lcb::Server *>(ppold[ii])->close();
@@ -30,11 +30,16 @@ class SeqnoDurset : public Durset
   public:
     SeqnoDurset(lcb_INSTANCE *instance_, const lcb_durability_opts_t *options) : Durset(instance_, options) {}
 
+    ~SeqnoDurset() override
+    {
+        if (instance->durpoller) {
+            instance->durpoller->cancel(this);
+        }
+    }
+
     lcb_STATUS poll_impl() override;
 
     lcb_STATUS after_add(Item &item, const lcb_MUTATION_TOKEN *token) override;
-
-    void update(const lcb_RESPOBSEQNO *resp);
 };
 } // namespace
 
@@ -45,11 +50,9 @@ Durset *Durset::createSeqnoDurset(lcb_INSTANCE *instance, const lcb_durability_o
 
 #define ENT_SEQNO(ent) (ent)->reqseqno
 
-static void seqno_callback(lcb_INSTANCE *, int, const lcb_RESPBASE *rb)
+static void seqno_update(Item *ent, const lcb_RESPOBSEQNO *resp)
 {
-    const lcb_RESPOBSEQNO *resp = (const lcb_RESPOBSEQNO *)rb;
     int flags = 0;
-    Item *ent = static_cast<Item *>(reinterpret_cast<CallbackCookie *>(resp->cookie));
 
     /* Now, process the response */
     if (resp->ctx.rc != LCB_SUCCESS) {
@@ -94,40 +97,29 @@ lcb_STATUS SeqnoDurset::poll_impl()
     lcb_STATUS ret_err = LCB_ERR_SDK_INTERNAL; /* This should never be returned */
     bool has_ops = false;
 
-    lcb_sched_enter(instance);
+    if (instance->durpoller == nullptr) {
+        instance->durpoller = new SeqnoPoller(instance);
+    }
+
     for (size_t ii = 0; ii < entries.size(); ii++) {
         Item &ent = entries[ii];
         lcb_U16 servers[4];
-        lcb_CMDOBSEQNO cmd = {0};
 
         if (ent.done) {
             continue;
         }
 
-        cmd.uuid = ent.uuid;
-        cmd.vbid = ent.vbid;
-        cmd.cmdflags = LCB_CMD_F_INTERNAL_CALLBACK;
-        ent.callback = seqno_callback;
-
         size_t nservers = ent.prepare(servers);
         if (nservers == 0) {
             ret_err = LCB_ERR_DURABILITY_TOO_MANY;
             continue;
         }
         for (size_t jj = 0; jj < nservers; jj++) {
-            lcb_STATUS err;
-            cmd.server_index = servers[jj];
-            LCB_CMD_SET_TRACESPAN(&cmd, span);
-            err = lcb_observe_seqno3(instance, &ent.callback, &cmd);
-            if (err == LCB_SUCCESS) {
-                waiting++;
-                has_ops = true;
-            } else {
-                ent.res().ctx.rc = ret_err = err;
-            }
+            instance->durpoller->add(&ent, servers[jj]);
+            waiting++;
+            has_ops = true;
         }
     }
-    lcb_sched_leave(instance);
     if (!has_ops) {
         return ret_err;
     } else {
@@ -155,3 +147,127 @@ lcb_STATUS SeqnoDurset::after_add(Item &item, const lcb_MUTATION_TOKEN *stok)
     ENT_SEQNO(&item) = LCB_MUTATION_TOKEN_SEQ(stok);
     return LCB_SUCCESS;
 }
+
+static void poller_callback(lcb_INSTANCE *, int, const lcb_RESPBASE *rb)
+{
+    const auto *resp = reinterpret_cast<const lcb_RESPOBSEQNO *>(rb);
+    auto *group = static_cast<SeqnoPoller::Group *>(reinterpret_cast<CallbackCookie *>(resp->cookie));
+    group->poller->on_response(group, resp);
+}
+
+SeqnoPoller::SeqnoPoller(lcb_INSTANCE *instance_) : instance(instance_), timer(instance_->iotable, this) {}
+
+SeqnoPoller::~SeqnoPoller()
+{
+    timer.release();
+    for (auto &group : groups) {
+        delete group.second;
+    }
+}
+
+void SeqnoPoller::add(Item *item, lcb_U16 server_index)
+{
+    Key key = {item->vbid, server_index, item->uuid};
+    Group *&group = groups[key];
+    if (group == nullptr) {
+        group = new Group(this, key);
+        group->callback = poller_callback;
+    }
+    if (group->waiters.empty() || item->parent->opts.interval < group->interval) {
+        group->interval = item->parent->opts.interval;
+    }
+    group->waiters.push_back(item);
+    if (!group->inflight) {
+        /* Let the other sets polling in this iteration join the probe */
+        timer.signal();
+    }
+}
+
+void SeqnoPoller::cancel(const Durset *dset)
+{
+    for (auto &group : groups) {
+        group.second->waiters.remove_if([dset](const Item *item) { return item->parent == dset; });
+    }
+}
+
+void SeqnoPoller::send(Group *group)
+{
+    lcb_CMDOBSEQNO cmd = {0};
+    cmd.uuid = group->key.uuid;
+    cmd.vbid = group->key.vbid;
+    cmd.server_index = group->key.server_index;
+    cmd.cmdflags = LCB_CMD_F_INTERNAL_CALLBACK;
+    LCB_CMD_SET_TRACESPAN(&cmd, group->waiters.front()->parent->span);
+
+    group->last_sent = gethrtime();
+    lcb_STATUS err = lcb_observe_seqno3(instance, static_cast<CallbackCookie *>(group), &cmd);
+    if (err == LCB_SUCCESS) {
+        group->inflight = true;
+        return;
+    }
+
+    lcb_RESPOBSEQNO resp{};
+    resp.ctx.rc = err;
+    resp.server_index = group->key.server_index;
+    on_response(group, &resp);
+}
+
+void SeqnoPoller::flush()
+{
+    hrtime_t now = gethrtime();
+    hrtime_t next_due = 0;
+
+    lcb_sched_enter(instance);
+    for (auto it = groups.begin(); it != groups.end();) {
+        Group *group = it->second;
+        hrtime_t due = group->last_sent + LCB_US2NS(group->interval);
+
+        if (group->inflight) {
+            ++it;
+        } else if (group->waiters.empty()) {
+            /* Remember idle groups for one interval so they stay rate limited */
+            if (due <= now) {
+                delete group;
+                it = groups.erase(it);
+            } else {
+                ++it;
+            }
+        } else if (group->last_sent && due > now) {
+            if (next_due == 0 || due < next_due) {
+                next_due = due;
+            }
+            ++it;
+        } else {
+            send(group);
+            ++it;
+        }
+    }
+    lcb_sched_leave(instance);
+
+    if (next_due) {
+        timer.rearm(LCB_NS2US(next_due - now));
+    }
+}
+
+void SeqnoPoller::on_response(Group *group, const lcb_RESPOBSEQNO *resp)
+{
+    group->inflight = false;
+
+    /* Every item waiting on the group is served by this response, including
+     * those which joined while the probe was in flight */
+    size_t nwaiters = group->waiters.size();
+    while (nwaiters-- && !group->waiters.empty()) {
+        Item *item = group->waiters.front();
+        group->waiters.pop_front();
+        seqno_update(item, resp);
+    }
+    if (!group->waiters.empty()) {
+        timer.arm_if_disarmed(0);
+    }
+}
+
+void lcbdur_poller_destroy(lcb_INSTANCE *instance)
+{
+    delete instance->durpoller;
+    instance->durpoller = nullptr;
+}
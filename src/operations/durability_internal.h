@@ -36,6 +36,9 @@ void lcbdurctx_set_durstore(lcb_MULTICMD_CTX *ctx, int enabled);
 
 void lcbdur_destroy(void *dset);
 
+/** Release the instance's shared OBSERVE_SEQNO poller (if it was created) */
+void lcbdur_poller_destroy(lcb_INSTANCE *instance);
+
 /**@}
  *
  * The rest of this file is internal to the various durability operations and
@@ -47,6 +50,10 @@ void lcbdur_destroy(void *dset);
 #endif
 
 #ifdef LCBDUR_PRIV_SYMS
+#include <list>
+#include <map>
+#include <lcbio/timer-cxx.h>
+
 namespace lcb
 {
 namespace durability
@@ -283,6 +290,77 @@ struct Durset : public MultiCmdContext {
     lcbtrace_SPAN *span;
 };
 
+/**
+ * Coalesces the OBSERVE_SEQNO probes of all the durability sets of an instance.
+ *
+ * Each set would otherwise send one probe per item and per server on every
+ * poll, even though a single response describes the state of every mutation
+ * in the vBucket. Instead, items register with the poller which groups them
+ * by (vBucket, server, vBucket UUID), sends one probe per group, and hands
+ * the response to every item of the group. A group is not probed more than
+ * once per polling interval, so that the polling traffic scales with the
+ * number of vBuckets rather than with the number of mutations.
+ */
+class SeqnoPoller
+{
+  public:
+    explicit SeqnoPoller(lcb_INSTANCE *instance);
+    ~SeqnoPoller();
+
+    /**
+     * Request the state of the item's vBucket on the given server. Once the
+     * response of the group's probe arrives, the item is updated and its
+     * set's `waiting` counter is decremented.
+     */
+    void add(Item *item, lcb_U16 server_index);
+
+    /** Forget the items of a set which is being destroyed */
+    void cancel(const Durset *dset);
+
+    /** Send the probes of the groups which are due */
+    void flush();
+
+    struct Key {
+        lcb_U16 vbid;
+        lcb_U16 server_index;
+        lcb_U64 uuid;
+
+        bool operator<(const Key &other) const
+        {
+            if (vbid != other.vbid) {
+                return vbid < other.vbid;
+            }
+            if (server_index != other.server_index) {
+                return server_index < other.server_index;
+            }
+            return uuid < other.uuid;
+        }
+    };
+
+    struct Group : public CallbackCookie {
+        Group(SeqnoPoller *poller_, const Key &key_)
+            : poller(poller_), key(key_), last_sent(0), interval(0), inflight(false)
+        {
+        }
+
+        SeqnoPoller *poller;
+        Key key;
+        std::list<Item *> waiters;
+        hrtime_t last_sent; /**< When the last probe was sent */
+        lcb_U32 interval;   /**< Shortest polling interval of the waiters (us) */
+        bool inflight;      /**< Whether a probe is awaiting its response */
+    };
+
+    void on_response(Group *group, const lcb_RESPOBSEQNO *resp);
+
+  private:
+    void send(Group *group);
+
+    lcb_INSTANCE *instance;
+    std::map<Key, Group *> groups;
+    lcb::io::Timer<SeqnoPoller, &SeqnoPoller::flush> timer;
+};
+
 } // namespace durability
 } // namespace lcb
 #endif // __cplusplus
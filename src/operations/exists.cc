@@ -209,15 +209,19 @@ lcb_STATUS lcb_exists(lcb_INSTANCE *instance, void *cookie, const lcb_CMDEXISTS
     cmd->cookie(cookie);
 
     if (instance->cmdq.config == nullptr) {
-        cmd->start_time_in_nanoseconds(gethrtime());
-        return lcb::defer_operation(instance, [instance, cmd](lcb_STATUS status) {
+        hrtime_t now = gethrtime();
+        cmd->start_time_in_nanoseconds(now);
+        hrtime_t deadline =
+            now + cmd->timeout_or_default_in_nanoseconds(LCB_US2NS(LCBT_SETTING(instance, operation_timeout)));
+        size_t nbytes = sizeof(*cmd) + cmd->key().size();
+        return lcb::defer_operation(instance, deadline, nbytes, [instance, cmd](lcb_STATUS status) {
             const auto callback_type = LCB_CALLBACK_EXISTS;
             lcb_RESPCALLBACK operation_callback = lcb_find_callback(instance, callback_type);
             lcb_RESPEXISTS response{};
             response.ctx.key = cmd->key();
             response.cookie = cmd->cookie();
             response.ctx.rc = status;
-            if (response.ctx.rc == LCB_ERR_REQUEST_CANCELED) {
+            if (response.ctx.rc != LCB_SUCCESS) {
                 operation_callback(instance, callback_type, &response);
                 return;
             }
@@ -15,12 +15,14 @@
  *   limitations under the License.
  */
 
+#include <algorithm>
 #include <memory>
 
 #include "internal.h"
 #include "collections.h"
 #include "trace.h"
 #include "defer.h"
+#include <lcbio/timer-cxx.h>
 
 #include "capi/cmd_get.hh"
 #include "capi/cmd_get_replica.hh"
@@ -252,14 +254,18 @@ lcb_STATUS lcb_get(lcb_INSTANCE *instance, void *cookie, const lcb_CMDGET *comma
     cmd->cookie(cookie);
 
     if (instance->cmdq.config == nullptr) {
-        cmd->start_time_in_nanoseconds(gethrtime());
-        return lcb::defer_operation(instance, [instance, cmd](lcb_STATUS status) {
+        hrtime_t now = gethrtime();
+        cmd->start_time_in_nanoseconds(now);
+        hrtime_t deadline =
+            now + cmd->timeout_or_default_in_nanoseconds(LCB_US2NS(LCBT_SETTING(instance, operation_timeout)));
+        size_t nbytes = sizeof(*cmd) + cmd->key().size();
+        return lcb::defer_operation(instance, deadline, nbytes, [instance, cmd](lcb_STATUS status) {
             const auto callback_type = LCB_CALLBACK_GET;
             lcb_RESPCALLBACK operation_callback = lcb_find_callback(instance, callback_type);
             lcb_RESPGET response{};
             response.ctx.key = cmd->key();
             response.cookie = cmd->cookie();
-            if (status == LCB_ERR_REQUEST_CANCELED) {
+            if (status != LCB_SUCCESS) {
                 response.ctx.rc = status;
                 operation_callback(instance, callback_type, &response);
                 return;
@@ -345,6 +351,9 @@ LIBCOUCHBASE_API lcb_STATUS lcb_cmdgetreplica_create(lcb_CMDGETREPLICA **cmd, lc
             res->strategy = LCB_REPLICA_SELECT;
             res->index = mode - LCB_REPLICA_MODE_IDX0;
             break;
+        case LCB_REPLICA_MODE_HEDGED:
+            res->strategy = LCB_REPLICA_HEDGED;
+            break;
         default:
             free(res);
             return LCB_ERR_INVALID_ARGUMENT;
@@ -474,6 +483,259 @@ RGetCookie::RGetCookie(void *cookie_, lcb_INSTANCE *instance_, lcb_replica_t str
 {
 }
 
+struct HedgedGetCookie : mc_REQDATAEX {
+    HedgedGetCookie(void *cookie, lcb_INSTANCE *instance, int vb, const lcb_CMDGETREPLICA *cmd);
+    void decref()
+    {
+        if (!--remaining) {
+            delete this;
+        }
+    }
+    lcb_STATUS schedule(mc_PIPELINE *pl, uint8_t opcode);
+    void launch_hedge();
+
+    lcb_INSTANCE *instance;
+    int vbucket;
+    std::uint32_t cid;
+    std::string key;
+    int remaining;
+    bool hedged;
+    bool completed;
+    lcb::io::Timer<HedgedGetCookie, &HedgedGetCookie::launch_hedge> timer;
+};
+
+static void hget_dtor(mc_PACKET *pkt)
+{
+    static_cast<HedgedGetCookie *>(pkt->u_rdata.exdata)->decref();
+}
+
+/**
+ * Errors from the active node after which racing a replica makes sense. A
+ * missing document is authoritative, and for a timeout or cancellation the
+ * replica read would share the same (already expired) deadline.
+ */
+static bool hget_should_hedge(lcb_STATUS err)
+{
+    return err != LCB_SUCCESS && err != LCB_ERR_DOCUMENT_NOT_FOUND && err != LCB_ERR_TIMEOUT &&
+           err != LCB_ERR_REQUEST_CANCELED;
+}
+
+/**
+ * Both reads of a hedged get complete with a lcb_RESPGET (from the handlers
+ * of GET and GET_REPLICA), while the user is given a lcb_RESPGETREPLICA.
+ */
+static void hget_make_response(const lcb_RESPGET *src, lcb_RESPGETREPLICA *dst)
+{
+    dst->ctx = src->ctx;
+    dst->cookie = src->cookie;
+    dst->rflags = src->rflags;
+    dst->value = src->value;
+    dst->nvalue = src->nvalue;
+    dst->bufh = src->bufh;
+    dst->datatype = src->datatype;
+    dst->itmflags = src->itmflags;
+}
+
+static void hget_callback(mc_PIPELINE *pipeline, mc_PACKET *pkt, lcb_STATUS err, const void *arg)
+{
+    auto *hck = static_cast<HedgedGetCookie *>(pkt->u_rdata.exdata);
+    lcb_INSTANCE *instance = hck->instance;
+    protocol_binary_request_header hdr;
+
+    mcreq_read_hdr(pkt, &hdr);
+    bool is_hedge = hdr.request.opcode == PROTOCOL_BINARY_CMD_GET_REPLICA;
+
+    if (!is_hedge) {
+        hck->timer.cancel();
+        if (!hck->completed && hget_should_hedge(err)) {
+            hck->launch_hedge();
+        }
+    }
+
+    if (hck->completed || (err != LCB_SUCCESS && hck->remaining > 1 && (is_hedge || hget_should_hedge(err)))) {
+        /* either the other read already won, or it is still in flight and
+         * may yet succeed */
+        if (is_hedge) {
+            MC_INCR_METRIC(pipeline, hedges_wasted, 1);
+        }
+        hck->decref();
+        return;
+    }
+
+    if (is_hedge) {
+        if (err == LCB_SUCCESS) {
+            MC_INCR_METRIC(pipeline, hedges_won, 1);
+        } else {
+            MC_INCR_METRIC(pipeline, hedges_wasted, 1);
+        }
+    }
+    hck->completed = true;
+    lcb_RESPGETREPLICA resp{};
+    hget_make_response(static_cast<const lcb_RESPGET *>(arg), &resp);
+    resp.rflags |= LCB_RESP_F_FINAL;
+    lcb_find_callback(instance, LCB_CALLBACK_GETREPLICA)(instance, LCB_CALLBACK_GETREPLICA, (lcb_RESPBASE *)&resp);
+    hck->decref();
+}
+
+static mc_REQDATAPROCS hget_procs = {hget_callback, hget_dtor};
+
+HedgedGetCookie::HedgedGetCookie(void *cookie_, lcb_INSTANCE *instance_, int vbucket_, const lcb_CMDGETREPLICA *cmd)
+    : mc_REQDATAEX(cookie_, hget_procs, gethrtime()), instance(instance_), vbucket(vbucket_), cid(cmd->cid),
+      key(static_cast<const char *>(cmd->key.contig.bytes), cmd->key.contig.nbytes), remaining(0), hedged(false),
+      completed(false), timer(instance_->iotable, this)
+{
+}
+
+lcb_STATUS HedgedGetCookie::schedule(mc_PIPELINE *pl, uint8_t opcode)
+{
+    protocol_binary_request_header req{};
+    lcb_KEYBUF kbuf;
+    mc_PACKET *pkt = mcreq_allocate_packet(pl);
+    if (!pkt) {
+        return LCB_ERR_NO_MEMORY;
+    }
+
+    pkt->u_rdata.exdata = this;
+    pkt->flags |= MCREQ_F_REQEXT;
+
+    LCB_KREQ_SIMPLE(&kbuf, key.c_str(), key.size());
+    mcreq_reserve_key(pl, pkt, sizeof(req.bytes), &kbuf, cid);
+    size_t nkey = pkt->kh_span.size - MCREQ_PKT_BASESIZE + pkt->extlen;
+    req.request.magic = PROTOCOL_BINARY_REQ;
+    req.request.opcode = opcode;
+    req.request.datatype = PROTOCOL_BINARY_RAW_BYTES;
+    req.request.vbucket = htons((uint16_t)vbucket);
+    req.request.keylen = htons((uint16_t)nkey);
+    req.request.bodylen = htonl((uint32_t)nkey);
+    req.request.opaque = pkt->opaque;
+    remaining++;
+    mcreq_write_hdr(pkt, &req);
+    mcreq_sched_add(pl, pkt);
+    return LCB_SUCCESS;
+}
+
+/**
+ * Invoked either by the hedge timer, or when the active node fails in a way
+ * a replica might not. Sends a GET_REPLICA to the first available replica.
+ */
+void HedgedGetCookie::launch_hedge()
+{
+    if (hedged || completed) {
+        return;
+    }
+
+    mc_CMDQUEUE *cq = &instance->cmdq;
+    mc_PIPELINE *pl = nullptr;
+    for (unsigned ii = 0; ii < LCBT_NREPLICAS(instance); ii++) {
+        int ix = lcbvb_vbreplica(cq->config, vbucket, ii);
+        if (ix > -1 && ix < (int)cq->npipelines) {
+            pl = cq->pipelines[ix];
+            break;
+        }
+    }
+    if (pl == nullptr || schedule(pl, PROTOCOL_BINARY_CMD_GET_REPLICA) != LCB_SUCCESS) {
+        return;
+    }
+    hedged = true;
+    MC_INCR_METRIC(pl, hedges_launched, 1);
+    if (!cq->ctxenter) {
+        mcreq_sched_leave(cq, 1);
+    }
+}
+
+struct HedgeDelayBuckets {
+    std::vector<std::pair<std::uint64_t, std::uint64_t>> buckets; /* {upper bound in us, count} */
+    std::uint64_t total{0};
+};
+
+static void hedge_delay_collect(const void *cookie, lcb_timeunit_t unit, lcb_U32, lcb_U32 max, lcb_U32 total,
+                                lcb_U32)
+{
+    auto *hb = static_cast<HedgeDelayBuckets *>(const_cast<void *>(cookie));
+    std::uint64_t max_us = max;
+    switch (unit) {
+        case LCB_TIMEUNIT_NSEC:
+            max_us = LCB_NS2US(max_us);
+            break;
+        case LCB_TIMEUNIT_MSEC:
+            max_us = LCB_MS2US(max_us);
+            break;
+        case LCB_TIMEUNIT_SEC:
+            max_us *= 1000000;
+            break;
+        default:
+            break;
+    }
+    hb->buckets.emplace_back(max_us, total);
+    hb->total += total;
+}
+
+/**
+ * Returns the delay (in microseconds) after which a hedged read should race a
+ * replica. Unless the user configured a fixed delay, this is the p99 of the
+ * KV timings histogram, recomputed at most once a second.
+ */
+static std::uint32_t hedge_delay(lcb_INSTANCE *instance)
+{
+    std::uint32_t delay = LCBT_SETTING(instance, replica_hedge_delay);
+    if (delay) {
+        return delay;
+    }
+    if (instance->kv_timings == nullptr) {
+        return LCB_DEFAULT_REPLICA_HEDGE_FALLBACK;
+    }
+
+    hrtime_t now = gethrtime();
+    if (instance->hedge_delay_ts && now - instance->hedge_delay_ts < LCB_S2NS(1)) {
+        return instance->hedge_delay;
+    }
+
+    HedgeDelayBuckets hb;
+    lcb_histogram_read(instance->kv_timings, &hb, hedge_delay_collect);
+    delay = LCB_DEFAULT_REPLICA_HEDGE_FALLBACK;
+    if (hb.total) {
+        std::uint64_t seen = 0;
+        for (const auto &bucket : hb.buckets) {
+            seen += bucket.second;
+            if (seen * 100 >= hb.total * 99) {
+                delay = (std::uint32_t)std::max<std::uint64_t>(1, std::min<std::uint64_t>(bucket.first, UINT32_MAX));
+                break;
+            }
+        }
+    }
+    instance->hedge_delay = delay;
+    instance->hedge_delay_ts = now;
+    return delay;
+}
+
+static lcb_STATUS getreplica_hedged(lcb_INSTANCE *instance, void *cookie, const lcb_CMDGETREPLICA *cmd)
+{
+    mc_CMDQUEUE *cq = &instance->cmdq;
+    int vbid, srvix;
+
+    mcreq_map_key(cq, &cmd->key, MCREQ_PKT_BASESIZE, &vbid, &srvix);
+    if (srvix < 0 || srvix >= (int)cq->npipelines) {
+        return LCB_ERR_NO_MATCHING_SERVER;
+    }
+
+    auto *hck = new HedgedGetCookie(cookie, instance, vbid, cmd);
+    std::uint32_t timeout = cmd->timeout ? cmd->timeout : LCBT_SETTING(instance, operation_timeout);
+    hck->deadline = hck->start + LCB_US2NS(timeout);
+
+    lcb_STATUS rc = hck->schedule(cq->pipelines[srvix], PROTOCOL_BINARY_CMD_GET);
+    if (rc != LCB_SUCCESS) {
+        delete hck;
+        return rc;
+    }
+    std::uint32_t delay = hedge_delay(instance);
+    if (delay < timeout) {
+        hck->timer.rearm(delay);
+    }
+
+    MAYBE_SCHEDLEAVE(instance);
+    return LCB_SUCCESS;
+}
+
 static lcb_STATUS getreplica_validate(lcb_INSTANCE *instance, const lcb_CMDGETREPLICA *cmd)
 {
     auto err = lcb_is_collection_valid(instance, cmd->scope, cmd->nscope, cmd->collection, cmd->ncollection);
@@ -486,6 +748,10 @@ static lcb_STATUS getreplica_validate(lcb_INSTANCE *instance, const lcb_CMDGETRE
     if (!instance->cmdq.config) {
         return LCB_ERR_NO_CONFIGURATION;
     }
+    if (cmd->strategy == LCB_REPLICA_HEDGED) {
+        /* the active node is always tried; replicas are only a fallback */
+        return LCB_SUCCESS;
+    }
     if (!LCBT_NREPLICAS(instance)) {
         return LCB_ERR_NO_MATCHING_SERVER;
     }
@@ -551,6 +817,10 @@ lcb_STATUS lcb_getreplica(lcb_INSTANCE *instance, void *cookie, const lcb_CMDGET
             cb(instance, LCB_CALLBACK_GETREPLICA, reinterpret_cast<const lcb_RESPBASE *>(&rget));
             return resp->ctx.rc;
         }
+        if (cmd->strategy == LCB_REPLICA_HEDGED) {
+            return getreplica_hedged(instance, cookie, cmd);
+        }
+
         /**
          * Because we need to direct these commands to specific servers, we can't
          * just use the 'basic_packet()' function.
@@ -459,6 +459,55 @@ static void handle_ping(mc_PIPELINE *pipeline, mc_PACKET *req, lcb_STATUS err, c
     invoke_ping_callback(server->get_instance(), ck);
 }
 
+static void handle_breaker_probe(mc_PIPELINE *, mc_PACKET *req, lcb_STATUS err, const void *)
+{
+    auto *probe = static_cast<lcb::BreakerProbe *>(req->u_rdata.exdata);
+    if (probe->server) {
+        probe->server->breaker_probe_done(err);
+    }
+    delete probe;
+}
+
+static void dtor_breaker_probe(mc_PACKET *pkt)
+{
+    delete static_cast<lcb::BreakerProbe *>(pkt->u_rdata.exdata);
+}
+
+static mc_REQDATAPROCS breaker_probe_procs = {handle_breaker_probe, dtor_breaker_probe};
+
+lcb::BreakerProbe::BreakerProbe(lcb::Server *server_)
+    : mc_REQDATAEX(nullptr, breaker_probe_procs, gethrtime()), server(server_)
+{
+    deadline = start + LCB_US2NS(server->default_timeout());
+}
+
+lcb_STATUS lcb::BreakerProbe::send()
+{
+    mc_PACKET *pkt = mcreq_allocate_packet(server);
+    protocol_binary_request_header hdr;
+    memset(&hdr, 0, sizeof(hdr));
+
+    if (!pkt) {
+        return LCB_ERR_NO_MEMORY;
+    }
+
+    pkt->u_rdata.exdata = this;
+    pkt->flags |= MCREQ_F_REQEXT;
+
+    hdr.request.magic = PROTOCOL_BINARY_REQ;
+    hdr.request.opaque = pkt->opaque;
+    hdr.request.opcode = PROTOCOL_BINARY_CMD_NOOP;
+
+    mcreq_reserve_header(server, pkt, MCREQ_PKT_BASESIZE);
+    memcpy(SPAN_BUFFER(&pkt->kh_span), hdr.bytes, sizeof(hdr.bytes));
+
+    /* Sent from a timer callback, outside of any scheduling context */
+    mcreq_enqueue_packet(server, pkt);
+    mcreq_rearm_timeout(server);
+    server->flush_start(server);
+    return LCB_SUCCESS;
+}
+
 static void handle_http(lcb_INSTANCE *instance, lcb_PING_SERVICE type, const lcb_RESPHTTP *resp)
 {
     if ((resp->rflags & LCB_RESP_F_FINAL) == 0) {
@@ -371,6 +371,24 @@ static int can_compress(lcb_INSTANCE *instance, const mc_PIPELINE *pipeline, uin
     return 1;
 }
 
+/* Client-side codec the value should be encoded with, if any */
+static const lcb_VALUE_CODEC *value_codec(lcb_INSTANCE *instance, const lcb_CMDSTORE *cmd)
+{
+    lcb_U8 id = LCBT_SETTING(instance, value_codec);
+    if (id == 0 || (LCBT_SETTING(instance, compressopts) & LCB_COMPRESS_OUT) == 0 ||
+        (cmd->datatype & LCB_VALUE_F_SNAPPYCOMP)) {
+        return nullptr;
+    }
+    switch (cmd->operation) {
+        case LCB_STORE_APPEND:
+        case LCB_STORE_PREPEND:
+            /* the server concatenates the values as they are */
+            return nullptr;
+        default:
+            return mcreq_codec_find(&instance->codecs, id);
+    }
+}
+
 static lcb_STATUS store_validate(lcb_INSTANCE *instance, const lcb_CMDSTORE *cmd)
 {
     auto err = lcb_is_collection_valid(instance, cmd->scope, cmd->nscope, cmd->collection, cmd->ncollection);
@@ -439,6 +457,7 @@ LIBCOUCHBASE_API lcb_STATUS lcb_store(lcb_INSTANCE *instance, void *cookie, cons
 
         int hsize;
         int should_compress = 0;
+        int encoded = 0;
         hdr->request.magic = PROTOCOL_BINARY_REQ;
 
         lcb_U8 ffextlen = 0;
@@ -462,15 +481,24 @@ LIBCOUCHBASE_API lcb_STATUS lcb_store(lcb_INSTANCE *instance, void *cookie, cons
             return err;
         }
 
-        should_compress = can_compress(instance, pipeline, cmd->datatype);
-        if (should_compress) {
-            int rv = mcreq_compress_value(pipeline, packet, &cmd->value, instance->settings, &should_compress);
-            if (rv != 0) {
-                mcreq_release_packet(pipeline, packet);
-                return LCB_ERR_NO_MEMORY;
+        const lcb_VALUE_CODEC *codec = value_codec(instance, cmd);
+        if (codec && mcreq_codec_encode_value(pipeline, packet, codec, &cmd->value, cmd->datatype, instance->settings,
+                                               &encoded) != 0) {
+            mcreq_release_packet(pipeline, packet);
+            return LCB_ERR_NO_MEMORY;
+        }
+
+        if (!encoded) {
+            should_compress = can_compress(instance, pipeline, cmd->datatype);
+            if (should_compress) {
+                int rv = mcreq_compress_value(pipeline, packet, &cmd->value, instance->settings, &should_compress);
+                if (rv != 0) {
+                    mcreq_release_packet(pipeline, packet);
+                    return LCB_ERR_NO_MEMORY;
+                }
+            } else {
+                mcreq_reserve_value(pipeline, packet, &cmd->value);
             }
-        } else {
-            mcreq_reserve_value(pipeline, packet, &cmd->value);
         }
 
         if (cmd->durability_mode == LCB_DURABILITY_POLL) {
@@ -520,7 +548,7 @@ LIBCOUCHBASE_API lcb_STATUS lcb_store(lcb_INSTANCE *instance, void *cookie, cons
             hdr->request.datatype |= PROTOCOL_BINARY_DATATYPE_COMPRESSED;
         }
 
-        if ((cmd->datatype & LCB_VALUE_F_JSON) && static_cast<const lcb::Server *>(pipeline)->supports_json()) {
+        if ((cmd->datatype & LCB_VALUE_F_JSON) && !encoded && static_cast<const lcb::Server *>(pipeline)->supports_json()) {
             hdr->request.datatype |= PROTOCOL_BINARY_DATATYPE_JSON;
         }
 
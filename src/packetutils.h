@@ -42,13 +42,13 @@ class Server;
 class MemcachedResponse
 {
   public:
-    MemcachedResponse() : payload(NULL), bufh(NULL)
+    MemcachedResponse() : payload(NULL), bufh(NULL), value_iov(NULL), value_niov(0)
     {
         // Bodyless. Members are initialized via load!
     }
 
     MemcachedResponse(protocol_binary_command cmd, uint32_t opaque_, protocol_binary_response_status code)
-        : res(), payload(NULL), bufh(NULL)
+        : res(), payload(NULL), bufh(NULL), value_iov(NULL), value_niov(0)
     {
         res.response.opcode = cmd;
         res.response.opaque = opaque_;
@@ -299,6 +299,18 @@ class MemcachedResponse
         return bufh;
     }
 
+    /**
+     * Gets the buffers holding the value, when it was left in the segments it
+     * was read into rather than made contiguous. In that case value() only
+     * points to the first of them.
+     * @return the number of buffers, 0 if the value is contiguous
+     */
+    unsigned value_fragments(const nb_IOV **iov) const
+    {
+        *iov = value_iov;
+        return value_niov;
+    }
+
     static lcb_STATUS parse_enhanced_error(const char *value, lcb_SIZE nvalue, char **err_ref, char **err_ctx)
     {
         if (value == NULL || nvalue == 0) {
@@ -332,6 +344,9 @@ class MemcachedResponse
     void *payload;
     /** Segment for payload */
     void *bufh;
+    /** Buffers of a value which is not contiguous */
+    const nb_IOV *value_iov;
+    unsigned value_niov;
 
     friend class lcb::Server;
 };
@@ -0,0 +1,329 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2020 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include "rope.h"
+#include "poolalloc.h"
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#if defined(MAP_ANONYMOUS) && (defined(MAP_HUGETLB) || defined(MADV_HUGEPAGE))
+#define POOL_HAVE_HUGEPAGES
+#endif
+#endif
+
+/** Where the buffer of a segment comes from */
+enum { POOL_BACKING_MALLOC = 0, POOL_BACKING_MMAP, POOL_BACKING_HUGETLB };
+
+/** Marks segments which are too big to be pooled */
+#define POOL_UNPOOLED RDB_POOLALLOC_NCLASSES
+
+typedef struct {
+    rdb_ROPESEG base;
+    unsigned char cls;
+    unsigned char backing;
+} my_SEG;
+
+typedef struct {
+    rdb_ALLOCATOR base;
+    lcb_clist_t classes[RDB_POOLALLOC_NCLASSES]; /* free lists */
+    unsigned pooled[RDB_POOLALLOC_NCLASSES];     /* bytes in each free list */
+    unsigned refcount;
+    unsigned class_cap;
+    int use_hugepages;
+    rdb_POOLSTATS stats;
+} my_POOLALLOC;
+
+static unsigned size_class(unsigned size)
+{
+    unsigned cls = 0, csize = RDB_POOLALLOC_CLASS_MIN;
+    if (size > RDB_POOLALLOC_CLASS_MAX) {
+        return POOL_UNPOOLED;
+    }
+    while (csize < size) {
+        csize <<= 1;
+        cls++;
+    }
+    return cls;
+}
+
+static char *buffer_new(my_POOLALLOC *alloc, unsigned size, unsigned char *backing)
+{
+#ifdef POOL_HAVE_HUGEPAGES
+    if (alloc->use_hugepages && size >= RDB_POOLALLOC_HUGEPAGE_SIZE) {
+        void *addr;
+#ifdef MAP_HUGETLB
+        addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (addr != MAP_FAILED) {
+            *backing = POOL_BACKING_HUGETLB;
+            return addr;
+        }
+#endif
+#ifdef MADV_HUGEPAGE
+        /* No reserved huge pages; ask for transparent ones instead */
+        addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (addr != MAP_FAILED) {
+            if (madvise(addr, size, MADV_HUGEPAGE) == 0) {
+                *backing = POOL_BACKING_MMAP;
+                return addr;
+            }
+            munmap(addr, size);
+        }
+#endif
+    }
+#endif
+    *backing = POOL_BACKING_MALLOC;
+    return malloc(size);
+}
+
+static void seg_destroy(my_POOLALLOC *alloc, my_SEG *seg)
+{
+    if (seg->backing == POOL_BACKING_MALLOC) {
+        free(seg->base.root);
+    } else {
+#ifdef POOL_HAVE_HUGEPAGES
+        munmap(seg->base.root, seg->base.nalloc);
+#endif
+        alloc->stats.hugepage_bytes -= seg->base.nalloc;
+    }
+    free(seg);
+}
+
+static void alloc_decref(rdb_ALLOCATOR *abase)
+{
+    unsigned ii;
+    my_POOLALLOC *alloc = (my_POOLALLOC *)abase;
+    if (--alloc->refcount) {
+        return;
+    }
+
+    for (ii = 0; ii < RDB_POOLALLOC_NCLASSES; ii++) {
+        lcb_list_t *llcur, *llnext;
+        LCB_LIST_SAFE_FOR(llcur, llnext, (lcb_list_t *)&alloc->classes[ii])
+        {
+            my_SEG *seg = (my_SEG *)LCB_LIST_ITEM(llcur, rdb_ROPESEG, llnode);
+            lcb_clist_delete(&alloc->classes[ii], llcur);
+            seg_destroy(alloc, seg);
+        }
+    }
+    free(alloc);
+}
+
+/** Whether the free list of `cls` may keep another segment of `size` bytes */
+static int may_pool(my_POOLALLOC *alloc, unsigned cls, unsigned size)
+{
+    if (!alloc->class_cap) {
+        return 0;
+    }
+    return LCB_CLIST_SIZE(&alloc->classes[cls]) == 0 || alloc->pooled[cls] + size <= alloc->class_cap;
+}
+
+static rdb_ROPESEG *seg_alloc(rdb_ALLOCATOR *abase, unsigned size)
+{
+    my_POOLALLOC *alloc = (my_POOLALLOC *)abase;
+    my_SEG *seg = NULL;
+    unsigned cls = size_class(size);
+
+    if (cls != POOL_UNPOOLED && LCB_CLIST_SIZE(&alloc->classes[cls])) {
+        lcb_list_t *ll = lcb_clist_shift(&alloc->classes[cls]);
+        seg = (my_SEG *)LCB_LIST_ITEM(ll, rdb_ROPESEG, llnode);
+        alloc->pooled[cls] -= seg->base.nalloc;
+        alloc->stats.pooled_bytes -= seg->base.nalloc;
+        alloc->stats.nreused++;
+    } else {
+        unsigned nalloc;
+        if (cls != POOL_UNPOOLED) {
+            nalloc = RDB_POOLALLOC_CLASS_MIN << cls;
+        } else if (alloc->use_hugepages) {
+            nalloc = (size + RDB_POOLALLOC_HUGEPAGE_SIZE - 1) & ~(RDB_POOLALLOC_HUGEPAGE_SIZE - 1);
+        } else {
+            nalloc = size;
+        }
+        seg = calloc(1, sizeof(*seg));
+        seg->cls = (unsigned char)cls;
+        seg->base.root = buffer_new(alloc, nalloc, &seg->backing);
+        seg->base.nalloc = nalloc;
+        if (seg->backing != POOL_BACKING_MALLOC) {
+            alloc->stats.hugepage_bytes += nalloc;
+        }
+    }
+
+    seg->base.shflags = RDB_ROPESEG_F_LIB;
+    seg->base.allocator = abase;
+    seg->base.allocid = RDB_ALLOCATOR_POOL;
+    seg->base.start = 0;
+    seg->base.nused = 0;
+    seg->base.refcnt = 0;
+
+    alloc->stats.nalloc++;
+    alloc->stats.live_bytes += seg->base.nalloc;
+    if (alloc->stats.live_bytes > alloc->stats.peak_live_bytes) {
+        alloc->stats.peak_live_bytes = alloc->stats.live_bytes;
+    }
+    alloc->refcount++;
+    return &seg->base;
+}
+
+static void seg_release(rdb_ALLOCATOR *abase, rdb_ROPESEG *sbase)
+{
+    my_POOLALLOC *alloc = (my_POOLALLOC *)abase;
+    my_SEG *seg = (my_SEG *)sbase;
+
+    alloc->stats.live_bytes -= sbase->nalloc;
+    if (seg->cls != POOL_UNPOOLED && may_pool(alloc, seg->cls, sbase->nalloc)) {
+        lcb_clist_prepend(&alloc->classes[seg->cls], &sbase->llnode);
+        alloc->pooled[seg->cls] += sbase->nalloc;
+        alloc->stats.pooled_bytes += sbase->nalloc;
+    } else {
+        seg_destroy(alloc, seg);
+    }
+    alloc_decref(abase);
+}
+
+/**
+ * Growing a segment means moving to a bigger class. Take a buffer of the right
+ * class, move the data to its beginning, and hand the old buffer back to the
+ * pool through a temporary segment.
+ */
+static rdb_ROPESEG *seg_realloc(rdb_ALLOCATOR *abase, rdb_ROPESEG *sbase, unsigned size)
+{
+    my_SEG *seg = (my_SEG *)sbase;
+    my_SEG *tmp;
+    char *root;
+    unsigned nalloc;
+    unsigned char cls, backing;
+
+    if (size <= sbase->nalloc) {
+        return sbase;
+    }
+
+    tmp = (my_SEG *)seg_alloc(abase, size);
+    memcpy(tmp->base.root, sbase->root + sbase->start, sbase->nused);
+
+    root = tmp->base.root;
+    nalloc = tmp->base.nalloc;
+    cls = tmp->cls;
+    backing = tmp->backing;
+
+    tmp->base.root = sbase->root;
+    tmp->base.nalloc = sbase->nalloc;
+    tmp->cls = seg->cls;
+    tmp->backing = seg->backing;
+
+    sbase->root = root;
+    sbase->nalloc = nalloc;
+    sbase->start = 0;
+    seg->cls = cls;
+    seg->backing = backing;
+
+    seg_release(abase, &tmp->base);
+    return sbase;
+}
+
+static void buf_reserve(rdb_ALLOCATOR *abase, rdb_ROPEBUF *buf, unsigned size)
+{
+    rdb_ROPESEG *newseg, *lastseg;
+
+    lastseg = RDB_SEG_LAST(buf);
+    if (lastseg && RDB_SEG_SPACE(lastseg) + buf->nused >= size) {
+        return;
+    }
+
+    newseg = seg_alloc(abase, size);
+    lcb_list_append(&buf->segments, &newseg->llnode);
+}
+
+static void trim_classes(my_POOLALLOC *alloc)
+{
+    unsigned ii;
+    for (ii = 0; ii < RDB_POOLALLOC_NCLASSES; ii++) {
+        lcb_clist_t *cl = &alloc->classes[ii];
+        while (LCB_CLIST_SIZE(cl) &&
+               (!alloc->class_cap || (alloc->pooled[ii] > alloc->class_cap && LCB_CLIST_SIZE(cl) > 1))) {
+            my_SEG *seg = (my_SEG *)LCB_LIST_ITEM(lcb_clist_pop(cl), rdb_ROPESEG, llnode);
+            alloc->pooled[ii] -= seg->base.nalloc;
+            alloc->stats.pooled_bytes -= seg->base.nalloc;
+            seg_destroy(alloc, seg);
+        }
+    }
+}
+
+static void dump_wrap(rdb_ALLOCATOR *abase, FILE *fp)
+{
+    static const char *indent = "  ";
+    my_POOLALLOC *alloc = (my_POOLALLOC *)abase;
+    unsigned ii;
+
+    fprintf(fp, "POOLALLOC @%p\n", (void *)alloc);
+    fprintf(fp, "%sClassCap: %u\n", indent, alloc->class_cap);
+    fprintf(fp, "%sHugepages: %s\n", indent, alloc->use_hugepages ? "yes" : "no");
+    for (ii = 0; ii < RDB_POOLALLOC_NCLASSES; ii++) {
+        if (LCB_CLIST_SIZE(&alloc->classes[ii])) {
+            fprintf(fp, "%sClass[%u]: %lu pooled\n", indent, RDB_POOLALLOC_CLASS_MIN << ii,
+                    (unsigned long)LCB_CLIST_SIZE(&alloc->classes[ii]));
+        }
+    }
+    fprintf(fp, "%sLiveBytes: %llu\n", indent, (unsigned long long)alloc->stats.live_bytes);
+    fprintf(fp, "%sPooledBytes: %llu\n", indent, (unsigned long long)alloc->stats.pooled_bytes);
+    fprintf(fp, "%sPeakLiveBytes: %llu\n", indent, (unsigned long long)alloc->stats.peak_live_bytes);
+    fprintf(fp, "%sHugepageBytes: %llu\n", indent, (unsigned long long)alloc->stats.hugepage_bytes);
+    fprintf(fp, "%sAllocations: %llu\n", indent, (unsigned long long)alloc->stats.nalloc);
+    fprintf(fp, "%sReused: %llu\n", indent, (unsigned long long)alloc->stats.nreused);
+}
+
+rdb_ALLOCATOR *rdb_poolalloc_new(unsigned class_cap, int use_hugepages)
+{
+    rdb_ALLOCATOR *abase;
+    unsigned ii;
+    my_POOLALLOC *alloc = calloc(1, sizeof(*alloc));
+    for (ii = 0; ii < RDB_POOLALLOC_NCLASSES; ii++) {
+        lcb_clist_init(&alloc->classes[ii]);
+    }
+    alloc->class_cap = class_cap;
+    alloc->use_hugepages = use_hugepages;
+    alloc->refcount = 1;
+
+    abase = &alloc->base;
+    abase->r_reserve = buf_reserve;
+    abase->s_alloc = seg_alloc;
+    abase->s_realloc = seg_realloc;
+    abase->s_release = seg_release;
+    abase->a_release = alloc_decref;
+    abase->dump = dump_wrap;
+    return abase;
+}
+
+rdb_ALLOCATOR *rdb_poolalloc_ref(rdb_ALLOCATOR *abase)
+{
+    ((my_POOLALLOC *)abase)->refcount++;
+    return abase;
+}
+
+void rdb_poolalloc_configure(rdb_ALLOCATOR *abase, unsigned class_cap, int use_hugepages)
+{
+    my_POOLALLOC *alloc = (my_POOLALLOC *)abase;
+    alloc->class_cap = class_cap;
+    alloc->use_hugepages = use_hugepages;
+    trim_classes(alloc);
+}
+
+void rdb_poolalloc_stats(rdb_ALLOCATOR *abase, rdb_POOLSTATS *stats)
+{
+    *stats = ((my_POOLALLOC *)abase)->stats;
+}
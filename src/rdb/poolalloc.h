@@ -0,0 +1,82 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2020 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef RDB_POOLALLOC
+#define RDB_POOLALLOC
+#include "rope.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Size-class pooling allocator.
+ *
+ * Segments are rounded up to a power of two between RDB_POOLALLOC_CLASS_MIN
+ * and RDB_POOLALLOC_CLASS_MAX, and released segments are kept in a free list
+ * per class, up to `class_cap` bytes per class. Larger segments are not
+ * pooled. Unlike bigalloc, one instance of this allocator is meant to be
+ * shared by all the connections of a library instance (each IOROPE holding a
+ * reference obtained with rdb_poolalloc_ref()), so buffers released by one
+ * connection are reused by the others, whatever the mix of value sizes.
+ *
+ * Optionally, segments of RDB_POOLALLOC_HUGEPAGE_SIZE and above are mapped
+ * from huge pages (MAP_HUGETLB, or transparent huge pages via madvise when
+ * no huge pages are reserved), falling back to malloc().
+ *
+ * The allocator is not thread safe, which matches the threading model of
+ * the library instance.
+ */
+
+#define RDB_POOLALLOC_CLASS_MIN 1024
+#define RDB_POOLALLOC_CLASS_MAX (2 * 1024 * 1024)
+#define RDB_POOLALLOC_NCLASSES 12
+#define RDB_POOLALLOC_HUGEPAGE_SIZE (2 * 1024 * 1024)
+
+typedef struct {
+    lcb_U64 live_bytes;      /**< bytes of segments handed out */
+    lcb_U64 pooled_bytes;    /**< bytes of segments waiting in the free lists */
+    lcb_U64 peak_live_bytes; /**< highest value of live_bytes */
+    lcb_U64 hugepage_bytes;  /**< bytes (live or pooled) backed by huge pages */
+    lcb_U64 nalloc;          /**< number of segments handed out */
+    lcb_U64 nreused;         /**< number of those which came from a free list */
+} rdb_POOLSTATS;
+
+/**
+ * Create a new pooling allocator. The caller owns the returned reference and
+ * releases it with `a_release`.
+ * @param class_cap maximum number of bytes kept in each free list. Every
+ *        class may keep at least one segment. 0 disables pooling
+ * @param use_hugepages whether large segments should be backed by huge pages
+ */
+rdb_ALLOCATOR *rdb_poolalloc_new(unsigned class_cap, int use_hugepages);
+
+/** Take another reference on the allocator, e.g. for a new IOROPE */
+rdb_ALLOCATOR *rdb_poolalloc_ref(rdb_ALLOCATOR *alloc);
+
+/**
+ * Change the parameters of an existing allocator. Free lists exceeding the
+ * new cap are trimmed. The hugepage setting only affects new segments.
+ */
+void rdb_poolalloc_configure(rdb_ALLOCATOR *alloc, unsigned class_cap, int use_hugepages);
+
+void rdb_poolalloc_stats(rdb_ALLOCATOR *alloc, rdb_POOLSTATS *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
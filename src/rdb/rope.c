@@ -228,6 +228,32 @@ void rdb_consolidate(rdb_IOROPE *ior, unsigned nr)
     rope_consolidate(&ior->recvd, nr);
 }
 
+unsigned rdb_reserve_contig(rdb_IOROPE *ior, unsigned n)
+{
+    rdb_ROPEBUF *rope = &ior->recvd;
+    rdb_ROPESEG *seg, *newseg;
+    lcb_list_t *llcur, *llnext;
+
+    lcb_assert(rope->nused < n);
+    seg = RDB_SEG_FIRST(rope);
+    if (seg && seg->nused + RDB_SEG_SPACE(seg) >= n) {
+        return 0;
+    }
+
+    newseg = ROPE_SALLOC(rope, n);
+    LCB_LIST_SAFE_FOR(llcur, llnext, &rope->segments)
+    {
+        seg = LCB_LIST_ITEM(llcur, rdb_ROPESEG, llnode);
+        memcpy(RDB_SEG_WBUF(newseg), RDB_SEG_RBUF(seg), seg->nused);
+        newseg->nused += seg->nused;
+        seg_consumed(rope, seg, seg->nused);
+    }
+
+    lcb_list_prepend(&rope->segments, &newseg->llnode);
+    rope->nused = newseg->nused;
+    return newseg->nused;
+}
+
 void rdb_copyread(rdb_IOROPE *ior, void *tgt, unsigned n)
 {
     lcb_list_t *ll;
@@ -167,6 +167,7 @@ enum rdb_ALLOCID {
     RDB_ALLOCATOR_BIGALLOC = 1,
     RDB_ALLOCATOR_CHUNKED,
     RDB_ALLOCATOR_LIBCALLOC,
+    RDB_ALLOCATOR_POOL,
 
     /** use constants higher than this for your own allocator(s) */
     RDB_ALLOCATOR_MAX
@@ -312,6 +313,24 @@ void rdb_consolidate(rdb_IOROPE *ior, unsigned n);
  */
 char *rdb_get_consolidated(rdb_IOROPE *ior, unsigned n);
 
+/**
+ * Prepare the rope to receive `n` contiguous bytes at its beginning, of which
+ * only a part has been read so far.
+ *
+ * Unlike rdb_consolidate(), which copies data that has already been received,
+ * this is meant to be called as soon as the size of an incoming message is
+ * known: the bytes received so far are moved into a single segment of `n`
+ * bytes, and the next rdb_rdstart() reads the rest of the message straight
+ * into its free space.
+ *
+ * @param ior the IOROPE structure
+ * @param n total number of bytes which will be needed contiguously. Must be
+ *        larger than the number of bytes already received
+ * @return the number of bytes copied, or 0 if the first segment could already
+ *         hold `n` bytes
+ */
+unsigned rdb_reserve_contig(rdb_IOROPE *ior, unsigned n);
+
 /**
  * @}
  */
@@ -23,53 +23,92 @@
 #include "bucketconfig/clconfig.h"
 #include "sllist-inl.h"
 #include "mc/mcreq.h"
+#include "rnd.h"
+
+#include <algorithm>
 
 #define LOGARGS(rq, lvl) (rq)->settings, "retryq", LCB_LOG_##lvl, __FILE__, __LINE__
 #define RETRY_PKT_KEY "retry_queue"
 
 using namespace lcb;
-struct SchedNode : lcb_list_t {
-};
-struct TmoNode : lcb_list_t {
-};
-
-struct lcb::RetryOp : mc_EPKTDATUM, SchedNode, TmoNode {
-    /**Cache the actual start time of the command. Since the start time may
-     * change if read_ts_wait is enabled, and we don't want to end up looping
-     * on a command forever. */
-    hrtime_t start;
-    hrtime_t deadline;
-    hrtime_t trytime; /**< Next retry time */
-    mc_PACKET *pkt;
-    lcb_STATUS origerr;
-    protocol_binary_response_status origstatus;
-    errmap::RetrySpec *spec;
-    explicit RetryOp(errmap::RetrySpec *spec);
-    ~RetryOp()
-    {
-        if (spec != nullptr) {
-            spec->unref();
+
+bool RetryHeap::less(size_t a, size_t b) const
+{
+    if (order == BY_TRYTIME) {
+        return ops[a]->trytime < ops[b]->trytime;
+    }
+    return ops[a]->deadline < ops[b]->deadline;
+}
+
+void RetryHeap::place(size_t ix, RetryOp *op)
+{
+    ops[ix] = op;
+    op->heappos[order] = ix;
+}
+
+void RetryHeap::sift_up(size_t ix)
+{
+    while (ix > 0) {
+        size_t parent = (ix - 1) / 2;
+        if (!less(ix, parent)) {
+            break;
+        }
+        RetryOp *tmp = ops[parent];
+        place(parent, ops[ix]);
+        place(ix, tmp);
+        ix = parent;
+    }
+}
+
+void RetryHeap::sift_down(size_t ix)
+{
+    size_t n = ops.size();
+    for (;;) {
+        size_t smallest = ix, left = 2 * ix + 1, right = left + 1;
+        if (left < n && less(left, smallest)) {
+            smallest = left;
+        }
+        if (right < n && less(right, smallest)) {
+            smallest = right;
+        }
+        if (smallest == ix) {
+            break;
         }
+        RetryOp *tmp = ops[smallest];
+        place(smallest, ops[ix]);
+        place(ix, tmp);
+        ix = smallest;
     }
-};
+}
 
-static RetryOp *from_schednode(lcb_list_t *ll)
+void RetryHeap::push(RetryOp *op)
 {
-    return static_cast<RetryOp *>(static_cast<SchedNode *>(ll));
+    ops.push_back(op);
+    place(ops.size() - 1, op);
+    sift_up(ops.size() - 1);
 }
-static RetryOp *from_tmonode(lcb_list_t *ll)
+
+void RetryHeap::remove(RetryOp *op)
 {
-    return static_cast<RetryOp *>(static_cast<TmoNode *>(ll));
+    size_t ix = op->heappos[order];
+    if (ix >= ops.size() || ops[ix] != op) {
+        return; /* not queued */
+    }
+    op->heappos[order] = SIZE_MAX;
+    RetryOp *last = ops.back();
+    ops.pop_back();
+    if (ix == ops.size()) {
+        return;
+    }
+    place(ix, last);
+    sift_up(ix);
+    sift_down(last->heappos[order]);
 }
-template <typename T>
-int list_cmp(const T &a, const T &b)
+
+void RetryHeap::rebuild()
 {
-    if (a == b) {
-        return 0;
-    } else if (a > b) {
-        return 1;
-    } else {
-        return -1;
+    for (size_t ii = ops.size() / 2; ii-- > 0;) {
+        sift_down(ii);
     }
 }
 
@@ -95,30 +134,74 @@ void RetryQueue::update_trytime(RetryOp *op, hrtime_t now)
         now = gethrtime();
     }
 
+    uint64_t us_trytime = 0, us_ceil = 0;
     if (op->spec) {
-        uint32_t us_trytime = op->spec->get_next_interval(op->pkt->retries - 1);
+        us_trytime = op->spec->get_next_interval(op->pkt->retries - 1);
         if (op->pkt->retries == 1) {
             us_trytime += op->spec->after;
         }
-        if (!us_trytime) {
-            goto GT_DEFAULT;
-        }
-        op->trytime = now + (LCB_US2NS(us_trytime));
-    } else {
-    GT_DEFAULT:
-        op->trytime = now + (hrtime_t)((float)get_retry_interval() * (float)op->pkt->retries);
+        us_ceil = op->spec->get_ceil();
+    }
+    if (!us_trytime) {
+        us_trytime = LCB_NS2US(get_retry_interval()) * op->pkt->retries;
     }
+
+    if (settings->retry_jitter && us_trytime) {
+        us_trytime = retry_jitter(us_trytime, op->last_interval, us_ceil);
+    }
+    op->last_interval = (uint32_t)std::min<uint64_t>(us_trytime, UINT32_MAX);
+    op->trytime = now + LCB_US2NS(us_trytime);
 }
 
-/** Comparison routine for sorting by timeout */
-static int cmpfn_tmo(lcb_list_t *ll_a, lcb_list_t *ll_b)
+uint64_t lcb::retry_jitter(uint64_t us_base, uint64_t us_prev, uint64_t us_ceil)
 {
-    return list_cmp(from_tmonode(ll_a)->deadline, from_tmonode(ll_b)->deadline);
+    /**
+     * Decorrelated jitter: pick uniformly between the base interval and
+     * three times the previous interval, so that operations which failed
+     * together do not all come back at the same instant.
+     */
+    uint64_t us_hi = std::max<uint64_t>(us_base, us_prev * 3);
+    us_hi = std::min<uint64_t>(us_hi, us_ceil ? std::max(us_ceil, us_base) : us_base * 3);
+    return us_base + lcb_next_rand32() % (us_hi - us_base + 1);
 }
 
-static int cmpfn_retry(lcb_list_t *ll_a, lcb_list_t *ll_b)
+hrtime_t RetryBudget::take(const std::string &hostport, unsigned rate, hrtime_t now)
 {
-    return list_cmp(from_schednode(ll_a)->trytime, from_schednode(ll_b)->trytime);
+    if (!rate) {
+        return 0;
+    }
+    /* Nodes leave the cluster over time. A bucket whose arrival time has
+     * passed holds a full burst, just like a missing one, so drop those */
+    if (tats.size() > LCB_RETRY_BUDGET_PRUNE) {
+        for (auto it = tats.begin(); it != tats.end();) {
+            it = it->second <= now ? tats.erase(it) : std::next(it);
+        }
+    }
+
+    hrtime_t interval = LCB_S2NS(1) / rate;
+    /* allow a burst of up to one second worth of retries */
+    hrtime_t tolerance = LCB_S2NS(1) - interval;
+    hrtime_t &tat = tats[hostport];
+    if (tat > now + tolerance) {
+        return tat - tolerance;
+    }
+    tat = std::max(tat, now) + interval;
+    return 0;
+}
+
+/**
+ * Take a token from the retry budget of the given server. The budget follows
+ * the node rather than its index, which changes with the configuration.
+ */
+hrtime_t RetryQueue::take_budget(const lcb::Server *server, hrtime_t now)
+{
+    if (!settings->retry_budget || !server->has_valid_host()) {
+        return 0;
+    }
+    const lcb_host_t &host = server->get_host();
+    std::string hostport(host.host);
+    hostport.append(":").append(host.port);
+    return budget.take(hostport, settings->retry_budget, now);
 }
 
 static void assign_error(RetryOp *op, lcb_STATUS err)
@@ -145,8 +228,8 @@ static void assign_error(RetryOp *op, lcb_STATUS err)
 
 void RetryQueue::erase(RetryOp *op)
 {
-    lcb_list_delete(static_cast<SchedNode *>(op));
-    lcb_list_delete(static_cast<TmoNode *>(op));
+    schedops.remove(op);
+    tmoops.remove(op);
 }
 
 void RetryQueue::fail(RetryOp *op, lcb_STATUS err, hrtime_t now)
@@ -190,8 +273,8 @@ void RetryQueue::schedule(hrtime_t now)
     }
 
     /** Figure out which is first */
-    RetryOp *first_tmo = from_tmonode(LCB_LIST_HEAD(&tmoops));
-    RetryOp *first_sched = from_schednode(LCB_LIST_HEAD(&schedops));
+    RetryOp *first_tmo = tmoops.top();
+    RetryOp *first_sched = schedops.top();
 
     hrtime_t schednext = first_sched->trytime;
     hrtime_t tmonext = first_tmo->deadline;
@@ -219,30 +302,19 @@ void RetryQueue::schedule(hrtime_t now)
 void RetryQueue::flush(bool throttle)
 {
     hrtime_t now = gethrtime();
-    lcb_list_t *ll, *ll_next;
-    lcb_list_t resched_next;
+    std::vector<RetryOp *> resched_next;
 
     /** Check timeouts first */
-    LCB_LIST_SAFE_FOR(ll, ll_next, &tmoops)
-    {
-        RetryOp *op = from_tmonode(ll);
-        hrtime_t curtmo = op->deadline;
-
-        if (curtmo <= now) {
-            fail(op, LCB_ERR_TIMEOUT, now);
-        } else {
-            break;
-        }
+    while (!tmoops.empty() && tmoops.top()->deadline <= now) {
+        fail(tmoops.top(), LCB_ERR_TIMEOUT, now);
     }
 
-    lcb_list_init(&resched_next);
-    LCB_LIST_SAFE_FOR(ll, ll_next, &schedops)
-    {
+    while (!schedops.empty()) {
         protocol_binary_request_header hdr;
         int vbid, srvix;
         hrtime_t curnext;
 
-        RetryOp *op = from_schednode(ll);
+        RetryOp *op = schedops.top();
         curnext = op->trytime - TIMEFUZZ_NS;
 
         if (curnext > now && throttle) {
@@ -263,32 +335,44 @@ void RetryQueue::flush(bool throttle)
              */
             get_instance()->bootstrap(lcb::BS_REFRESH_THROTTLE);
             if (get_instance()->confmon->is_refreshing() || settings->retry[LCB_RETRY_ON_MISSINGNODE]) {
-
-                lcb_list_delete(static_cast<SchedNode *>(op));
-                lcb_list_delete(static_cast<TmoNode *>(op));
-                lcb_list_append(&resched_next, static_cast<SchedNode *>(op));
+                erase(op);
+                resched_next.push_back(op);
                 op->pkt->retries++;
                 update_trytime(op, now);
             } else {
                 fail(op, LCB_ERR_NO_MATCHING_SERVER, now);
             }
-        } else {
-            uint32_t cid = mcreq_get_cid(get_instance(), op->pkt);
-            lcb_log(LOGARGS(this, TRACE),
-                    "Flush PKT=%p to network. retries=%u, cid=%u, opaque=%u, IX=%d, time=%" PRIu64 "us",
-                    (void *)op->pkt, op->pkt->retries, cid, op->pkt->opaque, srvix, LCB_NS2US(now - op->start));
-            mc_PIPELINE *newpl = cq->pipelines[srvix];
-            mcreq_enqueue_packet(newpl, op->pkt);
-            newpl->flush_start(newpl);
+            continue;
+        }
+
+        mc_PIPELINE *newpl = cq->pipelines[srvix];
+        hrtime_t next_token = take_budget(static_cast<lcb::Server *>(newpl), now);
+        if (next_token) {
+            /* Budget for this server is exhausted. Leave the packet in the
+             * queue until the next token is available */
+            lcb_log(LOGARGS(this, TRACE), "Retry budget exhausted for IX=%d. Deferring PKT=%p by %" PRIu64 "us",
+                    srvix, (void *)op->pkt, LCB_NS2US(next_token - now));
+            MC_INCR_METRIC(newpl, retry_budget_exhausted, 1);
             erase(op);
+            resched_next.push_back(op);
+            op->trytime = next_token;
+            continue;
         }
+
+        uint32_t cid = mcreq_get_cid(get_instance(), op->pkt);
+        lcb_log(LOGARGS(this, TRACE),
+                "Flush PKT=%p to network. retries=%u, cid=%u, opaque=%u, IX=%d, time=%" PRIu64 "us",
+                (void *)op->pkt, op->pkt->retries, cid, op->pkt->opaque, srvix, LCB_NS2US(now - op->start));
+        MC_INCR_METRIC(newpl, packets_retried, 1);
+        MC_INCR_METRIC(newpl, retry_queue_time, LCB_NS2US(now - op->enqueued));
+        mcreq_enqueue_packet(newpl, op->pkt);
+        newpl->flush_start(newpl);
+        erase(op);
     }
 
-    LCB_LIST_SAFE_FOR(ll, ll_next, &resched_next)
-    {
-        RetryOp *op = from_schednode(ll);
-        lcb_list_add_sorted(&schedops, static_cast<SchedNode *>(op), cmpfn_retry);
-        lcb_list_add_sorted(&tmoops, static_cast<TmoNode *>(op), cmpfn_tmo);
+    for (auto *op : resched_next) {
+        schedops.push(op);
+        tmoops.push(op);
     }
 
     schedule(now);
@@ -314,9 +398,16 @@ static void op_dtorfn(mc_EPKTDATUM *d)
     delete static_cast<RetryOp *>(d);
 }
 
+RetryOp::~RetryOp()
+{
+    if (spec != nullptr) {
+        spec->unref();
+    }
+}
+
 RetryOp::RetryOp(errmap::RetrySpec *spec_)
-    : mc_EPKTDATUM(), start(0), deadline(0), trytime(0), pkt(nullptr), origerr(LCB_SUCCESS),
-      origstatus(PROTOCOL_BINARY_RESPONSE_SUCCESS), spec(spec_)
+    : mc_EPKTDATUM(), start(0), deadline(0), trytime(0), enqueued(0), last_interval(0), heappos{SIZE_MAX, SIZE_MAX},
+      pkt(nullptr), origerr(LCB_SUCCESS), origstatus(PROTOCOL_BINARY_RESPONSE_SUCCESS), spec(spec_)
 {
     mc_EPKTDATUM::dtorfn = op_dtorfn;
     mc_EPKTDATUM::key = RETRY_PKT_KEY;
@@ -390,6 +481,7 @@ void RetryQueue::add(mc_EXPACKET *pkt, const lcb_STATUS err, protocol_binary_res
     pkt->base.retries++;
     assign_error(op, err);
     hrtime_t now = gethrtime();
+    op->enqueued = now;
     if (options & RETRY_SCHED_IMM) {
         op->trytime = now;
     } else if (err == LCB_ERR_NOT_MY_VBUCKET) {
@@ -398,8 +490,10 @@ void RetryQueue::add(mc_EXPACKET *pkt, const lcb_STATUS err, protocol_binary_res
         update_trytime(op);
     }
 
-    lcb_list_add_sorted(&schedops, static_cast<SchedNode *>(op), cmpfn_retry);
-    lcb_list_add_sorted(&tmoops, static_cast<TmoNode *>(op), cmpfn_tmo);
+    /* the op may still be queued if the packet was re-added before being flushed */
+    erase(op);
+    schedops.push(op);
+    tmoops.push(op);
 
     uint32_t cid = mcreq_get_cid(get_instance(), &pkt->base);
     lcb_log(LOGARGS(this, DEBUG),
@@ -415,16 +509,13 @@ void RetryQueue::add(mc_EXPACKET *pkt, const lcb_STATUS err, protocol_binary_res
 
 bool RetryQueue::empty(bool ignore_cfgreq) const
 {
-    bool is_empty = LCB_LIST_IS_EMPTY(&schedops);
-    if (is_empty) {
+    if (schedops.empty()) {
         return true;
     }
     if (ignore_cfgreq) {
-        lcb_list_t *ll, *llnext;
-        LCB_LIST_SAFE_FOR(ll, llnext, &schedops)
-        {
+        for (size_t ii = 0; ii < schedops.size(); ii++) {
             protocol_binary_request_header hdr = {};
-            RetryOp *op = from_schednode(ll);
+            RetryOp *op = schedops.at(ii);
             mcreq_read_hdr(op->pkt, &hdr);
             if (hdr.request.opcode != PROTOCOL_BINARY_CMD_GET_CLUSTER_CONFIG) {
                 return false;
@@ -464,13 +555,12 @@ void RetryQueue::add_fallback(mc_PACKET *pkt)
 
 void RetryQueue::reset_timeouts(lcb_U64 now)
 {
-    lcb_list_t *ll;
-    LCB_LIST_FOR(ll, &schedops)
-    {
-        RetryOp *op = from_schednode(ll);
+    for (size_t ii = 0; ii < schedops.size(); ii++) {
+        RetryOp *op = schedops.at(ii);
         op->deadline = now + (op->deadline - op->start);
         op->start = now;
     }
+    tmoops.rebuild();
 }
 
 RetryQueue::RetryQueue(mc_CMDQUEUE *cq_, lcbio_pTABLE table, lcb_settings *settings_)
@@ -480,20 +570,15 @@ RetryQueue::RetryQueue(mc_CMDQUEUE *cq_, lcbio_pTABLE table, lcb_settings *setti
     timer = lcbio_timer_new(table, this, rq_tick);
 
     lcb_settings_ref(settings);
-    lcb_list_init(&tmoops);
-    lcb_list_init(&schedops);
     mcreq_set_fallback_handler(cq, fallback_handler);
 }
 
 RetryQueue::~RetryQueue()
 {
-    lcb_list_t *llcur, *llnext;
     hrtime_t now = gethrtime();
 
-    LCB_LIST_SAFE_FOR(llcur, llnext, &schedops)
-    {
-        RetryOp *op = from_schednode(llcur);
-        fail(op, LCB_ERR_GENERIC, now);
+    while (!schedops.empty()) {
+        fail(schedops.top(), LCB_ERR_GENERIC, now);
     }
 
     lcbio_timer_destroy(timer);
@@ -515,10 +600,7 @@ lcb_STATUS RetryQueue::error_for(const mc_PACKET *packet)
 
 void RetryQueue::dump(FILE *fp, mcreq_payload_dump_fn dumpfn)
 {
-    lcb_list_t *cur;
-    LCB_LIST_FOR(cur, &schedops)
-    {
-        RetryOp *op = from_schednode(cur);
-        mcreq_dump_packet(op->pkt, fp, dumpfn);
+    for (size_t ii = 0; ii < schedops.size(); ii++) {
+        mcreq_dump_packet(schedops.at(ii)->pkt, fp, dumpfn);
     }
 }
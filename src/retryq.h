@@ -21,9 +21,11 @@
 #include <lcbio/lcbio.h>
 #include <lcbio/timer-ng.h>
 #include <mc/mcreq.h>
-#include "list.h"
 
 #ifdef __cplusplus
+#include <map>
+#include <string>
+#include <vector>
 
 /**
  * @file
@@ -42,7 +44,113 @@
 namespace lcb
 {
 
-struct RetryOp;
+namespace errmap
+{
+class RetrySpec;
+}
+
+struct RetryOp : mc_EPKTDATUM {
+    /**Cache the actual start time of the command. Since the start time may
+     * change if read_ts_wait is enabled, and we don't want to end up looping
+     * on a command forever. */
+    hrtime_t start;
+    hrtime_t deadline;
+    hrtime_t trytime;       /**< Next retry time */
+    hrtime_t enqueued;      /**< When the op was (last) placed in the queue */
+    uint32_t last_interval; /**< Previous retry interval (us), for jitter */
+    size_t heappos[2];      /**< Position in each RetryHeap, or SIZE_MAX */
+    mc_PACKET *pkt;
+    lcb_STATUS origerr;
+    protocol_binary_response_status origstatus;
+    errmap::RetrySpec *spec;
+    explicit RetryOp(errmap::RetrySpec *spec);
+    ~RetryOp();
+};
+
+/**
+ * Intrusive binary min-heap of retry operations. Each operation remembers its
+ * position within the heap so that it may be removed in logarithmic time once
+ * it is flushed to the network or failed.
+ */
+class RetryHeap
+{
+  public:
+    enum Order { BY_TRYTIME = 0, BY_DEADLINE = 1 };
+
+    explicit RetryHeap(Order order_) : order(order_) {}
+
+    bool empty() const
+    {
+        return ops.empty();
+    }
+    size_t size() const
+    {
+        return ops.size();
+    }
+    RetryOp *top() const
+    {
+        return ops.front();
+    }
+    RetryOp *at(size_t ix) const
+    {
+        return ops[ix];
+    }
+    void push(RetryOp *op);
+    void remove(RetryOp *op);
+    /** Restore the heap ordering after the keys of all entries were modified */
+    void rebuild();
+
+  private:
+    bool less(size_t a, size_t b) const;
+    void place(size_t ix, RetryOp *op);
+    void sift_up(size_t ix);
+    void sift_down(size_t ix);
+
+    Order order;
+    std::vector<RetryOp *> ops;
+};
+
+/**
+ * Pick the next retry interval with decorrelated jitter.
+ *
+ * @param us_base the interval without jitter
+ * @param us_prev the previous interval of the operation, or zero
+ * @param us_ceil the ceiling of the retry spec, or zero
+ * @return an interval between `us_base` and three times `us_prev`, capped by
+ *  the ceiling (by three times `us_base` if there is none)
+ */
+uint64_t retry_jitter(uint64_t us_base, uint64_t us_prev, uint64_t us_ceil);
+
+/** Prune retry budgets which no longer matter once there are more than this */
+#define LCB_RETRY_BUDGET_PRUNE 64
+
+/**
+ * Per-node retry budgets (see LCB_CNTL_RETRY_BUDGET), each kept as the
+ * theoretical arrival time of the next retry (GCRA) and keyed by host:port.
+ */
+class RetryBudget
+{
+  public:
+    /**
+     * Take a token from the budget of the given node.
+     * @param hostport the node
+     * @param rate retries allowed per second, zero for no limit
+     * @param now current time
+     * @return zero if the retry may proceed, or the time at which the next
+     *  token becomes available
+     */
+    hrtime_t take(const std::string &hostport, unsigned rate, hrtime_t now);
+
+    size_t size() const
+    {
+        return tats.size();
+    }
+
+  private:
+    std::map<std::string, hrtime_t> tats;
+};
+
+class Server;
 
 class RetryQueue
 {
@@ -143,12 +251,13 @@ class RetryQueue
     inline void add_fallback(mc_PACKET *pkt);
 
   private:
-    static void erase(RetryOp *);
+    void erase(RetryOp *);
     void fail(RetryOp *, lcb_STATUS, hrtime_t);
     void schedule(hrtime_t now = 0);
     void flush(bool throttle);
     void update_trytime(RetryOp *op, hrtime_t now = 0);
     hrtime_t get_retry_interval() const;
+    hrtime_t take_budget(const lcb::Server *server, hrtime_t now);
     lcb_INSTANCE *get_instance() const
     {
         return reinterpret_cast<lcb_INSTANCE *>(cq->cqdata);
@@ -157,10 +266,11 @@ class RetryQueue
     enum AddOptions { RETRY_SCHED_IMM = 0x01 };
     void add(mc_EXPACKET *pkt, lcb_STATUS, protocol_binary_response_status, errmap::RetrySpec *, int options);
 
-    /** List of operations in retry ordering. Sorted by 'crtime' */
-    lcb_list_t schedops{};
-    /** List of operations in timeout ordering. Ordered by 'start_time' */
-    lcb_list_t tmoops{};
+    /** Heap of operations in retry ordering. Keyed by 'trytime' */
+    RetryHeap schedops{RetryHeap::BY_TRYTIME};
+    /** Heap of operations in timeout ordering. Keyed by 'deadline' */
+    RetryHeap tmoops{RetryHeap::BY_DEADLINE};
+    RetryBudget budget;
     /** Parent command queue */
     mc_CMDQUEUE *cq;
     lcb_settings *settings;
@@ -0,0 +1,198 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2020 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+#include "scramcache.h"
+#include "rnd.h"
+
+#include <cstring>
+
+#ifndef LCB_NO_SSL
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+#endif
+
+using namespace lcb;
+
+const size_t ScramCache::MAX_ENTRIES;
+
+static void cleanse(void *ptr, size_t len)
+{
+#ifndef LCB_NO_SSL
+    OPENSSL_cleanse(ptr, len);
+#else
+    volatile unsigned char *p = static_cast<volatile unsigned char *>(ptr);
+    while (len--) {
+        *p++ = 0;
+    }
+#endif
+}
+
+static std::string make_key(int mech, const std::string &user, const std::string &salt, unsigned iterations)
+{
+    std::string key;
+    key.reserve(user.size() + salt.size() + 16);
+    key.append(std::to_string(mech)).append(1, '\0');
+    key.append(user).append(1, '\0');
+    key.append(salt).append(1, '\0');
+    key.append(std::to_string(iterations));
+    return key;
+}
+
+ScramCache::ScramCache()
+{
+#ifndef LCB_NO_SSL
+    if (RAND_bytes(secret_, sizeof(secret_)) == 1) {
+        return;
+    }
+#endif
+    for (size_t ii = 0; ii < sizeof(secret_); ii += sizeof(lcb_U32)) {
+        lcb_U32 rnd = lcb_next_rand32();
+        memcpy(secret_ + ii, &rnd, sizeof(rnd));
+    }
+}
+
+ScramCache::~ScramCache()
+{
+    clear();
+    cleanse(secret_, sizeof(secret_));
+}
+
+ScramCache &ScramCache::global()
+{
+    static ScramCache *instance = new ScramCache();
+    return *instance;
+}
+
+std::string ScramCache::fingerprint(const std::string &password) const
+{
+#ifndef LCB_NO_SSL
+    unsigned char md[EVP_MAX_MD_SIZE];
+    unsigned int nmd = 0;
+    if (HMAC(EVP_sha256(), secret_, sizeof(secret_), reinterpret_cast<const unsigned char *>(password.data()),
+             password.size(), md, &nmd) != nullptr) {
+        return std::string(reinterpret_cast<const char *>(md), nmd);
+    }
+#endif
+    (void)password;
+    return std::string();
+}
+
+void ScramCache::wipe(Entry &entry)
+{
+    if (!entry.salted.empty()) {
+        cleanse(&entry.salted[0], entry.salted.size());
+    }
+}
+
+void ScramCache::erase_user(const std::string &user)
+{
+    for (auto it = entries_.begin(); it != entries_.end();) {
+        if (it->user == user) {
+            wipe(*it);
+            it = entries_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+unsigned ScramCache::lookup(int mech, const std::string &user, const std::string &password, const std::string &salt,
+                            unsigned iterations, unsigned char *out)
+{
+    std::string fp = fingerprint(password);
+    if (fp.empty()) {
+        return 0;
+    }
+    std::string key = make_key(mech, user, salt, iterations);
+
+    std::lock_guard<std::mutex> guard(mutex_);
+    for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+        if (it->user != user) {
+            continue;
+        }
+        if (it->fingerprint != fp) {
+            /* password changed since this user was cached */
+            erase_user(user);
+            return 0;
+        }
+        if (it->key != key) {
+            continue;
+        }
+        entries_.splice(entries_.begin(), entries_, it);
+        memcpy(out, it->salted.data(), it->salted.size());
+        return static_cast<unsigned>(it->salted.size());
+    }
+    return 0;
+}
+
+void ScramCache::store(int mech, const std::string &user, const std::string &password, const std::string &salt,
+                       unsigned iterations, const unsigned char *salted, unsigned nsalted)
+{
+    std::string fp = fingerprint(password);
+    if (fp.empty()) {
+        return;
+    }
+
+    Entry entry;
+    entry.key = make_key(mech, user, salt, iterations);
+    entry.fingerprint = fp;
+    entry.user = user;
+    entry.salted.assign(reinterpret_cast<const char *>(salted), nsalted);
+
+    std::lock_guard<std::mutex> guard(mutex_);
+    for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+        if (it->user == user && it->fingerprint != fp) {
+            erase_user(user);
+            break;
+        }
+        if (it->key == entry.key) {
+            wipe(*it);
+            entries_.erase(it);
+            break;
+        }
+    }
+    entries_.push_front(entry);
+    wipe(entry);
+    while (entries_.size() > MAX_ENTRIES) {
+        wipe(entries_.back());
+        entries_.pop_back();
+    }
+}
+
+void ScramCache::forget(const std::string &user)
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    erase_user(user);
+}
+
+void ScramCache::clear()
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    for (auto &entry : entries_) {
+        wipe(entry);
+    }
+    entries_.clear();
+}
+
+size_t ScramCache::size()
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    return entries_.size();
+}
@@ -0,0 +1,101 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2020 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LCB_SCRAMCACHE_H
+#define LCB_SCRAMCACHE_H
+
+#ifdef __cplusplus
+#include <list>
+#include <mutex>
+#include <string>
+
+namespace lcb
+{
+
+/**
+ * Cache of SCRAM SaltedPassword values.
+ *
+ * Deriving the salted password runs PBKDF2 with the iteration count chosen by
+ * the server (thousands of rounds), which dominates the cost of establishing
+ * a KV connection. The result only depends on the password, the salt, the
+ * iteration count and the hash function, so it may be reused for every
+ * connection authenticating as the same user.
+ *
+ * Entries are keyed by (mechanism, user, salt, iterations). Each entry also
+ * remembers a keyed digest of the password it was derived from; if a lookup
+ * is made with a different password the credentials have changed, and every
+ * entry of that user is wiped.
+ *
+ * The cache is internally locked so that the process-wide instance may be
+ * shared by instances running in different threads.
+ */
+class ScramCache
+{
+  public:
+    ScramCache();
+    ~ScramCache();
+
+    /**
+     * Copy the cached salted password into `out` (which must be able to hold
+     * the largest digest).
+     * @return the length of the salted password, or 0 if nothing was found
+     */
+    unsigned lookup(int mech, const std::string &user, const std::string &password, const std::string &salt,
+                    unsigned iterations, unsigned char *out);
+
+    void store(int mech, const std::string &user, const std::string &password, const std::string &salt,
+               unsigned iterations, const unsigned char *salted, unsigned nsalted);
+
+    /** Wipe all the entries of the given user */
+    void forget(const std::string &user);
+
+    /** Wipe all the entries */
+    void clear();
+
+    size_t size();
+
+    /** The cache shared by all instances configured with LCB_SCRAM_CACHE_PROCESS */
+    static ScramCache &global();
+
+    /** Maximum number of salted passwords remembered */
+    static const size_t MAX_ENTRIES = 64;
+
+  private:
+    struct Entry {
+        std::string key;
+        std::string fingerprint;
+        std::string user;
+        std::string salted;
+    };
+
+    std::string fingerprint(const std::string &password) const;
+    void erase_user(const std::string &user);
+    static void wipe(Entry &entry);
+
+    std::mutex mutex_;
+    std::list<Entry> entries_; /**< most recently used first */
+    unsigned char secret_[32];   /**< key for password fingerprints */
+};
+
+} // namespace lcb
+
+typedef lcb::ScramCache *lcb_pSCRAMCACHE;
+#else
+typedef struct lcb_SCRAMCACHE *lcb_pSCRAMCACHE;
+#endif /* __cplusplus */
+
+#endif /* LCB_SCRAMCACHE_H */
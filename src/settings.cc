@@ -34,6 +34,16 @@ void lcb_default_settings(lcb_settings *settings)
     settings->durability_timeout = LCB_DEFAULT_DURABILITY_TIMEOUT;
     settings->durability_interval = LCB_DEFAULT_DURABILITY_INTERVAL;
     settings->persistence_timeout_floor = LCB_DEFAULT_PERSISTENCE_TIMEOUT_FLOOR;
+    settings->replica_hedge_delay = LCB_DEFAULT_REPLICA_HEDGE_DELAY;
+    settings->retry_jitter = 0;
+    settings->retry_budget = LCB_DEFAULT_RETRY_BUDGET;
+    settings->circuit_breaker_volume = LCB_DEFAULT_CIRCUIT_BREAKER_VOLUME;
+    settings->circuit_breaker_threshold = LCB_DEFAULT_CIRCUIT_BREAKER_THRESHOLD;
+    settings->circuit_breaker_window = LCB_DEFAULT_CIRCUIT_BREAKER_WINDOW;
+    settings->circuit_breaker_sleep = LCB_DEFAULT_CIRCUIT_BREAKER_SLEEP;
+    settings->connect_attempt_delay = LCB_DEFAULT_CONNECT_ATTEMPT_DELAY;
+    settings->bootstrap_race_count = LCB_DEFAULT_BOOTSTRAP_RACE_COUNT;
+    settings->bootstrap_race_delay = LCB_DEFAULT_BOOTSTRAP_RACE_DELAY;
     settings->http_timeout = LCB_DEFAULT_HTTP_TIMEOUT;
     settings->weird_things_threshold = LCB_DEFAULT_CONFIG_ERRORS_THRESHOLD;
     settings->weird_things_delay = LCB_DEFAULT_CONFIG_ERRORS_DELAY;
@@ -43,6 +53,8 @@ void lcb_default_settings(lcb_settings *settings)
     settings->bc_http_stream_time = LCB_DEFAULT_BC_HTTP_DISCONNTMO;
     settings->retry_interval = LCB_DEFAULT_RETRY_INTERVAL;
     settings->sslopts = 0;
+    settings->ssl_session_cache = 1;
+    settings->scram_cache_mode = LCB_SCRAM_CACHE_INSTANCE;
     settings->retry[LCB_RETRY_ON_SOCKERR] = LCB_DEFAULT_NETRETRY;
     settings->retry[LCB_RETRY_ON_TOPOCHANGE] = LCB_DEFAULT_TOPORETRY;
     settings->retry[LCB_RETRY_ON_VBMAPERR] = LCB_DEFAULT_NMVRETRY;
@@ -51,7 +63,10 @@ void lcb_default_settings(lcb_settings *settings)
     settings->compressopts = LCB_DEFAULT_COMPRESSOPTS;
     settings->compress_min_size = LCB_DEFAULT_COMPRESS_MIN_SIZE;
     settings->compress_min_ratio = (float)LCB_DEFAULT_COMPRESS_MIN_RATIO;
+    settings->value_codec_min_size = LCB_DEFAULT_VALUE_CODEC_MIN_SIZE;
     settings->allocator_factory = rdb_bigalloc_new;
+    settings->read_allocator = LCB_READ_ALLOCATOR_DEFAULT;
+    settings->read_pool_class_cap = LCB_DEFAULT_READ_POOL_CLASS_CAP;
     settings->detailed_neterr = 0;
     settings->refresh_on_hterr = 1;
     settings->sched_implicit_flush = 1;
@@ -93,6 +108,7 @@ lcb_settings *lcb_settings_new(void)
     settings->refcount = 1;
     settings->auth = lcbauth_new();
     settings->errmap = lcb_errmap_new();
+    settings->scram_cache = new lcb::ScramCache();
     return settings;
 }
 
@@ -111,6 +127,10 @@ void lcb_settings_unref(lcb_settings *settings)
 
     lcbauth_unref(settings->auth);
     lcb_errmap_free(settings->errmap);
+    delete settings->scram_cache;
+    if (settings->read_pool) {
+        settings->read_pool->a_release(settings->read_pool);
+    }
 
     if (settings->ssl_ctx) {
         lcbio_ssl_free(settings->ssl_ctx);
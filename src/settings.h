@@ -74,6 +74,36 @@
 /* 10ms */
 #define LCB_DEFAULT_RETRY_INTERVAL LCB_MS2US(10)
 
+/* 0 (derive from the p99 of the KV timings histogram) */
+#define LCB_DEFAULT_REPLICA_HEDGE_DELAY 0
+
+/* 10ms, used when the hedge delay is derived but timings are disabled */
+#define LCB_DEFAULT_REPLICA_HEDGE_FALLBACK LCB_MS2US(10)
+
+/* Unlimited */
+#define LCB_DEFAULT_RETRY_BUDGET 0
+
+/* 20 operations */
+#define LCB_DEFAULT_CIRCUIT_BREAKER_VOLUME 20
+
+/* 50 percent */
+#define LCB_DEFAULT_CIRCUIT_BREAKER_THRESHOLD 50
+
+/* 1 minute */
+#define LCB_DEFAULT_CIRCUIT_BREAKER_WINDOW LCB_MS2US(60000)
+
+/* 5 seconds */
+#define LCB_DEFAULT_CIRCUIT_BREAKER_SLEEP LCB_MS2US(5000)
+
+/* 250 ms, as recommended by RFC 8305 */
+#define LCB_DEFAULT_CONNECT_ATTEMPT_DELAY LCB_MS2US(250)
+
+/* one node at a time */
+#define LCB_DEFAULT_BOOTSTRAP_RACE_COUNT 1
+
+/* 500 ms */
+#define LCB_DEFAULT_BOOTSTRAP_RACE_DELAY LCB_MS2US(500)
+
 #define LCB_DEFAULT_TOPORETRY LCB_RETRY_CMDS_ALL
 #define LCB_DEFAULT_NETRETRY LCB_RETRY_CMDS_ALL
 #define LCB_DEFAULT_NMVRETRY LCB_RETRY_CMDS_ALL
@@ -84,6 +114,8 @@
 #define LCB_DEFAULT_COMPRESS_MIN_SIZE 32
 /* compressed_bytes / original_bytes */
 #define LCB_DEFAULT_COMPRESS_MIN_RATIO 0.83
+/* in bytes */
+#define LCB_DEFAULT_VALUE_CODEC_MIN_SIZE (64 * 1024)
 
 #define LCB_DEFAULT_NVM_RETRY_IMM 0
 #define LCB_DEFAULT_RETRY_NMV_INTERVAL LCB_MS2US(100)
@@ -109,10 +141,14 @@
 
 #define LCB_DEFAULT_PERSISTENCE_TIMEOUT_FLOOR 1500000
 
+/* idle bytes kept by each size class of the read pool */
+#define LCB_DEFAULT_READ_POOL_CLASS_CAP (4 * 1024 * 1024)
+
 #include "config.h"
 #include <libcouchbase/couchbase.h>
 #include <libcouchbase/metrics.h>
 #include "errmap.h"
+#include "scramcache.h"
 
 #include <libcouchbase/tracing.h>
 
@@ -143,6 +179,7 @@ typedef struct lcb_settings_st {
     lcb_U32 durability_timeout;
     lcb_U32 durability_interval;
     lcb_U32 persistence_timeout_floor;
+    lcb_U32 replica_hedge_delay; /** delay before racing a replica read, in microseconds. 0 means p99 of KV */
     lcb_U32 config_timeout;
     lcb_U32 config_node_timeout;
     lcb_U32 retry_interval;
@@ -195,6 +232,12 @@ typedef struct lcb_settings_st {
     unsigned wait_for_config : 1;
     unsigned enable_durable_write : 1;
     unsigned enable_unordered_execution : 1;
+    unsigned retry_jitter : 1;
+    unsigned circuit_breaker : 1;
+    unsigned ssl_session_cache : 1;
+    unsigned ssl_ktls : 1;
+    unsigned read_pool_hugepages : 1;
+    unsigned collections_prefetch : 1;
 
     lcb_RETRY_STRATEGY retry_strategy;
     short max_redir;
@@ -209,13 +252,28 @@ typedef struct lcb_settings_st {
     char *keypath;
     lcb_AUTHENTICATOR *auth;
     struct rdb_ALLOCATOR *(*allocator_factory)(void);
+    lcb_READ_ALLOCATOR read_allocator;
+    lcb_U32 read_pool_class_cap;
+    lcb_U32 deferred_max_ops;   /** operations waiting for the first configuration, 0 for unlimited */
+    lcb_U32 deferred_max_bytes; /** memory held by those operations, 0 for unlimited */
+    struct rdb_ALLOCATOR *read_pool; /** shared by the connections when read_allocator is POOL, created on first use */
     struct lcbio_SSLCTX *ssl_ctx;
     const lcb_LOGGER *logger;
     void (*dtorcb)(const void *);
     void *dtorarg;
     char *client_string;
     lcb_pERRMAP errmap;
+    lcb_SCRAM_CACHE scram_cache_mode;
+    lcb_pSCRAMCACHE scram_cache;
     lcb_U32 retry_nmv_interval;
+    lcb_U32 retry_budget; /** maximum retries per second to a single server, 0 for unlimited */
+    lcb_U32 circuit_breaker_volume;    /** minimum operations in the window before the breaker may open */
+    lcb_U32 circuit_breaker_threshold; /** failure percentage at which the breaker opens */
+    lcb_U32 circuit_breaker_window;    /** length of the rolling window, in microseconds */
+    lcb_U32 circuit_breaker_sleep;     /** time before an open breaker sends a probe, in microseconds */
+    lcb_U32 connect_attempt_delay;     /** delay before racing the next address of a host, in microseconds */
+    lcb_U32 bootstrap_race_count;      /** maximum number of nodes asked for the configuration at once */
+    lcb_U32 bootstrap_race_delay;      /** delay before asking another node for the configuration, in microseconds */
     struct lcb_METRICS_st *metrics;
     lcbtrace_TRACER *tracer;
     lcb_U32 tracer_orphaned_queue_flush_interval;
@@ -225,6 +283,8 @@ typedef struct lcb_settings_st {
     lcb_U32 tracer_threshold[LCBTRACE_THRESHOLD__MAX];
     lcb_U32 compress_min_size;
     float compress_min_ratio;
+    lcb_U8 value_codec;           /** client-side codec of large values, 0 for none */
+    lcb_U32 value_codec_min_size; /** smallest value encoded by that codec */
     char *network; /** network resolution, AKA "Multi Network Configurations" */
 } lcb_settings;
 
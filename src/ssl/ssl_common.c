@@ -27,8 +27,12 @@
 
 #if OPENSSL_VERSION_NUMBER >= 0x1010100fL
 #define HAVE_CIPHERSUITES 1
+#define HAVE_TLS13_SESSIONS 1
 #endif
 
+/* Maximum number of hosts whose sessions are remembered by one SSL context */
+#define SESSION_CACHE_MAX 64
+
 #define LOGARGS(ssl, lvl) ((lcbio_SOCKET *)SSL_get_app_data(ssl))->settings, "SSL", lvl, __FILE__, __LINE__
 static char *global_event = "dummy event for ssl";
 
@@ -135,6 +139,11 @@ void iotssl_init_common(lcbio_XSSL *xs, lcbio_TABLE *orig, SSL_CTX *sctx)
 void iotssl_destroy_common(lcbio_XSSL *xs)
 {
     free(xs->iops_dummy_);
+    if (!xs->error) {
+        /* We never send close_notify. Without this, SSL_free() marks the
+         * session as not resumable, and so invalidates the cached copy */
+        SSL_set_shutdown(xs->ssl, SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+    }
     SSL_free(xs->ssl);
     lcbio_table_unref(xs->orig);
 }
@@ -243,8 +252,14 @@ static void log_callback(const SSL *ssl, int where, int ret)
             SSL_state_string_long(ssl), ret, retstr);
 
     if (where == SSL_CB_HANDSHAKE_DONE) {
-        lcb_log(LOGARGS(ssl, LCB_LOG_DEBUG), "sock=%p. Using SSL version %s. Cipher=%s", (void *)sock,
-                SSL_get_version(ssl), SSL_get_cipher_name(ssl));
+        lcb_log(LOGARGS(ssl, LCB_LOG_DEBUG), "sock=%p. Using SSL version %s. Cipher=%s. Resumed=%d", (void *)sock,
+                SSL_get_version(ssl), SSL_get_cipher_name(ssl), (int)SSL_session_reused((SSL *)ssl));
+#if LCB_CAN_KTLS
+        if (sock && sock->settings->ssl_ktls) {
+            lcb_log(LOGARGS(ssl, LCB_LOG_DEBUG), "sock=%p. kTLS send=%d, recv=%d", (void *)sock,
+                    (int)BIO_get_ktls_send(SSL_get_wbio(ssl)), (int)BIO_get_ktls_recv(SSL_get_rbio(ssl)));
+        }
+#endif
     }
 }
 
@@ -274,10 +289,127 @@ msg_callback(int write_p, int version, int ctype, const void *buf, size_t n,
 }
 #endif
 
+/* Last session received from a host, keyed by "host:port" */
+typedef struct ssl_CACHED_SESSION {
+    struct ssl_CACHED_SESSION *next;
+    char *key;
+    SSL_SESSION *session;
+} ssl_CACHED_SESSION;
+
 struct lcbio_SSLCTX {
     SSL_CTX *ctx;
+    /** Most recently used first */
+    ssl_CACHED_SESSION *sessions;
+    unsigned nsessions;
 };
 
+static char *session_key(const lcbio_SOCKET *sock)
+{
+    const lcb_host_t *host = &sock->info->ep_remote;
+    size_t n = strlen(host->host) + strlen(host->port) + 2;
+    char *key = malloc(n);
+    snprintf(key, n, "%s:%s", host->host, host->port);
+    return key;
+}
+
+static void session_free(ssl_CACHED_SESSION *ent)
+{
+    SSL_SESSION_free(ent->session);
+    free(ent->key);
+    free(ent);
+}
+
+/* Find the entry for `key` and unlink it from the list */
+static ssl_CACHED_SESSION *session_take(lcbio_pSSLCTX sctx, const char *key)
+{
+    ssl_CACHED_SESSION **pp;
+    for (pp = &sctx->sessions; *pp; pp = &(*pp)->next) {
+        ssl_CACHED_SESSION *ent = *pp;
+        if (strcmp(ent->key, key) == 0) {
+            *pp = ent->next;
+            ent->next = NULL;
+            sctx->nsessions--;
+            return ent;
+        }
+    }
+    return NULL;
+}
+
+/* Called by OpenSSL whenever the server hands out a new session or ticket */
+static int new_session_callback(SSL *ssl, SSL_SESSION *session)
+{
+    lcbio_SOCKET *sock = SSL_get_app_data(ssl);
+    lcbio_pSSLCTX sctx = SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl));
+    ssl_CACHED_SESSION *ent;
+    char *key;
+
+    if (!sock || !sctx || !sock->settings->ssl_session_cache) {
+        return 0;
+    }
+
+    key = session_key(sock);
+    ent = session_take(sctx, key);
+    if (ent) {
+        free(key);
+        SSL_SESSION_free(ent->session);
+    } else {
+        ent = calloc(1, sizeof(*ent));
+        ent->key = key;
+    }
+    ent->session = session;
+    ent->next = sctx->sessions;
+    sctx->sessions = ent;
+    sctx->nsessions++;
+
+    if (sctx->nsessions > SESSION_CACHE_MAX) {
+        ssl_CACHED_SESSION *cur = sctx->sessions;
+        while (cur->next->next) {
+            cur = cur->next;
+        }
+        session_free(cur->next);
+        cur->next = NULL;
+        sctx->nsessions--;
+    }
+    lcb_log(LOGARGS(ssl, LCB_LOG_TRACE), "sock=%p. Cached TLS session for %s", (void *)sock, ent->key);
+    return 1; /* we keep the reference */
+}
+
+/* Offer the cached session (if any) for the socket's remote host */
+static void session_resume(lcbio_SOCKET *sock, lcbio_pSSLCTX sctx, SSL *ssl)
+{
+    ssl_CACHED_SESSION *ent;
+    char *key;
+
+    if (!sock->settings->ssl_session_cache || !sctx->sessions) {
+        return;
+    }
+
+    key = session_key(sock);
+    ent = session_take(sctx, key);
+    free(key);
+    if (!ent) {
+        return;
+    }
+#ifdef HAVE_TLS13_SESSIONS
+    if (!SSL_SESSION_is_resumable(ent->session)) {
+        session_free(ent);
+        return;
+    }
+#endif
+    SSL_set_session(ssl, ent->session);
+#ifdef HAVE_TLS13_SESSIONS
+    /* TLS 1.3 tickets should be used only once; the server sends a fresh one
+     * after the handshake. Older sessions may be reused, so keep them */
+    if (SSL_SESSION_get_protocol_version(ent->session) >= TLS1_3_VERSION) {
+        session_free(ent);
+        return;
+    }
+#endif
+    ent->next = sctx->sessions;
+    sctx->sessions = ent;
+    sctx->nsessions++;
+}
+
 #define LOGARGS_S(settings, lvl) settings, "SSL", lvl, __FILE__, __LINE__
 
 static long decode_ssl_protocol(const char *protocol)
@@ -410,6 +542,12 @@ lcbio_pSSLCTX lcbio_ssl_new(const char *tsfile, const char *cafile, const char *
      */
     SSL_CTX_set_mode(ret->ctx, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
     SSL_CTX_set_options(ret->ctx, decode_ssl_protocol(minimum_tls));
+
+    /* Sessions are cached per host by new_session_callback(), not by OpenSSL's
+     * own cache which is keyed by session ID and useless to clients */
+    SSL_CTX_set_app_data(ret->ctx, ret);
+    SSL_CTX_set_session_cache_mode(ret->ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(ret->ctx, new_session_callback);
     return ret;
 
 GT_ERR:
@@ -434,7 +572,7 @@ lcb_STATUS lcbio_ssl_apply(lcbio_SOCKET *sock, lcbio_pSSLCTX sctx)
     lcbio_PROTOCTX *sproto;
 
     if (old_iot->model == LCB_IOMODEL_EVENT) {
-        new_iot = lcbio_Essl_new(old_iot, sock->u.fd, sctx->ctx);
+        new_iot = lcbio_Essl_new(old_iot, sock->u.fd, sctx->ctx, sock->settings->ssl_ktls);
     } else {
         new_iot = lcbio_Cssl_new(old_iot, sock->u.sd, sctx->ctx);
     }
@@ -446,8 +584,14 @@ lcb_STATUS lcbio_ssl_apply(lcbio_SOCKET *sock, lcbio_pSSLCTX sctx)
         lcbio_protoctx_add(sock, sproto);
         lcbio_table_unref(old_iot);
         sock->io = new_iot;
-        /* just for logging */
+        /* for logging and the session cache */
         SSL_set_app_data(((lcbio_XSSL *)new_iot)->ssl, sock);
+        session_resume(sock, sctx, ((lcbio_XSSL *)new_iot)->ssl);
+        if (sock->settings->ssl_ktls && (!LCB_CAN_KTLS || old_iot->model != LCB_IOMODEL_EVENT)) {
+            lcb_log(LOGARGS(((lcbio_XSSL *)new_iot)->ssl, LCB_LOG_DEBUG),
+                    "sock=%p. Kernel TLS is not available for this IO plugin/OpenSSL, using userspace TLS",
+                    (void *)sock);
+        }
         return LCB_SUCCESS;
 
     } else {
@@ -468,6 +612,11 @@ lcb_STATUS lcbio_ssl_get_error(lcbio_SOCKET *sock)
 
 void lcbio_ssl_free(lcbio_pSSLCTX ctx)
 {
+    while (ctx->sessions) {
+        ssl_CACHED_SESSION *ent = ctx->sessions;
+        ctx->sessions = ent->next;
+        session_free(ent);
+    }
     SSL_CTX_free(ctx->ctx);
     free(ctx);
 }
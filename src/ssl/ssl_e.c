@@ -28,6 +28,10 @@
  *
  * - SSL_want_read() is true
  * - The wbio is not empty
+ *
+ * In "direct" mode (used for kernel TLS) the SSL object owns a socket BIO and
+ * performs network I/O itself; only readiness is proxied through the
+ * original IO table.
  */
 
 typedef struct {
@@ -42,6 +46,7 @@ typedef struct {
     lcb_socket_t fd; /**< Socket descriptor */
     lcbio_pTIMER as_fake;
     lcb_SIZE last_nw; /**< Last failed call to SSL_write() */
+    int direct;       /**< SSL reads/writes the socket directly */
 } lcbio_ESSL;
 
 #ifdef USE_EAGAIN
@@ -88,7 +93,13 @@ static void schedule_pending(lcbio_ESSL *es)
         wanted |= LCB_READ_EVENT;
     }
 
-    if (BIO_ctrl_pending(es->wbio)) {
+    if (es->direct) {
+        if (SSL_want_write(es->ssl)) {
+            /* socket buffer is full; wait until it drains */
+            avail &= ~LCB_WRITE_EVENT;
+            wanted |= LCB_WRITE_EVENT;
+        }
+    } else if (BIO_ctrl_pending(es->wbio)) {
         /* have data to flush */
         wanted |= LCB_WRITE_EVENT;
     }
@@ -119,6 +130,14 @@ static int read_ssl_data(lcbio_ESSL *es)
 
 #if LCB_CAN_OPTIMIZE_SSL_BIO
     BUF_MEM *rmb;
+#endif
+
+    if (es->direct) {
+        /* SSL_read() pulls from the socket itself */
+        return 0;
+    }
+
+#if LCB_CAN_OPTIMIZE_SSL_BIO
 
     /* This block is an optimization over BIO_write to avoid copying the memory
      * to a temporary buffer and _then_ copying it into the BIO */
@@ -172,6 +191,11 @@ static int flush_ssl_data(lcbio_ESSL *es)
     int tmp_len, nw;
     lcbio_pTABLE iot = es->orig;
 
+    if (es->direct) {
+        /* SSL_write() already pushed everything it could to the socket */
+        return 0;
+    }
+
     BIO_get_mem_ptr(es->wbio, &wmb);
     tmp_p = wmb->data;
     tmp_len = wmb->length;
@@ -404,7 +428,26 @@ static void Essl_dtor(void *arg)
     free(es);
 }
 
-lcbio_pTABLE lcbio_Essl_new(lcbio_pTABLE orig, lcb_socket_t fd, SSL_CTX *sctx)
+/* Replace the memory BIOs with a socket BIO so that OpenSSL may install the
+ * session keys into the kernel once the handshake completes */
+static void enable_direct(lcbio_ESSL *es)
+{
+#if LCB_CAN_KTLS
+    BIO *sbio = BIO_new_socket((int)es->fd, BIO_NOCLOSE);
+    if (sbio == NULL) {
+        return;
+    }
+    /* frees the memory BIOs */
+    SSL_set_bio(es->ssl, sbio, sbio);
+    es->rbio = es->wbio = sbio;
+    SSL_set_options(es->ssl, SSL_OP_ENABLE_KTLS);
+    es->direct = 1;
+#else
+    (void)es;
+#endif
+}
+
+lcbio_pTABLE lcbio_Essl_new(lcbio_pTABLE orig, lcb_socket_t fd, SSL_CTX *sctx, int ktls)
 {
     lcbio_ESSL *es = calloc(1, sizeof(*es));
     lcbio_TABLE *iot = &es->base_;
@@ -420,5 +463,8 @@ lcbio_pTABLE lcbio_Essl_new(lcbio_pTABLE orig, lcb_socket_t fd, SSL_CTX *sctx)
     iot->u_io.v0.io.close = Essl_close;
     iot->dtor = Essl_dtor;
     iotssl_init_common((lcbio_XSSL *)es, orig, sctx);
+    if (ktls) {
+        enable_direct(es);
+    }
     return iot;
 }
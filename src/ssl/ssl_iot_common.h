@@ -26,6 +26,13 @@
 #include <openssl/ssl.h>
 #include <lcbio/ssl.h>
 
+/* Whether sockets can be handed to OpenSSL for kernel TLS offload */
+#if defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS) && !defined(_WIN32)
+#define LCB_CAN_KTLS 1
+#else
+#define LCB_CAN_KTLS 0
+#endif
+
 #define IOTSSL_COMMON_FIELDS                                                                                           \
     lcbio_TABLE base_;        /**< Base table structure to export */                                                   \
     lcbio_pTABLE orig;        /**< Table pointer we are wrapping */                                                    \
@@ -168,8 +175,10 @@ lcbio_pTABLE lcbio_Cssl_new(lcbio_pTABLE orig, lcb_sockdata_t *sd, SSL_CTX *sctx
  * @param orig The original pointer
  * @param fd Socket descriptor
  * @param sctx
+ * @param ktls if nonzero, let OpenSSL use the socket directly (rather than
+ * memory BIOs) and enable kernel TLS if available
  * @return NULL on error.
  */
-lcbio_pTABLE lcbio_Essl_new(lcbio_pTABLE orig, lcb_socket_t fd, SSL_CTX *sctx);
+lcbio_pTABLE lcbio_Essl_new(lcbio_pTABLE orig, lcb_socket_t fd, SSL_CTX *sctx, int ktls);
 
 #endif
@@ -0,0 +1,369 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2020 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "internal.h"
+#include <lcbio/iotable.h>
+#include <lcbio/timer-ng.h>
+#include <libcouchbase/submitq.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>
+#endif
+#endif
+
+#define LOGARGS(q, lvl) (q)->instance->settings, "submitq", LCB_LOG_##lvl, __FILE__, __LINE__
+
+/*
+ * The ring is the bounded queue described by Dmitry Vyukov: every cell
+ * carries a sequence number telling whether it is free for the producer
+ * holding position `pos` (seq == pos) or filled for the consumer at that
+ * position (seq == pos + 1). Producers claim a position with a CAS on `tail`,
+ * the single consumer (the I/O thread) owns `head`.
+ */
+struct lcb_SUBMITQ_st {
+    struct Cell {
+        std::atomic<size_t> seq;
+        lcb_SUBMIT_CALLBACK callback;
+        void *arg;
+    };
+
+    lcb_INSTANCE *instance{nullptr};
+    Cell *cells{nullptr};
+    size_t capacity{0};
+    size_t mask{0};
+    size_t head{0};
+    /* keep the producers' cache line away from the consumer's */
+    char pad0_[64]{};
+    std::atomic<size_t> tail{0};
+    char pad1_[64]{};
+    /** Set when the I/O thread has been (or is about to be) signalled */
+    std::atomic<bool> wakeup_pending{false};
+    std::atomic<bool> stopping{false};
+    bool running{false};
+
+    /** Read and write ends of the wakeup descriptor. Both are the same with eventfd */
+    int rfd{-1};
+    int wfd{-1};
+    void *event{nullptr};
+    lcbio_TIMER *poll_timer{nullptr};
+
+    bool push(lcb_SUBMIT_CALLBACK callback, void *arg)
+    {
+        size_t pos = tail.load(std::memory_order_relaxed);
+        Cell *cell;
+        for (;;) {
+            cell = &cells[pos & mask];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+        cell->callback = callback;
+        cell->arg = arg;
+        cell->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(lcb_SUBMIT_CALLBACK *callback, void **arg)
+    {
+        Cell *cell = &cells[head & mask];
+        if (cell->seq.load(std::memory_order_acquire) != head + 1) {
+            /* empty, or the producer of this cell has not finished yet. It
+             * will signal us once it has */
+            return false;
+        }
+        *callback = cell->callback;
+        *arg = cell->arg;
+        cell->seq.store(head + capacity, std::memory_order_release);
+        head++;
+        return true;
+    }
+
+    void signal()
+    {
+        if (wakeup_pending.exchange(true)) {
+            return;
+        }
+#ifndef _WIN32
+        if (wfd == -1) {
+            return; /* polled */
+        }
+#ifdef HAVE_SYS_EVENTFD_H
+        uint64_t one = 1;
+#else
+        char one = 1;
+#endif
+        ssize_t rv;
+        do {
+            rv = write(wfd, &one, sizeof(one));
+        } while (rv == -1 && errno == EINTR);
+        /* EAGAIN means the descriptor is readable already */
+#endif
+    }
+
+    void clear_wakeup()
+    {
+#ifndef _WIN32
+        if (rfd != -1) {
+            char buf[64];
+            for (;;) {
+                ssize_t rv = read(rfd, buf, sizeof(buf));
+                if (rv > 0) {
+#ifdef HAVE_SYS_EVENTFD_H
+                    break; /* the counter is reset by a single read */
+#else
+                    continue;
+#endif
+                }
+                if (rv == -1 && errno == EINTR) {
+                    continue;
+                }
+                break;
+            }
+        }
+#endif
+        wakeup_pending.store(false);
+    }
+
+    /**
+     * Invoke the entries present in the ring, at most a ring's worth so that
+     * busy producers do not starve the network, inside a single scheduling
+     * context.
+     */
+    size_t drain()
+    {
+        size_t n = 0;
+        lcb_SUBMIT_CALLBACK callback;
+        void *arg;
+        while (n < capacity && pop(&callback, &arg)) {
+            if (n == 0) {
+                lcb_sched_enter(instance);
+            }
+            callback(instance, arg);
+            n++;
+        }
+        if (n) {
+            lcb_sched_leave(instance);
+        }
+        if (n == capacity) {
+            signal();
+        }
+        return n;
+    }
+
+    void on_wakeup()
+    {
+        clear_wakeup();
+        drain();
+        if (running && stopping.load()) {
+            lcb_stop_loop(instance);
+        }
+    }
+
+    void arm()
+    {
+        if (event) {
+            instance->iotable->E_event_watch(rfd, event, LCB_READ_EVENT, this, event_handler);
+        } else {
+            lcbio_timer_rearm(poll_timer, LCB_SUBMITQ_POLL_INTERVAL);
+        }
+    }
+
+    void disarm()
+    {
+        if (event) {
+            instance->iotable->E_event_cancel(rfd, event);
+        } else {
+            lcbio_timer_disarm(poll_timer);
+        }
+    }
+
+    static void event_handler(lcb_socket_t, short, void *arg)
+    {
+        static_cast<lcb_SUBMITQ *>(arg)->on_wakeup();
+    }
+
+    static void poll_handler(void *arg)
+    {
+        auto *queue = static_cast<lcb_SUBMITQ *>(arg);
+        queue->on_wakeup();
+        if (queue->running && !queue->stopping.load()) {
+            lcbio_timer_rearm(queue->poll_timer, LCB_SUBMITQ_POLL_INTERVAL);
+        }
+    }
+};
+
+static bool open_wakeup(lcb_SUBMITQ *queue)
+{
+#ifdef _WIN32
+    (void)queue;
+    return false;
+#else
+#ifdef HAVE_SYS_EVENTFD_H
+    int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+    queue->rfd = queue->wfd = fd;
+#else
+    int fds[2];
+    if (pipe(fds) == -1) {
+        return false;
+    }
+    for (int fd : fds) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+    queue->rfd = fds[0];
+    queue->wfd = fds[1];
+#endif
+    return true;
+#endif
+}
+
+static void close_wakeup(lcb_SUBMITQ *queue)
+{
+#ifndef _WIN32
+    if (queue->rfd != -1) {
+        close(queue->rfd);
+    }
+    if (queue->wfd != -1 && queue->wfd != queue->rfd) {
+        close(queue->wfd);
+    }
+#endif
+    queue->rfd = queue->wfd = -1;
+}
+
+LIBCOUCHBASE_API
+lcb_STATUS lcb_submitq_create(lcb_INSTANCE *instance, lcb_U32 capacity, lcb_SUBMITQ **queue)
+{
+    if (instance == nullptr || queue == nullptr) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    if (capacity == 0) {
+        capacity = LCB_SUBMITQ_DEFAULT_CAPACITY;
+    }
+    size_t ncells = 2;
+    while (ncells < capacity) {
+        ncells <<= 1;
+    }
+
+    auto *q = new lcb_SUBMITQ();
+    q->instance = instance;
+    q->capacity = ncells;
+    q->mask = ncells - 1;
+    q->cells = new (std::nothrow) lcb_SUBMITQ::Cell[ncells];
+    if (q->cells == nullptr) {
+        delete q;
+        return LCB_ERR_NO_MEMORY;
+    }
+    for (size_t ii = 0; ii < ncells; ii++) {
+        q->cells[ii].seq.store(ii, std::memory_order_relaxed);
+    }
+
+    lcbio_pTABLE iot = instance->iotable;
+    if (iot->is_E() && open_wakeup(q)) {
+        q->event = iot->E_event_create();
+        if (q->event == nullptr) {
+            close_wakeup(q);
+            delete[] q->cells;
+            delete q;
+            return LCB_ERR_SDK_INTERNAL;
+        }
+    } else {
+        close_wakeup(q);
+        q->poll_timer = lcbio_timer_new(iot, q, lcb_SUBMITQ::poll_handler);
+        lcb_log(LOGARGS(q, DEBUG), "Submission queue will be polled every %uus", LCB_SUBMITQ_POLL_INTERVAL);
+    }
+    *queue = q;
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API
+lcb_STATUS lcb_submitq_push(lcb_SUBMITQ *queue, lcb_SUBMIT_CALLBACK callback, void *arg)
+{
+    if (queue->stopping.load()) {
+        return LCB_ERR_REQUEST_CANCELED;
+    }
+    if (!queue->push(callback, arg)) {
+        return LCB_ERR_TEMPORARY_FAILURE;
+    }
+    queue->signal();
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API
+lcb_STATUS lcb_submitq_run(lcb_SUBMITQ *queue)
+{
+    queue->running = true;
+    queue->arm();
+    queue->on_wakeup();
+    while (!queue->stopping.load()) {
+        lcb_run_loop(queue->instance);
+    }
+    queue->running = false;
+    queue->disarm();
+    queue->clear_wakeup();
+    while (queue->drain()) {
+    }
+    return lcb_wait(queue->instance, LCB_WAIT_DEFAULT);
+}
+
+LIBCOUCHBASE_API
+void lcb_submitq_stop(lcb_SUBMITQ *queue)
+{
+    queue->stopping.store(true);
+    queue->wakeup_pending.store(false);
+    queue->signal();
+}
+
+LIBCOUCHBASE_API
+void lcb_submitq_destroy(lcb_SUBMITQ *queue)
+{
+    size_t ninvoked = 0, n;
+    while ((n = queue->drain()) != 0) {
+        ninvoked += n;
+    }
+    if (ninvoked) {
+        lcb_wait(queue->instance, LCB_WAIT_DEFAULT);
+    }
+    lcbio_pTABLE iot = queue->instance->iotable;
+    if (queue->event) {
+        iot->E_event_cancel(queue->rfd, queue->event);
+        iot->E_event_destroy(queue->event);
+    }
+    if (queue->poll_timer) {
+        lcbio_timer_destroy(queue->poll_timer);
+    }
+    close_wakeup(queue);
+    delete[] queue->cells;
+    delete queue;
+}
@@ -0,0 +1,53 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2020 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef VB_SNAPSHOT_H
+#define VB_SNAPSHOT_H
+
+#include <libcouchbase/vbucket.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Serialize the configuration as a binary image. Unlike the JSON form, it also
+ * preserves the fast-forward map and the selected alternate addresses.
+ * Integers are stored little endian.
+ *
+ * @param vbc the configuration
+ * @param[out] nbuf the size of the returned buffer
+ * @return a buffer which should be freed using free(), or NULL on allocation
+ *  failure
+ */
+char *lcbvb_save_binary(lcbvb_CONFIG *vbc, size_t *nbuf);
+
+/**
+ * Load a configuration from an image created by lcbvb_save_binary()
+ *
+ * @param vbc an empty configuration, created with lcbvb_create()
+ * @param data the image. It is only read, and may point to a read-only
+ *  memory mapping
+ * @param ndata the size of the image
+ * @return 0 on success, nonzero on failure (see lcbvb_get_error())
+ */
+int lcbvb_load_binary(lcbvb_CONFIG *vbc, const void *data, size_t ndata);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
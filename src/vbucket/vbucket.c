@@ -25,6 +25,7 @@
 #include "json-inl.h"
 #include "hash.h"
 #include "crc32.h"
+#include "snapshot.h"
 
 #define STRINGIFY_(X) #X
 #define STRINGIFY(X) STRINGIFY_(X)
@@ -1038,6 +1039,350 @@ char *lcbvb_save_json(lcbvb_CONFIG *cfg)
     return ret;
 }
 
+/******************************************************************************
+ ******************************************************************************
+ ** Binary Snapshots                                                         **
+ ******************************************************************************
+ ******************************************************************************/
+
+/* All integers are stored little endian, whatever the host byte order, so that
+ * a snapshot on shared storage can be read by any architecture. */
+#define VBBIN_MAGIC 0x3242564cU /* "LVB2" */
+#define VBBIN_NULLSTR 0xffffffffU
+
+typedef struct {
+    char *buf;
+    size_t len;
+    size_t cap;
+    int failed;
+} vbbin_WBUF;
+
+typedef struct {
+    const char *buf;
+    size_t len;
+    size_t pos;
+} vbbin_RBUF;
+
+static void wbuf_put(vbbin_WBUF *wb, const void *src, size_t n)
+{
+    if (wb->failed) {
+        return;
+    }
+    if (wb->len + n > wb->cap) {
+        size_t newcap = wb->cap ? wb->cap : 1024;
+        char *newbuf;
+        while (newcap < wb->len + n) {
+            newcap *= 2;
+        }
+        if ((newbuf = realloc(wb->buf, newcap)) == NULL) {
+            wb->failed = 1;
+            return;
+        }
+        wb->buf = newbuf;
+        wb->cap = newcap;
+    }
+    memcpy(wb->buf + wb->len, src, n);
+    wb->len += n;
+}
+
+static void wbuf_uint(vbbin_WBUF *wb, lcb_U64 val, size_t n)
+{
+    unsigned char bytes[8];
+    size_t ii;
+    for (ii = 0; ii < n; ii++) {
+        bytes[ii] = (unsigned char)(val >> (8 * ii));
+    }
+    wbuf_put(wb, bytes, n);
+}
+
+static void wbuf_u32(vbbin_WBUF *wb, lcb_U32 val)
+{
+    wbuf_uint(wb, val, 4);
+}
+
+static void wbuf_u64(vbbin_WBUF *wb, lcb_U64 val)
+{
+    wbuf_uint(wb, val, 8);
+}
+
+static void wbuf_str(vbbin_WBUF *wb, const char *s)
+{
+    if (s == NULL) {
+        wbuf_u32(wb, VBBIN_NULLSTR);
+    } else {
+        size_t n = strlen(s);
+        wbuf_u32(wb, (lcb_U32)n);
+        wbuf_put(wb, s, n);
+    }
+}
+
+static void wbuf_svc(vbbin_WBUF *wb, const lcbvb_SERVICES *svc)
+{
+    lcb_U16 ports[9];
+    unsigned ii;
+    ports[0] = svc->data;
+    ports[1] = svc->mgmt;
+    ports[2] = svc->views;
+    ports[3] = svc->ixquery;
+    ports[4] = svc->ixadmin;
+    ports[5] = svc->n1ql;
+    ports[6] = svc->fts;
+    ports[7] = svc->cbas;
+    ports[8] = svc->eventing;
+    for (ii = 0; ii < 9; ii++) {
+        wbuf_uint(wb, ports[ii], 2);
+    }
+}
+
+static void wbuf_vbmap(vbbin_WBUF *wb, const lcbvb_CONFIG *cfg, const lcbvb_VBUCKET *vbs)
+{
+    unsigned ii, jj;
+    for (ii = 0; ii < cfg->nvb; ii++) {
+        for (jj = 0; jj < 4; jj++) {
+            wbuf_u32(wb, (lcb_U32)vbs[ii].servers[jj]);
+        }
+    }
+}
+
+static int rbuf_get(vbbin_RBUF *rb, void *dst, size_t n)
+{
+    if (rb->len - rb->pos < n) {
+        return 0;
+    }
+    memcpy(dst, rb->buf + rb->pos, n);
+    rb->pos += n;
+    return 1;
+}
+
+static int rbuf_uint(vbbin_RBUF *rb, lcb_U64 *val, size_t n)
+{
+    unsigned char bytes[8];
+    size_t ii;
+    if (!rbuf_get(rb, bytes, n)) {
+        return 0;
+    }
+    *val = 0;
+    for (ii = 0; ii < n; ii++) {
+        *val |= (lcb_U64)bytes[ii] << (8 * ii);
+    }
+    return 1;
+}
+
+static int rbuf_u32(vbbin_RBUF *rb, unsigned *val)
+{
+    lcb_U64 tmp;
+    if (!rbuf_uint(rb, &tmp, 4)) {
+        return 0;
+    }
+    *val = (unsigned)tmp;
+    return 1;
+}
+
+static int rbuf_u64(vbbin_RBUF *rb, lcb_U64 *val)
+{
+    return rbuf_uint(rb, val, 8);
+}
+
+static int rbuf_s64(vbbin_RBUF *rb, int64_t *val)
+{
+    lcb_U64 tmp;
+    if (!rbuf_uint(rb, &tmp, 8)) {
+        return 0;
+    }
+    *val = (int64_t)tmp;
+    return 1;
+}
+
+static int rbuf_str(vbbin_RBUF *rb, char **s)
+{
+    unsigned n;
+    if (!rbuf_u32(rb, &n)) {
+        return 0;
+    }
+    if (n == VBBIN_NULLSTR) {
+        *s = NULL;
+        return 1;
+    }
+    if (rb->len - rb->pos < n || (*s = malloc(n + 1)) == NULL) {
+        return 0;
+    }
+    memcpy(*s, rb->buf + rb->pos, n);
+    (*s)[n] = '\0';
+    rb->pos += n;
+    return 1;
+}
+
+static int rbuf_svc(vbbin_RBUF *rb, lcbvb_SERVICES *svc)
+{
+    lcb_U16 ports[9];
+    lcb_U64 port;
+    unsigned ii;
+    for (ii = 0; ii < 9; ii++) {
+        if (!rbuf_uint(rb, &port, 2)) {
+            return 0;
+        }
+        ports[ii] = (lcb_U16)port;
+    }
+    svc->data = ports[0];
+    svc->mgmt = ports[1];
+    svc->views = ports[2];
+    svc->ixquery = ports[3];
+    svc->ixadmin = ports[4];
+    svc->n1ql = ports[5];
+    svc->fts = ports[6];
+    svc->cbas = ports[7];
+    svc->eventing = ports[8];
+    return 1;
+}
+
+static int rbuf_vbmap(lcbvb_CONFIG *cfg, vbbin_RBUF *rb, lcbvb_VBUCKET **out)
+{
+    unsigned ii, jj, val;
+    lcbvb_VBUCKET *vbs;
+
+    if ((rb->len - rb->pos) / (4 * 4) < cfg->nvb || (vbs = malloc(sizeof(**out) * cfg->nvb)) == NULL) {
+        return 0;
+    }
+    for (ii = 0; ii < cfg->nvb; ii++) {
+        for (jj = 0; jj < 4; jj++) {
+            int ix;
+            rbuf_u32(rb, &val);
+            ix = (int)(lcb_S32)val;
+            if (ix < -1 || ix >= (int)cfg->nsrv) {
+                free(vbs);
+                return 0;
+            }
+            vbs[ii].servers[jj] = ix;
+        }
+    }
+    *out = vbs;
+    return 1;
+}
+
+char *lcbvb_save_binary(lcbvb_CONFIG *cfg, size_t *nbuf)
+{
+    unsigned ii;
+    vbbin_WBUF wb = {NULL, 0, 0, 0};
+
+    wbuf_u32(&wb, VBBIN_MAGIC);
+    wbuf_u32(&wb, cfg->dtype);
+    wbuf_u32(&wb, cfg->nvb);
+    wbuf_u32(&wb, cfg->nsrv);
+    wbuf_u32(&wb, cfg->ndatasrv);
+    wbuf_u32(&wb, cfg->nrepl);
+    wbuf_u32(&wb, cfg->is3x);
+    wbuf_u32(&wb, cfg->vbuckets != NULL);
+    wbuf_u32(&wb, cfg->ffvbuckets != NULL);
+    wbuf_u64(&wb, (lcb_U64)cfg->revepoch);
+    wbuf_u64(&wb, (lcb_U64)cfg->revid);
+    wbuf_u64(&wb, cfg->caps);
+    wbuf_u64(&wb, cfg->ccaps);
+    wbuf_str(&wb, cfg->bname);
+    wbuf_str(&wb, cfg->buuid);
+
+    for (ii = 0; ii < cfg->nsrv; ii++) {
+        const lcbvb_SERVER *srv = cfg->servers + ii;
+        wbuf_str(&wb, srv->hostname);
+        wbuf_str(&wb, srv->viewpath);
+        wbuf_str(&wb, srv->querypath);
+        wbuf_str(&wb, srv->ftspath);
+        wbuf_str(&wb, srv->cbaspath);
+        wbuf_str(&wb, srv->eventingpath);
+        wbuf_str(&wb, srv->alt_hostname);
+        wbuf_u32(&wb, srv->nvbs);
+        wbuf_svc(&wb, &srv->svc);
+        wbuf_svc(&wb, &srv->svc_ssl);
+        wbuf_svc(&wb, &srv->alt_svc);
+        wbuf_svc(&wb, &srv->alt_svc_ssl);
+    }
+    if (cfg->vbuckets) {
+        wbuf_vbmap(&wb, cfg, cfg->vbuckets);
+    }
+    if (cfg->ffvbuckets) {
+        wbuf_vbmap(&wb, cfg, cfg->ffvbuckets);
+    }
+
+    if (wb.failed) {
+        free(wb.buf);
+        return NULL;
+    }
+    *nbuf = wb.len;
+    return wb.buf;
+}
+
+int lcbvb_load_binary(lcbvb_CONFIG *cfg, const void *data, size_t ndata)
+{
+    unsigned ii, magic, dtype, nsrv, has_map, has_ffmap;
+    vbbin_RBUF rb;
+    lcbvb_SERVER *servers;
+
+    rb.buf = data;
+    rb.len = ndata;
+    rb.pos = 0;
+
+    if (!rbuf_u32(&rb, &magic) || magic != VBBIN_MAGIC) {
+        SET_ERRSTR(cfg, "Not a binary configuration snapshot");
+        return -1;
+    }
+    if (!rbuf_u32(&rb, &dtype) || !rbuf_u32(&rb, &cfg->nvb) || !rbuf_u32(&rb, &nsrv) ||
+        !rbuf_u32(&rb, &cfg->ndatasrv) || !rbuf_u32(&rb, &cfg->nrepl) || !rbuf_u32(&rb, &cfg->is3x) ||
+        !rbuf_u32(&rb, &has_map) || !rbuf_u32(&rb, &has_ffmap) ||
+        !rbuf_s64(&rb, &cfg->revepoch) || !rbuf_s64(&rb, &cfg->revid) || !rbuf_u64(&rb, &cfg->caps) ||
+        !rbuf_u64(&rb, &cfg->ccaps) ||
+        !rbuf_str(&rb, &cfg->bname) || !rbuf_str(&rb, &cfg->buuid)) {
+        SET_ERRSTR(cfg, "Truncated configuration snapshot");
+        return -1;
+    }
+    if (dtype > LCBVB_DIST_UNKNOWN || cfg->ndatasrv > nsrv || cfg->nrepl > 3 || nsrv > ndata ||
+        (dtype == LCBVB_DIST_VBUCKET && !has_map)) {
+        SET_ERRSTR(cfg, "Inconsistent configuration snapshot");
+        return -1;
+    }
+    cfg->dtype = dtype;
+    cfg->bname_len = cfg->bname ? strlen(cfg->bname) : 0;
+
+    if ((servers = calloc(nsrv ? nsrv : 1, sizeof(*servers))) == NULL) {
+        SET_ERRSTR(cfg, "Couldn't allocate servers");
+        return -1;
+    }
+    cfg->servers = servers;
+    cfg->nsrv = nsrv;
+
+    for (ii = 0; ii < nsrv; ii++) {
+        lcbvb_SERVER *srv = servers + ii;
+        if (!rbuf_str(&rb, &srv->hostname) || !rbuf_str(&rb, &srv->viewpath) || !rbuf_str(&rb, &srv->querypath) ||
+            !rbuf_str(&rb, &srv->ftspath) || !rbuf_str(&rb, &srv->cbaspath) ||
+            !rbuf_str(&rb, &srv->eventingpath) || !rbuf_str(&rb, &srv->alt_hostname) ||
+            !rbuf_u32(&rb, &srv->nvbs) || !rbuf_svc(&rb, &srv->svc) || !rbuf_svc(&rb, &srv->svc_ssl) ||
+            !rbuf_svc(&rb, &srv->alt_svc) || !rbuf_svc(&rb, &srv->alt_svc_ssl) || srv->hostname == NULL) {
+            SET_ERRSTR(cfg, "Truncated server in configuration snapshot");
+            return -1;
+        }
+        if (!build_server_strings(cfg, srv)) {
+            return -1;
+        }
+    }
+
+    if (has_map && !rbuf_vbmap(cfg, &rb, &cfg->vbuckets)) {
+        SET_ERRSTR(cfg, "Invalid vBucket map in configuration snapshot");
+        return -1;
+    }
+    if (has_ffmap && !rbuf_vbmap(cfg, &rb, &cfg->ffvbuckets)) {
+        SET_ERRSTR(cfg, "Invalid forward vBucket map in configuration snapshot");
+        return -1;
+    }
+    if (rb.pos != rb.len) {
+        SET_ERRSTR(cfg, "Trailing data in configuration snapshot");
+        return -1;
+    }
+    if (cfg->dtype == LCBVB_DIST_KETAMA && !update_ketama(cfg)) {
+        SET_ERRSTR(cfg, "Failed to establish ketama continuums");
+        return -1;
+    }
+    cfg->randbuf = malloc(cfg->nsrv * sizeof(*cfg->randbuf));
+    return 0;
+}
+
 /******************************************************************************
  ******************************************************************************
  ** Mapping Routines                                                         **
@@ -215,6 +215,7 @@ void lcb_VIEW_HANDLE_::JSPARSE_on_row(const lcb::jsparse::Row &datum)
         resp.htresp = cur_htresp;
         invoke_row(&resp);
     }
+    flow.row_delivered(datum.row.iov_len, htreq);
 }
 
 void lcb_VIEW_HANDLE_::JSPARSE_on_error(const std::string &)
@@ -234,9 +235,8 @@ static void doc_callback(lcb_INSTANCE *, int, const lcb_RESPGET *resp)
 
     q->ref();
 
-    q->n_awaiting_response--;
     dreq->docresp = *resp;
-    dreq->ready = 1;
+    q->on_response(dreq, resp->ctx.rc);
     dreq->docresp.ctx.key.assign((const char *)dreq->docid.iov_base, dreq->docid.iov_len);
 
     /* Reference the response data, since we might not be invoking this right
@@ -289,14 +289,10 @@ static void cb_doc_ready(lcb::docreq::Queue *q, lcb::docreq::DocRequest *req_bas
 static void cb_docq_throttle(lcb::docreq::Queue *q, int enabled)
 {
     auto *req = reinterpret_cast<lcb_VIEW_HANDLE_ *>(q->parent);
-    if (req == nullptr || req->htreq == nullptr) {
+    if (req == nullptr) {
         return;
     }
-    if (enabled) {
-        req->htreq->pause();
-    } else {
-        req->htreq->resume();
-    }
+    req->flow.set(lcb::http::FlowControl::DOCQUEUE, enabled, req->htreq);
 }
 
 lcb_VIEW_HANDLE_::~lcb_VIEW_HANDLE_()
@@ -389,14 +385,14 @@ lcb_VIEW_HANDLE_::lcb_VIEW_HANDLE_(lcb_INSTANCE *instance_, void *cookie_, const
         docq->cb_schedule = cb_op_schedule;
         docq->cb_ready = cb_doc_ready;
         docq->cb_throttle = cb_docq_throttle;
-        if (cmd->docs_concurrent_max) {
-            docq->max_pending_response = cmd->docs_concurrent_max;
-        }
+        docq->window.set_max(cmd->docs_concurrent_max);
+        docq->ordered = !cmd->docs_unordered;
     }
 
     if (cmd->handle) {
         *cmd->handle = this;
     }
+    flow.set_high_watermark(cmd->high_watermark);
 
     lcb_aspend_add(&instance->pendops, LCB_PENDTYPE_COUNTER, nullptr);
 
@@ -429,6 +425,36 @@ lcb_STATUS lcb_view_cancel(lcb_INSTANCE *, lcb_VIEW_HANDLE *handle)
     return LCB_SUCCESS;
 }
 
+LIBCOUCHBASE_API
+lcb_STATUS lcb_view_pause(lcb_INSTANCE *, lcb_VIEW_HANDLE *handle)
+{
+    if (handle == nullptr) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    handle->flow.set(lcb::http::FlowControl::USER, true, handle->htreq);
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API
+lcb_STATUS lcb_view_resume(lcb_INSTANCE *, lcb_VIEW_HANDLE *handle)
+{
+    if (handle == nullptr) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    handle->flow.set(lcb::http::FlowControl::USER, false, handle->htreq);
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API
+lcb_STATUS lcb_view_consumed(lcb_INSTANCE *, lcb_VIEW_HANDLE *handle, size_t nbytes)
+{
+    if (handle == nullptr) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    handle->flow.consumed(nbytes, handle->htreq);
+    return LCB_SUCCESS;
+}
+
 void lcb_VIEW_HANDLE_::cancel()
 {
     if (callback) {
@@ -437,5 +463,7 @@ void lcb_VIEW_HANDLE_::cancel()
         if (docq) {
             docq->cancel();
         }
+        /* Let the rest of the response drain, so that the handle is released */
+        flow.release(htreq);
     }
 }
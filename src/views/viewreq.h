@@ -20,6 +20,7 @@
 #include <jsparse/parser.h>
 #include <string>
 #include "docreq/docreq.h"
+#include "http/http.h"
 
 #include "capi/views.hh"
 
@@ -95,4 +96,6 @@ struct lcb_VIEW_HANDLE_ : lcb::jsparse::Parser::Actions {
     uint32_t cmdflags;
     lcb_STATUS lasterr{LCB_SUCCESS};
     lcbtrace_SPAN *span{nullptr};
+    /** Pausing of the rows stream, see lcb_view_pause() */
+    lcb::http::FlowControl flow;
 };
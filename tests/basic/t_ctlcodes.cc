@@ -74,6 +74,7 @@ TEST_F(CtlTest, testStringCtls)
                         {"error_thresh_delay", LCB_CNTL_CONFDELAY_THRESH},
                         {"config_total_timeout", LCB_CNTL_CONFIGURATION_TIMEOUT},
                         {"config_node_timeout", LCB_CNTL_CONFIG_NODE_TIMEOUT},
+                        {"replica_hedge_delay", LCB_CNTL_REPLICA_HEDGE_DELAY},
                         {NULL, 0}};
 
     for (PairMap *cur = ctlMap; cur->key; cur++) {
@@ -104,6 +105,103 @@ TEST_F(CtlTest, testStringCtls)
     ASSERT_EQ(LCB_SUCCESS, err);
     ASSERT_EQ(LCB_COMPRESS_IN, getSetting< lcb_COMPRESSOPTS >(instance, LCB_CNTL_COMPRESSION_OPTS));
 
+    // client-side value codec
+    ASSERT_EQ(0, getSetting< int >(instance, LCB_CNTL_VALUE_CODEC));
+    err = lcb_cntl_string(instance, "value_codec", "snappy");
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_EQ(1, getSetting< int >(instance, LCB_CNTL_VALUE_CODEC));
+    err = lcb_cntl_string(instance, "value_codec", "42");
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_EQ(42, getSetting< int >(instance, LCB_CNTL_VALUE_CODEC));
+    ASSERT_NE(LCB_SUCCESS, lcb_cntl_string(instance, "value_codec", "zstd"));
+    ASSERT_NE(LCB_SUCCESS, lcb_cntl_string(instance, "value_codec", "256"));
+    err = lcb_cntl_string(instance, "value_codec_min_size", "102400");
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_EQ(102400, lcb_cntl_getu32(instance, LCB_CNTL_VALUE_CODEC_MIN_SIZE));
+
+    // retry tuning
+    ASSERT_EQ(0, getSetting< int >(instance, LCB_CNTL_RETRY_JITTER));
+    err = lcb_cntl_string(instance, "retry_jitter", "true");
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_EQ(1, getSetting< int >(instance, LCB_CNTL_RETRY_JITTER));
+
+    ASSERT_EQ(0, lcb_cntl_getu32(instance, LCB_CNTL_RETRY_BUDGET));
+    err = lcb_cntl_string(instance, "retry_budget", "250");
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_EQ(250, lcb_cntl_getu32(instance, LCB_CNTL_RETRY_BUDGET));
+
+    err = lcb_cntl_string(instance, "kv_pipeline_max_ops", "1024");
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_EQ(1024, lcb_cntl_getu32(instance, LCB_CNTL_KV_PIPELINE_MAX_OPS));
+    err = lcb_cntl_string(instance, "kv_max_bytes", "16777216");
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_EQ(16777216, getSetting< lcb_SIZE >(instance, LCB_CNTL_KV_MAX_BYTES));
+
+    ASSERT_EQ(0, getSetting< int >(instance, LCB_CNTL_CIRCUIT_BREAKER));
+    err = lcb_cntl_string(instance, "circuit_breaker", "true");
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_EQ(1, getSetting< int >(instance, LCB_CNTL_CIRCUIT_BREAKER));
+    ASSERT_EQ(50, lcb_cntl_getu32(instance, LCB_CNTL_CIRCUIT_BREAKER_THRESHOLD));
+    err = lcb_cntl_string(instance, "circuit_breaker_threshold", "101");
+    ASSERT_NE(LCB_SUCCESS, err);
+    err = lcb_cntl_string(instance, "circuit_breaker_sleep_window", "2.5");
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_EQ(2500000, lcb_cntl_getu32(instance, LCB_CNTL_CIRCUIT_BREAKER_SLEEP_WINDOW));
+
+    ASSERT_EQ(1, getSetting< int >(instance, LCB_CNTL_SSL_SESSION_CACHE));
+    err = lcb_cntl_string(instance, "ssl_session_cache", "false");
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_EQ(0, getSetting< int >(instance, LCB_CNTL_SSL_SESSION_CACHE));
+    ASSERT_EQ(0, getSetting< int >(instance, LCB_CNTL_SSL_KTLS));
+    err = lcb_cntl_string(instance, "ssl_ktls", "true");
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_EQ(1, getSetting< int >(instance, LCB_CNTL_SSL_KTLS));
+
+    ASSERT_EQ(LCB_SCRAM_CACHE_INSTANCE, getSetting< lcb_SCRAM_CACHE >(instance, LCB_CNTL_SCRAM_CACHE));
+    err = lcb_cntl_string(instance, "scram_cache", "process");
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_EQ(LCB_SCRAM_CACHE_PROCESS, getSetting< lcb_SCRAM_CACHE >(instance, LCB_CNTL_SCRAM_CACHE));
+    err = lcb_cntl_string(instance, "scram_cache", "always");
+    ASSERT_NE(LCB_SUCCESS, err);
+
+    ASSERT_EQ(250000, lcb_cntl_getu32(instance, LCB_CNTL_CONNECT_ATTEMPT_DELAY));
+    err = lcb_cntl_string(instance, "connect_attempt_delay", "0.1");
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_EQ(100000, lcb_cntl_getu32(instance, LCB_CNTL_CONNECT_ATTEMPT_DELAY));
+    ASSERT_EQ(1, lcb_cntl_getu32(instance, LCB_CNTL_BOOTSTRAP_RACE_COUNT));
+    err = lcb_cntl_string(instance, "bootstrap_race_count", "3");
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_EQ(3, lcb_cntl_getu32(instance, LCB_CNTL_BOOTSTRAP_RACE_COUNT));
+    err = lcb_cntl_string(instance, "bootstrap_race_count", "0");
+    ASSERT_NE(LCB_SUCCESS, err);
+    err = lcb_cntl_string(instance, "bootstrap_race_delay", "0.2");
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_EQ(200000, lcb_cntl_getu32(instance, LCB_CNTL_BOOTSTRAP_RACE_DELAY));
+
+    ASSERT_EQ(LCB_READ_ALLOCATOR_DEFAULT, getSetting< lcb_READ_ALLOCATOR >(instance, LCB_CNTL_READ_ALLOCATOR));
+    err = lcb_cntl_string(instance, "read_allocator", "pool");
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_EQ(LCB_READ_ALLOCATOR_POOL, getSetting< lcb_READ_ALLOCATOR >(instance, LCB_CNTL_READ_ALLOCATOR));
+    err = lcb_cntl_string(instance, "read_allocator", "arena");
+    ASSERT_NE(LCB_SUCCESS, err);
+    ASSERT_EQ(4 * 1024 * 1024, lcb_cntl_getu32(instance, LCB_CNTL_READ_POOL_CLASS_CAP));
+    err = lcb_cntl_string(instance, "read_pool_class_cap", "65536");
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_EQ(65536, lcb_cntl_getu32(instance, LCB_CNTL_READ_POOL_CLASS_CAP));
+    ASSERT_EQ(0, getSetting< int >(instance, LCB_CNTL_READ_POOL_HUGEPAGES));
+    err = lcb_cntl_string(instance, "read_pool_hugepages", "true");
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_EQ(1, getSetting< int >(instance, LCB_CNTL_READ_POOL_HUGEPAGES));
+    lcb_READ_POOL_STATS pool_stats;
+    err = lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_READ_POOL_STATS, &pool_stats);
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_EQ(0, pool_stats.allocations);
+
+    ASSERT_EQ(0, getSetting< int >(instance, LCB_CNTL_COLLECTIONS_PREFETCH));
+    err = lcb_cntl_string(instance, "collections_prefetch", "true");
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_EQ(1, getSetting< int >(instance, LCB_CNTL_COLLECTIONS_PREFETCH));
+
     err = lcb_cntl_string(instance, "unsafe_optimize", "1");
     ASSERT_EQ(LCB_SUCCESS, err);
     err = lcb_cntl_string(instance, "unsafe_optimize", "0");
@@ -0,0 +1,97 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2020 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include "config.h"
+#include <gtest/gtest.h>
+#include "internal.h"
+#include "docreq/docreq.h"
+
+using lcb::docreq::Window;
+
+class DocreqWindow : public ::testing::Test
+{
+};
+
+static const hrtime_t MS = LCB_MS2NS(1);
+
+TEST_F(DocreqWindow, testAdditiveIncrease)
+{
+    Window window(4, 100);
+    hrtime_t now = 1000 * MS;
+    // A window's worth of fast responses grows it by one
+    for (unsigned ii = 0; ii < 4; ii++) {
+        window.on_response(MS, now - MS, now);
+    }
+    ASSERT_EQ(5U, window.size());
+    for (unsigned ii = 0; ii < 4; ii++) {
+        window.on_response(MS, now - MS, now);
+    }
+    ASSERT_EQ(5U, window.size());
+    window.on_response(MS, now - MS, now);
+    ASSERT_EQ(6U, window.size());
+}
+
+TEST_F(DocreqWindow, testMaximum)
+{
+    Window window(2, 3);
+    hrtime_t now = 1000 * MS;
+    for (unsigned ii = 0; ii < 100; ii++) {
+        window.on_response(MS, now - MS, now);
+    }
+    ASSERT_EQ(3U, window.size());
+
+    window.set_max(2);
+    ASSERT_EQ(2U, window.size());
+}
+
+TEST_F(DocreqWindow, testMultiplicativeDecrease)
+{
+    Window window(16, 100);
+    hrtime_t now = 1000 * MS;
+    window.on_response(MS, now - MS, now);
+    ASSERT_EQ(16U, window.size());
+
+    // Much slower than the base latency
+    now += 10 * MS;
+    window.on_response(10 * MS, now - 10 * MS, now);
+    ASSERT_EQ(8U, window.size());
+
+    // Other operations of the same round trip don't shrink it again
+    window.on_response(10 * MS, now - 10 * MS, now + 1);
+    window.on_congestion(now - 5 * MS, now + 2);
+    ASSERT_EQ(8U, window.size());
+
+    // Operations scheduled after the decrease do
+    now += 20 * MS;
+    window.on_congestion(now - MS, now);
+    ASSERT_EQ(4U, window.size());
+
+    for (unsigned ii = 0; ii < 10; ii++) {
+        now += 20 * MS;
+        window.on_congestion(now - MS, now);
+    }
+    ASSERT_EQ(1U, window.size());
+}
+
+TEST_F(DocreqWindow, testJitterTolerance)
+{
+    Window window(8, 100);
+    hrtime_t now = 1000 * MS;
+    window.on_response(LCB_US2NS(50), now, now);
+    // Above twice the base latency, but within the slack
+    window.on_response(LCB_US2NS(300), now, now);
+    ASSERT_EQ(8U, window.size());
+}
@@ -0,0 +1,115 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2020 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include "config.h"
+#include <gtest/gtest.h>
+#include "internal.h"
+#include "http/http.h"
+#include "capi/cmd_http.hh"
+
+using lcb::http::FlowControl;
+
+class FlowControlTest : public ::testing::Test
+{
+  protected:
+    void SetUp() override
+    {
+        ASSERT_EQ(LCB_SUCCESS, lcb_create(&instance, nullptr));
+        lcb_CMDHTTP *cmd;
+        lcb_cmdhttp_create(&cmd, LCB_HTTP_TYPE_QUERY);
+        lcb_cmdhttp_streaming(cmd, true);
+        req = new lcb::http::Request(instance, nullptr, cmd);
+        lcb_cmdhttp_destroy(cmd);
+    }
+
+    void TearDown() override
+    {
+        delete req;
+        lcb_destroy(instance);
+    }
+
+    lcb_INSTANCE *instance{nullptr};
+    lcb::http::Request *req{nullptr};
+};
+
+TEST_F(FlowControlTest, testReasons)
+{
+    FlowControl flow;
+    ASSERT_FALSE(flow.is_paused());
+
+    flow.set(FlowControl::USER, true, req);
+    ASSERT_TRUE(req->paused);
+    flow.set(FlowControl::DOCQUEUE, true, req);
+    flow.set(FlowControl::USER, false, req);
+    // Still throttled by the document queue
+    ASSERT_TRUE(req->paused);
+    flow.set(FlowControl::DOCQUEUE, false, req);
+    ASSERT_FALSE(req->paused);
+}
+
+TEST_F(FlowControlTest, testHighWatermark)
+{
+    FlowControl flow;
+    flow.set_high_watermark(1000);
+
+    flow.row_delivered(600, req);
+    ASSERT_FALSE(req->paused);
+    flow.row_delivered(600, req);
+    ASSERT_TRUE(req->paused);
+
+    // 1200 -> 600 is above half of the watermark
+    flow.consumed(600, req);
+    ASSERT_TRUE(req->paused);
+    flow.consumed(100, req);
+    ASSERT_FALSE(req->paused);
+
+    // Consuming more than delivered must not underflow
+    flow.consumed(10000, req);
+    flow.row_delivered(999, req);
+    ASSERT_FALSE(req->paused);
+}
+
+TEST_F(FlowControlTest, testWatermarkDisabled)
+{
+    FlowControl flow;
+    flow.row_delivered(1 << 30, req);
+    ASSERT_FALSE(req->paused);
+}
+
+TEST_F(FlowControlTest, testRelease)
+{
+    FlowControl flow;
+    flow.set_high_watermark(10);
+    flow.set(FlowControl::USER, true, req);
+    flow.row_delivered(100, req);
+    ASSERT_TRUE(req->paused);
+
+    flow.release(req);
+    ASSERT_FALSE(req->paused);
+    flow.row_delivered(100, req);
+    ASSERT_FALSE(req->paused);
+}
+
+TEST_F(FlowControlTest, testApplyToNewRequest)
+{
+    FlowControl flow;
+    flow.set(FlowControl::USER, true, nullptr);
+    ASSERT_TRUE(flow.is_paused());
+    ASSERT_FALSE(req->paused);
+    // e.g. the request issued when retrying
+    flow.apply(req);
+    ASSERT_TRUE(req->paused);
+}
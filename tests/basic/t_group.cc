@@ -0,0 +1,91 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2020 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include "config.h"
+#include <gtest/gtest.h>
+#include "group.h"
+
+#include <set>
+
+class GroupRouting : public ::testing::Test
+{
+  protected:
+    void SetUp() override
+    {
+        config = lcbvb_create();
+        ASSERT_EQ(0, lcbvb_genconfig(config, 4, 1, 1024));
+    }
+
+    void TearDown() override
+    {
+        lcbvb_destroy(config);
+    }
+
+    /** Nodes holding the active copy of the vBuckets of each shard */
+    std::vector<std::set<int>> shard_nodes(const std::vector<lcb_U16> &routes, unsigned nshards)
+    {
+        std::vector<std::set<int>> nodes(nshards);
+        for (unsigned vbid = 0; vbid < routes.size(); vbid++) {
+            nodes[routes[vbid]].insert(lcbvb_vbmaster(config, vbid));
+        }
+        return nodes;
+    }
+
+    lcbvb_CONFIG *config{nullptr};
+};
+
+TEST_F(GroupRouting, testVbucketRouting)
+{
+    std::vector<lcb_U16> routes = lcb::group_route_vbuckets(config, 3, LCB_GROUP_ROUTE_VBUCKET);
+    ASSERT_EQ(1024, routes.size());
+    std::vector<unsigned> counts(3, 0);
+    for (auto shard : routes) {
+        ASSERT_LT(shard, 3);
+        counts[shard]++;
+    }
+    // Evenly spread
+    ASSERT_EQ(342, counts[0]);
+    ASSERT_EQ(341, counts[1]);
+    ASSERT_EQ(341, counts[2]);
+}
+
+TEST_F(GroupRouting, testNodeRoutingFewerShards)
+{
+    std::vector<lcb_U16> routes = lcb::group_route_vbuckets(config, 2, LCB_GROUP_ROUTE_NODE);
+    std::vector<std::set<int>> nodes = shard_nodes(routes, 2);
+    // Each shard talks to two nodes of its own
+    ASSERT_EQ(std::set<int>({0, 2}), nodes[0]);
+    ASSERT_EQ(std::set<int>({1, 3}), nodes[1]);
+}
+
+TEST_F(GroupRouting, testNodeRoutingMoreShards)
+{
+    std::vector<lcb_U16> routes = lcb::group_route_vbuckets(config, 6, LCB_GROUP_ROUTE_NODE);
+    std::vector<std::set<int>> nodes = shard_nodes(routes, 6);
+    std::vector<unsigned> counts(6, 0);
+    for (auto shard : routes) {
+        counts[shard]++;
+    }
+    for (unsigned ii = 0; ii < 6; ii++) {
+        // A single node per shard, and every shard has some work
+        ASSERT_EQ(1, nodes[ii].size()) << "Shard " << ii;
+        ASSERT_EQ((int)(ii % 4), *nodes[ii].begin());
+        ASSERT_GT(counts[ii], 0) << "Shard " << ii;
+    }
+    // Nodes 0 and 1 are split between two shards
+    ASSERT_EQ(counts[0], counts[4]);
+    ASSERT_EQ(counts[1], counts[5]);
+}
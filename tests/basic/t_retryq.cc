@@ -0,0 +1,188 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2020 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include "config.h"
+#include <gtest/gtest.h>
+
+#include "internal.h"
+#include "retryq.h"
+
+#include <memory>
+#include <vector>
+
+using lcb::RetryBudget;
+using lcb::RetryHeap;
+using lcb::RetryOp;
+
+class RetryQueueTest : public ::testing::Test
+{
+  protected:
+    void makeOps(size_t n)
+    {
+        for (size_t ii = 0; ii < n; ii++) {
+            RetryOp *op = new RetryOp(nullptr);
+            // both keys are unrelated to the insertion order and to each other
+            op->trytime = (ii * 7919) % 1009;
+            op->deadline = (ii * 104729) % 997;
+            ops.emplace_back(op);
+        }
+    }
+
+    static void drain(RetryHeap &heap, RetryHeap::Order order, size_t expected)
+    {
+        hrtime_t last = 0;
+        size_t count = 0;
+        while (!heap.empty()) {
+            RetryOp *op = heap.top();
+            hrtime_t key = order == RetryHeap::BY_TRYTIME ? op->trytime : op->deadline;
+            ASSERT_LE(last, key);
+            last = key;
+            heap.remove(op);
+            ASSERT_EQ(SIZE_MAX, op->heappos[order]);
+            count++;
+        }
+        ASSERT_EQ(expected, count);
+    }
+
+    std::vector<std::unique_ptr<RetryOp>> ops;
+};
+
+TEST_F(RetryQueueTest, testHeapOrdering)
+{
+    makeOps(200);
+    RetryHeap schedops(RetryHeap::BY_TRYTIME);
+    RetryHeap tmoops(RetryHeap::BY_DEADLINE);
+    for (auto &op : ops) {
+        schedops.push(op.get());
+        tmoops.push(op.get());
+    }
+    ASSERT_EQ(ops.size(), schedops.size());
+
+    // removal from the middle keeps both heaps ordered, each op tracking its
+    // position in either of them
+    size_t removed = 0;
+    for (size_t ii = 0; ii < ops.size(); ii += 3) {
+        schedops.remove(ops[ii].get());
+        tmoops.remove(ops[ii].get());
+        removed++;
+    }
+    // removing an op which is not queued is a no-op
+    schedops.remove(ops[0].get());
+    ASSERT_EQ(ops.size() - removed, schedops.size());
+
+    drain(schedops, RetryHeap::BY_TRYTIME, ops.size() - removed);
+    drain(tmoops, RetryHeap::BY_DEADLINE, ops.size() - removed);
+}
+
+TEST_F(RetryQueueTest, testHeapRebuild)
+{
+    makeOps(100);
+    RetryHeap tmoops(RetryHeap::BY_DEADLINE);
+    for (auto &op : ops) {
+        tmoops.push(op.get());
+    }
+    // e.g. reset_timeouts() moving every deadline
+    for (size_t ii = 0; ii < ops.size(); ii++) {
+        ops[ii]->deadline = 1000 - ops[ii]->deadline + (ii % 5);
+    }
+    tmoops.rebuild();
+    drain(tmoops, RetryHeap::BY_DEADLINE, ops.size());
+}
+
+TEST_F(RetryQueueTest, testJitterBounds)
+{
+    // the first retry, without a previous interval, is not spread below the base
+    for (unsigned ii = 0; ii < 1000; ii++) {
+        ASSERT_EQ(100, lcb::retry_jitter(100, 0, 0));
+    }
+
+    bool seen_lo = false, seen_hi = false;
+    for (unsigned ii = 0; ii < 10000; ii++) {
+        uint64_t us = lcb::retry_jitter(100, 200, 10000);
+        ASSERT_GE(us, 100);
+        ASSERT_LE(us, 600);
+        seen_lo |= us < 200;
+        seen_hi |= us > 500;
+    }
+    ASSERT_TRUE(seen_lo);
+    ASSERT_TRUE(seen_hi);
+
+    // the ceiling of the retry spec caps the interval...
+    for (unsigned ii = 0; ii < 10000; ii++) {
+        uint64_t us = lcb::retry_jitter(100, 200, 250);
+        ASSERT_GE(us, 100);
+        ASSERT_LE(us, 250);
+    }
+    // ...but never below the base interval
+    for (unsigned ii = 0; ii < 1000; ii++) {
+        ASSERT_EQ(300, lcb::retry_jitter(300, 1000, 250));
+    }
+    // without a ceiling, at most three times the base interval
+    for (unsigned ii = 0; ii < 10000; ii++) {
+        uint64_t us = lcb::retry_jitter(100, 1000, 0);
+        ASSERT_GE(us, 100);
+        ASSERT_LE(us, 300);
+    }
+}
+
+TEST_F(RetryQueueTest, testBudgetBurstAndRefill)
+{
+    RetryBudget budget;
+    hrtime_t now = LCB_S2NS(100);
+
+    // no limit
+    for (unsigned ii = 0; ii < 1000; ii++) {
+        ASSERT_EQ(0, budget.take("a:11210", 0, now));
+    }
+
+    // one second worth of retries may go at once
+    for (unsigned ii = 0; ii < 10; ii++) {
+        ASSERT_EQ(0, budget.take("a:11210", 10, now)) << ii;
+    }
+    hrtime_t next = budget.take("a:11210", 10, now);
+    ASSERT_EQ(now + LCB_MS2NS(100), next);
+
+    // other nodes have their own budget
+    ASSERT_EQ(0, budget.take("b:11210", 10, now));
+    ASSERT_EQ(0, budget.take("a:11207", 10, now));
+
+    // tokens come back at the configured rate
+    ASSERT_EQ(next, budget.take("a:11210", 10, next - 1));
+    ASSERT_EQ(0, budget.take("a:11210", 10, next));
+    ASSERT_NE(0, budget.take("a:11210", 10, next));
+
+    // and refill to a full burst, not more
+    now = next + LCB_S2NS(10);
+    for (unsigned ii = 0; ii < 10; ii++) {
+        ASSERT_EQ(0, budget.take("a:11210", 10, now)) << ii;
+    }
+    ASSERT_NE(0, budget.take("a:11210", 10, now));
+}
+
+TEST_F(RetryQueueTest, testBudgetPrune)
+{
+    RetryBudget budget;
+    hrtime_t now = LCB_S2NS(100);
+    for (unsigned ii = 0; ii <= LCB_RETRY_BUDGET_PRUNE; ii++) {
+        ASSERT_EQ(0, budget.take("node" + std::to_string(ii) + ":11210", 10, now));
+    }
+    ASSERT_EQ(LCB_RETRY_BUDGET_PRUNE + 1, budget.size());
+
+    // once their tokens are back, the budgets of departed nodes are dropped
+    now += LCB_S2NS(1);
+    ASSERT_EQ(0, budget.take("node0:11210", 10, now));
+    ASSERT_EQ(1, budget.size());
+}
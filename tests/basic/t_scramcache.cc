@@ -0,0 +1,86 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2020 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include "config.h"
+#include <gtest/gtest.h>
+
+#include "scramcache.h"
+
+#ifndef LCB_NO_SSL
+class ScramCacheTest : public ::testing::Test
+{
+};
+
+TEST_F(ScramCacheTest, testLookupStore)
+{
+    lcb::ScramCache cache;
+    unsigned char salted[64] = {0};
+    unsigned char out[64] = {0};
+    for (unsigned ii = 0; ii < sizeof(salted); ii++) {
+        salted[ii] = static_cast< unsigned char >(ii);
+    }
+
+    ASSERT_EQ(0, cache.lookup(1, "user", "secret", "c2FsdA==", 4096, out));
+    cache.store(1, "user", "secret", "c2FsdA==", 4096, salted, 32);
+    ASSERT_EQ(1, cache.size());
+    ASSERT_EQ(32, cache.lookup(1, "user", "secret", "c2FsdA==", 4096, out));
+    ASSERT_EQ(0, memcmp(salted, out, 32));
+
+    // every part of the key matters
+    ASSERT_EQ(0, cache.lookup(2, "user", "secret", "c2FsdA==", 4096, out));
+    ASSERT_EQ(0, cache.lookup(1, "other", "secret", "c2FsdA==", 4096, out));
+    ASSERT_EQ(0, cache.lookup(1, "user", "secret", "c2FsdB==", 4096, out));
+    ASSERT_EQ(0, cache.lookup(1, "user", "secret", "c2FsdA==", 8192, out));
+    ASSERT_EQ(1, cache.size());
+}
+
+TEST_F(ScramCacheTest, testPasswordChange)
+{
+    lcb::ScramCache cache;
+    unsigned char salted[32] = {1};
+    unsigned char out[64];
+
+    cache.store(1, "user", "secret", "salt1", 4096, salted, sizeof(salted));
+    cache.store(2, "user", "secret", "salt2", 4096, salted, sizeof(salted));
+    cache.store(1, "bob", "hunter2", "salt3", 4096, salted, sizeof(salted));
+    ASSERT_EQ(3, cache.size());
+
+    // lookup with a new password drops every entry of that user
+    ASSERT_EQ(0, cache.lookup(1, "user", "changed", "salt1", 4096, out));
+    ASSERT_EQ(1, cache.size());
+    ASSERT_EQ(sizeof(salted), cache.lookup(1, "bob", "hunter2", "salt3", 4096, out));
+
+    cache.forget("bob");
+    ASSERT_EQ(0, cache.size());
+}
+
+TEST_F(ScramCacheTest, testEviction)
+{
+    lcb::ScramCache cache;
+    unsigned char salted[20] = {0};
+    unsigned char out[64];
+
+    for (unsigned ii = 0; ii < lcb::ScramCache::MAX_ENTRIES + 10; ii++) {
+        cache.store(1, "user", "secret", std::to_string(ii), 4096, salted, sizeof(salted));
+    }
+    ASSERT_EQ(lcb::ScramCache::MAX_ENTRIES, cache.size());
+    ASSERT_EQ(0, cache.lookup(1, "user", "secret", "0", 4096, out));
+    ASSERT_EQ(sizeof(salted), cache.lookup(1, "user", "secret", "10", 4096, out));
+
+    cache.clear();
+    ASSERT_EQ(0, cache.size());
+}
+#endif
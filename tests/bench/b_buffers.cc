@@ -0,0 +1,190 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2020 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+#include "harness.h"
+#include "netbuf/netbuf.h"
+#include "rdb/rope.h"
+#include "rdb/poolalloc.h"
+
+#include <cstring>
+#include <vector>
+
+/*
+ * netbuf: the write path. Reserve a batch of small spans (as the packets of a
+ * pipeline would), enqueue them, flush them in one go and release them.
+ */
+static void netbuf_cycle(BenchState &state, unsigned nspans, unsigned spansize)
+{
+    nb_MGR mgr;
+    netbuf_init(&mgr, nullptr);
+    std::vector< nb_SPAN > spans(nspans);
+    nb_IOV iovs[64];
+
+    while (state.keepRunning()) {
+        for (unsigned ii = 0; ii < nspans; ii++) {
+            spans[ii].size = spansize;
+            if (netbuf_mblock_reserve(&mgr, &spans[ii]) != 0) {
+                state.skipWithError("netbuf_mblock_reserve failed");
+                netbuf_cleanup(&mgr);
+                return;
+            }
+            memset(SPAN_BUFFER(&spans[ii]), 'x', spansize);
+            netbuf_enqueue_span(&mgr, &spans[ii], nullptr);
+        }
+        nb_SIZE nflush;
+        while ((nflush = netbuf_start_flush(&mgr, iovs, 64, nullptr)) != 0) {
+            netbuf_end_flush(&mgr, nflush);
+        }
+        for (unsigned ii = 0; ii < nspans; ii++) {
+            netbuf_mblock_release(&mgr, &spans[ii]);
+        }
+    }
+    netbuf_cleanup(&mgr);
+    state.setItemsProcessed((lcb_U64)state.iterations() * nspans);
+    state.setBytesProcessed((lcb_U64)state.iterations() * nspans * spansize);
+}
+
+static void bench_netbuf_small(BenchState &state)
+{
+    netbuf_cycle(state, 32, 48);
+}
+LCB_BENCHMARK("netbuf/reserve_flush_release/32x48", bench_netbuf_small);
+
+static void bench_netbuf_large(BenchState &state)
+{
+    netbuf_cycle(state, 4, 16384);
+}
+LCB_BENCHMARK("netbuf/reserve_flush_release/4x16K", bench_netbuf_large);
+
+/*
+ * rope: the read path. Fill the rope the way the socket does (rdb_rdstart and
+ * rdb_rdend in `rdsize` chunks), then consume a stream of packets, making each
+ * one contiguous first as the response parser does.
+ */
+static void rope_fill(rdb_IOROPE *ior, const std::string &data)
+{
+    size_t nfed = 0;
+    nb_IOV iov[32];
+    while (nfed < data.size()) {
+        unsigned niov = rdb_rdstart(ior, iov, 32);
+        unsigned nr = 0;
+        for (unsigned ii = 0; ii < niov && nfed < data.size(); ii++) {
+            size_t n = std::min(data.size() - nfed, (size_t)iov[ii].iov_len);
+            memcpy(iov[ii].iov_base, data.data() + nfed, n);
+            nfed += n;
+            nr += n;
+        }
+        rdb_rdend(ior, nr);
+    }
+}
+
+static void rope_consolidate(BenchState &state, rdb_ALLOCATOR *allocator, unsigned pktsize)
+{
+    const unsigned npkts = 64;
+    std::string data(pktsize * npkts, 'x');
+    rdb_IOROPE ior;
+    rdb_init(&ior, allocator);
+    ior.rdsize = 8192;
+
+    lcb_U64 checksum = 0;
+    while (state.keepRunning()) {
+        rope_fill(&ior, data);
+        for (unsigned ii = 0; ii < npkts; ii++) {
+            rdb_consolidate(&ior, pktsize);
+            checksum += (unsigned char)rdb_get_consolidated(&ior, pktsize)[pktsize - 1];
+            rdb_consumed(&ior, pktsize);
+        }
+    }
+    rdb_cleanup(&ior);
+    if (checksum != (lcb_U64)'x' * npkts * state.iterations()) {
+        state.skipWithError("corrupted data");
+    }
+    state.setItemsProcessed((lcb_U64)state.iterations() * npkts);
+    state.setBytesProcessed((lcb_U64)state.iterations() * data.size());
+}
+
+static void bench_rope_bigalloc_small(BenchState &state)
+{
+    rope_consolidate(state, rdb_bigalloc_new(), 100);
+}
+LCB_BENCHMARK("rope/fill_consolidate/bigalloc/100", bench_rope_bigalloc_small);
+
+static void bench_rope_bigalloc_large(BenchState &state)
+{
+    rope_consolidate(state, rdb_bigalloc_new(), 20000);
+}
+LCB_BENCHMARK("rope/fill_consolidate/bigalloc/20000", bench_rope_bigalloc_large);
+
+static void bench_rope_chunkalloc_small(BenchState &state)
+{
+    rope_consolidate(state, rdb_chunkalloc_new(256), 100);
+}
+LCB_BENCHMARK("rope/fill_consolidate/chunkalloc/100", bench_rope_chunkalloc_small);
+
+static void bench_rope_libcalloc_large(BenchState &state)
+{
+    rope_consolidate(state, rdb_libcalloc_new(), 20000);
+}
+LCB_BENCHMARK("rope/fill_consolidate/libcalloc/20000", bench_rope_libcalloc_large);
+
+static void bench_rope_poolalloc_small(BenchState &state)
+{
+    rope_consolidate(state, rdb_poolalloc_new(4 * 1024 * 1024, 0), 100);
+}
+LCB_BENCHMARK("rope/fill_consolidate/poolalloc/100", bench_rope_poolalloc_small);
+
+static void bench_rope_poolalloc_large(BenchState &state)
+{
+    rope_consolidate(state, rdb_poolalloc_new(4 * 1024 * 1024, 0), 20000);
+}
+LCB_BENCHMARK("rope/fill_consolidate/poolalloc/20000", bench_rope_poolalloc_large);
+
+/* Reading values by reference (rdb_refread_ex) rather than copying them */
+static void bench_rope_refread(BenchState &state)
+{
+    const unsigned pktsize = 4096, npkts = 64;
+    std::string data(pktsize * npkts, 'x');
+    rdb_IOROPE ior;
+    rdb_init(&ior, rdb_bigalloc_new());
+    ior.rdsize = 8192;
+
+    nb_IOV iovs[8];
+    rdb_ROPESEG *segs[8];
+    while (state.keepRunning()) {
+        rope_fill(&ior, data);
+        for (unsigned ii = 0; ii < npkts; ii++) {
+            int niov = rdb_refread_ex(&ior, iovs, segs, 8, pktsize);
+            if (niov < 0) {
+                state.skipWithError("rdb_refread_ex failed");
+                rdb_cleanup(&ior);
+                return;
+            }
+            for (int jj = 0; jj < niov; jj++) {
+                rdb_seg_ref(segs[jj]);
+            }
+            rdb_consumed(&ior, pktsize);
+            for (int jj = 0; jj < niov; jj++) {
+                rdb_seg_unref(segs[jj]);
+            }
+        }
+    }
+    rdb_cleanup(&ior);
+    state.setItemsProcessed((lcb_U64)state.iterations() * npkts);
+    state.setBytesProcessed((lcb_U64)state.iterations() * data.size());
+}
+LCB_BENCHMARK("rope/fill_refread/bigalloc/4096", bench_rope_refread);
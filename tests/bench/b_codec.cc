@@ -0,0 +1,190 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2020 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+#include "harness.h"
+#include "mc/compress.h"
+
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
+/*
+ * Client-side value codecs over large JSON documents. The label reports the
+ * size of the encoded documents relative to the original ones, so that a
+ * codec plugged in by an application can be compared on the same corpora.
+ */
+namespace
+{
+struct Random {
+    lcb_U32 seed;
+
+    explicit Random(lcb_U32 seed_) : seed(seed_) {}
+
+    unsigned next(unsigned bound)
+    {
+        seed = seed * 1103515245 + 12345;
+        return (seed >> 16) % bound;
+    }
+
+    const char *pick(const char *const *words, unsigned nwords)
+    {
+        return words[next(nwords)];
+    }
+};
+
+const char *const first_names[] = {"Alice", "Bob", "Chloe", "David", "Emma", "Farid", "Grace", "Hiro", "Ines", "Jonas"};
+const char *const last_names[] = {"Martin", "Smith", "Garcia", "Nguyen", "Kowalski", "Rossi", "Tanaka", "Dubois"};
+const char *const cities[] = {"Paris", "Berlin", "Austin", "Osaka", "Lagos", "Lima", "Oslo", "Pune", "Perth"};
+const char *const levels[] = {"debug", "info", "info", "info", "warn", "error"};
+const char *const services[] = {"checkout", "catalog", "search", "auth", "billing", "shipping"};
+
+/* Customer profiles with their order history: repetitive keys, varied values */
+std::string make_profiles(size_t size)
+{
+    Random rnd(42);
+    std::string doc = "{\"type\":\"customer_batch\",\"customers\":[";
+    for (unsigned ii = 0; doc.size() < size; ii++) {
+        char buf[512];
+        snprintf(buf, sizeof(buf),
+                 "%s{\"id\":\"cust::%06u\",\"name\":{\"first\":\"%s\",\"last\":\"%s\"},\"email\":\"%s.%u@example.com\","
+                 "\"address\":{\"city\":\"%s\",\"zip\":\"%05u\",\"street\":\"%u Main Street\"},"
+                 "\"loyalty\":{\"tier\":%u,\"points\":%u},\"orders\":[",
+                 ii ? "," : "", ii, rnd.pick(first_names, 10), rnd.pick(last_names, 8), rnd.pick(first_names, 10), ii,
+                 rnd.pick(cities, 9), rnd.next(100000), rnd.next(2000), rnd.next(4), rnd.next(50000));
+        doc += buf;
+        unsigned norders = 1 + rnd.next(5);
+        for (unsigned jj = 0; jj < norders; jj++) {
+            snprintf(buf, sizeof(buf),
+                     "%s{\"order_id\":\"ord::%08u\",\"total\":%u.%02u,\"currency\":\"EUR\",\"status\":\"%s\","
+                     "\"created\":\"2020-%02u-%02uT%02u:%02u:00Z\"}",
+                     jj ? "," : "", rnd.next(100000000), rnd.next(1000), rnd.next(100),
+                     rnd.next(4) ? "delivered" : "pending", 1 + rnd.next(12), 1 + rnd.next(28), rnd.next(24),
+                     rnd.next(60));
+            doc += buf;
+        }
+        doc += "]}";
+    }
+    doc += "]}";
+    return doc;
+}
+
+/* Telemetry events: random identifiers and measurements compress worse */
+std::string make_events(size_t size)
+{
+    Random rnd(7);
+    std::string doc = "{\"type\":\"event_batch\",\"events\":[";
+    for (unsigned ii = 0; doc.size() < size; ii++) {
+        char buf[512];
+        snprintf(buf, sizeof(buf),
+                 "%s{\"trace_id\":\"%08x%08x\",\"span_id\":\"%08x\",\"ts\":%u%06u,\"level\":\"%s\","
+                 "\"service\":\"%s\",\"latency_ms\":%u.%03u,\"host\":\"node-%02u\",\"bytes\":%u}",
+                 ii ? "," : "", rnd.next(0xffffffff), rnd.next(0xffffffff), rnd.next(0xffffffff),
+                 1600000000 + rnd.next(1000000), rnd.next(1000000), rnd.pick(levels, 6), rnd.pick(services, 6),
+                 rnd.next(500), rnd.next(1000), rnd.next(32), rnd.next(1 << 20));
+        doc += buf;
+    }
+    doc += "]}";
+    return doc;
+}
+
+const std::string &corpus(bool profiles, size_t size)
+{
+    static std::map< std::string, std::string > cache;
+    std::string key = std::string(profiles ? "profiles" : "events") + std::to_string(size);
+    auto it = cache.find(key);
+    if (it == cache.end()) {
+        it = cache.emplace(key, profiles ? make_profiles(size) : make_events(size)).first;
+    }
+    return it->second;
+}
+
+const lcb_VALUE_CODEC *find_codec(lcb_U8 id)
+{
+    static mc_CODECTABLE table = {nullptr, 0};
+    return mcreq_codec_find(&table, id);
+}
+
+void set_ratio(BenchState &state, size_t encoded, size_t original)
+{
+    char buf[32];
+    snprintf(buf, sizeof(buf), "ratio=%.3f", (double)encoded / original);
+    state.setLabel(buf);
+}
+
+void codec_encode(BenchState &state, lcb_U8 id, const std::string &doc)
+{
+    const lcb_VALUE_CODEC *codec = find_codec(id);
+    std::vector< char > out(codec->bound(codec->cookie, doc.size()));
+    lcb_SIZE nout = 0;
+    while (state.keepRunning()) {
+        nout = codec->encode(codec->cookie, doc.data(), doc.size(), out.data(), out.size());
+        if (nout == 0) {
+            state.skipWithError("encode failed");
+            return;
+        }
+    }
+    set_ratio(state, nout, doc.size());
+    state.setBytesProcessed((lcb_U64)state.iterations() * doc.size());
+    state.setItemsProcessed(state.iterations());
+}
+
+void codec_decode(BenchState &state, lcb_U8 id, const std::string &doc)
+{
+    const lcb_VALUE_CODEC *codec = find_codec(id);
+    std::vector< char > encoded(codec->bound(codec->cookie, doc.size()));
+    lcb_SIZE nencoded = codec->encode(codec->cookie, doc.data(), doc.size(), encoded.data(), encoded.size());
+    std::string out(doc.size(), '\0');
+    while (state.keepRunning()) {
+        if (codec->decode(codec->cookie, encoded.data(), nencoded, &out[0], out.size()) != 0) {
+            state.skipWithError("decode failed");
+            return;
+        }
+    }
+    if (out != doc) {
+        state.skipWithError("corrupted data");
+    }
+    set_ratio(state, nencoded, doc.size());
+    state.setBytesProcessed((lcb_U64)state.iterations() * doc.size());
+    state.setItemsProcessed(state.iterations());
+}
+} // namespace
+
+static void bench_snappy_encode_profiles(BenchState &state)
+{
+    codec_encode(state, MCREQ_CODEC_SNAPPY, corpus(true, 128 * 1024));
+}
+LCB_BENCHMARK("codec/snappy/encode/profiles_128K", bench_snappy_encode_profiles);
+
+static void bench_snappy_decode_profiles(BenchState &state)
+{
+    codec_decode(state, MCREQ_CODEC_SNAPPY, corpus(true, 128 * 1024));
+}
+LCB_BENCHMARK("codec/snappy/decode/profiles_128K", bench_snappy_decode_profiles);
+
+static void bench_snappy_encode_events(BenchState &state)
+{
+    codec_encode(state, MCREQ_CODEC_SNAPPY, corpus(false, 1024 * 1024));
+}
+LCB_BENCHMARK("codec/snappy/encode/events_1M", bench_snappy_encode_events);
+
+static void bench_snappy_decode_events(BenchState &state)
+{
+    codec_decode(state, MCREQ_CODEC_SNAPPY, corpus(false, 1024 * 1024));
+}
+LCB_BENCHMARK("codec/snappy/decode/events_1M", bench_snappy_decode_events);
@@ -0,0 +1,87 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2020 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+#include "harness.h"
+#include <libcouchbase/vbucket.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/* Key to vBucket/server mapping, done for every KV command */
+static void bench_vbucket_map_key(BenchState &state)
+{
+    const unsigned nkeys = 1000;
+    lcbvb_CONFIG *config = lcbvb_create();
+    lcbvb_genconfig(config, 4, 1, 1024);
+    std::vector< std::string > keys;
+    for (unsigned ii = 0; ii < nkeys; ii++) {
+        keys.push_back("user::" + std::to_string(ii * 7919));
+    }
+
+    unsigned sum = 0;
+    while (state.keepRunning()) {
+        for (unsigned ii = 0; ii < nkeys; ii++) {
+            int vbid, srvix;
+            lcbvb_map_key(config, keys[ii].c_str(), keys[ii].size(), &vbid, &srvix);
+            sum += vbid + srvix;
+        }
+    }
+    lcbvb_destroy(config);
+    if (sum == 0) {
+        state.skipWithError("all keys mapped to the first vBucket");
+    }
+    state.setItemsProcessed((lcb_U64)state.iterations() * nkeys);
+}
+LCB_BENCHMARK("vbucket/map_key", bench_vbucket_map_key);
+
+/* Parsing a cluster map, as received over CCCP or HTTP */
+static void config_parse(BenchState &state, unsigned nservers, unsigned nvbuckets)
+{
+    lcbvb_CONFIG *orig = lcbvb_create();
+    lcbvb_genconfig(orig, nservers, 1, nvbuckets);
+    char *json = lcbvb_save_json(orig);
+    lcbvb_destroy(orig);
+    size_t njson = strlen(json);
+
+    while (state.keepRunning()) {
+        lcbvb_CONFIG *config = lcbvb_create();
+        if (lcbvb_load_json(config, json) != 0) {
+            state.skipWithError(std::string("unable to parse config: ") + lcbvb_get_error(config));
+            lcbvb_destroy(config);
+            free(json);
+            return;
+        }
+        lcbvb_destroy(config);
+    }
+    free(json);
+    state.setBytesProcessed((lcb_U64)state.iterations() * njson);
+}
+
+static void bench_config_parse_small(BenchState &state)
+{
+    config_parse(state, 4, 1024);
+}
+LCB_BENCHMARK("vbucket/parse_config/4x1024", bench_config_parse_small);
+
+static void bench_config_parse_large(BenchState &state)
+{
+    config_parse(state, 32, 1024);
+}
+LCB_BENCHMARK("vbucket/parse_config/32x1024", bench_config_parse_large);
@@ -0,0 +1,119 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2020 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+#include "harness.h"
+#include "jsparse/parser.h"
+
+#include <algorithm>
+#include <string>
+
+using namespace lcb::jsparse;
+
+namespace
+{
+struct RowCounter : Parser::Actions {
+    unsigned nrows{0};
+    bool complete{false};
+    bool error{false};
+
+    void JSPARSE_on_row(const Row &) override
+    {
+        nrows++;
+    }
+    void JSPARSE_on_complete(const std::string &) override
+    {
+        complete = true;
+    }
+    void JSPARSE_on_error(const std::string &) override
+    {
+        error = true;
+    }
+};
+} // namespace
+
+static std::string make_n1ql_response(unsigned nrows)
+{
+    std::string body = "{\"requestID\":\"3f5e2b7c-1c1e-4c52-a1d3-0a5d7c9f1e42\",\"signature\":{\"*\":\"*\"},\"results\":[";
+    for (unsigned ii = 0; ii < nrows; ii++) {
+        if (ii) {
+            body += ",";
+        }
+        body += "{\"default\":{\"id\":" + std::to_string(ii) + ",\"name\":\"user_" + std::to_string(ii) +
+                "\",\"email\":\"user_" + std::to_string(ii) +
+                "@example.com\",\"tags\":[\"a\",\"b\",\"c\"],\"address\":{\"city\":\"Paris\",\"zip\":\"75001\"}}}";
+    }
+    body += "],\"status\":\"success\",\"metrics\":{\"elapsedTime\":\"1.2ms\",\"executionTime\":\"1.1ms\","
+            "\"resultCount\":" +
+            std::to_string(nrows) + ",\"resultSize\":" + std::to_string(nrows * 150) + "}}";
+    return body;
+}
+
+static std::string make_view_response(unsigned nrows)
+{
+    std::string body = "{\"total_rows\":" + std::to_string(nrows) + ",\"rows\":[";
+    for (unsigned ii = 0; ii < nrows; ii++) {
+        if (ii) {
+            body += ",";
+        }
+        body += "{\"id\":\"doc_" + std::to_string(ii) + "\",\"key\":[\"user\"," + std::to_string(ii) +
+                "],\"value\":{\"name\":\"user_" + std::to_string(ii) + "\",\"score\":" + std::to_string(ii % 100) +
+                "}}";
+    }
+    body += "]}";
+    return body;
+}
+
+/*
+ * Feed a whole response through the row parser in chunks, as the HTTP
+ * layer would deliver it.
+ */
+static void parse_rows(BenchState &state, Parser::Mode mode, const std::string &body, unsigned nrows,
+                       size_t chunksize)
+{
+    while (state.keepRunning()) {
+        RowCounter counter;
+        Parser parser(mode, &counter);
+        for (size_t pos = 0; pos < body.size(); pos += chunksize) {
+            parser.feed(body.c_str() + pos, std::min(chunksize, body.size() - pos));
+        }
+        if (counter.error || !counter.complete || counter.nrows != nrows) {
+            state.skipWithError("unexpected parse result");
+            return;
+        }
+    }
+    state.setItemsProcessed((lcb_U64)state.iterations() * nrows);
+    state.setBytesProcessed((lcb_U64)state.iterations() * body.size());
+}
+
+static void bench_jsparse_n1ql(BenchState &state)
+{
+    parse_rows(state, Parser::MODE_N1QL, make_n1ql_response(1000), 1000, 16384);
+}
+LCB_BENCHMARK("jsparse/n1ql/1000_rows", bench_jsparse_n1ql);
+
+static void bench_jsparse_n1ql_small_chunks(BenchState &state)
+{
+    parse_rows(state, Parser::MODE_N1QL, make_n1ql_response(1000), 1000, 512);
+}
+LCB_BENCHMARK("jsparse/n1ql/1000_rows/512B_chunks", bench_jsparse_n1ql_small_chunks);
+
+static void bench_jsparse_views(BenchState &state)
+{
+    parse_rows(state, Parser::MODE_VIEWS, make_view_response(1000), 1000, 16384);
+}
+LCB_BENCHMARK("jsparse/views/1000_rows", bench_jsparse_views);
@@ -0,0 +1,226 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2020 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+#include "harness.h"
+#include "internal.h"
+#include "mc/mcreq.h"
+#include "mc/mcreq-flush-inl.h"
+#include "mc/compress.h"
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#define NUM_PIPELINES 4
+
+/** A command queue with unconnected pipelines, as in the mc tests */
+struct BenchQueue : mc_CMDQUEUE {
+    lcbvb_CONFIG *config;
+
+    BenchQueue()
+    {
+        mc_PIPELINE *pll[NUM_PIPELINES];
+        config = lcbvb_create();
+        lcbvb_genconfig(config, NUM_PIPELINES, 1, 1024);
+        for (unsigned ii = 0; ii < NUM_PIPELINES; ii++) {
+            pll[ii] = new lcb::Server();
+            mcreq_pipeline_init(pll[ii]);
+        }
+        cqdata = nullptr;
+        mcreq_queue_init(this);
+        mcreq_queue_add_pipelines(this, pll, NUM_PIPELINES, config);
+    }
+
+    ~BenchQueue()
+    {
+        for (unsigned ii = 0; ii < npipelines; ii++) {
+            mc_PIPELINE *pipeline = pipelines[ii];
+            mcreq_pipeline_cleanup(pipeline);
+            delete static_cast< lcb::Server * >(pipeline);
+        }
+        mcreq_queue_cleanup(this);
+        lcbvb_destroy(config);
+    }
+
+    BenchQueue(const BenchQueue &);
+};
+
+/*
+ * The life of a GET packet without the network: allocate and route it,
+ * enqueue it, flush it, then look it up by opaque and complete it as the
+ * response handler would.
+ */
+static void bench_mcreq_packet_cycle(BenchState &state)
+{
+    const unsigned nkeys = 32;
+    BenchQueue cq;
+    std::vector< std::string > keys;
+    for (unsigned ii = 0; ii < nkeys; ii++) {
+        keys.push_back("key_" + std::to_string(ii));
+    }
+    std::vector< mc_PACKET * > pkts(nkeys);
+    std::vector< mc_PIPELINE * > pls(nkeys);
+    nb_IOV iovs[64];
+
+    while (state.keepRunning()) {
+        for (unsigned ii = 0; ii < nkeys; ii++) {
+            protocol_binary_request_header hdr{};
+            lcb_KEYBUF kb = {LCB_KV_COPY, {keys[ii].c_str(), keys[ii].size()}};
+            if (mcreq_basic_packet(&cq, &kb, 0, &hdr, 0, 0, &pkts[ii], &pls[ii], 0) != LCB_SUCCESS) {
+                state.skipWithError("mcreq_basic_packet failed");
+                return;
+            }
+            hdr.request.magic = PROTOCOL_BINARY_REQ;
+            hdr.request.opcode = PROTOCOL_BINARY_CMD_GET;
+            hdr.request.opaque = pkts[ii]->opaque;
+            hdr.request.bodylen = htonl((lcb_U32)keys[ii].size());
+            memcpy(SPAN_BUFFER(&pkts[ii]->kh_span), hdr.bytes, sizeof(hdr.bytes));
+            mcreq_enqueue_packet(pls[ii], pkts[ii]);
+        }
+        for (unsigned ii = 0; ii < cq.npipelines; ii++) {
+            mc_PIPELINE *pl = cq.pipelines[ii];
+            unsigned nflush;
+            while ((nflush = mcreq_flush_iov_fill(pl, iovs, 64, nullptr)) != 0) {
+                mcreq_flush_done(pl, nflush, nflush);
+            }
+        }
+        for (unsigned ii = 0; ii < nkeys; ii++) {
+            mc_PACKET *pkt = mcreq_pipeline_remove(pls[ii], pkts[ii]->opaque);
+            mcreq_packet_handled(pls[ii], pkt);
+        }
+    }
+    state.setItemsProcessed((lcb_U64)state.iterations() * nkeys);
+}
+LCB_BENCHMARK("mcreq/packet_cycle/get", bench_mcreq_packet_cycle);
+
+/*
+ * Snappy through compress.cc: deflate into a packet value (as lcb_store does
+ * with compression enabled) and inflate a received value.
+ */
+static std::string make_json_value(size_t size)
+{
+    std::string value = "[";
+    for (unsigned ii = 0; value.size() < size; ii++) {
+        value += "{\"id\":" + std::to_string(ii) + ",\"name\":\"user_" + std::to_string(ii % 97) +
+                 "\",\"active\":true,\"tags\":[\"alpha\",\"beta\"]},";
+    }
+    value[value.size() - 1] = ']';
+    return value;
+}
+
+static void snappy_deflate(BenchState &state, size_t size)
+{
+    BenchQueue cq;
+    lcb_settings *settings = lcb_settings_new();
+    std::string value = make_json_value(size);
+    std::string key("compressed");
+    lcb_VALBUF vb;
+    vb.vtype = LCB_KV_CONTIG;
+    vb.u_buf.contig.bytes = value.c_str();
+    vb.u_buf.contig.nbytes = value.size();
+
+    lcb_U64 ncompressed = 0;
+    while (state.keepRunning()) {
+        protocol_binary_request_header hdr{};
+        lcb_KEYBUF kb = {LCB_KV_COPY, {key.c_str(), key.size()}};
+        mc_PACKET *pkt;
+        mc_PIPELINE *pl;
+        int compressed = 1;
+        if (mcreq_basic_packet(&cq, &kb, 0, &hdr, 0, 0, &pkt, &pl, 0) != LCB_SUCCESS ||
+            mcreq_compress_value(pl, pkt, &vb, settings, &compressed) != 0) {
+            state.skipWithError("unable to compress value");
+            lcb_settings_unref(settings);
+            return;
+        }
+        ncompressed += compressed;
+        mcreq_wipe_packet(pl, pkt);
+        mcreq_release_packet(pl, pkt);
+    }
+    lcb_settings_unref(settings);
+    if (ncompressed != state.iterations()) {
+        state.skipWithError("value was not compressed");
+    }
+    state.setBytesProcessed((lcb_U64)state.iterations() * value.size());
+}
+
+static void bench_snappy_deflate_4k(BenchState &state)
+{
+    snappy_deflate(state, 4096);
+}
+LCB_BENCHMARK("snappy/deflate/4K", bench_snappy_deflate_4k);
+
+static void bench_snappy_deflate_256k(BenchState &state)
+{
+    snappy_deflate(state, 262144);
+}
+LCB_BENCHMARK("snappy/deflate/256K", bench_snappy_deflate_256k);
+
+static void snappy_inflate(BenchState &state, size_t size)
+{
+    BenchQueue cq;
+    lcb_settings *settings = lcb_settings_new();
+    std::string value = make_json_value(size);
+    std::string key("compressed");
+    lcb_VALBUF vb;
+    vb.vtype = LCB_KV_CONTIG;
+    vb.u_buf.contig.bytes = value.c_str();
+    vb.u_buf.contig.nbytes = value.size();
+
+    /* Produce the compressed form with the library itself */
+    protocol_binary_request_header hdr{};
+    lcb_KEYBUF kb = {LCB_KV_COPY, {key.c_str(), key.size()}};
+    mc_PACKET *pkt;
+    mc_PIPELINE *pl;
+    int compressed = 1;
+    if (mcreq_basic_packet(&cq, &kb, 0, &hdr, 0, 0, &pkt, &pl, 0) != LCB_SUCCESS ||
+        mcreq_compress_value(pl, pkt, &vb, settings, &compressed) != 0 || !compressed) {
+        state.skipWithError("unable to compress value");
+        lcb_settings_unref(settings);
+        return;
+    }
+    std::string deflated(SPAN_BUFFER(&pkt->u_value.single), pkt->u_value.single.size);
+    mcreq_wipe_packet(pl, pkt);
+    mcreq_release_packet(pl, pkt);
+    lcb_settings_unref(settings);
+
+    while (state.keepRunning()) {
+        const void *bytes;
+        lcb_SIZE nbytes;
+        void *freeptr = nullptr;
+        if (mcreq_inflate_value(deflated.c_str(), deflated.size(), &bytes, &nbytes, &freeptr) != 0 ||
+            nbytes != value.size()) {
+            state.skipWithError("unable to inflate value");
+            free(freeptr);
+            return;
+        }
+        free(freeptr);
+    }
+    state.setBytesProcessed((lcb_U64)state.iterations() * value.size());
+}
+
+static void bench_snappy_inflate_4k(BenchState &state)
+{
+    snappy_inflate(state, 4096);
+}
+LCB_BENCHMARK("snappy/inflate/4K", bench_snappy_inflate_4k);
+
+static void bench_snappy_inflate_256k(BenchState &state)
+{
+    snappy_inflate(state, 262144);
+}
+LCB_BENCHMARK("snappy/inflate/256K", bench_snappy_inflate_256k);
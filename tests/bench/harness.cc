@@ -0,0 +1,289 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2020 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+#include "harness.h"
+#define CLIOPTS_ENABLE_CXX
+#include "contrib/cliopts/cliopts.h"
+#include "contrib/lcb-jsoncpp/lcb-jsoncpp.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <vector>
+
+namespace
+{
+struct BenchCase {
+    std::string name;
+    BenchFunction fn;
+};
+
+std::vector< BenchCase > &registry()
+{
+    static std::vector< BenchCase > cases;
+    return cases;
+}
+
+struct BenchResult {
+    size_t iterations;
+    double ns_min;
+    double ns_mean;
+    double ns_max;
+    double bytes_per_second;
+    double items_per_second;
+    std::string label;
+};
+
+class Runner
+{
+  public:
+    Runner()
+        : o_filter("filter"), o_mintime("min-time"), o_reps("repetitions"), o_json("json"), o_baseline("baseline"),
+          o_list("list")
+    {
+        o_filter.abbrev('f').description("Only run benchmarks whose name contains this string. May be repeated");
+        o_mintime.abbrev('t').description("Minimum duration of every run, in milliseconds").setDefault(200);
+        o_reps.abbrev('r').description("Number of timed runs per benchmark").setDefault(3);
+        o_json.abbrev('j').description("Write the results as JSON to this file ('-' for stdout)");
+        o_baseline.abbrev('b').description("Compare against a JSON file previously written with --json");
+        o_list.abbrev('l').description("List the benchmarks and exit");
+    }
+
+    bool parseOptions(int argc, char **argv)
+    {
+        cliopts::Parser parser("micro-bench");
+        parser.addOption(o_filter);
+        parser.addOption(o_mintime);
+        parser.addOption(o_reps);
+        parser.addOption(o_json);
+        parser.addOption(o_baseline);
+        parser.addOption(o_list);
+        if (!parser.parse(argc, argv, false)) {
+            return false;
+        }
+        if (o_reps.result() == 0) {
+            fprintf(stderr, "At least one repetition is required\n");
+            return false;
+        }
+        if (o_baseline.passed() && !loadBaseline(o_baseline.result())) {
+            return false;
+        }
+        table = o_json.passed() && o_json.result() == "-" ? stderr : stdout;
+        return true;
+    }
+
+    int run()
+    {
+        std::vector< BenchCase > cases = registry();
+        std::sort(cases.begin(), cases.end(),
+                  [](const BenchCase &a, const BenchCase &b) { return a.name < b.name; });
+
+        if (o_list.result()) {
+            for (size_t ii = 0; ii < cases.size(); ii++) {
+                if (matches(cases[ii].name)) {
+                    printf("%s\n", cases[ii].name.c_str());
+                }
+            }
+            return 0;
+        }
+
+        Json::Value report;
+        report["context"]["version"] = lcb_get_version(nullptr);
+        report["context"]["min_time_ms"] = (Json::UInt)o_mintime.result();
+        report["context"]["repetitions"] = (Json::UInt)o_reps.result();
+        report["benchmarks"] = Json::Value(Json::arrayValue);
+
+        fprintf(table, "%-36s %12s %12s %12s %12s %12s%s\n", "BENCHMARK", "ITERATIONS", "NS/OP(min)", "NS/OP(mean)",
+                "MB/S", "ITEMS/S", baseline.empty() ? "" : "    BASELINE");
+        int ret = 0;
+        for (size_t ii = 0; ii < cases.size(); ii++) {
+            const BenchCase &bc = cases[ii];
+            if (!matches(bc.name)) {
+                continue;
+            }
+            BenchResult res;
+            std::string error;
+            if (!runCase(bc, res, error)) {
+                fprintf(table, "%-36s ERROR: %s\n", bc.name.c_str(), error.c_str());
+                ret = 1;
+                continue;
+            }
+            std::string delta;
+            std::map< std::string, double >::const_iterator it = baseline.find(bc.name);
+            if (it != baseline.end() && it->second > 0) {
+                char buf[32];
+                snprintf(buf, sizeof(buf), "    %+.1f%%", (res.ns_min - it->second) * 100.0 / it->second);
+                delta = buf;
+            }
+            if (!res.label.empty()) {
+                delta += "    " + res.label;
+            }
+            fprintf(table, "%-36s %12u %12.1f %12.1f %12.1f %12.0f%s\n", bc.name.c_str(), (unsigned)res.iterations,
+                    res.ns_min, res.ns_mean, res.bytes_per_second / 1e6, res.items_per_second, delta.c_str());
+
+            Json::Value jr;
+            jr["name"] = bc.name;
+            jr["iterations"] = (Json::UInt64)res.iterations;
+            jr["ns_per_op_min"] = res.ns_min;
+            jr["ns_per_op_mean"] = res.ns_mean;
+            jr["ns_per_op_max"] = res.ns_max;
+            if (res.bytes_per_second > 0) {
+                jr["bytes_per_second"] = res.bytes_per_second;
+            }
+            if (res.items_per_second > 0) {
+                jr["items_per_second"] = res.items_per_second;
+            }
+            if (!res.label.empty()) {
+                jr["label"] = res.label;
+            }
+            report["benchmarks"].append(jr);
+        }
+
+        if (o_json.passed()) {
+            std::string path = o_json.result();
+            Json::StyledWriter writer;
+            if (path == "-") {
+                std::cout << writer.write(report);
+            } else {
+                std::ofstream out(path.c_str());
+                if (!out) {
+                    fprintf(stderr, "Unable to open %s for writing\n", path.c_str());
+                    return 1;
+                }
+                out << writer.write(report);
+            }
+        }
+        return ret;
+    }
+
+  private:
+    bool matches(const std::string &name)
+    {
+        const std::vector< std::string > &filters = o_filter.const_result();
+        if (filters.empty()) {
+            return true;
+        }
+        for (size_t ii = 0; ii < filters.size(); ii++) {
+            if (name.find(filters[ii]) != std::string::npos) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool loadBaseline(const std::string &path)
+    {
+        std::ifstream in(path.c_str());
+        Json::Value root;
+        Json::Reader reader;
+        if (!in || !reader.parse(in, root) || !root["benchmarks"].isArray()) {
+            fprintf(stderr, "Unable to load baseline from %s\n", path.c_str());
+            return false;
+        }
+        const Json::Value &benchmarks = root["benchmarks"];
+        for (Json::ArrayIndex ii = 0; ii < benchmarks.size(); ii++) {
+            baseline[benchmarks[ii]["name"].asString()] = benchmarks[ii]["ns_per_op_min"].asDouble();
+        }
+        return true;
+    }
+
+    /** Run the benchmark once with the given number of iterations */
+    static bool runOnce(const BenchCase &bc, BenchState &state)
+    {
+        bc.fn(state);
+        return state.error.empty();
+    }
+
+    bool runCase(const BenchCase &bc, BenchResult &res, std::string &error)
+    {
+        lcb_U64 mintime = (lcb_U64)o_mintime.result() * 1000000;
+        size_t iterations = 1;
+
+        // Grow the iteration count until a run lasts long enough
+        while (true) {
+            BenchState state(iterations);
+            if (!runOnce(bc, state)) {
+                error = state.error;
+                return false;
+            }
+            lcb_U64 elapsed = std::max< lcb_U64 >(state.elapsed(), 1);
+            if (elapsed >= mintime || iterations >= 1000000000) {
+                break;
+            }
+            double factor = std::min(10.0, std::max(2.0, 1.4 * mintime / elapsed));
+            iterations = (size_t)(iterations * factor);
+        }
+
+        res.iterations = iterations;
+        res.ns_min = 0;
+        res.ns_max = 0;
+        res.bytes_per_second = 0;
+        res.items_per_second = 0;
+        double total = 0;
+        for (unsigned ii = 0; ii < o_reps.result(); ii++) {
+            BenchState state(iterations);
+            if (!runOnce(bc, state)) {
+                error = state.error;
+                return false;
+            }
+            double seconds = state.elapsed() / 1e9;
+            double nsop = (double)state.elapsed() / iterations;
+            total += nsop;
+            if (ii == 0 || nsop < res.ns_min) {
+                res.ns_min = nsop;
+                res.bytes_per_second = seconds > 0 ? state.nbytes / seconds : 0;
+                res.items_per_second = seconds > 0 ? state.nitems / seconds : 0;
+            }
+            res.ns_max = std::max(res.ns_max, nsop);
+            res.label = state.label;
+        }
+        res.ns_mean = total / o_reps.result();
+        return true;
+    }
+
+    cliopts::ListOption o_filter;
+    cliopts::UIntOption o_mintime;
+    cliopts::UIntOption o_reps;
+    cliopts::StringOption o_json;
+    cliopts::StringOption o_baseline;
+    cliopts::BoolOption o_list;
+
+    std::map< std::string, double > baseline;
+    FILE *table{stdout};
+};
+} // namespace
+
+int bench_register(const char *name, BenchFunction fn)
+{
+    BenchCase bc;
+    bc.name = name;
+    bc.fn = fn;
+    registry().push_back(bc);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    Runner runner;
+    if (!runner.parseOptions(argc, argv)) {
+        return 1;
+    }
+    return runner.run();
+}
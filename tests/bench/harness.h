@@ -0,0 +1,136 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2020 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+/**
+ * @file
+ * Minimal micro-benchmark harness for the library internals.
+ *
+ * A benchmark is a function which performs its setup and then loops on
+ * BenchState::keepRunning(); only the loop is timed:
+ *
+ * @code{.cpp}
+ * static void bench_thing(BenchState &state)
+ * {
+ *     Thing thing;
+ *     while (state.keepRunning()) {
+ *         thing.doIt();
+ *     }
+ *     state.setItemsProcessed(state.iterations());
+ * }
+ * LCB_BENCHMARK("thing/do_it", bench_thing);
+ * @endcode
+ *
+ * The runner calibrates the number of iterations so that each run lasts at
+ * least the requested minimum time, and repeats every run a few times.
+ */
+
+#ifndef LCB_BENCH_HARNESS_H
+#define LCB_BENCH_HARNESS_H
+
+#include <libcouchbase/couchbase.h>
+#include <libcouchbase/utils.h>
+#include <string>
+
+class BenchState
+{
+  public:
+    explicit BenchState(size_t iterations) : max_iterations(iterations) {}
+
+    /**
+     * @return true while the benchmark should execute another iteration.
+     * The timer starts on the first call and stops on the last one.
+     */
+    bool keepRunning()
+    {
+        if (ncalled == 0) {
+            begin = lcb_nstime();
+        }
+        if (ncalled++ < max_iterations) {
+            return true;
+        }
+        end = lcb_nstime();
+        return false;
+    }
+
+    /** Pause the timer, e.g. to reset state between iterations */
+    void pauseTiming()
+    {
+        paused_at = lcb_nstime();
+    }
+
+    void resumeTiming()
+    {
+        begin += lcb_nstime() - paused_at;
+    }
+
+    size_t iterations() const
+    {
+        return max_iterations;
+    }
+
+    /** Total bytes handled by all iterations, used to report throughput */
+    void setBytesProcessed(lcb_U64 n)
+    {
+        nbytes = n;
+    }
+
+    /** Total logical items (rows, packets, keys) handled by all iterations */
+    void setItemsProcessed(lcb_U64 n)
+    {
+        nitems = n;
+    }
+
+    /** Note shown along with the results, e.g. a compression ratio */
+    void setLabel(const std::string &text)
+    {
+        label = text;
+    }
+
+    /** Abort the benchmark, e.g. when the operation under test fails */
+    void skipWithError(const std::string &msg)
+    {
+        error = msg;
+    }
+
+    lcb_U64 elapsed() const
+    {
+        return end - begin;
+    }
+
+    lcb_U64 nbytes{0};
+    lcb_U64 nitems{0};
+    std::string label;
+    std::string error;
+
+  private:
+    size_t max_iterations;
+    size_t ncalled{0};
+    lcb_U64 begin{0};
+    lcb_U64 end{0};
+    lcb_U64 paused_at{0};
+};
+
+typedef void (*BenchFunction)(BenchState &);
+
+/** Add a benchmark to the global registry. Use LCB_BENCHMARK instead */
+int bench_register(const char *name, BenchFunction fn);
+
+#define LCB_BENCH_CONCAT_(a, b) a##b
+#define LCB_BENCH_CONCAT(a, b) LCB_BENCH_CONCAT_(a, b)
+#define LCB_BENCHMARK(name, fn) static int LCB_BENCH_CONCAT(lcb_bench_reg_, __LINE__) = bench_register(name, fn)
+
+#endif
@@ -0,0 +1,374 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2020 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+/**
+ * End-to-end KV benchmark of the library over loopback.
+ *
+ * The operations are served by the in-process LCBTest::KVServer, so the
+ * numbers reflect the cost of the client (scheduling, encoding, I/O and
+ * parsing) rather than the cluster, and may be compared between commits.
+ */
+
+#include "config.h"
+#include <ioserver/kvserver.h>
+#include <libcouchbase/couchbase.h>
+#include <libcouchbase/utils.h>
+#define CLIOPTS_ENABLE_CXX
+#include "contrib/cliopts/cliopts.h"
+#include "contrib/lcb-jsoncpp/lcb-jsoncpp.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+using namespace LCBTest;
+
+namespace
+{
+struct BenchOp {
+    lcb_U64 start;
+};
+
+struct BenchContext {
+    std::vector< lcb_U64 > latencies;
+    size_t errors{0};
+};
+
+void record(BenchContext *ctx, BenchOp *op, lcb_STATUS rc)
+{
+    ctx->latencies.push_back(lcb_nstime() - op->start);
+    if (rc != LCB_SUCCESS) {
+        ctx->errors++;
+    }
+}
+
+extern "C" {
+static void store_callback(lcb_INSTANCE *instance, int, const lcb_RESPSTORE *resp)
+{
+    BenchOp *op;
+    lcb_respstore_cookie(resp, (void **)&op);
+    record((BenchContext *)lcb_get_cookie(instance), op, lcb_respstore_status(resp));
+}
+
+static void get_callback(lcb_INSTANCE *instance, int, const lcb_RESPGET *resp)
+{
+    BenchOp *op;
+    lcb_respget_cookie(resp, (void **)&op);
+    record((BenchContext *)lcb_get_cookie(instance), op, lcb_respget_status(resp));
+}
+
+static void subdoc_callback(lcb_INSTANCE *instance, int, const lcb_RESPSUBDOC *resp)
+{
+    BenchOp *op;
+    lcb_respsubdoc_cookie(resp, (void **)&op);
+    lcb_STATUS rc = lcb_respsubdoc_status(resp);
+    if (rc == LCB_SUCCESS && lcb_respsubdoc_result_size(resp) > 0) {
+        rc = lcb_respsubdoc_result_status(resp, 0);
+    }
+    record((BenchContext *)lcb_get_cookie(instance), op, rc);
+}
+}
+
+class Benchmark
+{
+  public:
+    Benchmark()
+        : o_scenarios("scenario"), o_ops("operations"), o_batch("batch-size"), o_valsize("value-size"),
+          o_keys("keys"), o_latency("server-latency"), o_json("json")
+    {
+        o_scenarios.abbrev('s').description("Scenarios to run (upsert, get, subdoc, mixed). Default is all");
+        o_ops.abbrev('n').description("Number of operations per scenario").setDefault(100000);
+        o_batch.abbrev('B').description("Number of operations scheduled before each wait").setDefault(32);
+        o_valsize.abbrev('V').description("Size of the document values").setDefault(256);
+        o_keys.abbrev('I').description("Number of distinct keys").setDefault(1000);
+        o_latency.abbrev('L').description("Latency added by the server to each batch, in microseconds");
+        o_json.abbrev('j').description("Write the results as JSON to this file ('-' for stdout)");
+    }
+
+    bool parseOptions(int argc, char **argv)
+    {
+        cliopts::Parser parser("kv-bench");
+        parser.addOption(o_scenarios);
+        parser.addOption(o_ops);
+        parser.addOption(o_batch);
+        parser.addOption(o_valsize);
+        parser.addOption(o_keys);
+        parser.addOption(o_latency);
+        parser.addOption(o_json);
+        if (!parser.parse(argc, argv, false)) {
+            return false;
+        }
+        scenarios = o_scenarios.result();
+        if (scenarios.empty()) {
+            scenarios.push_back("upsert");
+            scenarios.push_back("get");
+            scenarios.push_back("subdoc");
+            scenarios.push_back("mixed");
+        }
+        for (size_t ii = 0; ii < scenarios.size(); ii++) {
+            const std::string &s = scenarios[ii];
+            if (s != "upsert" && s != "get" && s != "subdoc" && s != "mixed") {
+                fprintf(stderr, "Unknown scenario '%s'\n", s.c_str());
+                return false;
+            }
+        }
+        if (o_batch.result() == 0 || o_keys.result() == 0) {
+            fprintf(stderr, "Batch size and number of keys must be positive\n");
+            return false;
+        }
+        return true;
+    }
+
+    int run()
+    {
+        KVServer server;
+        server.setLatency(o_latency.result());
+
+        std::string connstr = server.getConnectionString();
+        lcb_CREATEOPTS *cropts = nullptr;
+        lcb_createopts_create(&cropts, LCB_TYPE_BUCKET);
+        lcb_createopts_connstr(cropts, connstr.c_str(), connstr.size());
+        lcb_STATUS rc = lcb_create(&instance, cropts);
+        lcb_createopts_destroy(cropts);
+        if (rc != LCB_SUCCESS) {
+            fprintf(stderr, "Failed to create instance: %s\n", lcb_strerror_short(rc));
+            return 1;
+        }
+        lcb_install_callback(instance, LCB_CALLBACK_STORE, (lcb_RESPCALLBACK)store_callback);
+        lcb_install_callback(instance, LCB_CALLBACK_GET, (lcb_RESPCALLBACK)get_callback);
+        lcb_install_callback(instance, LCB_CALLBACK_SDLOOKUP, (lcb_RESPCALLBACK)subdoc_callback);
+        lcb_connect(instance);
+        lcb_wait(instance, LCB_WAIT_DEFAULT);
+        if ((rc = lcb_get_bootstrap_status(instance)) != LCB_SUCCESS) {
+            fprintf(stderr, "Failed to bootstrap: %s\n", lcb_strerror_short(rc));
+            lcb_destroy(instance);
+            return 1;
+        }
+        buildDocument();
+
+        Json::Value report;
+        report["config"]["operations"] = (Json::UInt)o_ops.result();
+        report["config"]["batch_size"] = (Json::UInt)o_batch.result();
+        report["config"]["value_size"] = (Json::UInt)o_valsize.result();
+        report["config"]["keys"] = (Json::UInt)o_keys.result();
+        report["config"]["server_latency_us"] = (Json::UInt)o_latency.result();
+        report["config"]["version"] = lcb_get_version(nullptr);
+
+        // Keep stdout clean when the JSON report goes there
+        table = o_json.passed() && o_json.result() == "-" ? stderr : stdout;
+        fprintf(table, "%-8s %10s %12s %9s %9s %9s %9s %9s %7s\n", "SCENARIO", "OPS", "OPS/SEC", "MIN(us)",
+                "P50(us)", "P90(us)", "P99(us)", "MAX(us)", "ERRORS");
+        int ret = 0;
+        for (size_t ii = 0; ii < scenarios.size(); ii++) {
+            populate();
+            BenchContext ctx;
+            lcb_U64 elapsed = runScenario(scenarios[ii], ctx);
+            report["scenarios"].append(summarize(scenarios[ii], ctx, elapsed));
+            if (ctx.errors) {
+                ret = 1;
+            }
+        }
+        lcb_destroy(instance);
+        instance = nullptr;
+
+        if (o_json.passed()) {
+            std::string path = o_json.result();
+            Json::StyledWriter writer;
+            if (path == "-") {
+                std::cout << writer.write(report);
+            } else {
+                std::ofstream out(path.c_str());
+                if (!out) {
+                    fprintf(stderr, "Unable to open %s for writing\n", path.c_str());
+                    return 1;
+                }
+                out << writer.write(report);
+            }
+        }
+        return ret;
+    }
+
+  private:
+    void buildDocument()
+    {
+        // A JSON object whose size approximates the requested value size
+        std::stringstream ss;
+        ss << "{\"name\":\"kv-bench\",\"counter\":42,\"padding\":\"";
+        size_t overhead = ss.str().size() + 2;
+        size_t npad = o_valsize.result() > overhead ? o_valsize.result() - overhead : 0;
+        ss << std::string(npad, 'x') << "\"}";
+        document = ss.str();
+    }
+
+    std::string makeKey(size_t ix)
+    {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "key_%08u", (unsigned)(ix % o_keys.result()));
+        return buf;
+    }
+
+    void populate()
+    {
+        BenchContext ctx;
+        lcb_set_cookie(instance, &ctx);
+        std::vector< BenchOp > ops(o_keys.result());
+        lcb_sched_enter(instance);
+        for (size_t ii = 0; ii < ops.size(); ii++) {
+            scheduleUpsert(makeKey(ii), &ops[ii]);
+        }
+        lcb_sched_leave(instance);
+        lcb_wait(instance, LCB_WAIT_DEFAULT);
+        lcb_set_cookie(instance, nullptr);
+    }
+
+    lcb_STATUS scheduleUpsert(const std::string &key, BenchOp *op)
+    {
+        lcb_CMDSTORE *cmd;
+        lcb_cmdstore_create(&cmd, LCB_STORE_UPSERT);
+        lcb_cmdstore_key(cmd, key.c_str(), key.size());
+        lcb_cmdstore_value(cmd, document.c_str(), document.size());
+        op->start = lcb_nstime();
+        lcb_STATUS rc = lcb_store(instance, op, cmd);
+        lcb_cmdstore_destroy(cmd);
+        return rc;
+    }
+
+    lcb_STATUS scheduleGet(const std::string &key, BenchOp *op)
+    {
+        lcb_CMDGET *cmd;
+        lcb_cmdget_create(&cmd);
+        lcb_cmdget_key(cmd, key.c_str(), key.size());
+        op->start = lcb_nstime();
+        lcb_STATUS rc = lcb_get(instance, op, cmd);
+        lcb_cmdget_destroy(cmd);
+        return rc;
+    }
+
+    lcb_STATUS scheduleLookup(const std::string &key, BenchOp *op)
+    {
+        lcb_SUBDOCSPECS *specs;
+        lcb_subdocspecs_create(&specs, 1);
+        lcb_subdocspecs_get(specs, 0, 0, "counter", 7);
+        lcb_CMDSUBDOC *cmd;
+        lcb_cmdsubdoc_create(&cmd);
+        lcb_cmdsubdoc_key(cmd, key.c_str(), key.size());
+        lcb_cmdsubdoc_specs(cmd, specs);
+        op->start = lcb_nstime();
+        lcb_STATUS rc = lcb_subdoc(instance, op, cmd);
+        lcb_cmdsubdoc_destroy(cmd);
+        lcb_subdocspecs_destroy(specs);
+        return rc;
+    }
+
+    lcb_U64 runScenario(const std::string &name, BenchContext &ctx)
+    {
+        size_t nops = o_ops.result();
+        size_t batch = o_batch.result();
+        std::vector< BenchOp > ops(batch);
+
+        ctx.latencies.reserve(nops);
+        lcb_set_cookie(instance, &ctx);
+        lcb_U64 begin = lcb_nstime();
+        for (size_t done = 0; done < nops;) {
+            size_t nbatch = std::min(batch, nops - done);
+            lcb_sched_enter(instance);
+            for (size_t ii = 0; ii < nbatch; ii++) {
+                size_t ix = done + ii;
+                std::string key = makeKey(ix);
+                lcb_STATUS rc;
+                if (name == "upsert" || (name == "mixed" && ix % 10 == 0)) {
+                    rc = scheduleUpsert(key, &ops[ii]);
+                } else if (name == "subdoc" || (name == "mixed" && ix % 10 == 1)) {
+                    rc = scheduleLookup(key, &ops[ii]);
+                } else {
+                    rc = scheduleGet(key, &ops[ii]);
+                }
+                if (rc != LCB_SUCCESS) {
+                    ctx.errors++;
+                }
+            }
+            lcb_sched_leave(instance);
+            lcb_wait(instance, LCB_WAIT_DEFAULT);
+            done += nbatch;
+        }
+        lcb_U64 elapsed = lcb_nstime() - begin;
+        lcb_set_cookie(instance, nullptr);
+        return elapsed;
+    }
+
+    static double percentile(const std::vector< lcb_U64 > &sorted, double pct)
+    {
+        if (sorted.empty()) {
+            return 0;
+        }
+        size_t ix = (size_t)(pct / 100.0 * (sorted.size() - 1) + 0.5);
+        return sorted[ix] / 1000.0;
+    }
+
+    Json::Value summarize(const std::string &name, BenchContext &ctx, lcb_U64 elapsed)
+    {
+        std::vector< lcb_U64 > &lat = ctx.latencies;
+        std::sort(lat.begin(), lat.end());
+        double seconds = elapsed / 1e9;
+        double opsps = seconds > 0 ? lat.size() / seconds : 0;
+
+        Json::Value res;
+        res["name"] = name;
+        res["operations"] = (Json::UInt64)lat.size();
+        res["errors"] = (Json::UInt64)ctx.errors;
+        res["seconds"] = seconds;
+        res["ops_per_sec"] = opsps;
+        Json::Value &jl = res["latency_us"];
+        jl["min"] = percentile(lat, 0);
+        jl["p50"] = percentile(lat, 50);
+        jl["p90"] = percentile(lat, 90);
+        jl["p99"] = percentile(lat, 99);
+        jl["p999"] = percentile(lat, 99.9);
+        jl["max"] = percentile(lat, 100);
+
+        fprintf(table, "%-8s %10u %12.0f %9.1f %9.1f %9.1f %9.1f %9.1f %7u\n", name.c_str(), (unsigned)lat.size(),
+                opsps, jl["min"].asDouble(), jl["p50"].asDouble(), jl["p90"].asDouble(), jl["p99"].asDouble(),
+                jl["max"].asDouble(), (unsigned)ctx.errors);
+        return res;
+    }
+
+    cliopts::ListOption o_scenarios;
+    cliopts::UIntOption o_ops;
+    cliopts::UIntOption o_batch;
+    cliopts::UIntOption o_valsize;
+    cliopts::UIntOption o_keys;
+    cliopts::UIntOption o_latency;
+    cliopts::StringOption o_json;
+
+    std::vector< std::string > scenarios;
+    std::string document;
+    lcb_INSTANCE *instance{nullptr};
+    FILE *table{stdout};
+};
+} // namespace
+
+int main(int argc, char **argv)
+{
+    Benchmark bench;
+    if (!bench.parseOptions(argc, argv)) {
+        return 1;
+    }
+    return bench.run();
+}
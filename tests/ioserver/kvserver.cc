@@ -0,0 +1,825 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2020 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "kvserver.h"
+#include <memcached/protocol_binary.h>
+#include "contrib/lcb-jsoncpp/lcb-jsoncpp.h"
+
+using namespace LCBTest;
+
+/* sub-document flags, see the server's subdocument documentation */
+#define SUBDOC_PATHFLAG_MKDIR_P 0x01
+#define SUBDOC_DOCFLAG_MKDOC 0x01
+#define SUBDOC_DOCFLAG_ADD 0x02
+
+namespace LCBTest
+{
+/** Server side of a single client connection. Runs in its own thread */
+class KVConnection
+{
+  public:
+    KVConnection(KVServer *server, SockFD *sock)
+        : bucket("default"), collections(false), tracing(false), parent(server), datasock(sock)
+    {
+        datasock->setNodelay();
+        thr = new Thread(runfunc, this);
+    }
+
+    ~KVConnection()
+    {
+        datasock->close();
+        delete thr; // joins
+        delete datasock;
+    }
+
+    void shutdown()
+    {
+        datasock->close();
+    }
+
+    std::string bucket;
+    /** Whether collections were negotiated with HELLO */
+    bool collections;
+    /** Whether tracing was negotiated with HELLO */
+    bool tracing;
+
+  private:
+    static void runfunc(void *arg)
+    {
+        static_cast<KVConnection *>(arg)->run();
+    }
+
+    void run()
+    {
+        std::string inbuf;
+        std::string outbuf;
+        char buf[65536];
+
+        while (true) {
+            ssize_t nr = datasock->recv(buf, sizeof(buf));
+            if (nr <= 0) {
+                return;
+            }
+            inbuf.append(buf, nr);
+
+            size_t pos = 0;
+            while (inbuf.size() - pos >= 24) {
+                uint32_t bodylen;
+                memcpy(&bodylen, inbuf.data() + pos + 8, sizeof(bodylen));
+                size_t nreq = 24 + ntohl(bodylen);
+                if (inbuf.size() - pos < nreq) {
+                    break;
+                }
+                size_t begin = outbuf.size();
+                parent->dispatch(this, inbuf.data() + pos, nreq, outbuf);
+                parent->addServerDuration(this, outbuf, begin);
+                pos += nreq;
+            }
+            inbuf.erase(0, pos);
+            if (outbuf.empty()) {
+                continue;
+            }
+
+            uint32_t latency = parent->getLatency();
+            if (latency) {
+#ifdef _WIN32
+                Sleep(latency / 1000);
+#else
+                usleep(latency);
+#endif
+            }
+            size_t nsent = 0;
+            while (nsent < outbuf.size()) {
+                ssize_t nw = datasock->send(outbuf.data() + nsent, outbuf.size() - nsent);
+                if (nw <= 0) {
+                    return;
+                }
+                nsent += nw;
+            }
+            outbuf.clear();
+        }
+    }
+
+    KVServer *parent;
+    SockFD *datasock;
+    Thread *thr;
+};
+} // namespace LCBTest
+
+namespace
+{
+class Lock
+{
+  public:
+    explicit Lock(Mutex &m) : mutex(m)
+    {
+        mutex.lock();
+    }
+    ~Lock()
+    {
+        mutex.unlock();
+    }
+
+  private:
+    Mutex &mutex;
+};
+
+uint16_t read16(const char *p)
+{
+    uint16_t v;
+    memcpy(&v, p, sizeof(v));
+    return ntohs(v);
+}
+
+uint32_t read32(const char *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return ntohl(v);
+}
+
+uint64_t read64(const char *p)
+{
+    uint64_t v = 0;
+    for (size_t ii = 0; ii < 8; ii++) {
+        v = (v << 8) | static_cast<uint8_t>(p[ii]);
+    }
+    return v;
+}
+
+/** @return the size of the leb128 collection ID at the beginning of the key, 0 if malformed */
+size_t read_leb128(const std::string &key, uint32_t *value)
+{
+    *value = 0;
+    for (size_t ii = 0; ii < key.size() && ii < 5; ii++) {
+        uint8_t byte = static_cast<uint8_t>(key[ii]);
+        *value |= static_cast<uint32_t>(byte & 0x7f) << (7 * ii);
+        if ((byte & 0x80) == 0) {
+            return ii + 1;
+        }
+    }
+    return 0;
+}
+
+void append16(std::string &out, uint16_t v)
+{
+    out.push_back(static_cast<char>(v >> 8));
+    out.push_back(static_cast<char>(v));
+}
+
+void append32(std::string &out, uint32_t v)
+{
+    append16(out, static_cast<uint16_t>(v >> 16));
+    append16(out, static_cast<uint16_t>(v));
+}
+
+void append64(std::string &out, uint64_t v)
+{
+    append32(out, static_cast<uint32_t>(v >> 32));
+    append32(out, static_cast<uint32_t>(v));
+}
+
+void respond(std::string &out, const char *req, uint16_t status, const std::string &extras = std::string(),
+             const std::string &value = std::string(), uint64_t cas = 0, uint8_t datatype = 0)
+{
+    out.push_back(static_cast<char>(PROTOCOL_BINARY_RES));
+    out.push_back(req[1]);
+    append16(out, 0);
+    out.push_back(static_cast<char>(extras.size()));
+    out.push_back(static_cast<char>(datatype));
+    append16(out, status);
+    append32(out, static_cast<uint32_t>(extras.size() + value.size()));
+    out.append(req + 12, 4); // opaque
+    append64(out, cas);
+    out.append(extras);
+    out.append(value);
+}
+
+std::string to_json(const Json::Value &value)
+{
+    std::string s = Json::FastWriter().write(value);
+    if (!s.empty() && s[s.size() - 1] == '\n') {
+        s.erase(s.size() - 1);
+    }
+    return s;
+}
+
+/** Resolve a dotted path of object members. Array indexes are not supported */
+Json::Value *walk(Json::Value &root, const std::string &path, bool create_parents, std::string *last,
+                  uint16_t *status)
+{
+    Json::Value *cur = &root;
+    size_t pos = 0;
+    if (path.find('[') != std::string::npos || path.find('`') != std::string::npos) {
+        *status = PROTOCOL_BINARY_RESPONSE_SUBDOC_PATH_EINVAL;
+        return nullptr;
+    }
+    while (true) {
+        size_t dot = path.find('.', pos);
+        std::string component = path.substr(pos, dot == std::string::npos ? std::string::npos : dot - pos);
+        if (!cur->isObject()) {
+            *status = PROTOCOL_BINARY_RESPONSE_SUBDOC_PATH_MISMATCH;
+            return nullptr;
+        }
+        if (dot == std::string::npos) {
+            *last = component;
+            return cur;
+        }
+        if (!cur->isMember(component)) {
+            if (!create_parents) {
+                *status = PROTOCOL_BINARY_RESPONSE_SUBDOC_PATH_ENOENT;
+                return nullptr;
+            }
+            (*cur)[component] = Json::Value(Json::objectValue);
+        }
+        cur = &(*cur)[component];
+        pos = dot + 1;
+    }
+}
+} // namespace
+
+KVServer::KVServer(unsigned nvb)
+    : closed(false), nvbuckets(nvb), next_cas(1), nrequests(0), latency_us(0), server_duration(0), snappy(false),
+      nmv_remaining(0), manifest_uid(0)
+{
+    lsn = SockFD::newListener();
+    thr = new Thread(runfunc, this);
+}
+
+KVServer::~KVServer()
+{
+    close();
+    delete thr;
+    delete lsn;
+    mutex.close();
+}
+
+void KVServer::runfunc(void *arg)
+{
+    static_cast<KVServer *>(arg)->run();
+}
+
+void KVServer::run()
+{
+    while (!closed) {
+        int lsnfd = *lsn;
+        if (lsnfd < 0) {
+            break;
+        }
+        fd_set fds;
+        struct timeval tmout = {0, 100000};
+        FD_ZERO(&fds);
+        FD_SET(lsnfd, &fds);
+        if (select(lsnfd + 1, &fds, nullptr, nullptr, &tmout) != 1) {
+            continue;
+        }
+        int newsock = accept(lsnfd, nullptr, nullptr);
+        if (newsock == -1) {
+            break;
+        }
+        auto *conn = new KVConnection(this, new SockFD(newsock));
+        bool accepted;
+        {
+            Lock guard(mutex);
+            accepted = !closed;
+            if (accepted) {
+                conns.push_back(conn);
+            }
+        }
+        if (!accepted) {
+            conn->shutdown();
+            delete conn;
+        }
+    }
+}
+
+void KVServer::close()
+{
+    std::list<KVConnection *> pending;
+    {
+        Lock guard(mutex);
+        if (closed) {
+            return;
+        }
+        closed = true;
+        pending.swap(conns);
+    }
+    lsn->close();
+    // Connection threads may be waiting for the mutex, so they are joined without holding it
+    for (auto *conn : pending) {
+        conn->shutdown();
+        delete conn;
+    }
+}
+
+std::string KVServer::getConnectionString(const std::string &bucket)
+{
+    char buf[256];
+    snprintf(buf, sizeof(buf), "couchbase://127.0.0.1:%d=mcd/%s?bootstrap_on=cccp", (int)getListenPort(),
+             bucket.c_str());
+    return buf;
+}
+
+void KVServer::setCredentials(const std::string &user, const std::string &pass)
+{
+    Lock guard(mutex);
+    username = user;
+    password = pass;
+}
+
+void KVServer::setLatency(uint32_t usec)
+{
+    Lock guard(mutex);
+    latency_us = usec;
+}
+
+void KVServer::enableCompression()
+{
+    Lock guard(mutex);
+    snappy = true;
+}
+
+void KVServer::setServerDuration(uint16_t encoded)
+{
+    Lock guard(mutex);
+    server_duration = encoded;
+}
+
+void KVServer::addServerDuration(KVConnection *conn, std::string &out, size_t begin)
+{
+    Lock guard(mutex);
+    if (!conn->tracing || server_duration == 0 || out.size() < begin + 24 ||
+        static_cast<uint8_t>(out[begin + 1]) == PROTOCOL_BINARY_CMD_HELLO) {
+        return;
+    }
+    // Alternative response: one byte of framing extras length, one byte of key length
+    std::string frame;
+    frame.push_back(static_cast<char>(0x02)); // id 0 (duration), length 2
+    append16(frame, server_duration);
+    out[begin] = static_cast<char>(PROTOCOL_BINARY_ARES);
+    out[begin + 2] = static_cast<char>(frame.size());
+    uint32_t bodylen = read32(out.data() + begin + 8) + frame.size();
+    std::string encoded;
+    append32(encoded, bodylen);
+    out.replace(begin + 8, 4, encoded);
+    out.insert(begin + 24, frame);
+}
+
+uint32_t KVServer::getLatency()
+{
+    Lock guard(mutex);
+    return latency_us;
+}
+
+void KVServer::injectError(uint8_t opcode, uint16_t status, unsigned count)
+{
+    Lock guard(mutex);
+    injected[opcode] = std::make_pair(status, count);
+}
+
+void KVServer::injectNotMyVbucket(unsigned count)
+{
+    Lock guard(mutex);
+    nmv_remaining = count;
+}
+
+size_t KVServer::getItemCount()
+{
+    Lock guard(mutex);
+    return items.size();
+}
+
+size_t KVServer::getRequestCount()
+{
+    Lock guard(mutex);
+    return nrequests;
+}
+
+size_t KVServer::getRequestCount(uint8_t opcode)
+{
+    Lock guard(mutex);
+    return opcode_requests[opcode];
+}
+
+void KVServer::addCollection(const std::string &scope, const std::string &collection, uint32_t cid)
+{
+    Lock guard(mutex);
+    collections[scope + "." + collection] = cid;
+    manifest_uid++;
+}
+
+void KVServer::flush()
+{
+    Lock guard(mutex);
+    items.clear();
+}
+
+bool KVServer::takeInjected(uint8_t opcode, uint16_t *status)
+{
+    auto it = injected.find(opcode);
+    if (it == injected.end()) {
+        return false;
+    }
+    *status = it->second.first;
+    if (--it->second.second == 0) {
+        injected.erase(it);
+    }
+    return true;
+}
+
+std::string KVServer::getConfig(const std::string &bucket)
+{
+    std::string port = std::to_string(getListenPort());
+    std::string config;
+    config.append("{\"rev\":1,\"name\":\"").append(bucket).append("\",");
+    config.append("\"uuid\":\"6c4bd1b4c7c6c5d9f8b8f8e6e7a3e0d1\",\"nodeLocator\":\"vbucket\",");
+    config.append("\"bucketCapabilities\":[\"touch\",\"cccp\",\"nodesExt\",\"cbhello\"");
+    config.append(collections.empty() ? "]," : ",\"collections\"],");
+    config.append("\"nodes\":[{\"hostname\":\"$HOST:8091\",\"ports\":{\"direct\":").append(port).append("}}],");
+    config.append("\"nodesExt\":[{\"services\":{\"mgmt\":8091,\"kv\":").append(port).append("},\"thisNode\":true}],");
+    config.append("\"vBucketServerMap\":{\"hashAlgorithm\":\"CRC\",\"numReplicas\":0,");
+    config.append("\"serverList\":[\"$HOST:").append(port).append("\"],\"vBucketMap\":[");
+    for (unsigned ii = 0; ii < nvbuckets; ii++) {
+        config.append(ii ? ",[0]" : "[0]");
+    }
+    config.append("]}}");
+    return config;
+}
+
+std::string KVServer::getManifest()
+{
+    std::map<std::string, Json::Value> scopes;
+    Json::Value dflt(Json::objectValue);
+    dflt["name"] = "_default";
+    dflt["uid"] = "0";
+    scopes["_default"]["collections"].append(dflt);
+    for (const auto &entry : collections) {
+        size_t dot = entry.first.find('.');
+        char uid[16];
+        snprintf(uid, sizeof(uid), "%x", entry.second);
+        Json::Value collection(Json::objectValue);
+        collection["name"] = entry.first.substr(dot + 1);
+        collection["uid"] = uid;
+        scopes[entry.first.substr(0, dot)]["collections"].append(collection);
+    }
+
+    char uid[32];
+    snprintf(uid, sizeof(uid), "%llx", (unsigned long long)manifest_uid);
+    Json::Value manifest(Json::objectValue);
+    manifest["uid"] = uid;
+    manifest["scopes"] = Json::Value(Json::arrayValue);
+    unsigned scope_uid = 8;
+    for (auto &scope : scopes) {
+        scope.second["name"] = scope.first;
+        scope.second["uid"] = scope.first == "_default" ? "0" : std::to_string(scope_uid++);
+        manifest["scopes"].append(scope.second);
+    }
+    return to_json(manifest);
+}
+
+void KVServer::dispatch(KVConnection *conn, const char *req, size_t nreq, std::string &out)
+{
+    uint8_t opcode = static_cast<uint8_t>(req[1]);
+    size_t nframe = 0;
+    size_t nkey;
+    if (static_cast<uint8_t>(req[0]) == PROTOCOL_BINARY_AREQ) {
+        nframe = static_cast<uint8_t>(req[2]);
+        nkey = static_cast<uint8_t>(req[3]);
+    } else {
+        nkey = read16(req + 2);
+    }
+    size_t nextras = static_cast<uint8_t>(req[4]);
+    uint8_t datatype = static_cast<uint8_t>(req[5]);
+    uint64_t cas = read64(req + 16);
+    const char *extras = req + 24 + nframe;
+    std::string key(extras + nextras, nkey);
+    const char *value = extras + nextras + nkey;
+    size_t nvalue = nreq - 24 - nframe - nextras - nkey;
+
+    Lock guard(mutex);
+    nrequests++;
+    opcode_requests[opcode]++;
+
+    uint16_t status;
+    if (takeInjected(opcode, &status)) {
+        respond(out, req, status);
+        return;
+    }
+
+    switch (opcode) {
+        case PROTOCOL_BINARY_CMD_HELLO: {
+            std::string features;
+            for (size_t ii = 0; ii + 1 < nvalue; ii += 2) {
+                uint16_t feature = read16(value + ii);
+                if (feature == PROTOCOL_BINARY_FEATURE_TCPNODELAY ||
+                    feature == PROTOCOL_BINARY_FEATURE_SELECT_BUCKET || feature == PROTOCOL_BINARY_FEATURE_JSON) {
+                    append16(features, feature);
+                } else if (feature == PROTOCOL_BINARY_FEATURE_SNAPPY && snappy) {
+                    append16(features, feature);
+                } else if (feature == PROTOCOL_BINARY_FEATURE_TRACING) {
+                    append16(features, feature);
+                    conn->tracing = true;
+                } else if (feature == PROTOCOL_BINARY_FEATURE_COLLECTIONS && !collections.empty()) {
+                    append16(features, feature);
+                    conn->collections = true;
+                }
+            }
+            respond(out, req, PROTOCOL_BINARY_RESPONSE_SUCCESS, std::string(), features);
+            return;
+        }
+
+        case PROTOCOL_BINARY_CMD_SASL_LIST_MECHS:
+            respond(out, req, PROTOCOL_BINARY_RESPONSE_SUCCESS, std::string(), username.empty() ? "" : "PLAIN");
+            return;
+
+        case PROTOCOL_BINARY_CMD_SASL_AUTH: {
+            // PLAIN: [authzid] \0 authcid \0 passwd
+            std::string payload(value, nvalue);
+            size_t sep1 = payload.find('\0');
+            size_t sep2 = sep1 == std::string::npos ? std::string::npos : payload.find('\0', sep1 + 1);
+            if (key != "PLAIN" || sep2 == std::string::npos || payload.substr(sep1 + 1, sep2 - sep1 - 1) != username ||
+                payload.substr(sep2 + 1) != password) {
+                respond(out, req, PROTOCOL_BINARY_RESPONSE_AUTH_ERROR);
+            } else {
+                respond(out, req, PROTOCOL_BINARY_RESPONSE_SUCCESS);
+            }
+            return;
+        }
+
+        case PROTOCOL_BINARY_CMD_SELECT_BUCKET:
+            conn->bucket = key;
+            respond(out, req, PROTOCOL_BINARY_RESPONSE_SUCCESS);
+            return;
+
+        case PROTOCOL_BINARY_CMD_GET_CLUSTER_CONFIG:
+            respond(out, req, PROTOCOL_BINARY_RESPONSE_SUCCESS, std::string(), getConfig(conn->bucket), 0,
+                    PROTOCOL_BINARY_DATATYPE_JSON);
+            return;
+
+        case PROTOCOL_BINARY_CMD_NOOP:
+            respond(out, req, PROTOCOL_BINARY_RESPONSE_SUCCESS);
+            return;
+
+        case PROTOCOL_BINARY_CMD_COLLECTIONS_GET_CID: {
+            std::string path(value, nvalue);
+            auto it = collections.find(path);
+            if (path != "_default._default" && it == collections.end()) {
+                respond(out, req, PROTOCOL_BINARY_RESPONSE_UNKNOWN_COLLECTION);
+                return;
+            }
+            std::string ids;
+            append64(ids, manifest_uid);
+            append32(ids, it == collections.end() ? 0 : it->second);
+            respond(out, req, PROTOCOL_BINARY_RESPONSE_SUCCESS, ids);
+            return;
+        }
+
+        case PROTOCOL_BINARY_CMD_COLLECTIONS_GET_MANIFEST:
+            respond(out, req, PROTOCOL_BINARY_RESPONSE_SUCCESS, std::string(), getManifest(), 0,
+                    PROTOCOL_BINARY_DATATYPE_JSON);
+            return;
+
+        case PROTOCOL_BINARY_CMD_GET:
+        case PROTOCOL_BINARY_CMD_SET:
+        case PROTOCOL_BINARY_CMD_ADD:
+        case PROTOCOL_BINARY_CMD_REPLACE:
+        case PROTOCOL_BINARY_CMD_DELETE:
+        case PROTOCOL_BINARY_CMD_SUBDOC_MULTI_LOOKUP:
+        case PROTOCOL_BINARY_CMD_SUBDOC_MULTI_MUTATION:
+            if (conn->collections) {
+                uint32_t cid;
+                bool known = false;
+                if (read_leb128(key, &cid)) {
+                    known = cid == 0;
+                    for (const auto &entry : collections) {
+                        known = known || entry.second == cid;
+                    }
+                }
+                if (!known) {
+                    respond(out, req, PROTOCOL_BINARY_RESPONSE_UNKNOWN_COLLECTION);
+                    return;
+                }
+            }
+            if (nmv_remaining) {
+                nmv_remaining--;
+                respond(out, req, PROTOCOL_BINARY_RESPONSE_NOT_MY_VBUCKET, std::string(), getConfig(conn->bucket), 0,
+                        PROTOCOL_BINARY_DATATYPE_JSON);
+                return;
+            }
+            break;
+
+        default:
+            respond(out, req, PROTOCOL_BINARY_RESPONSE_UNKNOWN_COMMAND);
+            return;
+    }
+
+    auto it = items.find(key);
+    switch (opcode) {
+        case PROTOCOL_BINARY_CMD_GET:
+            if (it == items.end()) {
+                respond(out, req, PROTOCOL_BINARY_RESPONSE_KEY_ENOENT);
+            } else {
+                std::string flags;
+                append32(flags, it->second.flags);
+                respond(out, req, PROTOCOL_BINARY_RESPONSE_SUCCESS, flags, it->second.value, it->second.cas,
+                        it->second.datatype);
+            }
+            return;
+
+        case PROTOCOL_BINARY_CMD_SET:
+        case PROTOCOL_BINARY_CMD_ADD:
+        case PROTOCOL_BINARY_CMD_REPLACE: {
+            if (opcode == PROTOCOL_BINARY_CMD_ADD && it != items.end()) {
+                respond(out, req, PROTOCOL_BINARY_RESPONSE_KEY_EEXISTS);
+                return;
+            }
+            if ((opcode == PROTOCOL_BINARY_CMD_REPLACE || cas) && it == items.end()) {
+                respond(out, req, PROTOCOL_BINARY_RESPONSE_KEY_ENOENT);
+                return;
+            }
+            if (cas && it->second.cas != cas) {
+                respond(out, req, PROTOCOL_BINARY_RESPONSE_KEY_EEXISTS);
+                return;
+            }
+            Item &item = items[key];
+            item.value.assign(value, nvalue);
+            item.flags = nextras >= 4 ? read32(extras) : 0;
+            item.datatype = datatype;
+            item.cas = next_cas++;
+            respond(out, req, PROTOCOL_BINARY_RESPONSE_SUCCESS, std::string(), std::string(), item.cas);
+            return;
+        }
+
+        case PROTOCOL_BINARY_CMD_DELETE:
+            if (it == items.end()) {
+                respond(out, req, PROTOCOL_BINARY_RESPONSE_KEY_ENOENT);
+            } else if (cas && it->second.cas != cas) {
+                respond(out, req, PROTOCOL_BINARY_RESPONSE_KEY_EEXISTS);
+            } else {
+                items.erase(it);
+                respond(out, req, PROTOCOL_BINARY_RESPONSE_SUCCESS, std::string(), std::string(), next_cas++);
+            }
+            return;
+
+        case PROTOCOL_BINARY_CMD_SUBDOC_MULTI_LOOKUP:
+            handleSubdocLookup(req, key, value, nvalue, out);
+            return;
+
+        case PROTOCOL_BINARY_CMD_SUBDOC_MULTI_MUTATION:
+            handleSubdocMutation(req, key, extras, nextras, value, nvalue, out);
+            return;
+
+        default:
+            return;
+    }
+}
+
+void KVServer::handleSubdocLookup(const char *req, const std::string &key, const char *specs, size_t nspecs,
+                                  std::string &out)
+{
+    auto it = items.find(key);
+    if (it == items.end()) {
+        respond(out, req, PROTOCOL_BINARY_RESPONSE_KEY_ENOENT);
+        return;
+    }
+
+    Json::Value doc;
+    bool is_json = Json::Reader().parse(it->second.value, doc, false);
+    uint16_t overall = PROTOCOL_BINARY_RESPONSE_SUCCESS;
+    std::string body;
+
+    for (size_t pos = 0; pos + 4 <= nspecs;) {
+        uint8_t opcode = static_cast<uint8_t>(specs[pos]);
+        size_t npath = read16(specs + pos + 2);
+        std::string path(specs + pos + 4, npath);
+        pos += 4 + npath;
+
+        uint16_t status = PROTOCOL_BINARY_RESPONSE_SUCCESS;
+        std::string result;
+        if (opcode == PROTOCOL_BINARY_CMD_GET && path.empty()) {
+            result = it->second.value;
+        } else if (opcode != PROTOCOL_BINARY_CMD_SUBDOC_GET && opcode != PROTOCOL_BINARY_CMD_SUBDOC_EXISTS) {
+            respond(out, req, PROTOCOL_BINARY_RESPONSE_NOT_SUPPORTED);
+            return;
+        } else if (!is_json) {
+            status = PROTOCOL_BINARY_RESPONSE_SUBDOC_DOC_NOTJSON;
+        } else {
+            std::string last;
+            Json::Value *parent = walk(doc, path, false, &last, &status);
+            if (parent != nullptr) {
+                if (!parent->isMember(last)) {
+                    status = PROTOCOL_BINARY_RESPONSE_SUBDOC_PATH_ENOENT;
+                } else if (opcode == PROTOCOL_BINARY_CMD_SUBDOC_GET) {
+                    result = to_json((*parent)[last]);
+                }
+            }
+        }
+        if (status != PROTOCOL_BINARY_RESPONSE_SUCCESS) {
+            overall = PROTOCOL_BINARY_RESPONSE_SUBDOC_MULTI_PATH_FAILURE;
+        }
+        append16(body, status);
+        append32(body, static_cast<uint32_t>(result.size()));
+        body.append(result);
+    }
+    respond(out, req, overall, std::string(), body, it->second.cas);
+}
+
+void KVServer::handleSubdocMutation(const char *req, const std::string &key, const char *extras, size_t nextras,
+                                    const char *specs, size_t nspecs, std::string &out)
+{
+    // extras are [expiry(4)] [docflags(1)]
+    uint8_t docflags = (nextras == 1 || nextras == 5) ? static_cast<uint8_t>(extras[nextras - 1]) : 0;
+    uint64_t cas = read64(req + 16);
+
+    auto it = items.find(key);
+    if (it == items.end() && (docflags & (SUBDOC_DOCFLAG_MKDOC | SUBDOC_DOCFLAG_ADD)) == 0) {
+        respond(out, req, PROTOCOL_BINARY_RESPONSE_KEY_ENOENT);
+        return;
+    }
+    if (it != items.end() && (docflags & SUBDOC_DOCFLAG_ADD)) {
+        respond(out, req, PROTOCOL_BINARY_RESPONSE_KEY_EEXISTS);
+        return;
+    }
+    if (cas && (it == items.end() || it->second.cas != cas)) {
+        respond(out, req, it == items.end() ? PROTOCOL_BINARY_RESPONSE_KEY_ENOENT : PROTOCOL_BINARY_RESPONSE_KEY_EEXISTS);
+        return;
+    }
+
+    Json::Value doc(Json::objectValue);
+    if (it != items.end() && !Json::Reader().parse(it->second.value, doc, false)) {
+        std::string body(1, 0);
+        append16(body, PROTOCOL_BINARY_RESPONSE_SUBDOC_DOC_NOTJSON);
+        respond(out, req, PROTOCOL_BINARY_RESPONSE_SUBDOC_MULTI_PATH_FAILURE, std::string(), body);
+        return;
+    }
+
+    uint8_t index = 0;
+    for (size_t pos = 0; pos + 8 <= nspecs; index++) {
+        uint8_t opcode = static_cast<uint8_t>(specs[pos]);
+        uint8_t pathflags = static_cast<uint8_t>(specs[pos + 1]);
+        size_t npath = read16(specs + pos + 2);
+        size_t nvalue = read32(specs + pos + 4);
+        std::string path(specs + pos + 8, npath);
+        std::string value(specs + pos + 8 + npath, nvalue);
+        pos += 8 + npath + nvalue;
+
+        uint16_t status = PROTOCOL_BINARY_RESPONSE_SUCCESS;
+        if (opcode == PROTOCOL_BINARY_CMD_SET && path.empty()) {
+            if (!Json::Reader().parse(value, doc, false)) {
+                status = PROTOCOL_BINARY_RESPONSE_SUBDOC_VALUE_CANTINSERT;
+            }
+        } else if (opcode != PROTOCOL_BINARY_CMD_SUBDOC_DICT_UPSERT && opcode != PROTOCOL_BINARY_CMD_SUBDOC_DICT_ADD &&
+                   opcode != PROTOCOL_BINARY_CMD_SUBDOC_REPLACE && opcode != PROTOCOL_BINARY_CMD_SUBDOC_DELETE) {
+            respond(out, req, PROTOCOL_BINARY_RESPONSE_NOT_SUPPORTED);
+            return;
+        } else {
+            std::string last;
+            Json::Value fragment;
+            Json::Value *parent = walk(doc, path, pathflags & SUBDOC_PATHFLAG_MKDIR_P, &last, &status);
+            if (parent == nullptr) {
+                // status already set
+            } else if (opcode != PROTOCOL_BINARY_CMD_SUBDOC_DELETE && !Json::Reader().parse(value, fragment, false)) {
+                status = PROTOCOL_BINARY_RESPONSE_SUBDOC_VALUE_CANTINSERT;
+            } else if (opcode == PROTOCOL_BINARY_CMD_SUBDOC_DICT_ADD && parent->isMember(last)) {
+                status = PROTOCOL_BINARY_RESPONSE_SUBDOC_PATH_EEXISTS;
+            } else if ((opcode == PROTOCOL_BINARY_CMD_SUBDOC_REPLACE || opcode == PROTOCOL_BINARY_CMD_SUBDOC_DELETE) &&
+                       !parent->isMember(last)) {
+                status = PROTOCOL_BINARY_RESPONSE_SUBDOC_PATH_ENOENT;
+            } else if (opcode == PROTOCOL_BINARY_CMD_SUBDOC_DELETE) {
+                parent->removeMember(last);
+            } else {
+                (*parent)[last] = fragment;
+            }
+        }
+
+        if (status != PROTOCOL_BINARY_RESPONSE_SUCCESS) {
+            std::string body(1, static_cast<char>(index));
+            append16(body, status);
+            respond(out, req, PROTOCOL_BINARY_RESPONSE_SUBDOC_MULTI_PATH_FAILURE, std::string(), body);
+            return;
+        }
+    }
+
+    Item &item = items[key];
+    if (it == items.end()) {
+        item.flags = 0;
+    }
+    item.value = to_json(doc);
+    item.datatype = PROTOCOL_BINARY_DATATYPE_JSON;
+    item.cas = next_cas++;
+    respond(out, req, PROTOCOL_BINARY_RESPONSE_SUCCESS, std::string(), std::string(), item.cas);
+}
@@ -0,0 +1,174 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2020 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+/**
+ * @file
+ * In-process memcached binary protocol server, used to exercise the whole
+ * library (bootstrap, scheduling, parsing) over loopback without a cluster
+ * or the Java mock.
+ */
+
+#ifndef LCB_TEST_KVSERVER_H
+#define LCB_TEST_KVSERVER_H
+
+#include "ioserver.h"
+#include <map>
+
+namespace LCBTest
+{
+class KVConnection;
+
+/**
+ * A single-node "couchbase" bucket served from an in-memory table.
+ *
+ * The server understands enough of the protocol for the library to bootstrap
+ * over CCCP (HELLO, SASL_LIST_MECHS/SASL_AUTH, SELECT_BUCKET,
+ * GET_CLUSTER_CONFIG) and to run the basic KV workload: GET, SET, ADD,
+ * REPLACE, DELETE, NOOP and multi-path sub-document lookups/mutations of
+ * (dotted) object paths within JSON documents. Anything else is answered
+ * with UNKNOWN_COMMAND.
+ *
+ * Every connection is served by its own thread, which reads as many requests
+ * as are available and writes all their responses at once, so pipelined
+ * requests are cheap.
+ *
+ * Faults may be injected at any time from the test thread:
+ * - setLatency() delays every batch of responses,
+ * - injectError() answers the next requests of a given opcode with a status,
+ * - injectNotMyVbucket() answers the next data requests with NOT_MY_VBUCKET
+ *   (carrying the current configuration, as the real server does).
+ *
+ * setServerDuration() makes the server report the time it spent on every
+ * request to the clients which negotiated tracing.
+ *
+ * Once addCollection() has been called, the bucket advertises collections:
+ * keys are expected to carry their collection ID, and COLLECTIONS_GET_CID and
+ * COLLECTIONS_GET_MANIFEST are answered.
+ */
+class KVServer
+{
+  public:
+    explicit KVServer(unsigned nvbuckets = 64);
+    ~KVServer();
+
+    /** Stop accepting connections and close all the current ones */
+    void close();
+
+    uint16_t getListenPort()
+    {
+        return lsn->getLocalPort();
+    }
+
+    /** @return a connection string which bootstraps from this server */
+    std::string getConnectionString(const std::string &bucket = "default");
+
+    /**
+     * Require SASL PLAIN authentication with the given credentials. By default
+     * no mechanisms are advertised, and the client skips authentication.
+     * Note that the client needs `sasl_mech_force=PLAIN` to use PLAIN over
+     * plain-text connections.
+     */
+    void setCredentials(const std::string &username, const std::string &password);
+
+    /**
+     * Advertise Snappy compression. Compressed values are stored and returned
+     * as they are, so sub-document operations on them are not supported
+     */
+    void enableCompression();
+
+    /** Delay every batch of responses by `usec` microseconds */
+    void setLatency(uint32_t usec);
+
+    /**
+     * Report `encoded` as the server duration (in the encoding of the
+     * protocol) in the responses to the connections which negotiated
+     * tracing. 0 stops reporting it
+     */
+    void setServerDuration(uint16_t encoded);
+
+    /** Fail the next `count` requests with `opcode` with the given status */
+    void injectError(uint8_t opcode, uint16_t status, unsigned count = 1);
+
+    /** Answer the next `count` data requests with NOT_MY_VBUCKET */
+    void injectNotMyVbucket(unsigned count = 1);
+
+    /** @return the number of stored documents */
+    size_t getItemCount();
+
+    /** @return the number of requests answered since the server was created */
+    size_t getRequestCount();
+
+    /** @return the number of requests with `opcode` answered so far */
+    size_t getRequestCount(uint8_t opcode);
+
+    /** Create a collection, which changes the manifest */
+    void addCollection(const std::string &scope, const std::string &collection, uint32_t cid);
+
+    /** Remove all the documents */
+    void flush();
+
+  private:
+    friend class KVConnection;
+
+    struct Item {
+        std::string value;
+        uint32_t flags;
+        uint8_t datatype;
+        uint64_t cas;
+    };
+
+    void run();
+    static void runfunc(void *arg);
+
+    /** Process one request, appending the response to `out` */
+    void dispatch(KVConnection *conn, const char *req, size_t nreq, std::string &out);
+    void handleSubdocLookup(const char *req, const std::string &key, const char *specs, size_t nspecs,
+                            std::string &out);
+    void handleSubdocMutation(const char *req, const std::string &key, const char *extras, size_t nextras,
+                              const char *specs, size_t nspecs, std::string &out);
+    /** Add the server duration frame to the response appended to `out` at `begin` */
+    void addServerDuration(KVConnection *conn, std::string &out, size_t begin);
+    bool takeInjected(uint8_t opcode, uint16_t *status);
+    std::string getConfig(const std::string &bucket);
+    std::string getManifest();
+    uint32_t getLatency();
+
+    volatile bool closed;
+    unsigned nvbuckets;
+    uint64_t next_cas;
+    size_t nrequests;
+    uint32_t latency_us;
+    uint16_t server_duration;
+    bool snappy;
+    unsigned nmv_remaining;
+    std::string username;
+    std::string password;
+    std::map<uint8_t, std::pair<uint16_t, unsigned> > injected;
+    std::map<std::string, Item> items;
+    std::map<uint8_t, size_t> opcode_requests;
+    std::map<std::string, uint32_t> collections;
+    uint64_t manifest_uid;
+    std::list<KVConnection *> conns;
+
+    SockFD *lsn;
+    Thread *thr;
+    Mutex mutex;
+};
+
+} // namespace LCBTest
+
+#endif
@@ -102,10 +102,9 @@ static void genCertificate(SSL_CTX *ctx)
     EVP_PKEY_free(pkey);
 }
 
-SslSocket::SslSocket(SockFD *inner) : SockFD(inner->getFD())
+static SSL_CTX *newContext()
 {
-    sfd = inner;
-    ctx = SSL_CTX_new(SSLv23_server_method());
+    SSL_CTX *ctx = SSL_CTX_new(SSLv23_server_method());
     assert(ctx != nullptr);
 
     SSL_CTX_set_info_callback(ctx, log_callback);
@@ -114,6 +113,23 @@ SslSocket::SslSocket(SockFD *inner) : SockFD(inner->getFD())
     SSL_CTX_set_options(ctx, SSL_OP_NO_SSLv2 | SSL_OP_NO_SSLv3);
     SSL_CTX_set_verify(ctx, SSL_VERIFY_NONE, nullptr);
     SSL_CTX_load_verify_locations(ctx, nullptr, nullptr);
+    return ctx;
+}
+
+/**
+ * All the connections share one context (and so one certificate and one set
+ * of session ticket keys), so that clients may resume their sessions
+ */
+static SSL_CTX *sharedContext()
+{
+    static SSL_CTX *ctx = newContext();
+    return ctx;
+}
+
+SslSocket::SslSocket(SockFD *inner) : SockFD(inner->getFD())
+{
+    sfd = inner;
+    ctx = sharedContext();
 
     ssl = SSL_new(ctx);
     assert(ssl != nullptr);
@@ -140,7 +156,6 @@ void SslSocket::close()
 SslSocket::~SslSocket()
 {
     SSL_free(ssl);
-    SSL_CTX_free(ctx);
     delete sfd;
 }
 
@@ -21,6 +21,8 @@
 #include "rnd.h"
 
 #include <cstdio>
+#include <fstream>
+#include <iterator>
 
 class ConfigCacheUnitTest : public MockUnitTest
 {
@@ -129,6 +131,7 @@ TEST_F(ConfigCacheUnitTest, testConfigCache)
     lcb_destroy(instance);
 
     remove(filename.c_str());
+    remove((filename + ".snapshot").c_str());
 
     // Try one more time, with a file that does not exist..
     doLcbCreate(&instance, cropts, MockEnvironment::getInstance());
@@ -139,3 +142,56 @@ TEST_F(ConfigCacheUnitTest, testConfigCache)
 
     lcb_createopts_destroy(cropts);
 }
+
+TEST_F(ConfigCacheUnitTest, testConfigCacheSharedWithOlderVersions)
+{
+    lcb_INSTANCE *instance;
+    lcb_STATUS err;
+    lcb_CREATEOPTS *cropts = nullptr;
+
+    std::string filename = random_cache_path();
+    std::string snapshot = filename + ".snapshot";
+    MockEnvironment::getInstance()->makeConnectParams(cropts, nullptr);
+
+    doLcbCreate(&instance, cropts, MockEnvironment::getInstance());
+    err = lcb_cntl(instance, LCB_CNTL_SET, LCB_CNTL_CONFIGCACHE, (void *)filename.c_str());
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_EQ(LCB_SUCCESS, lcb_connect(instance));
+    ASSERT_EQ(LCB_SUCCESS, lcb_wait(instance, LCB_WAIT_DEFAULT));
+    lcb_destroy(instance);
+
+    // The cache file itself keeps the JSON format read by older versions
+    std::ifstream ifs(filename.c_str());
+    std::string text((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    ifs.close();
+    size_t magic = text.find("{{{fb85b563d0a8f65fa8d3d58f1b3a0708}}}");
+    ASSERT_NE(std::string::npos, magic);
+    lcbvb_CONFIG *vbc = lcbvb_create();
+    ASSERT_EQ(0, lcbvb_load_json(vbc, text.substr(0, magic).c_str()));
+    lcbvb_destroy(vbc);
+
+    FILE *fp = fopen(snapshot.c_str(), "rb");
+    ASSERT_TRUE(fp != nullptr);
+    fclose(fp);
+
+    // A corrupt snapshot is dropped in favour of the JSON file
+    fp = fopen(snapshot.c_str(), "wb");
+    ASSERT_TRUE(fp != nullptr);
+    fputs("LCBCFGS1 garbage", fp);
+    fclose(fp);
+
+    doLcbCreate(&instance, cropts, MockEnvironment::getInstance());
+    err = lcb_cntl(instance, LCB_CNTL_SET, LCB_CNTL_CONFIGCACHE_RO, (void *)filename.c_str());
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_EQ(LCB_SUCCESS, lcb_connect(instance));
+    ASSERT_EQ(LCB_SUCCESS, lcb_wait(instance, LCB_WAIT_DEFAULT));
+    int is_loaded = 0;
+    err = lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_CONFIG_CACHE_LOADED, &is_loaded);
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_NE(0, is_loaded);
+    lcb_destroy(instance);
+
+    remove(filename.c_str());
+    remove(snapshot.c_str());
+    lcb_createopts_destroy(cropts);
+}
@@ -1085,3 +1085,208 @@ TEST_F(DurabilityUnitTest, testRemoveWithDurability)
         ASSERT_EQ(LCB_SUCCESS, res.rc);
     }
 }
+
+/* Keys which are all mapped to the same vBucket */
+static vector<string> keysOnSameVbucket(lcb_INSTANCE *instance, const string &prefix, size_t nkeys)
+{
+    lcbvb_CONFIG *vbc;
+    EXPECT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_VBCONFIG, &vbc));
+    vector<string> keys;
+    int first_vbid = -1;
+    for (unsigned ii = 0; keys.size() < nkeys; ii++) {
+        string key = prefix + std::to_string(ii);
+        int vbid, srvix;
+        lcbvb_map_key(vbc, key.c_str(), key.size(), &vbid, &srvix);
+        if (first_vbid == -1) {
+            first_vbid = vbid;
+        }
+        if (vbid == first_vbid) {
+            keys.push_back(key);
+        }
+    }
+    return keys;
+}
+
+/* Number of OBSERVE_SEQNO requests which are queued or waiting for their response */
+static unsigned countSeqnoProbes(lcb_INSTANCE *instance)
+{
+    unsigned nprobes = 0;
+    for (unsigned ii = 0; ii < instance->cmdq.npipelines; ii++) {
+        sllist_node *cur;
+        SLLIST_FOREACH(&instance->cmdq.pipelines[ii]->requests, cur)
+        {
+            protocol_binary_request_header hdr;
+            mcreq_read_hdr(SLLIST_ITEM(cur, mc_PACKET, slnode), &hdr);
+            if (hdr.request.opcode == PROTOCOL_BINARY_CMD_OBSERVE_SEQNO) {
+                nprobes++;
+            }
+        }
+    }
+    return nprobes;
+}
+
+extern "C" {
+static void stopLoopCallback(void *cookie)
+{
+    lcb_stop_loop((lcb_INSTANCE *)cookie);
+}
+}
+
+/* Run the event loop for a while, without waiting for the pending operations */
+static void runLoopFor(lcb_INSTANCE *instance, lcb_U32 usec)
+{
+    lcbio_pTIMER timer = lcbio_timer_new(instance->iotable, instance, stopLoopCallback);
+    lcbio_timer_rearm(timer, usec);
+    lcb_run_loop(instance);
+    lcbio_timer_destroy(timer);
+}
+
+static void scheduleSeqnoEndure(lcb_INSTANCE *instance, lcb_durability_opts_t *opts, const Item &itm,
+                                DurabilityOperation *dop)
+{
+    lcb_STATUS rc;
+    lcb_MULTICMD_CTX *mctx = lcb_endure3_ctxnew(instance, opts, &rc);
+    ASSERT_FALSE(mctx == nullptr);
+    lcb_CMDENDURE cmd = {0};
+    LCB_CMD_SET_KEY(&cmd, itm.key.c_str(), itm.key.size());
+    cmd.cas = itm.cas;
+    ASSERT_EQ(LCB_SUCCESS, mctx->add_endure(mctx, &cmd));
+    lcb_install_callback(instance, LCB_CALLBACK_ENDURE, (lcb_RESPCALLBACK)defaultDurabilityCallback);
+    ASSERT_EQ(LCB_SUCCESS, mctx->done(mctx, dop));
+}
+
+static void masterSeqnoOptions(lcb_durability_opts_t &opts)
+{
+    opts.version = 1;
+    opts.v.v0.persist_to = 1;
+    opts.v.v0.replicate_to = 0;
+    opts.v.v0.pollopts = LCB_DURABILITY_MODE_SEQNO;
+}
+
+TEST_F(DurabilityUnitTest, testSeqnoProbesCoalesced)
+{
+    SKIP_UNLESS_MOCK()
+
+    HandleWrap hw;
+    lcb_INSTANCE *instance;
+    createConnection(hw, &instance);
+    if (!supportsMutationTokens(instance)) {
+        return;
+    }
+
+    vector<Item> items;
+    for (const auto &key : keysOnSameVbucket(instance, "seqno-coalesced-", 8)) {
+        Item itm(key, key);
+        KVOperation kvo(&itm);
+        kvo.store(instance);
+        items.push_back(kvo.result);
+    }
+
+    lcb_durability_opts_t opts = {0};
+    masterSeqnoOptions(opts);
+    lcb_MULTICMD_CTX *mctx = lcb_endure3_ctxnew(instance, &opts, nullptr);
+    ASSERT_FALSE(mctx == nullptr);
+    for (const auto &itm : items) {
+        lcb_CMDENDURE cmd = {0};
+        LCB_CMD_SET_KEY(&cmd, itm.key.c_str(), itm.key.size());
+        cmd.cas = itm.cas;
+        ASSERT_EQ(LCB_SUCCESS, mctx->add_endure(mctx, &cmd));
+    }
+    DurabilityMultiOperation dmo;
+    lcb_install_callback(instance, LCB_CALLBACK_ENDURE, (lcb_RESPCALLBACK)multiDurabilityCallback);
+    ASSERT_EQ(LCB_SUCCESS, mctx->done(mctx, &dmo));
+
+    // Hold the responses back, so that the probes of the round can be counted
+    MockEnvironment *mock = MockEnvironment::getInstance();
+    mock->hiccupNodes(1000, 1);
+    runLoopFor(instance, 200000);
+    // The items all live on the same vBucket and master: a single probe serves them
+    ASSERT_EQ(1, countSeqnoProbes(instance));
+
+    lcb_wait(instance, LCB_WAIT_DEFAULT);
+    mock->hiccupNodes(0, 0);
+    ASSERT_EQ(items.size(), dmo.counter);
+    for (const auto &operation : dmo.kmap) {
+        ASSERT_EQ(LCB_SUCCESS, operation.second.resp_.ctx.rc) << operation.first;
+    }
+}
+
+TEST_F(DurabilityUnitTest, testSeqnoJoinProbeInFlight)
+{
+    SKIP_UNLESS_MOCK()
+
+    HandleWrap hw;
+    lcb_INSTANCE *instance;
+    createConnection(hw, &instance);
+    if (!supportsMutationTokens(instance)) {
+        return;
+    }
+
+    vector<Item> items;
+    for (const auto &key : keysOnSameVbucket(instance, "seqno-join-", 2)) {
+        Item itm(key, key);
+        KVOperation kvo(&itm);
+        kvo.store(instance);
+        items.push_back(kvo.result);
+    }
+
+    lcb_durability_opts_t opts = {0};
+    masterSeqnoOptions(opts);
+    MockEnvironment *mock = MockEnvironment::getInstance();
+    mock->hiccupNodes(1000, 1);
+
+    DurabilityOperation first, second;
+    scheduleSeqnoEndure(instance, &opts, items[0], &first);
+    runLoopFor(instance, 200000);
+    ASSERT_EQ(1, countSeqnoProbes(instance));
+
+    // The second set polls the same vBucket while the first probe is still in flight
+    scheduleSeqnoEndure(instance, &opts, items[1], &second);
+    runLoopFor(instance, 200000);
+    ASSERT_EQ(1, countSeqnoProbes(instance));
+
+    lcb_wait(instance, LCB_WAIT_DEFAULT);
+    mock->hiccupNodes(0, 0);
+    ASSERT_EQ(LCB_SUCCESS, first.resp_.ctx.rc);
+    ASSERT_EQ(LCB_SUCCESS, second.resp_.ctx.rc);
+    ASSERT_EQ(0, countSeqnoProbes(instance));
+}
+
+TEST_F(DurabilityUnitTest, testSeqnoDursetDestroyedWithProbeInFlight)
+{
+    SKIP_UNLESS_MOCK()
+
+    HandleWrap hw;
+    lcb_INSTANCE *instance;
+    createConnection(hw, &instance);
+    if (!supportsMutationTokens(instance)) {
+        return;
+    }
+
+    string key = "seqno-destroyed";
+    Item itm(key, key);
+    KVOperation kvo(&itm);
+    kvo.store(instance);
+
+    lcb_durability_opts_t opts = {0};
+    masterSeqnoOptions(opts);
+    opts.v.v0.timeout = 200000;
+    MockEnvironment *mock = MockEnvironment::getInstance();
+    mock->hiccupNodes(1000, 1);
+
+    // The set times out, and is destroyed, before the response of its probe arrives
+    DurabilityOperation expired;
+    scheduleSeqnoEndure(instance, &opts, kvo.result, &expired);
+    runLoopFor(instance, 400000);
+    ASSERT_EQ(LCB_ERR_TIMEOUT, expired.resp_.ctx.rc);
+    ASSERT_EQ(1, countSeqnoProbes(instance));
+    mock->hiccupNodes(0, 0);
+
+    // The late response has nobody left to serve but the next set
+    opts.v.v0.timeout = 0;
+    DurabilityOperation next;
+    scheduleSeqnoEndure(instance, &opts, kvo.result, &next);
+    lcb_wait(instance, LCB_WAIT_DEFAULT);
+    ASSERT_EQ(LCB_SUCCESS, next.resp_.ctx.rc);
+    ASSERT_EQ(0, countSeqnoProbes(instance));
+}
@@ -17,6 +17,7 @@
 #include "config.h"
 #include <libcouchbase/couchbase.h>
 #include <libcouchbase/utils.h>
+#include <libcouchbase/metrics.h>
 #include <map>
 #include "iotests.h"
 #include "logging.h"
@@ -489,6 +490,151 @@ TEST_F(GetUnitTest, testGetReplica)
     lcb_wait(instance, LCB_WAIT_DEFAULT);
 }
 
+TEST_F(GetUnitTest, testGetReplicaHedged)
+{
+    SKIP_UNLESS_MOCK()
+    MockEnvironment *mock = MockEnvironment::getInstance();
+    HandleWrap hw;
+    lcb_INSTANCE *instance;
+    createConnection(hw, &instance);
+    std::string key("a_key_GETREPLICA_HEDGED");
+
+    lcb_install_callback(instance, LCB_CALLBACK_GETREPLICA, (lcb_RESPCALLBACK)rget_callback);
+
+    // Only the active node has the item. With a hedge delay well above the
+    // expected latency, the active read is the only one sent.
+    MockMutationCommand mcCmd(MockCommand::CACHE, key);
+    mcCmd.cas = 4242;
+    mcCmd.onMaster = true;
+    mcCmd.replicaCount = 0;
+    mock->sendCommand(mcCmd);
+    mock->getResponse();
+
+    lcb_cntl_setu32(instance, LCB_CNTL_REPLICA_HEDGE_DELAY, 2000000);
+
+    RGetCookie rck;
+    rck.remaining = 1;
+    rck.expectrc = LCB_SUCCESS;
+    rck.cas = mcCmd.cas;
+
+    lcb_CMDGETREPLICA *rcmd;
+    ASSERT_EQ(LCB_SUCCESS, lcb_cmdgetreplica_create(&rcmd, LCB_REPLICA_MODE_HEDGED));
+    lcb_cmdgetreplica_key(rcmd, key.c_str(), key.size());
+    lcb_sched_enter(instance);
+    lcb_STATUS err = lcb_getreplica(instance, &rck, rcmd);
+    lcb_cmdgetreplica_destroy(rcmd);
+    ASSERT_EQ(LCB_SUCCESS, err);
+    lcb_sched_leave(instance);
+    lcb_wait(instance, LCB_WAIT_DEFAULT);
+    ASSERT_EQ(0, rck.remaining);
+
+    // A missing item on the active node is authoritative, and is delivered
+    // exactly once even if a hedge was raced against it.
+    removeKey(instance, key);
+    lcb_cntl_setu32(instance, LCB_CNTL_REPLICA_HEDGE_DELAY, 1);
+    rck.remaining = 1;
+    rck.expectrc = LCB_ERR_DOCUMENT_NOT_FOUND;
+    lcb_cmdgetreplica_create(&rcmd, LCB_REPLICA_MODE_HEDGED);
+    lcb_cmdgetreplica_key(rcmd, key.c_str(), key.size());
+    lcb_sched_enter(instance);
+    err = lcb_getreplica(instance, &rck, rcmd);
+    lcb_cmdgetreplica_destroy(rcmd);
+    ASSERT_EQ(LCB_SUCCESS, err);
+    lcb_sched_leave(instance);
+    lcb_wait(instance, LCB_WAIT_DEFAULT);
+    ASSERT_EQ(0, rck.remaining);
+}
+
+struct HedgeCounts {
+    lcb_SIZE launched{0};
+    lcb_SIZE won{0};
+    lcb_SIZE wasted{0};
+};
+
+static HedgeCounts hedge_counts(lcb_INSTANCE *instance)
+{
+    HedgeCounts counts;
+    lcb_METRICS *metrics = nullptr;
+    lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_METRICS, &metrics);
+    for (lcb_SIZE ii = 0; metrics && ii < metrics->nservers; ii++) {
+        counts.launched += metrics->servers[ii]->hedges_launched;
+        counts.won += metrics->servers[ii]->hedges_won;
+        counts.wasted += metrics->servers[ii]->hedges_wasted;
+    }
+    return counts;
+}
+
+TEST_F(GetUnitTest, testGetReplicaHedgeRaces)
+{
+    SKIP_UNLESS_MOCK()
+    MockEnvironment *mock = MockEnvironment::getInstance();
+    lcb_INSTANCE *instance;
+    lcb_CREATEOPTS *crParams = nullptr;
+    mock->makeConnectParams(crParams, nullptr);
+    doLcbCreate(&instance, crParams, mock);
+    lcb_createopts_destroy(crParams);
+    // Server metrics are only collected if enabled before connecting
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "metrics", "true"));
+    ASSERT_EQ(LCB_SUCCESS, lcb_connect(instance));
+    lcb_wait(instance, LCB_WAIT_DEFAULT);
+    ASSERT_EQ(LCB_SUCCESS, lcb_get_bootstrap_status(instance));
+    if (lcb_get_num_replicas(instance) < 1) {
+        lcb_destroy(instance);
+        MockEnvironment::printSkipMessage(__FILE__, __LINE__, "needs a replica");
+        return;
+    }
+    lcb_install_callback(instance, LCB_CALLBACK_GETREPLICA, (lcb_RESPCALLBACK)rget_callback);
+
+    std::string key("a_key_GETREPLICA_HEDGE_RACES");
+    MockMutationCommand mcCmd(MockCommand::CACHE, key);
+    mcCmd.cas = 4343;
+    mcCmd.onMaster = true;
+    mcCmd.replicaCount = 1;
+    mock->sendCommand(mcCmd);
+    mock->getResponse();
+
+    RGetCookie rck;
+    rck.expectrc = LCB_SUCCESS;
+    rck.cas = mcCmd.cas;
+
+    // With a tiny delay the hedge timer fires before the active node could
+    // answer: both reads succeed, the first one is delivered (and the callback
+    // fails the test if invoked twice), the other one is discarded.
+    lcb_cntl_setu32(instance, LCB_CNTL_REPLICA_HEDGE_DELAY, 1);
+    rck.remaining = 1;
+    lcb_CMDGETREPLICA *rcmd;
+    lcb_cmdgetreplica_create(&rcmd, LCB_REPLICA_MODE_HEDGED);
+    lcb_cmdgetreplica_key(rcmd, key.c_str(), key.size());
+    ASSERT_EQ(LCB_SUCCESS, lcb_getreplica(instance, &rck, rcmd));
+    lcb_cmdgetreplica_destroy(rcmd);
+    lcb_wait(instance, LCB_WAIT_DEFAULT);
+    ASSERT_EQ(0, rck.remaining);
+    HedgeCounts counts = hedge_counts(instance);
+    ASSERT_EQ(1, counts.launched);
+    ASSERT_EQ(1, counts.won + counts.wasted);
+
+    // When the active node fails in a way the replica may not, its reply is
+    // discarded and the replica wins, however long the hedge delay
+    lcb_cntl_setu32(instance, LCB_CNTL_REPLICA_HEDGE_DELAY, 2000000);
+    MockOpfailCommand failCmd(PROTOCOL_BINARY_RESPONSE_EINTERNAL, instance->map_key(key), 1);
+    doMockTxn(failCmd);
+    rck.remaining = 1;
+    lcb_cmdgetreplica_create(&rcmd, LCB_REPLICA_MODE_HEDGED);
+    lcb_cmdgetreplica_key(rcmd, key.c_str(), key.size());
+    ASSERT_EQ(LCB_SUCCESS, lcb_getreplica(instance, &rck, rcmd));
+    lcb_cmdgetreplica_destroy(rcmd);
+    lcb_wait(instance, LCB_WAIT_DEFAULT);
+    MockOpFailClearCommand clearCmd(mock->getNumNodes());
+    doMockTxn(clearCmd);
+    ASSERT_EQ(0, rck.remaining);
+    HedgeCounts after = hedge_counts(instance);
+    ASSERT_EQ(counts.launched + 1, after.launched);
+    ASSERT_EQ(counts.won + 1, after.won);
+    ASSERT_EQ(counts.wasted, after.wasted);
+
+    lcb_destroy(instance);
+}
+
 extern "C" {
 static void store_callback(lcb_INSTANCE *instance, lcb_CALLBACK_TYPE, const lcb_RESPSTORE *resp)
 {
@@ -272,6 +272,66 @@ TEST_F(MockUnitTest, testTimeoutOnlyStale)
     lcb_cmdstore_destroy(cmd);
 }
 
+extern "C" {
+static void breaker_wait_callback(void *cookie)
+{
+    lcb_loop_unref((lcb_INSTANCE *)cookie);
+}
+}
+
+TEST_F(MockUnitTest, testCircuitBreaker)
+{
+    SKIP_UNLESS_MOCK()
+
+    HandleWrap hw;
+    createConnection(hw);
+    lcb_INSTANCE *instance = hw.getLcb();
+    int nremaining;
+    struct timeout_test_cookie cookie {
+    };
+    MockEnvironment *mock = MockEnvironment::getInstance();
+
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "operation_timeout", "0.5"));
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "circuit_breaker", "true"));
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "circuit_breaker_volume", "1"));
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "circuit_breaker_sleep_window", "0.1"));
+    lcb_install_callback(instance, LCB_CALLBACK_STORE, (lcb_RESPCALLBACK)set_callback);
+
+    const char *key = "circuit-breaker";
+    const char *value = "a value";
+    removeKey(instance, key);
+
+    lcb_CMDSTORE *cmd;
+    lcb_cmdstore_create(&cmd, LCB_STORE_UPSERT);
+    lcb_cmdstore_key(cmd, key, strlen(key));
+    lcb_cmdstore_value(cmd, value, strlen(value));
+
+    // One success and one timeout reach the 50% threshold and open the circuit
+    mock->hiccupNodes(1500, 1);
+    nremaining = 1;
+    cookie.counter = &nremaining;
+    cookie.expected = LCB_ERR_TIMEOUT;
+    ASSERT_EQ(LCB_SUCCESS, lcb_store(instance, &cookie, cmd));
+    lcb_wait(instance, LCB_WAIT_DEFAULT);
+    ASSERT_EQ(0, nremaining);
+
+    ASSERT_EQ(LCB_ERR_CIRCUIT_OPEN, lcb_store(instance, &cookie, cmd));
+
+    // The hiccup is gone; after the sleep window a probe closes the circuit
+    lcbio_pTIMER timer = lcbio_timer_new(instance->iotable, instance, breaker_wait_callback);
+    lcb_loop_ref(instance);
+    lcbio_timer_rearm(timer, 500000);
+    lcb_wait(instance, LCB_WAIT_DEFAULT);
+    lcbio_timer_destroy(timer);
+
+    nremaining = 1;
+    cookie.expected = LCB_SUCCESS;
+    ASSERT_EQ(LCB_SUCCESS, lcb_store(instance, &cookie, cmd));
+    lcb_wait(instance, LCB_WAIT_DEFAULT);
+    ASSERT_EQ(0, nremaining);
+    lcb_cmdstore_destroy(cmd);
+}
+
 TEST_F(MockUnitTest, testTimeoutOnlyStaleWithPerOperationProperty)
 {
     SKIP_UNLESS_MOCK()
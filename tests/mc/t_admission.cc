@@ -0,0 +1,111 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2011-2020 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "mctest.h"
+
+class McAdmission : public ::testing::Test
+{
+};
+
+static int ready_called = 0;
+
+extern "C" {
+static void ready_cb(mc_CMDQUEUE *)
+{
+    ready_called++;
+}
+}
+
+static lcb_STATUS schedule_one(CQWrap &cq, int ii)
+{
+    PacketWrap pw;
+    char kbuf[128];
+    lcb_STATUS err;
+
+    sprintf(kbuf, "key_%d", ii);
+    pw.setCopyKey(kbuf);
+    err = mcreq_basic_packet(&cq, &pw.keybuf, 0, &pw.hdr, 0, 0, &pw.pkt, &pw.pipeline, 0);
+    if (err != LCB_SUCCESS) {
+        return err;
+    }
+    pw.setHeaderSize();
+    pw.copyHeader();
+    mcreq_sched_add(pw.pipeline, pw.pkt);
+    return LCB_SUCCESS;
+}
+
+TEST_F(McAdmission, testQueueLimit)
+{
+    CQWrap cq;
+    cq.admit.max_ops = 8;
+    cq.admit.ready = ready_cb;
+    ready_called = 0;
+
+    mcreq_sched_enter(&cq);
+    for (int ii = 0; ii < 8; ii++) {
+        ASSERT_EQ(LCB_SUCCESS, schedule_one(cq, ii));
+    }
+    ASSERT_EQ(8, cq.admit.ops);
+    ASSERT_NE(0, cq.admit.bytes);
+    ASSERT_EQ(LCB_ERR_BACKPRESSURE, schedule_one(cq, 8));
+    ASSERT_NE(0, cq.admit.blocked);
+    ASSERT_EQ(0, ready_called);
+
+    mcreq_sched_fail(&cq);
+    ASSERT_EQ(0, cq.admit.ops);
+    ASSERT_EQ(0, cq.admit.bytes);
+    ASSERT_EQ(0, cq.admit.blocked);
+    ASSERT_EQ(1, ready_called);
+    for (unsigned ii = 0; ii < cq.npipelines; ii++) {
+        ASSERT_EQ(0, cq.pipelines[ii]->admitted_ops);
+        ASSERT_EQ(0, cq.pipelines[ii]->admitted_bytes);
+    }
+}
+
+TEST_F(McAdmission, testPipelineLimit)
+{
+    CQWrap cq;
+    cq.admit.max_pipeline_ops = 2;
+    cq.admit.ready = ready_cb;
+    ready_called = 0;
+
+    mcreq_sched_enter(&cq);
+    int nrejected = 0;
+    for (int ii = 0; ii < 64; ii++) {
+        lcb_STATUS err = schedule_one(cq, ii);
+        if (err == LCB_ERR_BACKPRESSURE) {
+            nrejected++;
+        } else {
+            ASSERT_EQ(LCB_SUCCESS, err);
+        }
+    }
+    ASSERT_EQ(64 - nrejected, (int)cq.admit.ops);
+    ASSERT_EQ(2 * NUM_PIPELINES, (int)cq.admit.ops);
+    for (unsigned ii = 0; ii < cq.npipelines; ii++) {
+        ASSERT_EQ(2, cq.pipelines[ii]->admitted_ops);
+    }
+
+    mcreq_sched_fail(&cq);
+    ASSERT_EQ(0, cq.admit.ops);
+    ASSERT_EQ(1, ready_called);
+
+    /* Unblocked; packets can be scheduled again */
+    mcreq_sched_enter(&cq);
+    ASSERT_EQ(LCB_SUCCESS, schedule_one(cq, 0));
+    mcreq_sched_fail(&cq);
+    ASSERT_EQ(0, cq.admit.ops);
+}
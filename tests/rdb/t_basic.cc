@@ -114,6 +114,35 @@ TEST_F(RopeTest, testConsolidatedReadAhead)
     ASSERT_EQ(*(char *)iovs[2].iov_base, '8');
 }
 
+// A large message is announced before most of it is received: the rest of it
+// should be read straight into a single segment.
+TEST_F(RopeTest, testReserveContig)
+{
+    IORope ior(rdb_chunkalloc_new(4));
+    ior.rdsize = 16;
+
+    nb_IOV iovs[32];
+    rdb_ROPESEG *segs[32];
+
+    // Header-ish bytes, spread over a few small chunks
+    ior.feed("0123456789");
+    ASSERT_EQ(10, rdb_reserve_contig(&ior, 1000));
+    ASSERT_EQ(10, rdb_get_contigsize(&ior));
+    // Already large enough
+    ASSERT_EQ(0, rdb_reserve_contig(&ior, 1000));
+
+    std::string body(990, 'b');
+    ior.feed(body + "next");
+    ASSERT_EQ(1004, ior.usedSize());
+    ASSERT_EQ(1, rdb_refread_ex(&ior, iovs, segs, 32, 1000));
+    ASSERT_EQ(1000, iovs[0].iov_len);
+    ASSERT_EQ(0, memcmp(iovs[0].iov_base, "0123456789", 10));
+    ASSERT_EQ(0, memcmp((char *)iovs[0].iov_base + 10, body.c_str(), body.size()));
+
+    rdb_consumed(&ior, 1000);
+    ASSERT_EQ("next", ior.stlstr(4));
+}
+
 // When I was integrating this into LCBIO, I realized this scenario. Trying to
 // figure out what the intended outcome is.
 // Apparently this cannot work because we can't consume a buffer which is also
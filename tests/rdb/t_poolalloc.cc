@@ -0,0 +1,144 @@
+#include "rdbtest.h"
+#include <rdb/poolalloc.h>
+class PoolallocTest : public ::testing::Test
+{
+};
+
+static rdb_POOLSTATS get_stats(RdbAllocator &a)
+{
+    rdb_POOLSTATS stats;
+    rdb_poolalloc_stats(a._inner, &stats);
+    return stats;
+}
+
+TEST_F(PoolallocTest, testSizeClasses)
+{
+    RdbAllocator a(rdb_poolalloc_new(1024 * 1024, 0));
+
+    rdb_ROPESEG *seg = a.alloc(1);
+    ASSERT_EQ(RDB_POOLALLOC_CLASS_MIN, seg->nalloc);
+    a.free(seg);
+
+    seg = a.alloc(RDB_POOLALLOC_CLASS_MIN + 1);
+    ASSERT_EQ(RDB_POOLALLOC_CLASS_MIN * 2, seg->nalloc);
+    a.free(seg);
+
+    seg = a.alloc(RDB_POOLALLOC_CLASS_MAX);
+    ASSERT_EQ(RDB_POOLALLOC_CLASS_MAX, seg->nalloc);
+    a.free(seg);
+
+    // Too big to be pooled: allocated to size
+    seg = a.alloc(RDB_POOLALLOC_CLASS_MAX + 1);
+    ASSERT_EQ(RDB_POOLALLOC_CLASS_MAX + 1, seg->nalloc);
+    a.free(seg);
+
+    rdb_POOLSTATS stats = get_stats(a);
+    ASSERT_EQ(0, stats.live_bytes);
+    ASSERT_EQ(RDB_POOLALLOC_CLASS_MIN * 3 + RDB_POOLALLOC_CLASS_MAX, stats.pooled_bytes);
+    ASSERT_EQ(RDB_POOLALLOC_CLASS_MAX + 1, stats.peak_live_bytes);
+    ASSERT_EQ(4, stats.nalloc);
+    ASSERT_EQ(0, stats.nreused);
+    a.release();
+}
+
+TEST_F(PoolallocTest, testReuse)
+{
+    RdbAllocator a(rdb_poolalloc_new(1024 * 1024, 0));
+    rdb_ROPESEG *seg = a.alloc(3000);
+    a.free(seg);
+
+    // Any size of the same class gets the pooled segment back
+    rdb_ROPESEG *newseg = a.alloc(2500);
+    ASSERT_EQ(seg, newseg);
+    ASSERT_EQ(0, newseg->start);
+    ASSERT_EQ(0, newseg->nused);
+    a.free(newseg);
+
+    // Other classes do not
+    newseg = a.alloc(100);
+    ASSERT_NE(seg, newseg);
+    a.free(newseg);
+
+    rdb_POOLSTATS stats = get_stats(a);
+    ASSERT_EQ(3, stats.nalloc);
+    ASSERT_EQ(1, stats.nreused);
+    a.release();
+}
+
+TEST_F(PoolallocTest, testClassCap)
+{
+    const unsigned cap = RDB_POOLALLOC_CLASS_MIN * 4;
+    RdbAllocator a(rdb_poolalloc_new(cap, 0));
+    std::vector< rdb_ROPESEG * > segs;
+
+    for (unsigned ii = 0; ii < 10; ii++) {
+        segs.push_back(a.alloc(RDB_POOLALLOC_CLASS_MIN));
+    }
+    // One segment above the cap is always kept
+    segs.push_back(a.alloc(RDB_POOLALLOC_CLASS_MIN * 8));
+    for (unsigned ii = 0; ii < segs.size(); ii++) {
+        a.free(segs[ii]);
+    }
+
+    rdb_POOLSTATS stats = get_stats(a);
+    ASSERT_EQ(cap + RDB_POOLALLOC_CLASS_MIN * 8, stats.pooled_bytes);
+
+    // Lowering the cap trims the free lists, disabling pooling empties them
+    rdb_poolalloc_configure(a._inner, RDB_POOLALLOC_CLASS_MIN, 0);
+    stats = get_stats(a);
+    ASSERT_EQ(RDB_POOLALLOC_CLASS_MIN + RDB_POOLALLOC_CLASS_MIN * 8, stats.pooled_bytes);
+
+    rdb_poolalloc_configure(a._inner, 0, 0);
+    stats = get_stats(a);
+    ASSERT_EQ(0, stats.pooled_bytes);
+
+    rdb_ROPESEG *seg = a.alloc(1);
+    a.free(seg);
+    stats = get_stats(a);
+    ASSERT_EQ(0, stats.pooled_bytes);
+    a.release();
+}
+
+TEST_F(PoolallocTest, testRealloc)
+{
+    RdbAllocator a(rdb_poolalloc_new(1024 * 1024, 0));
+    rdb_ROPESEG *seg = a.alloc(100);
+    memcpy(seg->root + 10, "Hello", 5);
+    seg->start = 10;
+    seg->nused = 5;
+
+    rdb_ROPESEG *newseg = a.realloc(seg, RDB_POOLALLOC_CLASS_MIN * 3);
+    ASSERT_EQ(seg, newseg);
+    ASSERT_EQ(RDB_POOLALLOC_CLASS_MIN * 4, seg->nalloc);
+    ASSERT_EQ(0, seg->start);
+    ASSERT_EQ(5, seg->nused);
+    ASSERT_EQ(0, memcmp(seg->root, "Hello", 5));
+
+    // The old buffer went back to the pool
+    rdb_POOLSTATS stats = get_stats(a);
+    ASSERT_EQ(RDB_POOLALLOC_CLASS_MIN, stats.pooled_bytes);
+    ASSERT_EQ(RDB_POOLALLOC_CLASS_MIN * 4, stats.live_bytes);
+    a.free(seg);
+    a.release();
+}
+
+TEST_F(PoolallocTest, testSharedByRopes)
+{
+    rdb_ALLOCATOR *pool = rdb_poolalloc_new(1024 * 1024, 0);
+    std::string data(5000, 'x');
+    {
+        IORope first(rdb_poolalloc_ref(pool));
+        first.feed(data);
+        ASSERT_EQ(data, first.stlstr(data.size()));
+    }
+    {
+        IORope second(rdb_poolalloc_ref(pool));
+        second.feed(data);
+        ASSERT_EQ(data, second.stlstr(data.size()));
+    }
+    rdb_POOLSTATS stats;
+    rdb_poolalloc_stats(pool, &stats);
+    ASSERT_GT(stats.nreused, 0);
+    ASSERT_EQ(0, stats.live_bytes);
+    pool->a_release(pool);
+}
@@ -157,3 +157,154 @@ TEST_F(SockConnTest, testImmediateUnref)
     ASSERT_EQ(1, sock.callCount);
     ASSERT_TRUE(sock.sock == NULL);
 }
+
+#ifdef __linux__
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <netdb.h>
+#include <unistd.h>
+
+/*
+ * "Happy Eyeballs" connects: the resolver is replaced so that the test server
+ * (which only listens on 127.0.0.1) is the last of several addresses. Other
+ * loopback addresses refuse connections, unless a stalled listener is bound
+ * to them.
+ */
+static vector<string> raceAddresses;
+
+extern "C" {
+static int resolveRaceAddresses(const char *, const char *port, const struct addrinfo *hints, struct addrinfo **res)
+{
+    struct addrinfo *head = NULL, **tail = &head;
+    for (size_t ii = 0; ii < raceAddresses.size(); ii++) {
+        int rv = getaddrinfo(raceAddresses[ii].c_str(), port, hints, tail);
+        if (rv != 0) {
+            if (head) {
+                freeaddrinfo(head);
+            }
+            return rv;
+        }
+        while (*tail) {
+            tail = &(*tail)->ai_next;
+        }
+    }
+    *res = head;
+    return 0;
+}
+}
+
+/* Listener whose backlog is full: connections to it neither fail nor complete */
+class StalledListener
+{
+  public:
+    StalledListener(const char *host, int port)
+    {
+        struct sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        inet_pton(AF_INET, host, &addr.sin_addr);
+        lsn = socket(AF_INET, SOCK_STREAM, 0);
+        EXPECT_EQ(0, bind(lsn, (struct sockaddr *)&addr, sizeof(addr)));
+        EXPECT_EQ(0, listen(lsn, 0));
+        filler = socket(AF_INET, SOCK_STREAM, 0);
+        EXPECT_EQ(0, ::connect(filler, (struct sockaddr *)&addr, sizeof(addr)));
+    }
+
+    ~StalledListener()
+    {
+        close(filler);
+        close(lsn);
+    }
+
+  private:
+    int lsn;
+    int filler;
+};
+
+static size_t countOpenFds()
+{
+    size_t nfds = 0;
+    DIR *dir = opendir("/proc/self/fd");
+    while (readdir(dir) != NULL) {
+        nfds++;
+    }
+    closedir(dir);
+    return nfds;
+}
+
+class SockRaceTest : public SockTest
+{
+  protected:
+    void SetUp()
+    {
+        SockTest::SetUp();
+        lcbio_set_resolver(resolveRaceAddresses);
+        raceAddresses.clear();
+        raceAddresses.push_back("127.0.0.2");
+        raceAddresses.push_back("127.0.0.1");
+        loop->populateHost(&host);
+    }
+
+    void TearDown()
+    {
+        lcbio_set_resolver(NULL);
+        SockTest::TearDown();
+    }
+
+    lcb_host_t host;
+};
+
+TEST_F(SockRaceTest, testRefusedThenNext)
+{
+    loop->settings->connect_attempt_delay = LCB_MS2US(1000);
+    ESocket sock;
+    hrtime_t begin = gethrtime();
+    loop->connect(&sock, &host, 3000);
+    ASSERT_FALSE(sock.sock == NULL);
+    // The refused attempt didn't wait for the delay to start the next one
+    ASSERT_LT(gethrtime() - begin, LCB_MS2NS(1000));
+    sock.close();
+}
+
+TEST_F(SockRaceTest, testLoserClosed)
+{
+    StalledListener stalled("127.0.0.2", atoi(host.port));
+    loop->settings->connect_attempt_delay = LCB_MS2US(50);
+
+    // Descriptors opened by a connection, on both sides of the test server
+    raceAddresses.erase(raceAddresses.begin());
+    size_t nfds = countOpenFds();
+    ESocket direct;
+    loop->connect(&direct, &host, 3000);
+    ASSERT_FALSE(direct.sock == NULL);
+    size_t perConnection = countOpenFds() - nfds;
+
+    raceAddresses.insert(raceAddresses.begin(), "127.0.0.2");
+    nfds = countOpenFds();
+    ESocket sock;
+    hrtime_t begin = gethrtime();
+    loop->connect(&sock, &host, 3000);
+    ASSERT_FALSE(sock.sock == NULL);
+    ASSERT_GE(gethrtime() - begin, LCB_MS2NS(50));
+    // The stalled attempt was closed when the second one won
+    ASSERT_EQ(nfds + perConnection, countOpenFds());
+    sock.close();
+    direct.close();
+}
+
+TEST_F(SockRaceTest, testNoDelayIsSequential)
+{
+    loop->settings->connect_attempt_delay = 0;
+    ESocket sock;
+    loop->connect(&sock, &host, 1000);
+    ASSERT_FALSE(sock.sock == NULL);
+    sock.close();
+
+    // Without racing, the next address is only tried once the stalled one fails
+    StalledListener stalled("127.0.0.2", atoi(host.port));
+    ESocket stalledSock;
+    loop->connect(&stalledSock, &host, 200);
+    ASSERT_TRUE(stalledSock.sock == NULL);
+    ASSERT_EQ(LCB_ERR_TIMEOUT, stalledSock.lasterr);
+}
+#endif
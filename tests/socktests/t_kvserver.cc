@@ -0,0 +1,999 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2020 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include "config.h"
+#include <gtest/gtest.h>
+#include <ioserver/kvserver.h>
+#include <memcached/protocol_binary.h>
+#include <libcouchbase/couchbase.h>
+#include <libcouchbase/utils.h>
+#include <libcouchbase/metrics.h>
+#include <libcouchbase/group.h>
+#include "internal.h"
+#include <fstream>
+#include <future>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace LCBTest;
+
+struct KVResult {
+    lcb_STATUS rc{LCB_ERR_GENERIC};
+    std::string value;
+    uint64_t cas{0};
+    uint64_t server_duration{0};
+    uint8_t datatype{0};
+    bool called{false};
+};
+
+extern "C" {
+static void kv_store_callback(lcb_INSTANCE *, int, const lcb_RESPSTORE *resp)
+{
+    KVResult *res;
+    lcb_respstore_cookie(resp, (void **)&res);
+    res->rc = lcb_respstore_status(resp);
+    lcb_respstore_cas(resp, &res->cas);
+    res->called = true;
+}
+
+static void kv_get_callback(lcb_INSTANCE *, int, const lcb_RESPGET *resp)
+{
+    KVResult *res;
+    lcb_respget_cookie(resp, (void **)&res);
+    res->rc = lcb_respget_status(resp);
+    if (res->rc == LCB_SUCCESS) {
+        const char *value;
+        size_t nvalue;
+        lcb_respget_value(resp, &value, &nvalue);
+        res->value.assign(value, nvalue);
+        lcb_respget_cas(resp, &res->cas);
+        lcb_respget_datatype(resp, &res->datatype);
+    }
+    const lcb_KEY_VALUE_ERROR_CONTEXT *ctx = nullptr;
+    lcb_respget_error_context(resp, &ctx);
+    lcb_errctx_kv_server_duration(ctx, &res->server_duration);
+    res->called = true;
+}
+
+static void count_histogram(const void *cookie, lcb_timeunit_t, lcb_U32, lcb_U32, lcb_U32 total, lcb_U32)
+{
+    *(lcb_U32 *)cookie += total;
+}
+
+/** Count the entries of the buckets reaching 10ms */
+static void count_histogram_slow(const void *cookie, lcb_timeunit_t unit, lcb_U32, lcb_U32 max, lcb_U32 total, lcb_U32)
+{
+    static const lcb_U64 ns_per_unit[] = {1, 1000, 1000000, 1000000000};
+    if (max * ns_per_unit[unit] >= 10000000) {
+        *(lcb_U32 *)cookie += total;
+    }
+}
+
+static void kv_subdoc_callback(lcb_INSTANCE *, int, const lcb_RESPSUBDOC *resp)
+{
+    KVResult *res;
+    lcb_respsubdoc_cookie(resp, (void **)&res);
+    res->rc = lcb_respsubdoc_status(resp);
+    if (res->rc == LCB_SUCCESS && lcb_respsubdoc_result_size(resp) > 0) {
+        res->rc = lcb_respsubdoc_result_status(resp, 0);
+        const char *value;
+        size_t nvalue;
+        lcb_respsubdoc_result_value(resp, 0, &value, &nvalue);
+        res->value.assign(value, nvalue);
+    }
+    res->called = true;
+}
+
+struct SubmitRequest {
+    std::string key;
+    lcb_INSTANCE *instance{nullptr};
+    std::promise<lcb_STATUS> done;
+};
+
+static void submit_store_callback(lcb_INSTANCE *, int, const lcb_RESPSTORE *resp)
+{
+    SubmitRequest *req;
+    lcb_respstore_cookie(resp, (void **)&req);
+    req->done.set_value(lcb_respstore_status(resp));
+}
+
+static void submit_store(lcb_INSTANCE *instance, void *arg)
+{
+    auto *req = static_cast<SubmitRequest *>(arg);
+    req->instance = instance;
+    lcb_CMDSTORE *cmd;
+    lcb_cmdstore_create(&cmd, LCB_STORE_UPSERT);
+    lcb_cmdstore_key(cmd, req->key.c_str(), req->key.size());
+    lcb_cmdstore_value(cmd, "{}", 2);
+    lcb_STATUS rc = lcb_store(instance, req, cmd);
+    lcb_cmdstore_destroy(cmd);
+    if (rc != LCB_SUCCESS) {
+        req->done.set_value(rc);
+    }
+}
+
+static void group_init(lcb_INSTANCE *instance, unsigned, void *)
+{
+    lcb_install_callback(instance, LCB_CALLBACK_STORE, (lcb_RESPCALLBACK)submit_store_callback);
+}
+
+static void submit_count(lcb_INSTANCE *, void *arg)
+{
+    ++*static_cast<unsigned *>(arg);
+}
+
+struct BatchFailure {
+    std::map<std::string, unsigned> calls;
+    std::map<std::string, lcb_STATUS> status;
+    lcb_STATUS fail_with{LCB_SUCCESS};
+    bool failed_mid_batch{false};
+};
+
+/** Fails the connection from within the first callback of a read batch */
+static void batch_fail_get_callback(lcb_INSTANCE *instance, int, const lcb_RESPGET *resp)
+{
+    BatchFailure *res;
+    lcb_respget_cookie(resp, (void **)&res);
+    const char *key;
+    size_t nkey;
+    lcb_respget_key(resp, &key, &nkey);
+    std::string k(key, nkey);
+    res->calls[k]++;
+    res->status[k] = lcb_respget_status(resp);
+
+    auto *server = static_cast<lcb::Server *>(instance->cmdq.pipelines[0]);
+    if (res->fail_with != LCB_SUCCESS && !res->failed_mid_batch && server->read_batch != nullptr) {
+        res->failed_mid_batch = true;
+        server->socket_failed(res->fail_with);
+    }
+}
+}
+
+class KVServerTest : public ::testing::Test
+{
+  protected:
+    void SetUp() override
+    {
+        server = new KVServer();
+        instance = nullptr;
+    }
+
+    void TearDown() override
+    {
+        if (instance) {
+            lcb_destroy(instance);
+        }
+        delete server;
+    }
+
+    void create(const std::string &options = "")
+    {
+        create_connstr(server->getConnectionString() + options);
+    }
+
+    void create_connstr(const std::string &connstr)
+    {
+        lcb_CREATEOPTS *cropts = nullptr;
+        lcb_createopts_create(&cropts, LCB_TYPE_BUCKET);
+        lcb_createopts_connstr(cropts, connstr.c_str(), connstr.size());
+        lcb_STATUS rc = lcb_create(&instance, cropts);
+        lcb_createopts_destroy(cropts);
+        EXPECT_EQ(LCB_SUCCESS, rc);
+        lcb_install_callback(instance, LCB_CALLBACK_STORE, (lcb_RESPCALLBACK)kv_store_callback);
+        lcb_install_callback(instance, LCB_CALLBACK_GET, (lcb_RESPCALLBACK)kv_get_callback);
+        lcb_install_callback(instance, LCB_CALLBACK_SDLOOKUP, (lcb_RESPCALLBACK)kv_subdoc_callback);
+        lcb_install_callback(instance, LCB_CALLBACK_SDMUTATE, (lcb_RESPCALLBACK)kv_subdoc_callback);
+    }
+
+    lcb_STATUS connect(const std::string &options = "")
+    {
+        create(options);
+        lcb_connect(instance);
+        lcb_wait(instance, LCB_WAIT_DEFAULT);
+        return lcb_get_bootstrap_status(instance);
+    }
+
+    KVResult store(const std::string &key, const std::string &value, uint8_t datatype = 0)
+    {
+        KVResult res;
+        lcb_CMDSTORE *cmd;
+        lcb_cmdstore_create(&cmd, LCB_STORE_UPSERT);
+        lcb_cmdstore_key(cmd, key.c_str(), key.size());
+        lcb_cmdstore_value(cmd, value.c_str(), value.size());
+        lcb_cmdstore_datatype(cmd, datatype);
+        EXPECT_EQ(LCB_SUCCESS, lcb_store(instance, &res, cmd));
+        lcb_cmdstore_destroy(cmd);
+        lcb_wait(instance, LCB_WAIT_DEFAULT);
+        EXPECT_TRUE(res.called);
+        return res;
+    }
+
+    KVResult get(const std::string &key)
+    {
+        KVResult res;
+        lcb_CMDGET *cmd;
+        lcb_cmdget_create(&cmd);
+        lcb_cmdget_key(cmd, key.c_str(), key.size());
+        EXPECT_EQ(LCB_SUCCESS, lcb_get(instance, &res, cmd));
+        lcb_cmdget_destroy(cmd);
+        lcb_wait(instance, LCB_WAIT_DEFAULT);
+        EXPECT_TRUE(res.called);
+        return res;
+    }
+
+    /** Run the event loop of the instance for `usec` microseconds */
+    void run_for(uint32_t usec)
+    {
+        lcbio_pTIMER timer = lcbio_timer_new(instance->iotable, instance, [](void *arg) {
+            lcb_stop_loop(static_cast<lcb_INSTANCE *>(arg));
+        });
+        lcbio_timer_rearm(timer, usec);
+        lcb_run_loop(instance);
+        lcbio_timer_destroy(timer);
+    }
+
+    KVServer *server;
+    lcb_INSTANCE *instance;
+};
+
+TEST_F(KVServerTest, testStoreGet)
+{
+    ASSERT_EQ(LCB_SUCCESS, connect());
+
+    KVResult res = get("missing");
+    ASSERT_EQ(LCB_ERR_DOCUMENT_NOT_FOUND, res.rc);
+
+    res = store("key", "value");
+    ASSERT_EQ(LCB_SUCCESS, res.rc);
+    uint64_t cas = res.cas;
+    ASSERT_NE(0, cas);
+
+    res = get("key");
+    ASSERT_EQ(LCB_SUCCESS, res.rc);
+    ASSERT_EQ("value", res.value);
+    ASSERT_EQ(cas, res.cas);
+    ASSERT_EQ(1, server->getItemCount());
+}
+
+TEST_F(KVServerTest, testAuthentication)
+{
+    server->setCredentials("user", "secret");
+    ASSERT_EQ(LCB_SUCCESS, connect("&sasl_mech_force=PLAIN&username=user&password=secret"));
+    lcb_destroy(instance);
+    instance = nullptr;
+    ASSERT_EQ(LCB_ERR_AUTHENTICATION_FAILURE, connect("&sasl_mech_force=PLAIN&username=user&password=wrong"));
+}
+
+TEST_F(KVServerTest, testSubdoc)
+{
+    ASSERT_EQ(LCB_SUCCESS, connect());
+    ASSERT_EQ(LCB_SUCCESS, store("doc", "{\"name\":\"pillow\",\"size\":{\"x\":1}}").rc);
+
+    lcb_SUBDOCSPECS *specs;
+    lcb_subdocspecs_create(&specs, 1);
+    lcb_subdocspecs_dict_upsert(specs, 0, 0, "size.y", 6, "2", 1);
+    lcb_CMDSUBDOC *cmd;
+    lcb_cmdsubdoc_create(&cmd);
+    lcb_cmdsubdoc_key(cmd, "doc", 3);
+    lcb_cmdsubdoc_specs(cmd, specs);
+    KVResult res;
+    ASSERT_EQ(LCB_SUCCESS, lcb_subdoc(instance, &res, cmd));
+    lcb_wait(instance, LCB_WAIT_DEFAULT);
+    ASSERT_EQ(LCB_SUCCESS, res.rc);
+    lcb_subdocspecs_destroy(specs);
+
+    lcb_subdocspecs_create(&specs, 1);
+    lcb_subdocspecs_get(specs, 0, 0, "size", 4);
+    lcb_cmdsubdoc_specs(cmd, specs);
+    res = KVResult();
+    ASSERT_EQ(LCB_SUCCESS, lcb_subdoc(instance, &res, cmd));
+    lcb_wait(instance, LCB_WAIT_DEFAULT);
+    ASSERT_EQ(LCB_SUCCESS, res.rc);
+    ASSERT_EQ("{\"x\":1,\"y\":2}", res.value);
+    lcb_subdocspecs_destroy(specs);
+
+    lcb_subdocspecs_create(&specs, 1);
+    lcb_subdocspecs_get(specs, 0, 0, "color", 5);
+    lcb_cmdsubdoc_specs(cmd, specs);
+    res = KVResult();
+    ASSERT_EQ(LCB_SUCCESS, lcb_subdoc(instance, &res, cmd));
+    lcb_wait(instance, LCB_WAIT_DEFAULT);
+    ASSERT_EQ(LCB_ERR_SUBDOC_PATH_NOT_FOUND, res.rc);
+    lcb_subdocspecs_destroy(specs);
+    lcb_cmdsubdoc_destroy(cmd);
+}
+
+TEST_F(KVServerTest, testReadBatchFailedMidBatch)
+{
+    ASSERT_EQ(LCB_SUCCESS, connect("&retry_interval=0.01&timeout=2.5"));
+    const unsigned nkeys = 16;
+    for (unsigned ii = 0; ii < nkeys; ii++) {
+        ASSERT_EQ(LCB_SUCCESS, store("key" + std::to_string(ii), "value").rc);
+    }
+    lcb_install_callback(instance, LCB_CALLBACK_GET, (lcb_RESPCALLBACK)batch_fail_get_callback);
+
+    for (lcb_STATUS err : {LCB_ERR_NETWORK, LCB_ERR_GENERIC}) {
+        // The responses are written at once, and read within a single batch
+        // whose first callback fails the connection
+        BatchFailure res;
+        res.fail_with = err;
+        server->setLatency(20000);
+        lcb_sched_enter(instance);
+        for (unsigned ii = 0; ii < nkeys; ii++) {
+            std::string key = "key" + std::to_string(ii);
+            lcb_CMDGET *cmd;
+            lcb_cmdget_create(&cmd);
+            lcb_cmdget_key(cmd, key.c_str(), key.size());
+            ASSERT_EQ(LCB_SUCCESS, lcb_get(instance, &res, cmd));
+            lcb_cmdget_destroy(cmd);
+        }
+        hrtime_t begin = gethrtime();
+        lcb_sched_leave(instance);
+        lcb_wait(instance, LCB_WAIT_DEFAULT);
+        server->setLatency(0);
+
+        // The requests of the frames which were not dispatched yet were failed
+        // (or retried) along with the rest of the pipeline, exactly once and
+        // without waiting for the operation timeout
+        ASSERT_LT(gethrtime() - begin, LCB_MS2NS(1000));
+        ASSERT_TRUE(res.failed_mid_batch);
+        ASSERT_EQ(nkeys, res.calls.size());
+        unsigned nsucceeded = 0;
+        for (const auto &entry : res.calls) {
+            ASSERT_EQ(1, entry.second) << entry.first;
+            if (res.status[entry.first] == LCB_SUCCESS) {
+                nsucceeded++;
+            }
+        }
+        ASSERT_GE(nsucceeded, 1);
+        if (err == LCB_ERR_GENERIC) {
+            ASSERT_EQ(1, nsucceeded);
+        }
+        ASSERT_FALSE(static_cast<lcb::Server *>(instance->cmdq.pipelines[0])->has_pending());
+    }
+
+    // The pipeline is usable again
+    lcb_install_callback(instance, LCB_CALLBACK_GET, (lcb_RESPCALLBACK)kv_get_callback);
+    ASSERT_EQ("value", get("key0").value);
+}
+
+TEST_F(KVServerTest, testInjectedFaults)
+{
+    ASSERT_EQ(LCB_SUCCESS, connect());
+
+    server->injectError(PROTOCOL_BINARY_CMD_SET, PROTOCOL_BINARY_RESPONSE_E2BIG);
+    ASSERT_EQ(LCB_ERR_VALUE_TOO_LARGE, store("key", "value").rc);
+    ASSERT_EQ(LCB_SUCCESS, store("key", "value").rc);
+
+    // NOT_MY_VBUCKET is retried transparently
+    server->injectNotMyVbucket(2);
+    KVResult res = get("key");
+    ASSERT_EQ(LCB_SUCCESS, res.rc);
+    ASSERT_EQ("value", res.value);
+
+    server->setLatency(50000);
+    lcb_U64 begin = lcb_nstime();
+    ASSERT_EQ(LCB_SUCCESS, get("key").rc);
+    ASSERT_GE(lcb_nstime() - begin, 50000000);
+}
+
+TEST_F(KVServerTest, testCircuitBreakerOpenedDuringDrain)
+{
+    ASSERT_EQ(LCB_SUCCESS, connect("&circuit_breaker=true&circuit_breaker_sleep_window=0.05"));
+    ASSERT_EQ(LCB_ERR_DOCUMENT_NOT_FOUND, get("warmup").rc);
+    auto *pipeline = static_cast<lcb::Server *>(instance->cmdq.pipelines[0]);
+    size_t nnoops = server->getRequestCount(PROTOCOL_BINARY_CMD_NOOP);
+
+    // The breaker opens while the connection is being drained
+    pipeline->state = lcb::Server::S_ERRDRAIN;
+    pipeline->breaker_open();
+    run_for(LCB_MS2US(120));
+    // No probe was sent, but the breaker is still waiting for the next sleep window
+    ASSERT_EQ(lcb::Server::CB_OPEN, pipeline->breaker.state);
+    ASSERT_EQ(nnoops, server->getRequestCount(PROTOCOL_BINARY_CMD_NOOP));
+    ASSERT_TRUE(lcbio_timer_armed(pipeline->breaker.timer));
+
+    // Once the connection is usable again, the breaker half-opens and its probe closes it
+    pipeline->state = lcb::Server::S_CLEAN;
+    run_for(LCB_MS2US(120));
+    ASSERT_EQ(nnoops + 1, server->getRequestCount(PROTOCOL_BINARY_CMD_NOOP));
+    ASSERT_EQ(lcb::Server::CB_CLOSED, pipeline->breaker.state);
+    ASSERT_EQ(LCB_SUCCESS, store("key", "value").rc);
+}
+
+TEST_F(KVServerTest, testBootstrapRaceSkipsStalledNode)
+{
+    // The first seed node accepts connections (in its backlog) but never answers
+    std::unique_ptr<SockFD> stalled(SockFD::newListener());
+    std::string connstr = "couchbase://127.0.0.1:" + std::to_string(stalled->getLocalPort()) + "=mcd;127.0.0.1:" +
+                          std::to_string(server->getListenPort()) +
+                          "=mcd/default?bootstrap_on=cccp&randomize_nodes=false&config_node_timeout=0.5";
+
+    // Asked in turn, the second node is only tried once the first one timed out
+    create_connstr(connstr);
+    hrtime_t begin = gethrtime();
+    lcb_connect(instance);
+    lcb_wait(instance, LCB_WAIT_DEFAULT);
+    ASSERT_EQ(LCB_SUCCESS, lcb_get_bootstrap_status(instance));
+    ASSERT_GE(gethrtime() - begin, LCB_MS2NS(500));
+    lcb_destroy(instance);
+    instance = nullptr;
+
+    // Racing, the second node is asked as soon as the race delay passes
+    create_connstr(connstr + "&bootstrap_race_count=2&bootstrap_race_delay=0.05");
+    begin = gethrtime();
+    lcb_connect(instance);
+    lcb_wait(instance, LCB_WAIT_DEFAULT);
+    ASSERT_EQ(LCB_SUCCESS, lcb_get_bootstrap_status(instance));
+    ASSERT_LT(gethrtime() - begin, LCB_MS2NS(500));
+    ASSERT_EQ(LCB_SUCCESS, store("key", "value").rc);
+}
+
+TEST_F(KVServerTest, testConfigCacheKeepsJsonFormat)
+{
+    std::string filename = std::string(lcb_get_tmpdir()) + "/lcb_config_cache." + std::to_string(lcb_next_rand32());
+    std::string snapshot = filename + ".snapshot";
+    ASSERT_EQ(LCB_SUCCESS, connect("&config_cache=" + filename));
+    lcb_destroy(instance);
+    instance = nullptr;
+
+    // Older versions sharing the cache read it as JSON
+    std::ifstream ifs(filename.c_str());
+    std::string text((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    ifs.close();
+    size_t magic = text.find("{{{fb85b563d0a8f65fa8d3d58f1b3a0708}}}");
+    ASSERT_NE(std::string::npos, magic);
+    lcbvb_CONFIG *vbc = lcbvb_create();
+    ASSERT_EQ(0, lcbvb_load_json(vbc, text.substr(0, magic).c_str()));
+    lcbvb_destroy(vbc);
+
+    std::ifstream sfs(snapshot.c_str(), std::ios::binary);
+    std::string image((std::istreambuf_iterator<char>(sfs)), std::istreambuf_iterator<char>());
+    sfs.close();
+    ASSERT_EQ(0, image.compare(0, 8, "LCBCFGS1"));
+
+    int is_loaded = 0;
+    ASSERT_EQ(LCB_SUCCESS, connect("&config_cache=" + filename));
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_CONFIG_CACHE_LOADED, &is_loaded));
+    ASSERT_NE(0, is_loaded);
+    lcb_destroy(instance);
+    instance = nullptr;
+
+    // A corrupt snapshot is removed, and the JSON file used instead
+    std::ofstream ofs(snapshot.c_str(), std::ios::binary | std::ios::trunc);
+    ofs << "LCBCFGS1" << std::string(64, 'x');
+    ofs.close();
+    ASSERT_EQ(LCB_SUCCESS, connect("&config_cache=" + filename));
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_CONFIG_CACHE_LOADED, &is_loaded));
+    ASSERT_NE(0, is_loaded);
+    ASSERT_EQ(LCB_SUCCESS, store("key", "value").rc);
+
+    remove(filename.c_str());
+    remove(snapshot.c_str());
+}
+
+TEST_F(KVServerTest, testLargeValueContiguous)
+{
+    // Bound each read so that the response header is seen before the whole
+    // value has been received over loopback
+    ASSERT_EQ(LCB_SUCCESS, connect("&metrics=true&read_chunk_size=65536"));
+
+    std::string value(4 * 1024 * 1024, 'v');
+    for (size_t ii = 0; ii < value.size(); ii += 4096) {
+        value[ii] = (char)('a' + (ii / 4096) % 26);
+    }
+    ASSERT_EQ(LCB_SUCCESS, store("large", value).rc);
+    KVResult res = get("large");
+    ASSERT_EQ(LCB_SUCCESS, res.rc);
+    ASSERT_EQ(value, res.value);
+
+    lcb_METRICS *metrics = nullptr;
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_METRICS, &metrics));
+    lcb_SIZE ncontig = 0, navoided = 0;
+    for (lcb_SIZE ii = 0; ii < metrics->nservers; ii++) {
+        ncontig += metrics->servers[ii]->packets_contig_reserved;
+        navoided += metrics->servers[ii]->bytes_consolidate_avoided;
+    }
+    ASSERT_EQ(1, ncontig);
+    ASSERT_GT(navoided, value.size() / 2);
+}
+
+TEST_F(KVServerTest, testServerDuration)
+{
+    ASSERT_EQ(LCB_SUCCESS, connect("&metrics=true"));
+    ASSERT_EQ(LCB_SUCCESS, store("key", "value").rc);
+    ASSERT_EQ(0, get("key").server_duration);
+
+    // 100 encodes 1510us
+    server->setServerDuration(100);
+    server->setLatency(20000);
+    const unsigned nops = 3;
+    for (unsigned ii = 0; ii < nops; ii++) {
+        KVResult res = get("key");
+        ASSERT_EQ(LCB_SUCCESS, res.rc);
+        ASSERT_EQ(1510, res.server_duration);
+    }
+
+    lcb_METRICS *metrics = nullptr;
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_METRICS, &metrics));
+    lcb_SIZE ntimed = 0, server_us = 0, network_us = 0;
+    lcb_U32 nserver_hg = 0, nnetwork_hg = 0;
+    for (lcb_SIZE ii = 0; ii < metrics->nservers; ii++) {
+        const lcb_SERVERMETRICS *entry = metrics->servers[ii];
+        ntimed += entry->packets_server_timed;
+        server_us += entry->server_duration;
+        network_us += entry->network_queue_duration;
+        lcb_histogram_read(entry->server_duration_hg, &nserver_hg, count_histogram);
+        lcb_histogram_read(entry->network_queue_duration_hg, &nnetwork_hg, count_histogram);
+    }
+    ASSERT_EQ(nops, ntimed);
+    ASSERT_EQ(nops * 1510, server_us);
+    // The injected latency is on the network side of the split
+    ASSERT_GE(network_us + server_us, nops * 20000);
+    ASSERT_GT(network_us, server_us);
+    ASSERT_EQ(nops, nserver_hg);
+    ASSERT_EQ(nops, nnetwork_hg);
+}
+
+TEST_F(KVServerTest, testPacketStages)
+{
+    ASSERT_EQ(LCB_SUCCESS, connect("&metrics=true"));
+    server->setLatency(20000);
+    const unsigned nops = 3;
+    for (unsigned ii = 0; ii < nops; ii++) {
+        ASSERT_EQ(LCB_SUCCESS, store("key", "value").rc);
+    }
+
+    lcb_METRICS *metrics = nullptr;
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_METRICS, &metrics));
+    lcb_U32 counts[LCB_PKTSTAGE__MAX] = {};
+    lcb_U32 nslow_wire = 0, nslow_other = 0;
+    for (lcb_SIZE ii = 0; ii < metrics->nservers; ii++) {
+        const lcb_SERVERMETRICS *entry = metrics->servers[ii];
+        for (int stage = 0; stage < LCB_PKTSTAGE__MAX; stage++) {
+            lcb_histogram_read(entry->stage_hg[stage], &counts[stage], count_histogram);
+            lcb_histogram_read(entry->stage_hg[stage], stage == LCB_PKTSTAGE_WIRE ? &nslow_wire : &nslow_other,
+                               count_histogram_slow);
+        }
+    }
+    for (int stage = 0; stage < LCB_PKTSTAGE__MAX; stage++) {
+        ASSERT_GE(counts[stage], nops) << "stage " << stage;
+    }
+    // The server's latency is only visible between sending and receiving
+    ASSERT_GE(nslow_wire, nops);
+    ASSERT_EQ(0, nslow_other);
+}
+
+TEST_F(KVServerTest, testInflateFragmentedValue)
+{
+    server->enableCompression();
+    ASSERT_EQ(LCB_SUCCESS, connect("&metrics=true&compression=on"));
+    // Values are only compressed once the node has negotiated SNAPPY
+    ASSERT_EQ(LCB_SUCCESS, store("warmup", "{}").rc);
+
+    // Compressible, but still spanning several read segments once compressed
+    static const char *words[] = {"couchbase", "snappy", "segment", "rope", "value", "inflate", "buffer", "pool"};
+    std::string value;
+    unsigned seed = 42;
+    while (value.size() < 2 * 1024 * 1024) {
+        seed = seed * 1103515245 + 12345;
+        value += words[(seed >> 16) % 8];
+    }
+    ASSERT_EQ(LCB_SUCCESS, store("compressed", value).rc);
+    for (int ii = 0; ii < 2; ii++) {
+        KVResult res = get("compressed");
+        ASSERT_EQ(LCB_SUCCESS, res.rc);
+        ASSERT_EQ(value, res.value);
+    }
+
+    lcb_METRICS *metrics = nullptr;
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_METRICS, &metrics));
+    lcb_SIZE nfragmented = 0, ncontig = 0;
+    for (lcb_SIZE ii = 0; ii < metrics->nservers; ii++) {
+        nfragmented += metrics->servers[ii]->packets_inflated_fragmented;
+        ncontig += metrics->servers[ii]->packets_contig_reserved;
+    }
+    ASSERT_EQ(2, nfragmented);
+    ASSERT_EQ(0, ncontig);
+}
+
+TEST_F(KVServerTest, testValueCodecSnappy)
+{
+    ASSERT_EQ(LCB_SUCCESS, connect("&value_codec=snappy&value_codec_min_size=1024"));
+
+    std::string large = "[";
+    for (int ii = 0; ii < 500; ii++) {
+        large += "{\"id\":" + std::to_string(ii) + ",\"name\":\"user\",\"tags\":[\"a\",\"b\"]},";
+    }
+    large += "{}]";
+    std::string small = "{\"id\":1}";
+    ASSERT_EQ(LCB_SUCCESS, store("large", large, LCB_VALUE_F_JSON).rc);
+    ASSERT_EQ(LCB_SUCCESS, store("small", small).rc);
+    KVResult res = get("large");
+    ASSERT_EQ(large, res.value);
+    // The datatype of the original value is kept in the header
+    ASSERT_EQ(LCB_VALUE_F_JSON, res.datatype);
+    ASSERT_EQ(small, get("small").value);
+
+    // Without inflation, the stored values are handed out as they are
+    int compressopts = LCB_COMPRESS_NONE;
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_SET, LCB_CNTL_COMPRESSION_OPTS, &compressopts));
+    std::string raw = get("large").value;
+    ASSERT_LT(raw.size(), large.size());
+    ASSERT_EQ(std::string("\x89LCZ\x01\x01", 6), raw.substr(0, 6));
+    ASSERT_EQ(small, get("small").value);
+}
+
+TEST_F(KVServerTest, testValueCodecPlainValueWithMagic)
+{
+    // A plain value which happens to begin with the header of an encoded one
+    std::string plain("\x89LCZ\x01\x00\x00\x00\x00\x40", 10);
+    plain += "not encoded by any codec";
+
+    ASSERT_EQ(LCB_SUCCESS, connect());
+    ASSERT_EQ(LCB_SUCCESS, store("plain", plain).rc);
+    // No codec is configured: the header is not looked at
+    KVResult res = get("plain");
+    ASSERT_EQ(LCB_SUCCESS, res.rc);
+    ASSERT_EQ(plain, res.value);
+
+    // With a codec configured, a value which fails to decode is returned as it is
+    int id = 1;
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_SET, LCB_CNTL_VALUE_CODEC, &id));
+    res = get("plain");
+    ASSERT_EQ(LCB_SUCCESS, res.rc);
+    ASSERT_EQ(plain, res.value);
+}
+
+/* Run-length encoding in (count, byte) pairs, enough to plug in a codec */
+extern "C" {
+static lcb_SIZE rle_bound(void *, lcb_SIZE nbytes)
+{
+    return 2 * nbytes;
+}
+
+static lcb_SIZE rle_encode(void *cookie, const void *in, lcb_SIZE nin, void *out, lcb_SIZE)
+{
+    auto *src = static_cast<const unsigned char *>(in);
+    auto *dst = static_cast<unsigned char *>(out);
+    lcb_SIZE nout = 0;
+    for (lcb_SIZE ii = 0; ii < nin;) {
+        unsigned run = 1;
+        while (ii + run < nin && run < 255 && src[ii + run] == src[ii]) {
+            run++;
+        }
+        dst[nout++] = run;
+        dst[nout++] = src[ii];
+        ii += run;
+    }
+    ++*static_cast<int *>(cookie);
+    return nout;
+}
+
+static int rle_decode(void *, const void *in, lcb_SIZE nin, void *out, lcb_SIZE nout)
+{
+    auto *src = static_cast<const unsigned char *>(in);
+    auto *dst = static_cast<unsigned char *>(out);
+    lcb_SIZE ndecoded = 0;
+    for (lcb_SIZE ii = 0; ii + 1 < nin; ii += 2) {
+        if (ndecoded + src[ii] > nout) {
+            return -1;
+        }
+        memset(dst + ndecoded, src[ii + 1], src[ii]);
+        ndecoded += src[ii];
+    }
+    return ndecoded == nout ? 0 : -1;
+}
+}
+
+TEST_F(KVServerTest, testValueCodecRegistered)
+{
+    ASSERT_EQ(LCB_SUCCESS, connect());
+
+    int nencoded = 0;
+    lcb_VALUE_CODEC codec = {7, rle_bound, rle_encode, rle_decode, &nencoded};
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_SET, LCB_CNTL_VALUE_CODEC_REGISTER, &codec));
+    int id = 7;
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_SET, LCB_CNTL_VALUE_CODEC, &id));
+
+    std::string value(200 * 1024, 'a');
+    value += std::string(100 * 1024, 'b');
+    ASSERT_EQ(LCB_SUCCESS, store("rle", value).rc);
+    ASSERT_EQ(1, nencoded);
+    ASSERT_EQ(value, get("rle").value);
+
+    // Below the minimum size
+    ASSERT_EQ(LCB_SUCCESS, store("short", std::string(1000, 'a')).rc);
+    ASSERT_EQ(1, nencoded);
+
+    // The built-in codec may not be replaced
+    codec.id = 1;
+    ASSERT_EQ(LCB_ERR_INVALID_ARGUMENT, lcb_cntl(instance, LCB_CNTL_SET, LCB_CNTL_VALUE_CODEC_REGISTER, &codec));
+}
+
+TEST_F(KVServerTest, testCollectionResolutionSingleFlight)
+{
+    server->addCollection("app", "users", 8);
+    ASSERT_EQ(LCB_SUCCESS, connect());
+
+    const unsigned nops = 50;
+    std::vector<KVResult> results(nops);
+    for (unsigned ii = 0; ii < nops; ii++) {
+        std::string key = "user::" + std::to_string(ii);
+        lcb_CMDSTORE *cmd;
+        lcb_cmdstore_create(&cmd, LCB_STORE_UPSERT);
+        lcb_cmdstore_collection(cmd, "app", 3, "users", 5);
+        lcb_cmdstore_key(cmd, key.c_str(), key.size());
+        lcb_cmdstore_value(cmd, "{}", 2);
+        ASSERT_EQ(LCB_SUCCESS, lcb_store(instance, &results[ii], cmd));
+        lcb_cmdstore_destroy(cmd);
+    }
+    lcb_wait(instance, LCB_WAIT_DEFAULT);
+    for (unsigned ii = 0; ii < nops; ii++) {
+        ASSERT_TRUE(results[ii].called);
+        ASSERT_EQ(LCB_SUCCESS, results[ii].rc);
+    }
+    // Every operation waited for the same GET_CID request
+    ASSERT_EQ(1, server->getRequestCount(PROTOCOL_BINARY_CMD_COLLECTIONS_GET_CID));
+    ASSERT_EQ(nops, server->getItemCount());
+}
+
+TEST_F(KVServerTest, testCollectionsManifestPrefetch)
+{
+    server->addCollection("app", "users", 8);
+    server->addCollection("app", "orders", 9);
+    ASSERT_EQ(LCB_SUCCESS, connect("&collections_prefetch=true"));
+
+    KVResult res;
+    lcb_CMDSTORE *cmd;
+    lcb_cmdstore_create(&cmd, LCB_STORE_UPSERT);
+    lcb_cmdstore_collection(cmd, "app", 3, "orders", 6);
+    lcb_cmdstore_key(cmd, "order::1", 8);
+    lcb_cmdstore_value(cmd, "{}", 2);
+    ASSERT_EQ(LCB_SUCCESS, lcb_store(instance, &res, cmd));
+    lcb_cmdstore_destroy(cmd);
+    lcb_wait(instance, LCB_WAIT_DEFAULT);
+    ASSERT_TRUE(res.called);
+    ASSERT_EQ(LCB_SUCCESS, res.rc);
+
+    ASSERT_EQ(1, server->getRequestCount(PROTOCOL_BINARY_CMD_COLLECTIONS_GET_MANIFEST));
+    ASSERT_EQ(0, server->getRequestCount(PROTOCOL_BINARY_CMD_COLLECTIONS_GET_CID));
+}
+
+static lcb_STATUS schedule_get(lcb_INSTANCE *instance, KVResult *res, const std::string &key, uint32_t timeout = 0)
+{
+    lcb_CMDGET *cmd;
+    lcb_cmdget_create(&cmd);
+    lcb_cmdget_key(cmd, key.c_str(), key.size());
+    if (timeout) {
+        lcb_cmdget_timeout(cmd, timeout);
+    }
+    lcb_STATUS rc = lcb_get(instance, res, cmd);
+    lcb_cmdget_destroy(cmd);
+    return rc;
+}
+
+TEST_F(KVServerTest, testDeferredOperationsReplay)
+{
+    create();
+    const unsigned nops = 40;
+    std::vector<KVResult> results(nops);
+    for (unsigned ii = 0; ii < nops; ii++) {
+        ASSERT_EQ(LCB_SUCCESS, schedule_get(instance, &results[ii], "key_" + std::to_string(ii)));
+    }
+    ASSERT_EQ(nops, instance->deferred_operations->size());
+
+    lcb_connect(instance);
+    lcb_wait(instance, LCB_WAIT_DEFAULT);
+    ASSERT_EQ(LCB_SUCCESS, lcb_get_bootstrap_status(instance));
+    ASSERT_FALSE(instance->has_deferred_operations());
+    for (unsigned ii = 0; ii < nops; ii++) {
+        ASSERT_TRUE(results[ii].called);
+        ASSERT_EQ(LCB_ERR_DOCUMENT_NOT_FOUND, results[ii].rc);
+    }
+    ASSERT_EQ(nops, server->getRequestCount(PROTOCOL_BINARY_CMD_GET));
+}
+
+TEST_F(KVServerTest, testDeferredOperationsCap)
+{
+    create("&deferred_max_ops=2");
+    KVResult results[3];
+    ASSERT_EQ(LCB_SUCCESS, schedule_get(instance, &results[0], "a"));
+    ASSERT_EQ(LCB_SUCCESS, schedule_get(instance, &results[1], "b"));
+    ASSERT_EQ(LCB_ERR_TEMPORARY_FAILURE, schedule_get(instance, &results[2], "c"));
+    lcb_connect(instance);
+    lcb_wait(instance, LCB_WAIT_DEFAULT);
+    ASSERT_TRUE(results[1].called);
+    ASSERT_FALSE(results[2].called);
+
+    lcb_destroy(instance);
+    instance = nullptr;
+    create("&deferred_max_bytes=1");
+    ASSERT_EQ(LCB_ERR_TEMPORARY_FAILURE, schedule_get(instance, &results[0], "a"));
+}
+
+TEST_F(KVServerTest, testDeferredOperationsDeadline)
+{
+    create();
+    KVResult shortlived, longlived;
+    ASSERT_EQ(LCB_SUCCESS, schedule_get(instance, &longlived, "long"));
+    ASSERT_EQ(LCB_SUCCESS, schedule_get(instance, &shortlived, "short", 10000));
+
+    // Not connecting: the operation must fail while waiting for a configuration
+    run_for(LCB_MS2US(200));
+    ASSERT_TRUE(shortlived.called);
+    ASSERT_EQ(LCB_ERR_TIMEOUT, shortlived.rc);
+    ASSERT_FALSE(longlived.called);
+    ASSERT_EQ(1, instance->deferred_operations->size());
+
+    lcb_connect(instance);
+    lcb_wait(instance, LCB_WAIT_DEFAULT);
+    ASSERT_TRUE(longlived.called);
+    ASSERT_EQ(LCB_ERR_DOCUMENT_NOT_FOUND, longlived.rc);
+}
+
+TEST_F(KVServerTest, testSubmitQueueFromThreads)
+{
+    ASSERT_EQ(LCB_SUCCESS, connect());
+    lcb_install_callback(instance, LCB_CALLBACK_STORE, (lcb_RESPCALLBACK)submit_store_callback);
+    lcb_SUBMITQ *queue = nullptr;
+    // A small ring, so that producers also run into a full queue
+    ASSERT_EQ(LCB_SUCCESS, lcb_submitq_create(instance, 64, &queue));
+
+    const unsigned nthreads = 4;
+    const unsigned nops = 250;
+    std::vector<SubmitRequest> requests(nthreads * nops);
+    std::vector<lcb_STATUS> results(nthreads * nops, LCB_ERR_GENERIC);
+    std::vector<std::thread> producers;
+    for (unsigned tt = 0; tt < nthreads; tt++) {
+        producers.emplace_back([&, tt]() {
+            std::vector<std::future<lcb_STATUS>> futures;
+            for (unsigned ii = tt * nops; ii < (tt + 1) * nops; ii++) {
+                requests[ii].key = "key_" + std::to_string(ii);
+                futures.push_back(requests[ii].done.get_future());
+                lcb_STATUS rc;
+                while ((rc = lcb_submitq_push(queue, submit_store, &requests[ii])) == LCB_ERR_TEMPORARY_FAILURE) {
+                    std::this_thread::yield();
+                }
+                if (rc != LCB_SUCCESS) {
+                    requests[ii].done.set_value(rc);
+                }
+            }
+            for (unsigned ii = 0; ii < nops; ii++) {
+                results[tt * nops + ii] = futures[ii].get();
+            }
+        });
+    }
+    std::thread stopper([&]() {
+        for (auto &producer : producers) {
+            producer.join();
+        }
+        lcb_submitq_stop(queue);
+    });
+
+    ASSERT_EQ(LCB_SUCCESS, lcb_submitq_run(queue));
+    stopper.join();
+    lcb_submitq_destroy(queue);
+
+    for (unsigned ii = 0; ii < nthreads * nops; ii++) {
+        ASSERT_EQ(LCB_SUCCESS, results[ii]) << "Request " << ii;
+    }
+    ASSERT_EQ(nthreads * nops, server->getItemCount());
+}
+
+TEST_F(KVServerTest, testSubmitQueueStop)
+{
+    ASSERT_EQ(LCB_SUCCESS, connect());
+    lcb_SUBMITQ *queue = nullptr;
+    ASSERT_EQ(LCB_SUCCESS, lcb_submitq_create(instance, 0, &queue));
+
+    // Entries pushed before the stop request are still invoked
+    unsigned ncalls = 0;
+    ASSERT_EQ(LCB_SUCCESS, lcb_submitq_push(queue, submit_count, &ncalls));
+    ASSERT_EQ(LCB_SUCCESS, lcb_submitq_push(queue, submit_count, &ncalls));
+    lcb_submitq_stop(queue);
+    ASSERT_EQ(LCB_ERR_REQUEST_CANCELED, lcb_submitq_push(queue, submit_count, &ncalls));
+    ASSERT_EQ(LCB_SUCCESS, lcb_submitq_run(queue));
+    ASSERT_EQ(2, ncalls);
+    lcb_submitq_destroy(queue);
+}
+
+TEST_F(KVServerTest, testInstanceGroup)
+{
+    lcb_CREATEOPTS *cropts = nullptr;
+    std::string connstr = server->getConnectionString();
+    lcb_createopts_create(&cropts, LCB_TYPE_BUCKET);
+    lcb_createopts_connstr(cropts, connstr.c_str(), connstr.size());
+    lcb_GROUPOPTS gopts{};
+    gopts.nshards = 4;
+    gopts.init_callback = group_init;
+    lcb_INSTANCE_GROUP *group = nullptr;
+    ASSERT_EQ(LCB_SUCCESS, lcb_group_create(&group, cropts, &gopts));
+    lcb_createopts_destroy(cropts);
+    ASSERT_EQ(4, lcb_group_nshards(group));
+
+    const unsigned nthreads = 3;
+    const unsigned nops = 200;
+    std::vector<SubmitRequest> requests(nthreads * nops);
+    std::vector<lcb_STATUS> results(nthreads * nops, LCB_ERR_GENERIC);
+    std::vector<std::thread> producers;
+    for (unsigned tt = 0; tt < nthreads; tt++) {
+        producers.emplace_back([&, tt]() {
+            std::vector<std::future<lcb_STATUS>> futures;
+            for (unsigned ii = tt * nops; ii < (tt + 1) * nops; ii++) {
+                SubmitRequest &req = requests[ii];
+                req.key = "key_" + std::to_string(ii);
+                futures.push_back(req.done.get_future());
+                lcb_STATUS rc = lcb_group_submit(group, req.key.c_str(), req.key.size(), submit_store, &req);
+                if (rc != LCB_SUCCESS) {
+                    req.done.set_value(rc);
+                }
+            }
+            for (unsigned ii = 0; ii < nops; ii++) {
+                results[tt * nops + ii] = futures[ii].get();
+            }
+        });
+    }
+    for (auto &producer : producers) {
+        producer.join();
+    }
+
+    std::vector<unsigned> per_shard(4, 0);
+    for (unsigned ii = 0; ii < nthreads * nops; ii++) {
+        ASSERT_EQ(LCB_SUCCESS, results[ii]) << "Request " << ii;
+        // Every operation ran on the shard owning its key
+        unsigned shard = lcb_group_shard_for_key(group, requests[ii].key.c_str(), requests[ii].key.size());
+        ASSERT_EQ(lcb_group_instance(group, shard), requests[ii].instance) << "Request " << ii;
+        per_shard[shard]++;
+    }
+    lcb_group_destroy(group);
+
+    for (unsigned ii = 0; ii < 4; ii++) {
+        ASSERT_GT(per_shard[ii], 0) << "Shard " << ii;
+    }
+    ASSERT_EQ(nthreads * nops, server->getItemCount());
+    // Only the first shard fetched the cluster map
+    ASSERT_EQ(1, server->getRequestCount(PROTOCOL_BINARY_CMD_GET_CLUSTER_CONFIG));
+}
+
+TEST_F(KVServerTest, testInstanceGroupRemovesPrivateCache)
+{
+    lcb_CREATEOPTS *cropts = nullptr;
+    std::string connstr = server->getConnectionString();
+    lcb_createopts_create(&cropts, LCB_TYPE_BUCKET);
+    lcb_createopts_connstr(cropts, connstr.c_str(), connstr.size());
+    lcb_GROUPOPTS gopts{};
+    gopts.nshards = 2;
+    lcb_INSTANCE_GROUP *group = nullptr;
+    ASSERT_EQ(LCB_SUCCESS, lcb_group_create(&group, cropts, &gopts));
+    lcb_createopts_destroy(cropts);
+
+    // The group made up a cache for its shards to bootstrap from
+    const char *cachefile = nullptr;
+    lcb_cntl(lcb_group_instance(group, 0), LCB_CNTL_GET, LCB_CNTL_CONFIGCACHE, &cachefile);
+    ASSERT_FALSE(cachefile == nullptr);
+    std::string filename(cachefile);
+    std::string snapshot = lcb::clconfig::file_snapshot_filename(filename);
+    ASSERT_TRUE(std::ifstream(filename.c_str()).good());
+    ASSERT_TRUE(std::ifstream(snapshot.c_str()).good());
+
+    lcb_group_destroy(group);
+    ASSERT_FALSE(std::ifstream(filename.c_str()).good());
+    ASSERT_FALSE(std::ifstream(snapshot.c_str()).good());
+}
@@ -20,10 +20,49 @@
 #ifndef LCB_NO_SSL
 
 #include <lcbio/ssl.h>
+#include "ssl/ssl_iot_common.h"
 using namespace LCBTest;
 using std::string;
 using std::vector;
 
+/**
+ * A socket which is never connected, for inspecting how lcbio_ssl_apply()
+ * sets up the SSL object. The IO table is a copy of the loop's, posing as the
+ * given model.
+ */
+struct DetachedSocket {
+    lcbio_TABLE table;
+    lcbio_CONNINFO info;
+    lcbio_SOCKET sock;
+
+    DetachedSocket(Loop *loop, lcb_iomodel_t model, const lcb_host_t &host) : table(*loop->iot), info(), sock()
+    {
+        table.model = model;
+        table.refcount = 2; // the socket's and ours
+        table.dtor = nullptr;
+        info.ep_remote = host;
+        sock.io = &table;
+        sock.settings = loop->settings;
+        sock.info = &info;
+        sock.refcount = 1;
+        sock.u.fd = INVALID_SOCKET;
+        lcb_list_init(&sock.protos);
+    }
+
+    ~DetachedSocket()
+    {
+        if (sock.io != &table) {
+            lcbio_protoctx_delid(&sock, LCBIO_PROTOCTX_SSL, 1);
+        }
+        lcbio_table_unref(sock.io);
+    }
+
+    SSL *ssl()
+    {
+        return reinterpret_cast<lcbio_XSSL *>(sock.io)->ssl;
+    }
+};
+
 class SSLTest : public SockTest
 {
   protected:
@@ -46,6 +85,40 @@ class SSLTest : public SockTest
         loop->settings->ssl_ctx = nullptr;
         SockTest::TearDown();
     }
+
+    /** Send and receive some data, which also completes the handshake */
+    void exchange(ESocket &sock)
+    {
+        string sendStr("Hello World");
+        RecvFuture rf(sendStr.size());
+        FutureBreakCondition wbc(&rf);
+        sock.conn->setRecv(&rf);
+        sock.put(sendStr);
+        sock.schedule();
+        loop->setBreakCondition(&wbc);
+        loop->start();
+        rf.wait();
+        ASSERT_TRUE(rf.isOk());
+        ASSERT_EQ(sendStr, rf.getString());
+
+        string recvStr("Goodbye World!");
+        SendFuture sf(recvStr);
+        ReadBreakCondition rbc(&sock, recvStr.size());
+        sock.conn->setSend(&sf);
+        sock.reqrd(recvStr.size());
+        sock.schedule();
+        loop->setBreakCondition(&rbc);
+        loop->start();
+        sf.wait();
+        ASSERT_TRUE(sf.isOk());
+        ASSERT_EQ(recvStr, sock.getReceived());
+        sock.readbuf.clear();
+    }
+
+    static SSL *getSSL(ESocket &sock)
+    {
+        return reinterpret_cast<lcbio_XSSL *>(sock.sock->io)->ssl;
+    }
 };
 
 TEST_F(SSLTest, testBasic)
@@ -91,6 +164,116 @@ TEST_F(SSLTest, testBasic)
     sock.close();
 }
 
+TEST_F(SSLTest, testSessionResumption)
+{
+    ESocket first;
+    loop->connect(&first);
+    ASSERT_FALSE(first.sock == nullptr);
+    exchange(first);
+    ASSERT_FALSE(SSL_session_reused(getSSL(first)));
+    first.close();
+
+    // The next connection to the same host:port skips the full handshake
+    ESocket second;
+    loop->connect(&second);
+    ASSERT_FALSE(second.sock == nullptr);
+    exchange(second);
+    ASSERT_TRUE(SSL_session_reused(getSSL(second)));
+    second.close();
+
+    // Unless the cache is disabled
+    loop->settings->ssl_session_cache = 0;
+    ESocket third;
+    loop->connect(&third);
+    ASSERT_FALSE(third.sock == nullptr);
+    exchange(third);
+    ASSERT_FALSE(SSL_session_reused(getSSL(third)));
+    third.close();
+}
+
+TEST_F(SSLTest, testTls13TicketUsedOnce)
+{
+    ESocket first;
+    loop->connect(&first);
+    ASSERT_FALSE(first.sock == nullptr);
+    exchange(first);
+    lcb_host_t host = *lcbio_get_host(first.sock);
+    bool tls13 = SSL_version(getSSL(first)) >= TLS1_3_VERSION;
+    first.close();
+    if (!tls13) {
+        std::cerr << "TLS 1.3 is not available, skipping" << std::endl;
+        return;
+    }
+
+    // Only the first socket to this host:port gets the cached ticket
+    {
+        DetachedSocket taker(loop, LCB_IOMODEL_EVENT, host);
+        DetachedSocket other(loop, LCB_IOMODEL_EVENT, host);
+        ASSERT_EQ(LCB_SUCCESS, lcbio_ssl_apply(&taker.sock, loop->settings->ssl_ctx));
+        ASSERT_EQ(LCB_SUCCESS, lcbio_ssl_apply(&other.sock, loop->settings->ssl_ctx));
+        ASSERT_FALSE(SSL_get_session(taker.ssl()) == nullptr);
+        ASSERT_TRUE(SSL_get_session(other.ssl()) == nullptr);
+    }
+
+    // Which leaves nothing for the next connection
+    ESocket second;
+    loop->connect(&second);
+    ASSERT_FALSE(second.sock == nullptr);
+    exchange(second);
+    ASSERT_FALSE(SSL_session_reused(getSSL(second)));
+    second.close();
+
+    // Until the server hands out a new ticket
+    ESocket third;
+    loop->connect(&third);
+    ASSERT_FALSE(third.sock == nullptr);
+    exchange(third);
+    ASSERT_TRUE(SSL_session_reused(getSSL(third)));
+    third.close();
+}
+
+TEST_F(SSLTest, testKtlsEventPlugin)
+{
+    if (loop->iot->model != LCB_IOMODEL_EVENT) {
+        std::cerr << "IO plugin is not event based, skipping" << std::endl;
+        return;
+    }
+
+    // Memory BIOs by default
+    ESocket plain;
+    loop->connect(&plain);
+    ASSERT_FALSE(plain.sock == nullptr);
+    ASSERT_EQ(BIO_TYPE_MEM, BIO_method_type(SSL_get_rbio(getSSL(plain))));
+    exchange(plain);
+    exchange(plain);
+    plain.close();
+
+    // OpenSSL owns the socket if it may enable kTLS, and the connection works
+    // whether or not the kernel accepted the keys
+    loop->settings->ssl_ktls = 1;
+    ESocket direct;
+    loop->connect(&direct);
+    ASSERT_FALSE(direct.sock == nullptr);
+    SSL *ssl = getSSL(direct);
+    ASSERT_EQ(LCB_CAN_KTLS ? BIO_TYPE_SOCKET : BIO_TYPE_MEM, BIO_method_type(SSL_get_rbio(ssl)));
+    ASSERT_EQ(LCB_CAN_KTLS ? BIO_TYPE_SOCKET : BIO_TYPE_MEM, BIO_method_type(SSL_get_wbio(ssl)));
+    exchange(direct);
+    exchange(direct);
+    direct.close();
+}
+
+TEST_F(SSLTest, testKtlsFallsBackOnCompletionPlugin)
+{
+    // A completion based plugin does not expose the socket to OpenSSL
+    lcb_host_t host = {"127.0.0.1", "11210", 0};
+    DetachedSocket completion(loop, LCB_IOMODEL_COMPLETION, host);
+    loop->settings->ssl_ktls = 1;
+    ASSERT_EQ(LCB_SUCCESS, lcbio_ssl_apply(&completion.sock, loop->settings->ssl_ctx));
+    ASSERT_TRUE(lcbio_ssl_check(&completion.sock));
+    ASSERT_EQ(BIO_TYPE_MEM, BIO_method_type(SSL_get_rbio(completion.ssl())));
+    ASSERT_EQ(BIO_TYPE_MEM, BIO_method_type(SSL_get_wbio(completion.ssl())));
+}
+
 #else
 class SSLTest : public ::testing::Test
 {
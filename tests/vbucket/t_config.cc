@@ -23,6 +23,7 @@
 #include <map>
 #include "contrib/lcb-jsoncpp/lcb-jsoncpp.h"
 #include "check_config.h"
+#include "vbucket/snapshot.h"
 #include "contrib/cJSON/cJSON.h"
 
 using std::map;
@@ -155,6 +156,66 @@ TEST_F(ConfigTest, testGeneration)
     free(js);
 }
 
+TEST_F(ConfigTest, testBinarySnapshot)
+{
+    string txt = getConfigFile("terse_30.json");
+    lcbvb_CONFIG *cfg = lcbvb_create();
+    ASSERT_EQ(0, lcbvb_load_json(cfg, txt.c_str()));
+    lcbvb_genffmap(cfg);
+
+    size_t nbuf = 0;
+    char *buf = lcbvb_save_binary(cfg, &nbuf);
+    ASSERT_TRUE(buf != NULL);
+
+    // integers are little endian whatever the host byte order
+    ASSERT_LT(4U, nbuf);
+    ASSERT_EQ(0, memcmp(buf, "LVB2", 4));
+
+    lcbvb_CONFIG *loaded = lcbvb_create();
+    ASSERT_EQ(0, lcbvb_load_binary(loaded, buf, nbuf));
+    ASSERT_STREQ(cfg->bname, loaded->bname);
+    ASSERT_STREQ(cfg->buuid, loaded->buuid);
+    ASSERT_EQ(cfg->revepoch, loaded->revepoch);
+    ASSERT_EQ(cfg->revid, loaded->revid);
+    ASSERT_EQ(cfg->caps, loaded->caps);
+    ASSERT_EQ(cfg->nsrv, loaded->nsrv);
+    ASSERT_EQ(cfg->ndatasrv, loaded->ndatasrv);
+    ASSERT_EQ(cfg->nrepl, loaded->nrepl);
+    ASSERT_EQ(cfg->nvb, loaded->nvb);
+    ASSERT_EQ(0, memcmp(cfg->vbuckets, loaded->vbuckets, sizeof(*cfg->vbuckets) * cfg->nvb));
+    ASSERT_EQ(0, memcmp(cfg->ffvbuckets, loaded->ffvbuckets, sizeof(*cfg->ffvbuckets) * cfg->nvb));
+    for (unsigned ii = 0; ii < cfg->nsrv; ii++) {
+        lcbvb_SERVER *a = LCBVB_GET_SERVER(cfg, ii), *b = LCBVB_GET_SERVER(loaded, ii);
+        ASSERT_STREQ(a->authority, b->authority);
+        ASSERT_EQ(a->nvbs, b->nvbs);
+        ASSERT_EQ(a->svc_ssl.mgmt, b->svc_ssl.mgmt);
+        ASSERT_STREQ(lcbvb_get_hostport(cfg, ii, LCBVB_SVCTYPE_VIEWS, LCBVB_SVCMODE_PLAIN),
+                     lcbvb_get_hostport(loaded, ii, LCBVB_SVCTYPE_VIEWS, LCBVB_SVCMODE_PLAIN));
+    }
+
+    string key("Hello");
+    int vb1, vb2, ix1, ix2;
+    lcbvb_map_key(cfg, key.c_str(), key.size(), &vb1, &ix1);
+    lcbvb_map_key(loaded, key.c_str(), key.size(), &vb2, &ix2);
+    ASSERT_EQ(vb1, vb2);
+    ASSERT_EQ(ix1, ix2);
+    lcbvb_destroy(loaded);
+
+    // truncated or corrupted images are rejected
+    for (size_t ii = 0; ii < nbuf; ii += 7) {
+        loaded = lcbvb_create();
+        ASSERT_NE(0, lcbvb_load_binary(loaded, buf, ii));
+        lcbvb_destroy(loaded);
+    }
+    buf[0] ^= 0xff;
+    loaded = lcbvb_create();
+    ASSERT_NE(0, lcbvb_load_binary(loaded, buf, nbuf));
+    lcbvb_destroy(loaded);
+
+    free(buf);
+    lcbvb_destroy(cfg);
+}
+
 TEST_F(ConfigTest, testAltMap)
 {
     lcbvb_CONFIG *cfg = lcbvb_create();
@@ -34,6 +34,8 @@
 #define usleep(n) Sleep(n / 1000)
 #endif
 #include <cstdarg>
+#include <cmath>
+#include <algorithm>
 #include <exception>
 #include <stdexcept>
 #include <memcached/protocol_binary.h>
@@ -42,8 +44,10 @@
 
 #include "docgen/seqgen.h"
 #include "docgen/docgen.h"
+#include "contrib/lcb-jsoncpp/lcb-jsoncpp.h"
 #include "internalstructs.h"
 #include "internal.h"
+#include "capi/cmd_noop.hh"
 
 using namespace std;
 using namespace cbc;
@@ -104,7 +108,9 @@ class Configuration
           o_startAt("start-at"), o_rateLimit("rate-limit"), o_userdocs("docs"), o_writeJson("json"),
           o_templatePairs("template"), o_subdoc("subdoc"), o_noop("noop"), o_sdPathCount("pathcount"),
           o_populateOnly("populate-only"), o_exptime("expiry"), o_collection("collection"), o_durability("durability"),
-          o_persist("persist-to"), o_replicate("replicate-to"), o_lock("lock")
+          o_persist("persist-to"), o_replicate("replicate-to"), o_lock("lock"), o_openLoop("open-loop"),
+          o_keyDist("key-distribution"), o_zipfTheta("zipf-theta"), o_hotKeys("hot-keys"), o_hotOps("hot-ops"),
+          o_reportJson("report-json")
     {
         o_multiSize.setDefault(100).abbrev('B').description("Number of operations to batch");
         o_numItems.setDefault(1000).abbrev('I').description("Number of items to operate on");
@@ -138,6 +144,14 @@ class Configuration
         o_replicate.description("Wait until item is replicated to this number of nodes (-1 for all replicas)")
             .setDefault(0);
         o_lock.description("Lock keys for updates for given time (will not lock when set to zero)").setDefault(0);
+        o_openLoop.description("Issue operations at the --rate-limit arrival rate without waiting for responses, and "
+                               "measure latency from the intended start time");
+        o_keyDist.description("Key access distribution: uniform, zipfian, hotspot or latest").setDefault("uniform");
+        o_zipfTheta.description("Skew of the zipfian and latest distributions (0 < theta < 1)").setDefault(0.99f);
+        o_hotKeys.description("Percentage of keys in the hot set of the hotspot distribution").setDefault(20);
+        o_hotOps.description("Percentage of operations which access the hot set of the hotspot distribution")
+            .setDefault(80);
+        o_reportJson.description("Write per-operation latency percentiles as JSON to this file ('-' for stdout)");
         params.getTimings().description("Enable command timings (second time to dump timings automatically)");
     }
 
@@ -248,6 +262,37 @@ class Configuration
         if (o_collection.passed()) {
             collections = o_collection.result();
         }
+
+        if (o_openLoop.result() && o_rateLimit.result() == 0) {
+            throw std::runtime_error("--open-loop requires --rate-limit");
+        }
+
+        const string &dist = o_keyDist.const_result();
+        if (dist == "uniform") {
+            keyDistribution = KEYDIST_UNIFORM;
+        } else if (dist == "zipfian") {
+            keyDistribution = KEYDIST_ZIPFIAN;
+        } else if (dist == "hotspot") {
+            keyDistribution = KEYDIST_HOTSPOT;
+        } else if (dist == "latest") {
+            keyDistribution = KEYDIST_LATEST;
+        } else {
+            throw std::runtime_error("invalid --key-distribution: " + dist);
+        }
+        if (keyDistribution != KEYDIST_UNIFORM) {
+            if (o_sequential.result()) {
+                throw std::runtime_error("--key-distribution cannot be used with --sequential");
+            }
+            if (lockTime) {
+                throw std::runtime_error("--key-distribution cannot be used with --lock");
+            }
+        }
+        if (o_zipfTheta.result() <= 0 || o_zipfTheta.result() >= 1) {
+            throw std::runtime_error("--zipf-theta must be between 0 and 1 (exclusive)");
+        }
+        if (o_hotKeys.result() == 0 || o_hotKeys.result() >= 100 || o_hotOps.result() > 100) {
+            throw std::runtime_error("--hot-keys must be between 1 and 99, --hot-ops between 0 and 100");
+        }
     }
 
     void addOptions(Parser &parser)
@@ -279,6 +324,12 @@ class Configuration
         parser.addOption(o_persist);
         parser.addOption(o_replicate);
         parser.addOption(o_lock);
+        parser.addOption(o_openLoop);
+        parser.addOption(o_keyDist);
+        parser.addOption(o_zipfTheta);
+        parser.addOption(o_hotKeys);
+        parser.addOption(o_hotOps);
+        parser.addOption(o_reportJson);
         params.addToParser(parser);
         depr.addOptions(parser);
     }
@@ -344,6 +395,35 @@ class Configuration
     {
         return o_exptime;
     }
+    bool openLoop()
+    {
+        return o_openLoop.result();
+    }
+    double getZipfTheta()
+    {
+        return o_zipfTheta.result();
+    }
+    double getHotKeys()
+    {
+        return o_hotKeys.result() / 100.0;
+    }
+    double getHotOps()
+    {
+        return o_hotOps.result() / 100.0;
+    }
+    bool writeReport()
+    {
+        return o_reportJson.passed();
+    }
+    const string &getReportPath()
+    {
+        return o_reportJson.const_result();
+    }
+    /** Whether per-operation latencies should be recorded and reported on exit */
+    bool measureLatency()
+    {
+        return openLoop() || writeReport();
+    }
 
     uint32_t opsPerCycle{};
     uint32_t sdOpsPerCmd{};
@@ -358,6 +438,8 @@ class Configuration
     int replicateTo{};
     int persistTo{};
     int lockTime{};
+    enum KeyDistribution { KEYDIST_UNIFORM, KEYDIST_ZIPFIAN, KEYDIST_HOTSPOT, KEYDIST_LATEST };
+    KeyDistribution keyDistribution{KEYDIST_UNIFORM};
 
   private:
     UIntOption o_multiSize;
@@ -398,6 +480,14 @@ class Configuration
     IntOption o_replicate;
 
     IntOption o_lock;
+
+    // Open-loop load and key access distributions
+    BoolOption o_openLoop;
+    StringOption o_keyDist;
+    FloatOption o_zipfTheta;
+    UIntOption o_hotKeys;
+    UIntOption o_hotOps;
+    StringOption o_reportJson;
     DeprecatedOptions depr;
 } config;
 
@@ -563,6 +653,19 @@ class KeyGenerator : public OpGenerator
         m_gensequence = new SeqGenerator(config.firstKeyOffset(), config.getNumItems() + config.firstKeyOffset(),
                                          config.getNumThreads(), ix);
 
+        m_genskewed = nullptr;
+        if (config.keyDistribution != Configuration::KEYDIST_UNIFORM) {
+            SkewedGenerator::Kind kind = SkewedGenerator::LATEST;
+            if (config.keyDistribution == Configuration::KEYDIST_ZIPFIAN) {
+                kind = SkewedGenerator::ZIPFIAN;
+            } else if (config.keyDistribution == Configuration::KEYDIST_HOTSPOT) {
+                kind = SkewedGenerator::HOTSPOT;
+            }
+            m_genskewed = new SkewedGenerator(kind, config.firstKeyOffset(),
+                                              config.getNumItems() + config.firstKeyOffset(), config.getZipfTheta(),
+                                              config.getHotKeys(), config.getHotOps(), config.getRandomSeed() + ix);
+        }
+
         if (m_in_population) {
             m_force_sequential = true;
         } else {
@@ -608,10 +711,18 @@ class KeyGenerator : public OpGenerator
             }
         }
 
-        if (m_in_population || !config.lockTime) {
-            op.m_seqno = (m_force_sequential ? m_gensequence : m_genrandom)->next();
+        // With a skewed distribution the hottest keys would otherwise all get
+        // the same operation type, so the mix is decided independently of the key
+        bool skewed_store = false;
+        if (m_in_population || !m_genskewed) {
+            if (m_in_population || !config.lockTime) {
+                op.m_seqno = (m_force_sequential ? m_gensequence : m_genrandom)->next();
+            } else {
+                op.m_seqno = (m_force_sequential ? m_gensequence : m_genrandom)->checkout();
+            }
         } else {
-            op.m_seqno = (m_force_sequential ? m_gensequence : m_genrandom)->checkout();
+            skewed_store = (m_opcount++ % 100) < config.setprc;
+            op.m_seqno = m_genskewed->next(skewed_store);
         }
 
         if (store_override) {
@@ -619,7 +730,7 @@ class KeyGenerator : public OpGenerator
             op.m_mode = NextOp::STORE;
             setValue(op);
 
-        } else if (shouldStore(op.m_seqno)) {
+        } else if (m_genskewed ? skewed_store : shouldStore(op.m_seqno)) {
             op.m_mode = m_mode_write;
             if (op.m_mode == NextOp::STORE) {
                 setValue(op);
@@ -690,7 +801,9 @@ class KeyGenerator : public OpGenerator
 
     SeqGenerator *m_genrandom;
     SeqGenerator *m_gensequence;
+    SkewedGenerator *m_genskewed;
     size_t m_gencount;
+    size_t m_opcount{0};
 
     bool m_force_sequential;
     bool m_in_population;
@@ -700,6 +813,93 @@ class KeyGenerator : public OpGenerator
     SubdocGeneratorState *m_sdgenstate;
 };
 
+/**
+ * Per-thread latency histograms, one for each type of operation.
+ *
+ * Durations are recorded in microseconds, so that queueing delays of
+ * several seconds (which open-loop runs against an overloaded cluster will
+ * produce) still fit the 32-bit bucket bounds of lcb_histogram_read().
+ */
+class OpLatencies
+{
+  public:
+    enum Type { GET, UPSERT, LOCKED_UPSERT, LOOKUP_IN, MUTATE_IN, NOOP, NTYPES };
+
+    OpLatencies()
+    {
+        for (size_t ii = 0; ii < NTYPES; ii++) {
+            usec_hg[ii] = nullptr;
+            count[ii] = 0;
+            errors[ii] = 0;
+        }
+    }
+
+    ~OpLatencies()
+    {
+        for (auto &h : usec_hg) {
+            if (h != nullptr) {
+                lcb_histogram_destroy(h);
+            }
+        }
+    }
+
+    void record(Type type, lcb_U64 start, lcb_STATUS rc)
+    {
+        lcb_U64 now = lcb_nstime();
+        lcb_U64 usec = now > start ? (now - start) / 1000 : 0;
+        if (usec_hg[type] == nullptr) {
+            usec_hg[type] = lcb_histogram_create();
+        }
+        lcb_histogram_record(usec_hg[type], usec ? usec : 1);
+        count[type]++;
+        if (rc != LCB_SUCCESS) {
+            errors[type]++;
+        }
+    }
+
+    static const char *name(Type type)
+    {
+        switch (type) {
+            case GET:
+                return "get";
+            case UPSERT:
+                return "upsert";
+            case LOCKED_UPSERT:
+                return "locked_upsert";
+            case LOOKUP_IN:
+                return "lookup_in";
+            case MUTATE_IN:
+                return "mutate_in";
+            case NOOP:
+            default:
+                return "noop";
+        }
+    }
+
+    /**
+     * Holding microseconds, while lcb_histogram_read() reports its values as
+     * nanoseconds: read them with LatencySummary
+     */
+    lcb_HISTOGRAM *usec_hg[NTYPES];
+    size_t count[NTYPES];
+    size_t errors[NTYPES];
+};
+
+/**
+ * Cookie of every measured operation. In open-loop mode `start` is the time
+ * at which the operation was due according to the arrival schedule rather
+ * than the time it was actually sent, so any delay caused by the client or
+ * the cluster falling behind is charged to the operation (there is no
+ * coordinated omission).
+ */
+struct OpCookie {
+    OpCookie(OpLatencies::Type t, lcb_U64 s, uintptr_t f = 0) : type(t), start(s), flags(f) {}
+
+    OpLatencies::Type type;
+    lcb_U64 start;
+    uintptr_t flags;
+};
+
 #define OPFLAGS_LOCKED 0x01
 
 class ThreadContext
@@ -732,6 +932,54 @@ class ThreadContext
         }
     }
 
+    /**
+     * Open-loop driver: operations are issued on a fixed timeline of
+     * (rate / threads) per second regardless of how many are outstanding.
+     * The event loop is polled between arrivals, so each thread occupies
+     * a full core.
+     */
+    void openLoop()
+    {
+        // Population is not part of the measurement and runs closed-loop
+        while (gen->inPopulation() && !config.isLoopDone(niter)) {
+            singleLoop();
+            ++niter;
+        }
+
+        const lcb_U64 interval_ns = (config.getNumThreads() * 1000000000ULL) / config.getRateLimit();
+        lcb_U64 due = lcb_nstime();
+        size_t issued = 0;
+        measureStart = due;
+
+        while (!config.isLoopDone(niter)) {
+            lcb_U64 now = lcb_nstime();
+            if (due <= now) {
+                // Issue everything that is due, but no more than a batch at a time so
+                // that responses keep being read while the client catches up
+                lcb_sched_enter(instance);
+                for (size_t ii = 0; ii < config.opsPerCycle && due <= now; ++ii) {
+                    scheduleNextOperation(due);
+                    due += interval_ns;
+                    if (++issued % config.opsPerCycle == 0) {
+                        ++niter;
+                    }
+                }
+                lcb_sched_leave(instance);
+            }
+            if (lcb_tick_nowait(instance) != LCB_SUCCESS) {
+                log("The I/O plugin does not support non-blocking ticks, required by --open-loop");
+                exit(EXIT_FAILURE);
+            }
+            if (outstanding == 0 && due > now + 1000000) {
+                // Nothing to read and the next arrival is far enough away
+                usleep((due - now) / 2000);
+            }
+        }
+        lcb_wait(instance, LCB_WAIT_DEFAULT);
+        measureEnd = lcb_nstime();
+        purgeRetryQueue();
+    }
+
     void singleLoop()
     {
         bool hasItems = false;
@@ -793,12 +1041,23 @@ class ThreadContext
         }
     }
 
-    bool scheduleNextOperation()
+    /**
+     * @param start when the operation was meant to be issued (open-loop),
+     *  or 0 for now
+     */
+    bool scheduleNextOperation(lcb_U64 start = 0)
     {
         NextOp opinfo;
         unsigned exptime = config.getExptime();
         gen->setNextOp(opinfo);
 
+        // Population is not measured
+        bool measure = config.measureLatency() && !gen->inPopulation();
+        if (measure && start == 0) {
+            start = lcb_nstime();
+        }
+        OpCookie *cookie = nullptr;
+
         switch (opinfo.m_mode) {
             case NextOp::STORE: {
                 if (!gen->inPopulation() && config.lockTime > 0) {
@@ -806,7 +1065,8 @@ class ThreadContext
                     lcb_cmdget_create(&gcmd);
                     lcb_cmdget_key(gcmd, opinfo.m_key.c_str(), opinfo.m_key.size());
                     lcb_cmdget_locktime(gcmd, config.lockTime);
-                    error = lcb_get(instance, (void *)OPFLAGS_LOCKED, gcmd);
+                    cookie = new OpCookie(OpLatencies::LOCKED_UPSERT, start, OPFLAGS_LOCKED);
+                    error = lcb_get(instance, cookie, gcmd);
                     lcb_cmdget_destroy(gcmd);
                 } else {
                     lcb_CMDSTORE *scmd;
@@ -828,7 +1088,10 @@ class ThreadContext
                     } else if (config.persistTo > 0 || config.replicateTo > 0) {
                         lcb_cmdstore_durability_observe(scmd, config.persistTo, config.replicateTo);
                     }
-                    error = lcb_store(instance, nullptr, scmd);
+                    if (measure) {
+                        cookie = new OpCookie(OpLatencies::UPSERT, start);
+                    }
+                    error = lcb_store(instance, cookie, scmd);
                     lcb_cmdstore_destroy(scmd);
                 }
                 break;
@@ -844,7 +1107,10 @@ class ThreadContext
                     }
                 }
                 lcb_cmdget_expiry(gcmd, exptime);
-                error = lcb_get(instance, this, gcmd);
+                if (measure) {
+                    cookie = new OpCookie(OpLatencies::GET, start);
+                }
+                error = lcb_get(instance, cookie, gcmd);
                 lcb_cmdget_destroy(gcmd);
                 break;
             }
@@ -878,7 +1144,10 @@ class ThreadContext
                 if (mutate && config.durabilityLevel != LCB_DURABILITYLEVEL_NONE) {
                     lcb_cmdsubdoc_durability(sdcmd, config.durabilityLevel);
                 }
-                error = lcb_subdoc(instance, nullptr, sdcmd);
+                if (measure) {
+                    cookie = new OpCookie(mutate ? OpLatencies::MUTATE_IN : OpLatencies::LOOKUP_IN, start);
+                }
+                error = lcb_subdoc(instance, cookie, sdcmd);
                 lcb_subdocspecs_destroy(specs);
                 lcb_cmdsubdoc_destroy(sdcmd);
                 break;
@@ -886,7 +1155,10 @@ class ThreadContext
             case NextOp::NOOP: {
                 lcb_CMDNOOP *ncmd;
                 lcb_cmdnoop_create(&ncmd);
-                error = lcb_noop(instance, nullptr, ncmd);
+                if (measure) {
+                    cookie = new OpCookie(OpLatencies::NOOP, start);
+                }
+                error = lcb_noop(instance, cookie, ncmd);
                 lcb_cmdnoop_destroy(ncmd);
                 break;
             }
@@ -894,15 +1166,41 @@ class ThreadContext
 
         if (error != LCB_SUCCESS) {
             log("Failed to schedule operation: %s", lcb_strerror_long(error));
+            delete cookie;
             return false;
         } else {
+            if (cookie != nullptr) {
+                outstanding++;
+            }
             return true;
         }
     }
 
+    /** Record the latency of an operation scheduled by scheduleNextOperation() */
+    void finishOperation(void *arg, lcb_STATUS rc)
+    {
+        auto *cookie = static_cast<OpCookie *>(arg);
+        if (cookie == nullptr) {
+            return;
+        }
+        if (config.measureLatency()) {
+            latencies.record(cookie->type, cookie->start, rc);
+        }
+        outstanding--;
+        delete cookie;
+    }
+
     bool run()
     {
+        if (config.openLoop()) {
+            openLoop();
+            return true;
+        }
+
         do {
+            if (measureStart == 0 && !gen->inPopulation()) {
+                measureStart = lcb_nstime();
+            }
             singleLoop();
 
             if (config.numTimings() > 1) {
@@ -916,6 +1214,7 @@ class ThreadContext
             }
 
         } while (!config.isLoopDone(++niter));
+        measureEnd = lcb_nstime();
 
         if (config.numTimings() > 1) {
             InstanceCookie::dumpTimings(instance, gen->getStageString(), true);
@@ -945,6 +1244,15 @@ class ThreadContext
         return instance;
     }
 
+    const OpLatencies &getLatencies() const
+    {
+        return latencies;
+    }
+
+    /** Interval in which the workload (excluding population) was running */
+    lcb_U64 measureStart{0};
+    lcb_U64 measureEnd{0};
+
   protected:
     // the callback methods needs to be able to set the error handler..
     friend void noopCallback(lcb_INSTANCE *, int, const lcb_RESPNOOP *);
@@ -985,6 +1293,8 @@ class ThreadContext
     lcb_STATUS error{LCB_SUCCESS};
     lcb_INSTANCE *instance{nullptr};
     std::queue<NextOp> retryq{};
+    OpLatencies latencies;
+    size_t outstanding{0};
 };
 
 static void updateOpsPerSecDisplay()
@@ -1034,6 +1344,11 @@ static void noopCallback(lcb_INSTANCE *instance, int, const lcb_RESPNOOP *resp)
     lcb_STATUS rc = lcb_respnoop_status(resp);
     tc->setError(rc);
     updateStats(cookie, rc);
+    if (resp->rflags & LCB_RESP_F_FINAL) {
+        void *opcookie = nullptr;
+        lcb_respnoop_cookie(resp, &opcookie);
+        tc->finishOperation(opcookie, rc);
+    }
     updateOpsPerSecDisplay();
 }
 
@@ -1050,6 +1365,10 @@ static void subdocCallback(lcb_INSTANCE *instance, int, const lcb_RESPSUBDOC *re
     lcb_respsubdoc_key(resp, &p, &n);
     (void)n;
     tc->checkin(std::strtol(p, nullptr, 10));
+
+    void *opcookie = nullptr;
+    lcb_respsubdoc_cookie(resp, &opcookie);
+    tc->finishOperation(opcookie, rc);
     updateOpsPerSecDisplay();
 }
 
@@ -1081,9 +1400,9 @@ static void getCallback(lcb_INSTANCE *instance, int, const lcb_RESPGET *resp)
     }
 
     uint32_t seqno = std::stol(key);
-    uintptr_t flags = 0;
-    lcb_respget_cookie(resp, (void **)&flags);
-    if (flags & OPFLAGS_LOCKED) {
+    OpCookie *opcookie = nullptr;
+    lcb_respget_cookie(resp, (void **)&opcookie);
+    if (opcookie != nullptr && (opcookie->flags & OPFLAGS_LOCKED)) {
         if (rc == LCB_SUCCESS) {
             vector<lcb_IOV> valuefrags;
             tc->populateIov(seqno, valuefrags);
@@ -1109,7 +1428,10 @@ static void getCallback(lcb_INSTANCE *instance, int, const lcb_RESPGET *resp)
             } else if (config.persistTo > 0 || config.replicateTo > 0) {
                 lcb_cmdstore_durability_observe(scmd, config.persistTo, config.replicateTo);
             }
-            lcb_store(instance, nullptr, scmd);
+            // The update is measured as a whole, so the cookie moves on to the store
+            if (lcb_store(instance, opcookie, scmd) == LCB_SUCCESS) {
+                opcookie = nullptr;
+            }
             lcb_cmdstore_destroy(scmd);
 
             done = false;
@@ -1128,6 +1450,7 @@ static void getCallback(lcb_INSTANCE *instance, int, const lcb_RESPGET *resp)
     if (done) {
         tc->checkin(seqno);
     }
+    tc->finishOperation(opcookie, rc);
     updateOpsPerSecDisplay();
 }
 
@@ -1181,11 +1504,188 @@ static void storeCallback(lcb_INSTANCE *instance, int, const lcb_RESPSTORE *resp
         tc->checkin(seqno);
     }
 
+    void *opcookie = nullptr;
+    lcb_respstore_cookie(resp, &opcookie);
+    tc->finishOperation(opcookie, rc);
     updateOpsPerSecDisplay();
 }
 
 std::list<ThreadContext *> contexts;
 
+/**
+ * Latency distribution of one operation type, merged from the histograms
+ * of all threads. All the values are in microseconds.
+ */
+class LatencySummary
+{
+  public:
+    /** @param usec_hg a histogram of OpLatencies, fed with microseconds */
+    void add(const lcb_HISTOGRAM *usec_hg)
+    {
+        if (usec_hg != nullptr) {
+            lcb_histogram_read(usec_hg, this, readBucket);
+        }
+    }
+
+    lcb_U64 count() const
+    {
+        lcb_U64 total = 0;
+        for (const auto &bucket : buckets) {
+            total += bucket.second;
+        }
+        return total;
+    }
+
+    /** @return the (upper bound of the) value below which `pct` percent of the samples fall */
+    lcb_U64 percentile(double pct)
+    {
+        lcb_U64 total = count();
+        if (total == 0) {
+            return 0;
+        }
+        std::sort(buckets.begin(), buckets.end());
+        lcb_U64 rank = static_cast<lcb_U64>(std::ceil(pct / 100.0 * total));
+        lcb_U64 seen = 0;
+        for (const auto &bucket : buckets) {
+            seen += bucket.second;
+            if (seen >= rank) {
+                return bucket.first;
+            }
+        }
+        return buckets.back().first;
+    }
+
+    double mean() const
+    {
+        lcb_U64 total = count();
+        if (total == 0) {
+            return 0;
+        }
+        double sum = 0;
+        for (const auto &bucket : buckets) {
+            sum += static_cast<double>(bucket.first) * bucket.second;
+        }
+        return sum / total;
+    }
+
+  private:
+    /*
+     * The histogram takes the recorded values for nanoseconds, and reports
+     * them in the unit it picks for their magnitude. Convert the bound back
+     * to the recorded value, which is in microseconds.
+     */
+    static lcb_U64 toMicroseconds(lcb_timeunit_t unit, lcb_U32 value)
+    {
+        switch (unit) {
+            case LCB_TIMEUNIT_SEC:
+                return value * 1000000000ULL;
+            case LCB_TIMEUNIT_MSEC:
+                return value * 1000000ULL;
+            case LCB_TIMEUNIT_USEC:
+                return value * 1000ULL;
+            default:
+                return value;
+        }
+    }
+
+    static void readBucket(const void *cookie, lcb_timeunit_t unit, lcb_U32, lcb_U32 max, lcb_U32 total, lcb_U32)
+    {
+        auto *self = static_cast<LatencySummary *>(const_cast<void *>(cookie));
+        if (total) {
+            self->buckets.emplace_back(toMicroseconds(unit, max), total);
+        }
+    }
+
+    std::vector<std::pair<lcb_U64, lcb_U64>> buckets;
+};
+
+static const double report_percentiles[] = {50, 90, 99, 99.9, 99.99};
+
+static void report_latencies()
+{
+    lcb_U64 start = 0, end = 0, total = 0;
+    for (auto *ctx : contexts) {
+        if (ctx->measureStart && (start == 0 || ctx->measureStart < start)) {
+            start = ctx->measureStart;
+        }
+        if (ctx->measureEnd > end) {
+            end = ctx->measureEnd;
+        }
+    }
+    double duration = end > start ? (end - start) / 1e9 : 0;
+
+    Json::Value root;
+    root["mode"] = config.openLoop() ? "open-loop" : "closed-loop";
+    root["threads"] = config.getNumThreads();
+    root["key_distribution"] = config.keyDistribution == Configuration::KEYDIST_ZIPFIAN   ? "zipfian"
+                               : config.keyDistribution == Configuration::KEYDIST_HOTSPOT ? "hotspot"
+                               : config.keyDistribution == Configuration::KEYDIST_LATEST  ? "latest"
+                                                                                          : "uniform";
+    if (config.openLoop()) {
+        root["target_ops_per_sec"] = config.getRateLimit();
+    }
+    root["duration_sec"] = duration;
+
+    fprintf(stderr, "\nLatency in microseconds, measured from the %s start time\n",
+            config.openLoop() ? "intended" : "actual");
+    fprintf(stderr, "%-14s %10s %8s %9s %9s %9s %9s %9s %9s %9s\n", "op", "count", "errors", "mean", "p50", "p90",
+            "p99", "p99.9", "p99.99", "max");
+
+    Json::Value ops(Json::objectValue);
+    for (int type = 0; type < OpLatencies::NTYPES; type++) {
+        LatencySummary summary;
+        lcb_U64 errors = 0;
+        for (auto *ctx : contexts) {
+            const OpLatencies &lat = ctx->getLatencies();
+            summary.add(lat.usec_hg[type]);
+            errors += lat.errors[type];
+        }
+        lcb_U64 count = summary.count();
+        if (count == 0) {
+            continue;
+        }
+        total += count;
+
+        const char *name = OpLatencies::name(static_cast<OpLatencies::Type>(type));
+        Json::Value op;
+        op["count"] = static_cast<Json::UInt64>(count);
+        op["errors"] = static_cast<Json::UInt64>(errors);
+        op["mean_us"] = summary.mean();
+        op["max_us"] = static_cast<Json::UInt64>(summary.percentile(100));
+        fprintf(stderr, "%-14s %10llu %8llu %9.0f", name, (unsigned long long)count, (unsigned long long)errors,
+                summary.mean());
+        for (double pct : report_percentiles) {
+            lcb_U64 value = summary.percentile(pct);
+            char label[16];
+            snprintf(label, sizeof(label), "%g", pct);
+            op["percentiles_us"][label] = static_cast<Json::UInt64>(value);
+            fprintf(stderr, " %9llu", (unsigned long long)value);
+        }
+        fprintf(stderr, " %9llu\n", (unsigned long long)summary.percentile(100));
+        ops[name] = op;
+    }
+    root["operations"] = ops;
+    root["ops_per_sec"] = duration > 0 ? total / duration : 0;
+    if (duration > 0) {
+        fprintf(stderr, "Throughput: %.0f ops/sec over %.1f seconds\n", total / duration, duration);
+    }
+
+    if (config.writeReport()) {
+        string json = Json::StyledWriter().write(root);
+        const string &path = config.getReportPath();
+        if (path == "-") {
+            fwrite(json.c_str(), 1, json.size(), stdout);
+        } else {
+            std::ofstream ofs(path.c_str());
+            if (!ofs.is_open()) {
+                perror(path.c_str());
+                return;
+            }
+            ofs << json;
+        }
+    }
+}
+
 extern "C" {
 typedef void (*handler_t)(int);
 
@@ -1417,5 +1917,8 @@ int main(int argc, char **argv)
     if (config.numTimings() > 0) {
         dump_metrics();
     }
+    if (config.measureLatency()) {
+        report_latencies();
+    }
     return exit_code;
 }
@@ -18,6 +18,9 @@
 #ifndef CBC_PILLOWFIGHT_SEQGEN_H
 #define CBC_PILLOWFIGHT_SEQGEN_H
 
+#include <cmath>
+#include <random>
+
 namespace Pillowfight
 {
 
@@ -38,7 +41,7 @@ class SeqGenerator
         offset = start;
         uint32_t total = end - start;
         total_self = total / num_workers;
-        locked = std::vector< bool >(total_self, false);
+        locked = std::vector<bool>(total_self, false);
         lnum = 0;
         offset += total_self * cur_worker;
         rnum = 0;
@@ -50,7 +53,7 @@ class SeqGenerator
     SeqGenerator(uint32_t start, uint32_t end)
     {
         total_self = end - start;
-        locked = std::vector< bool >(total_self, false);
+        locked = std::vector<bool>(total_self, false);
         lnum = 0;
         offset = start;
         rnum = 0;
@@ -118,13 +121,124 @@ class SeqGenerator
 
   private:
     bool sequential;
-    std::vector< uint32_t > seqpool;
-    std::vector< bool > locked; // lock markers
+    std::vector<uint32_t> seqpool;
+    std::vector<bool> locked; // lock markers
     uint32_t lnum;              // number of locked keys
     uint32_t rnum;              // internal iterator
     uint32_t offset;            // beginning numerical offset
     uint32_t total_self;        // maximum value of iterator
     uint32_t curr_seqno;
 };
+
+/**
+ * Non-uniform key chooser over a numeric range.
+ *
+ * - ZIPFIAN: rank `i` is chosen with probability proportional to 1/i^theta,
+ *   using the rejection-free method of Gray et al. ("Quickly Generating
+ *   Billion-Record Synthetic Databases"), as popularised by YCSB.
+ * - HOTSPOT: `hot_ops` of the accesses go to the first `hot_keys` of the
+ *   range, the remainder is spread uniformly over the rest.
+ * - LATEST: writes append to a cursor which wraps around the range, reads
+ *   are zipfian-distributed backwards from the most recently written key.
+ *
+ * Like SeqGenerator there is one instance per thread.
+ */
+class SkewedGenerator
+{
+  public:
+    enum Kind { ZIPFIAN, HOTSPOT, LATEST };
+
+    SkewedGenerator(Kind k, uint32_t start, uint32_t end, double skew, double hot_keys, double hot_access,
+                    uint32_t seed)
+        : kind(k), offset(start), total(end - start), theta(skew), hot_ops(hot_access), rng(seed), latest(0)
+    {
+        if (total == 0) {
+            total = 1;
+        }
+        nhot = static_cast<uint32_t>(total * hot_keys);
+        if (nhot == 0) {
+            nhot = 1;
+        } else if (nhot >= total) {
+            nhot = total - 1;
+        }
+
+        zetan = zeta(total, theta);
+        double zeta2 = zeta(2, theta);
+        alpha = 1.0 / (1.0 - theta);
+        eta = (1.0 - std::pow(2.0 / total, 1.0 - theta)) / (1.0 - zeta2 / zetan);
+        half_pow_theta = 1.0 + std::pow(0.5, theta);
+        latest = total - 1;
+    }
+
+    /**
+     * Get the next key in range
+     * @param write whether the key is going to be mutated; only meaningful
+     *  for LATEST, where writes move the "latest" cursor forward
+     */
+    uint32_t next(bool write)
+    {
+        switch (kind) {
+            case ZIPFIAN:
+                return offset + zipf();
+
+            case HOTSPOT:
+                if (total == 1 || uniform() < hot_ops) {
+                    return offset + static_cast<uint32_t>(uniform() * nhot);
+                }
+                return offset + nhot + static_cast<uint32_t>(uniform() * (total - nhot));
+
+            case LATEST:
+            default:
+                if (write) {
+                    latest = (latest + 1) % total;
+                    return offset + latest;
+                }
+                return offset + (latest + total - zipf()) % total;
+        }
+    }
+
+  private:
+    static double zeta(uint32_t n, double skew)
+    {
+        double sum = 0;
+        for (uint32_t ii = 1; ii <= n; ii++) {
+            sum += 1.0 / std::pow(static_cast<double>(ii), skew);
+        }
+        return sum;
+    }
+
+    double uniform()
+    {
+        return dist(rng);
+    }
+
+    uint32_t zipf()
+    {
+        double u = uniform();
+        double uz = u * zetan;
+        if (uz < 1.0) {
+            return 0;
+        }
+        if (uz < half_pow_theta) {
+            return total > 1 ? 1 : 0;
+        }
+        uint32_t rank = static_cast<uint32_t>(total * std::pow(eta * u - eta + 1.0, alpha));
+        return rank < total ? rank : total - 1;
+    }
+
+    Kind kind;
+    uint32_t offset;   // beginning numerical offset
+    uint32_t total;    // number of keys in range
+    uint32_t nhot;     // number of keys in the hot set
+    double theta;      // zipfian skew, 0 < theta < 1
+    double hot_ops;    // fraction of accesses which go to the hot set
+    double zetan;
+    double alpha;
+    double eta;
+    double half_pow_theta;
+    std::mt19937 rng;
+    std::uniform_real_distribution<double> dist{0.0, 1.0};
+    uint32_t latest; // most recently written key (LATEST)
+};
 } // namespace Pillowfight
 #endif